@@ -1,8 +1,13 @@
 // Copyright 2023-2025 hrzlgnm
 // SPDX-License-Identifier: MIT-0
 
+#include <memory>
+#include <optional>
 #include <stdexcept>
 #include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
 
 #include "analyzer.hpp"
 
@@ -22,7 +27,6 @@
 #include <builtin/builtin.hpp>
 #include <compiler/symbol_table.hpp>
 #include <doctest/doctest.h>
-#include <eval/environment.hpp>
 #include <fmt/format.h>
 #include <fmt/ranges.h>
 #include <lexer/lexer.hpp>
@@ -36,36 +40,83 @@ namespace
 }
 }  // namespace
 
-void analyze_program(const program* program,
-                     symbol_table* existing_symbols,
-                     const environment* existing_env) noexcept(false)
+auto analyze_program(const program* program, const symbol_table* existing_symbols) noexcept(false)
+    -> name_resolution
 {
-    symbol_table* symbols = nullptr;
-    if (existing_symbols != nullptr) {
-        symbols = symbol_table::create_enclosed(existing_symbols);
-    } else {
-        symbols = symbol_table::create();
+    // only lives as long as the analysis, so it stays off the collected heap
+    symbol_table builtins;
+    if (existing_symbols == nullptr) {
         for (auto i = 0; const auto* builtin : builtin::builtins()) {
-            symbols->define_builtin(i++, builtin->name);
+            builtins.define_builtin(i++, builtin->name);
         }
+        existing_symbols = &builtins;
     }
-    if (existing_env != nullptr) {
-        for (const auto& [key, _] : existing_env->store) {
-            symbols->define(key);
-        }
-    }
-    analyzer an {symbols};
-    an.analyze(program);
+    analyzer an {existing_symbols};
+    return an.analyze(program);
 }
 
-analyzer::analyzer(symbol_table* symbols)
-    : m_symbols {symbols}
+analyzer::analyzer(const symbol_table* existing_symbols)
+    : m_existing {existing_symbols}
 {
 }
 
-void analyzer::analyze(const program* prgrm)
+auto analyzer::analyze(const program* prgrm) -> name_resolution
 {
+    m_resolution.nodes = prgrm->nodes.get();
+    m_resolution.names.resize(prgrm->num_identifiers);
+    enter_scope(/*inside_loop=*/false);
     prgrm->accept(*this);
+    m_resolution.defined.assign(m_scopes.front().names.begin(), m_scopes.front().names.end());
+    m_resolution.num_bindings = m_bindings.size();
+    return std::move(m_resolution);
+}
+
+auto analyzer::enter_scope(const bool inside_loop) -> void
+{
+    m_scopes.push_back(scope {.names = {}, .inside_loop = inside_loop});
+}
+
+auto analyzer::leave_scope() -> void
+{
+    for (const auto name : m_scopes.back().names) {
+        m_visible[name].pop_back();
+    }
+    m_scopes.pop_back();
+}
+
+auto analyzer::define(const std::string_view name, const bool function_name) -> std::size_t
+{
+    const auto idx = m_bindings.size();
+    m_bindings.push_back(binding {.scope = m_scopes.size() - 1, .depth = m_depth, .function_name = function_name});
+    m_visible[name].push_back(idx);
+    m_scopes.back().names.push_back(name);
+    return idx;
+}
+
+// The evaluator binds the name of a function in the environment the function is defined in, the environments are
+// those of the calls, loops have none.
+auto analyzer::resolve(const identifier& expr) const -> resolved_name
+{
+    if (const auto itr = m_visible.find(expr.value); itr != m_visible.end() && !itr->second.empty()) {
+        const auto idx = itr->second.back();
+        const auto& bnd = m_bindings[idx];
+        return {.binding = idx, .builtin = {}, .depth = m_depth - bnd.depth + (bnd.function_name ? 1 : 0)};
+    }
+    const auto definition = m_existing->definition(expr.value);
+    if (!definition.has_value()) {
+        fail(fmt::format("{}: identifier not found: {}", expr.l, expr.value));
+    }
+    const auto& sym = definition->sym;
+    return {.binding = {},
+            .builtin = sym.scope == symbol_scope::builtin ? std::optional {sym.index} : std::nullopt,
+            .depth = m_depth};
+}
+
+auto analyzer::annotate(const identifier& expr, const resolved_name& resolved) -> void
+{
+    if (expr.index < m_resolution.names.size()) {
+        m_resolution.names[expr.index] = resolved;
+    }
 }
 
 void analyzer::visit(const array_literal& expr)
@@ -75,19 +126,16 @@ void analyzer::visit(const array_literal& expr)
     }
 }
 
+// only the function being defined itself, not one enclosing it, can not be reassigned
 void analyzer::visit(const assign_expression& expr)
 {
-    const auto maybe_symbol = m_symbols->resolve(expr.name->value);
-    if (!maybe_symbol.has_value()) {
-        fail(fmt::format("{}: identifier not found: {}", expr.l, expr.name->value));
-    }
-    // NOLINTBEGIN(bugprone-unchecked-optional-access)
-    if (const auto& symbol = maybe_symbol.value();
-        symbol.is_function() || (symbol.is_outer() && symbol.ptr.value().is_function()))
-    {
-        fail(fmt::format("{}: cannot reassign the current function being defined: {}", expr.l, expr.name->value));
+    const auto resolved = resolve(*expr.name);
+    if (resolved.binding.has_value()) {
+        if (const auto& bnd = m_bindings[*resolved.binding]; bnd.function_name && bnd.depth == m_depth) {
+            fail(fmt::format("{}: cannot reassign the current function being defined: {}", expr.l, expr.name->value));
+        }
     }
-    // NOLINTEND(bugprone-unchecked-optional-access)
+    annotate(*expr.name, resolved);
     expr.value->accept(*this);
 }
 
@@ -107,9 +155,7 @@ void analyzer::visit(const hash_literal& expr)
 
 void analyzer::visit(const identifier& expr)
 {
-    if (auto symbol = m_symbols->resolve(expr.value); !symbol.has_value()) {
-        fail(fmt::format("{}: identifier not found: {}", expr.l, expr.value));
-    }
+    annotate(expr, resolve(expr));
 }
 
 void analyzer::visit(const if_expression& expr)
@@ -124,10 +170,9 @@ void analyzer::visit(const if_expression& expr)
 void analyzer::visit(const while_statement& expr)
 {
     expr.condition->accept(*this);
-
-    auto* inner = symbol_table::create_enclosed(m_symbols, /*inside_loop=*/true);
-    analyzer w {inner};
-    expr.body->accept(w);
+    enter_scope(/*inside_loop=*/true);
+    expr.body->accept(*this);
+    leave_scope();
 }
 
 void analyzer::visit(const index_expression& expr)
@@ -143,14 +188,16 @@ void analyzer::visit(const program& expr)
     }
 }
 
+// a name can be defined again where it is the name of the function or was defined in an enclosing scope
 void analyzer::visit(const let_statement& expr)
 {
-    if (auto symbol = m_symbols->resolve(expr.name->value); symbol.has_value()) {
-        if (const auto& value = symbol.value(); value.is_local() || (value.is_global() && m_symbols->is_global())) {
+    if (const auto itr = m_visible.find(expr.name->value); itr != m_visible.end() && !itr->second.empty()) {
+        if (const auto& bnd = m_bindings[itr->second.back()]; bnd.scope == m_scopes.size() - 1 && !bnd.function_name)
+        {
             fail(fmt::format("{}: {} is already defined", expr.l, expr.name->value));
         }
     }
-    m_symbols->define(expr.name->value);
+    annotate(*expr.name, {.binding = define(expr.name->value, /*function_name=*/false), .builtin = {}, .depth = 0});
     expr.value->accept(*this);
 }
 
@@ -161,14 +208,14 @@ void analyzer::visit(const return_statement& expr)
 
 void analyzer::visit(const break_statement& expr)
 {
-    if (!m_symbols->inside_loop()) {
+    if (!m_scopes.back().inside_loop) {
         fail(fmt::format("{}: syntax error: break outside loop", expr.l));
     }
 }
 
 void analyzer::visit(const continue_statement& expr)
 {
-    if (!m_symbols->inside_loop()) {
+    if (!m_scopes.back().inside_loop) {
         fail(fmt::format("{}: syntax error: continue outside loop", expr.l));
     }
 }
@@ -192,16 +239,17 @@ void analyzer::visit(const unary_expression& expr)
 
 void analyzer::visit(const function_literal& expr)
 {
-    auto* inner = symbol_table::create_enclosed(m_symbols);
+    enter_scope(/*inside_loop=*/false);
+    m_depth++;
     if (!expr.name.empty()) {
-        inner->define_function_name(expr.name);
+        define(expr.name, /*function_name=*/true);
     }
-
     for (const auto* parameter : expr.parameters) {
-        inner->define(parameter->value);
+        annotate(*parameter, {.binding = define(parameter->value, /*function_name=*/false), .builtin = {}, .depth = 0});
     }
-    analyzer f(inner);
-    expr.body->accept(f);
+    expr.body->accept(*this);
+    m_depth--;
+    leave_scope();
 }
 
 void analyzer::visit(const call_expression& expr)
@@ -222,21 +270,21 @@ auto check_no_parse_errors(const parser& prsr) -> bool
     return prsr.errors().empty();
 }
 
-using parsed_program = std::pair<const program*, parser>;
+using parsed_program = std::pair<std::unique_ptr<program>, parser>;
 
 auto check_program(const std::string_view input) -> parsed_program
 {
     auto prsr = parser {lexer {input}};
-    const auto* prgrm = prsr.parse_program();
+    auto prgrm = prsr.parse_program();
     INFO("while parsing: `", input, "`");
     CHECK(check_no_parse_errors(prsr));
-    return {prgrm, std::move(prsr)};
+    return {std::move(prgrm), std::move(prsr)};
 }
 
 auto analyze(const std::string_view input) noexcept(false) -> void
 {
     const auto [prgrm, _] = check_program(input);
-    analyze_program(prgrm, nullptr, nullptr);
+    analyze_program(prgrm.get(), nullptr);
 }
 
 TEST_SUITE("analyzer")
@@ -286,6 +334,58 @@ TEST_SUITE("analyzer")
             CHECK_THROWS_WITH_AS(analyze(tst.input), tst.expected_exception_string, std::runtime_error);
         }
     }
+
+    TEST_CASE("definedNames")
+    {
+        auto* symbols = symbol_table::create();
+        for (auto idx = 0; const auto* bltn : builtin::builtins()) {
+            symbols->define_builtin(idx++, bltn->name);
+        }
+        symbols->define("a");
+        const auto [prgrm, _] = check_program("let b = a; let f = fn(x) { let y = x; y }; let len = f(b); len");
+        CHECK_EQ(analyze_program(prgrm.get(), symbols).defined, std::vector<std::string> {"b", "f", "len"});
+        CHECK_FALSE(symbols->symbols().contains("b"));
+    }
+
+    TEST_CASE("resolvedNames")
+    {
+        const auto [prgrm, _] = check_program("let a = 1; let f = fn(x) { while (x) { x = a; } f }; len");
+        const auto resolution = analyze_program(prgrm.get(), nullptr);
+        CHECK_EQ(resolution.num_bindings, 4);
+        CHECK_EQ(resolution.defined, std::vector<std::string> {"a", "f"});
+        const auto resolved = [&](const expression* expr)
+        {
+            const auto* ident = dynamic_cast<const identifier*>(expr);
+            REQUIRE(ident != nullptr);
+            const auto* name = resolution.find(*ident);
+            REQUIRE(name != nullptr);
+            return *name;
+        };
+        const auto expression_of = [](const expression* stmt)
+        { return dynamic_cast<const expression_statement*>(stmt)->expr; };
+
+        const auto* let_a = dynamic_cast<const let_statement*>(prgrm->statements[0]);
+        CHECK_EQ(resolved(let_a->name).binding, 0);
+        const auto* let_f = dynamic_cast<const let_statement*>(prgrm->statements[1]);
+        CHECK_EQ(resolved(let_f->name).binding, 1);
+        const auto* func = dynamic_cast<const function_literal*>(let_f->value);
+        CHECK_EQ(resolved(func->parameters[0]).binding, 3);
+        const auto* loop = dynamic_cast<const while_statement*>(func->body->statements[0]);
+        const auto* assign = dynamic_cast<const assign_expression*>(loop->body->statements[0]);
+        // loops have no environment of their own
+        CHECK_EQ(resolved(assign->name).binding, 3);
+        CHECK_EQ(resolved(assign->name).depth, 0);
+        CHECK_EQ(resolved(assign->value).binding, 0);
+        CHECK_EQ(resolved(assign->value).depth, 1);
+        // the function is bound where it is defined
+        const auto self = resolved(expression_of(func->body->statements[1]));
+        CHECK_EQ(self.binding, 2);
+        CHECK_EQ(self.depth, 1);
+        const auto bltn = resolved(expression_of(prgrm->statements[2]));
+        CHECK_FALSE(bltn.binding.has_value());
+        CHECK_EQ(bltn.builtin, 0);
+        CHECK_EQ(bltn.depth, 0);
+    }
 }
 
 // NOLINTEND(*)
@@ -3,15 +3,25 @@
 
 #pragma once
 
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include <ast/identifier.hpp>
 #include <ast/program.hpp>
 #include <ast/visitor.hpp>
 #include <compiler/symbol_table.hpp>
-#include <eval/environment.hpp>
 
+#include "name_resolution.hpp"
+
+// Checks the names of a program and resolves each identifier to its binding, looking up the names it does not
+// define in `existing_symbols`.
 struct analyzer final : visitor
 {
-    explicit analyzer(symbol_table* symbols);
-    void analyze(const program* prgrm) noexcept(false);
+    explicit analyzer(const symbol_table* existing_symbols);
+    [[nodiscard]] auto analyze(const program* prgrm) noexcept(false) -> name_resolution;
 
     void visit(const array_literal& expr) override;
     void visit(const assign_expression& expr) override;
@@ -43,9 +53,40 @@ struct analyzer final : visitor
     void visit(const string_literal& /* expr */) override {}
 
   private:
-    symbol_table* m_symbols;
+    // a function, the body of a loop or the top level
+    struct scope final
+    {
+        // the names defined in it
+        std::vector<std::string_view> names;
+        bool inside_loop {};
+    };
+
+    struct binding final
+    {
+        // the scope it is defined in, counted from the top level
+        std::size_t scope {};
+        // the number of functions enclosing the definition
+        int depth {};
+        bool function_name {};
+    };
+
+    auto enter_scope(bool inside_loop) -> void;
+    auto leave_scope() -> void;
+    auto define(std::string_view name, bool function_name) -> std::size_t;
+    [[nodiscard]] auto resolve(const identifier& expr) const -> resolved_name;
+    auto annotate(const identifier& expr, const resolved_name& resolved) -> void;
+
+    const symbol_table* m_existing;
+    // the bindings visible by name, the innermost last
+    std::unordered_map<std::string_view, std::vector<std::size_t>> m_visible;
+    std::vector<scope> m_scopes;
+    std::vector<binding> m_bindings;
+    int m_depth {};
+    name_resolution m_resolution;
 };
 
-void analyze_program(const program* program,
-                     symbol_table* existing_symbols,
-                     const environment* existing_env) noexcept(false);
+// Checks the program against the names defined in `existing_symbols`, if given, and the builtins otherwise,
+// without adding its own to them. The compiler and the evaluator take the names as resolved here, a repl adds
+// the ones defined at the top level once they are bound.
+auto analyze_program(const program* program, const symbol_table* existing_symbols) noexcept(false)
+    -> name_resolution;
@@ -0,0 +1,42 @@
+// Copyright 2023-2025 hrzlgnm
+// SPDX-License-Identifier: MIT-0
+
+#pragma once
+
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <ast/arena.hpp>
+#include <ast/identifier.hpp>
+
+// what an identifier refers to
+struct resolved_name final
+{
+    // the let, parameter or function name, numbered in the order they are defined, none for the names defined
+    // before the program
+    std::optional<std::size_t> binding;
+    // the index of the builtin, if it refers to one
+    std::optional<int> builtin;
+    // the number of environments between the one of the identifier and the one the evaluator binds the name in
+    int depth {};
+};
+
+// The names of a program as resolved by analyze_program, once for the compiler and the evaluator. The definitions
+// of the lets and parameters are resolved to their own binding.
+struct name_resolution final
+{
+    // the nodes of the program
+    const ast_arena* nodes {};
+    // by the index of the identifier
+    std::vector<resolved_name> names;
+    std::size_t num_bindings {};
+    // the names the program defines at the top level, in order
+    std::vector<std::string> defined;
+
+    [[nodiscard]] auto find(const identifier& expr) const -> const resolved_name*
+    {
+        return expr.index < names.size() ? &names[expr.index] : nullptr;
+    }
+};
@@ -0,0 +1,122 @@
+// Copyright 2023-2025 hrzlgnm
+// SPDX-License-Identifier: MIT-0
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <ranges>
+#include <string>
+#include <utility>
+
+#include "arena.hpp"
+
+#include <doctest/doctest.h>
+
+#include "visitor.hpp"
+
+namespace
+{
+constexpr std::size_t first_chunk_size = 1024;
+constexpr std::size_t max_chunk_size = 64 * 1024;
+}  // namespace
+
+ast_arena::ast_arena(std::shared_ptr<const source_file> source)
+    : m_source {std::move(source)}
+{
+}
+
+ast_arena::~ast_arena()
+{
+    for (const auto* node : std::views::reverse(m_nodes)) {
+        node->~expression();
+    }
+}
+
+auto ast_arena::allocate_bytes(const std::size_t size, const std::size_t alignment) -> void*
+{
+    void* cursor = m_cursor;
+    if (std::align(alignment, size, cursor, m_remaining) == nullptr) {
+        m_next_chunk_size = std::clamp(m_next_chunk_size * 2, first_chunk_size, max_chunk_size);
+        const auto chunk_size = std::max(m_next_chunk_size, size + alignment);
+        m_chunks.push_back(std::make_unique_for_overwrite<std::byte[]>(chunk_size));
+        m_bytes_reserved += chunk_size;
+        cursor = m_chunks.back().get();
+        m_remaining = chunk_size;
+        std::align(alignment, size, cursor, m_remaining);
+    }
+    m_cursor = static_cast<std::byte*>(cursor) + size;
+    m_remaining -= size;
+    return cursor;
+}
+
+namespace
+{
+// NOLINTBEGIN(*)
+struct counted final : expression
+{
+    counted(int& live, const location& loc)
+        : expression {loc}
+        , live {live}
+    {
+        ++live;
+    }
+
+    ~counted() override { --live; }
+
+    counted(const counted&) = delete;
+    counted(counted&&) = delete;
+    auto operator=(const counted&) -> counted& = delete;
+    auto operator=(counted&&) -> counted& = delete;
+
+    [[nodiscard]] auto string() const -> std::string override { return {}; }
+
+    void accept(visitor& /*visitor*/) const override {}
+
+    int& live;
+    std::string padding = std::string(64, 'x');
+};
+
+TEST_SUITE("arena")
+{
+    TEST_CASE("destroysAllNodesOnRelease")
+    {
+        int live = 0;
+        {
+            ast_arena arena;
+            for (int i = 0; i < 1000; ++i) {
+                arena.make<counted>(live, location {});
+            }
+            CHECK_EQ(live, 1000);
+            CHECK_EQ(arena.node_count(), 1000);
+        }
+        CHECK_EQ(live, 0);
+    }
+
+    TEST_CASE("chunksGrowGeometricallyUpToALimit")
+    {
+        int live = 0;
+        ast_arena arena;
+        arena.make<counted>(live, location {});
+        CHECK_EQ(arena.bytes_reserved(), first_chunk_size);
+        for (int i = 0; i < 10000; ++i) {
+            arena.make<counted>(live, location {});
+        }
+        const auto used = arena.node_count() * sizeof(counted);
+        CHECK_GE(arena.bytes_reserved(), used);
+        CHECK_LE(arena.bytes_reserved(), used + (2 * max_chunk_size));
+    }
+
+    TEST_CASE("nodesAreSuitablyAligned")
+    {
+        int live = 0;
+        ast_arena arena;
+        for (int i = 0; i < 100; ++i) {
+            const auto* node = arena.make<counted>(live, location {});
+            CHECK_EQ(reinterpret_cast<std::uintptr_t>(node) % alignof(counted), 0);
+        }
+    }
+}
+
+// NOLINTEND(*)
+}  // namespace
@@ -0,0 +1,56 @@
+// Copyright 2023-2025 hrzlgnm
+// SPDX-License-Identifier: MIT-0
+
+#pragma once
+
+#include <concepts>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+#include <lexer/location.hpp>
+
+#include "expression.hpp"
+
+// Bump allocator owning every node of one parse. Nodes are destroyed in reverse order of creation and their
+// memory is released in bulk once the last owner, the program or an evaluator function object, lets go of it.
+class ast_arena final
+{
+  public:
+    explicit ast_arena(std::shared_ptr<const source_file> source = {});
+    ~ast_arena();
+    ast_arena(const ast_arena&) = delete;
+    ast_arena(ast_arena&&) = delete;
+    auto operator=(const ast_arena&) -> ast_arena& = delete;
+    auto operator=(ast_arena&&) -> ast_arena& = delete;
+
+    template<typename T, typename... Args>
+        requires std::derived_from<T, expression>
+    auto make(Args&&... args) -> T*
+    {
+        void* storage = allocate_bytes(sizeof(T), alignof(T));
+        T* node = new (storage) T(std::forward<Args>(args)...);
+        m_nodes.push_back(node);
+        return node;
+    }
+
+    // the source the node locations point into
+    [[nodiscard]] auto source() const -> const std::shared_ptr<const source_file>& { return m_source; }
+
+    [[nodiscard]] auto node_count() const -> std::size_t { return m_nodes.size(); }
+
+    [[nodiscard]] auto bytes_reserved() const -> std::size_t { return m_bytes_reserved; }
+
+  private:
+    auto allocate_bytes(std::size_t size, std::size_t alignment) -> void*;
+
+    std::shared_ptr<const source_file> m_source;
+    std::vector<std::unique_ptr<std::byte[]>> m_chunks;
+    std::vector<const expression*> m_nodes;
+    std::byte* m_cursor {};
+    std::size_t m_remaining {};
+    std::size_t m_next_chunk_size {};
+    std::size_t m_bytes_reserved {};
+};
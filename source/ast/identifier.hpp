@@ -3,6 +3,7 @@
 
 #pragma once
 
+#include <cstddef>
 #include <utility>
 #include <vector>
 
@@ -12,9 +13,10 @@
 
 struct identifier final : expression
 {
-    explicit identifier(std::string val, const location& loc)
+    explicit identifier(std::string val, const location& loc, const std::size_t idx = 0)
         : expression {loc}
         , value {std::move(val)}
+        , index {idx}
     {
     }
 
@@ -22,6 +24,8 @@ struct identifier final : expression
     void accept(visitor& visitor) const override;
 
     std::string value;
+    // the position among the identifiers of the program, which the analysis annotates by it
+    std::size_t index {};
 };
 
 using identifiers = std::vector<const identifier*>;
@@ -3,6 +3,10 @@
 
 #pragma once
 
+#include <cstddef>
+#include <memory>
+
+#include "arena.hpp"
 #include "expression.hpp"
 
 struct program final : expression
@@ -12,4 +16,6 @@ struct program final : expression
     void accept(visitor& visitor) const override;
 
     expressions statements;
+    std::shared_ptr<ast_arena> nodes;
+    std::size_t num_identifiers {};
 };
@@ -18,10 +18,12 @@
 
 builtin::builtin(std::string name,
                  std::vector<std::string> params,
-                 std::function<const object*(array_object::value_type&& arguments)> bod)
+                 std::function<const object*(array_object::value_type&& arguments)> bod,
+                 const bool pure)
     : name {std::move(name)}
     , parameters {std::move(params)}
     , body {std::move(bod)}
+    , pure {pure}
 {
 }
 
@@ -53,7 +55,8 @@ const builtin len {
             return allocate<integer_object>(static_cast<int64_t>(hsh.size()));
         }
         return make_error("argument of type {} to len() is not supported", maybe_string_or_array_or_hash->type());
-    }};
+    },
+    /*pure=*/true};
 
 const builtin pts {"puts",
                    {"val..."},
@@ -73,7 +76,8 @@ const builtin pts {"puts",
                        }
                        fmt::print("\n");
                        return null();
-                   }};
+                   },
+                   /*pure=*/false};
 
 const builtin first {
     "first",
@@ -98,7 +102,8 @@ const builtin first {
             return null();
         }
         return make_error("argument of type {} to first() is not supported", maybe_string_or_array->type());
-    }};
+    },
+    /*pure=*/true};
 
 const builtin last {
     "last",
@@ -123,7 +128,8 @@ const builtin last {
             return null();
         }
         return make_error("argument of type {} to last() is not supported", maybe_string_or_array->type());
-    }};
+    },
+    /*pure=*/true};
 
 const builtin rest {
     "rest",
@@ -150,7 +156,8 @@ const builtin rest {
             return null();
         }
         return make_error("argument of type {} to rest() is not supported", maybe_string_or_array->type());
-    }};
+    },
+    /*pure=*/true};
 
 const builtin push {
     "push",
@@ -192,7 +199,8 @@ const builtin push {
                 "argument of type {}, {} and {} to push() are not supported", lhs->type(), k->type(), v->type());
         }
         return make_error("invalid call to push()");
-    }};
+    },
+    /*pure=*/true};
 
 const builtin type {"type",
                     {"val"},
@@ -204,7 +212,8 @@ const builtin type {"type",
                         }
                         const auto& val = arguments[0];
                         return allocate<string_object>(fmt::format("{}", val->type()));
-                    }};
+                    },
+                    /*pure=*/true};
 const builtin chr {"chr",
                    {"int"},
                    [](const array_object::value_type& arguments) -> const object*
@@ -222,7 +231,8 @@ const builtin chr {"chr",
                            return make_error("number {} is out of range to be an ascii character", as_int);
                        }
                        return make_error("argument of type {} to chr() is not supported", val->type());
-                   }};
+                   },
+                   /*pure=*/true};
 }  // namespace
 
 auto builtin::builtins() -> const std::vector<const builtin*>&
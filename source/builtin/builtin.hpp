@@ -13,11 +13,14 @@ struct builtin final
 {
     builtin(std::string name,
             std::vector<std::string> params,
-            std::function<const object*(std::vector<const object*>&& arguments)> bod);
+            std::function<const object*(std::vector<const object*>&& arguments)> bod,
+            bool pure);
 
     static auto builtins() -> const std::vector<const builtin*>&;
 
     std::string name;
     std::vector<std::string> parameters;
     std::function<const object*(array_object::value_type&& arguments)> body;
+    // without side effects, a call whose result is unused can be dropped
+    bool pure {};
 };
@@ -4,9 +4,14 @@
 #include <algorithm>
 #include <array>
 #include <cstdint>
+#include <cstring>
 #include <iterator>
+#include <limits>
+#include <map>
+#include <numeric>
 #include <optional>
 #include <ostream>
+#include <ranges>
 #include <stdexcept>
 #include <string>
 #include <utility>
@@ -67,6 +72,8 @@ auto operator<<(std::ostream& ostream, opcodes opcode) -> std::ostream&
             return ostream << "index";
         case call:
             return ostream << "call";
+        case tail_call:
+            return ostream << "tail_call";
         case return_value:
             return ostream << "return_value";
         case ret:
@@ -111,11 +118,120 @@ auto operator<<(std::ostream& ostream, opcodes opcode) -> std::ostream&
             return ostream << "continue";
         case greater_equal:
             return ostream << "greater_equal";
+        case add_int:
+            return ostream << "add_int";
+        case sub_int:
+            return ostream << "sub_int";
+        case mul_int:
+            return ostream << "mul_int";
+        case equal_int:
+            return ostream << "equal_int";
+        case not_equal_int:
+            return ostream << "not_equal_int";
+        case greater_than_int:
+            return ostream << "greater_than_int";
+        case greater_equal_int:
+            return ostream << "greater_equal_int";
+        case add_dec:
+            return ostream << "add_dec";
+        case sub_dec:
+            return ostream << "sub_dec";
+        case mul_dec:
+            return ostream << "mul_dec";
+        case div_dec:
+            return ostream << "div_dec";
+        case greater_than_dec:
+            return ostream << "greater_than_dec";
+        case greater_equal_dec:
+            return ostream << "greater_equal_dec";
+        case frame_closure:
+            return ostream << "frame_closure";
+        case frame_array:
+            return ostream << "frame_array";
+        case wide:
+            return ostream << "wide";
+        case constant_small:
+            return ostream << "constant_small";
     }
     throw std::runtime_error(
         fmt::format("operator <<(std::ostream&) for {} is not implemented yet", static_cast<uint8_t>(opcode)));
 }
 
+namespace
+{
+struct specialization final
+{
+    opcodes generic {};
+    opcodes specialized {};
+};
+
+constexpr std::array integer_specializations {
+    specialization {.generic = opcodes::add, .specialized = opcodes::add_int},
+    specialization {.generic = opcodes::sub, .specialized = opcodes::sub_int},
+    specialization {.generic = opcodes::mul, .specialized = opcodes::mul_int},
+    specialization {.generic = opcodes::equal, .specialized = opcodes::equal_int},
+    specialization {.generic = opcodes::not_equal, .specialized = opcodes::not_equal_int},
+    specialization {.generic = opcodes::greater_than, .specialized = opcodes::greater_than_int},
+    specialization {.generic = opcodes::greater_equal, .specialized = opcodes::greater_equal_int},
+};
+
+constexpr std::array decimal_specializations {
+    specialization {.generic = opcodes::add, .specialized = opcodes::add_dec},
+    specialization {.generic = opcodes::sub, .specialized = opcodes::sub_dec},
+    specialization {.generic = opcodes::mul, .specialized = opcodes::mul_dec},
+    specialization {.generic = opcodes::div, .specialized = opcodes::div_dec},
+    specialization {.generic = opcodes::greater_than, .specialized = opcodes::greater_than_dec},
+    specialization {.generic = opcodes::greater_equal, .specialized = opcodes::greater_equal_dec},
+};
+
+template<std::size_t N>
+auto specialize(const std::array<specialization, N>& specializations, const opcodes opcode) -> std::optional<opcodes>
+{
+    const auto* itr = std::ranges::find(specializations, opcode, &specialization::generic);
+    if (itr == specializations.end()) {
+        return std::nullopt;
+    }
+    return itr->specialized;
+}
+
+template<std::size_t N>
+auto generalize(const std::array<specialization, N>& specializations, const opcodes opcode) -> std::optional<opcodes>
+{
+    const auto* itr = std::ranges::find(specializations, opcode, &specialization::specialized);
+    if (itr == specializations.end()) {
+        return std::nullopt;
+    }
+    return itr->generic;
+}
+}  // namespace
+
+auto generic_opcode(const opcodes opcode) -> opcodes
+{
+    return generalize(integer_specializations, opcode)
+        .or_else([opcode] { return generalize(decimal_specializations, opcode); })
+        .value_or(opcode);
+}
+
+auto integer_opcode(const opcodes opcode) -> std::optional<opcodes>
+{
+    return specialize(integer_specializations, opcode);
+}
+
+auto decimal_opcode(const opcodes opcode) -> std::optional<opcodes>
+{
+    return specialize(decimal_specializations, opcode);
+}
+
+namespace
+{
+constexpr auto bits_in_byte = 8U;
+
+auto fits(const std::size_t operand, const std::size_t width) -> bool
+{
+    return width >= sizeof(std::size_t) || operand >> (width * bits_in_byte) == 0;
+}
+}  // namespace
+
 auto make(opcodes opcode, const operands& operands) -> instructions
 {
     if (!definitions.contains(opcode)) {
@@ -123,12 +239,24 @@ auto make(opcodes opcode, const operands& operands) -> instructions
     }
     const auto& definition = definitions.at(opcode);
     instructions instr;
+    const auto is_wide = std::ranges::any_of(std::views::iota(std::size_t {}, operands.size()),
+                                             [&](const std::size_t idx)
+                                             { return !fits(operands[idx], definition.operand_widths[idx]); });
+    if (is_wide) {
+        instr.push_back(static_cast<uint8_t>(opcodes::wide));
+    }
     instr.push_back(static_cast<uint8_t>(opcode));
     for (size_t idx = 0; const auto operand : operands) {
-        switch (const auto width = definition.operand_widths[idx]) {
+        const auto width = definition.operand_widths[idx] * (is_wide ? 2 : 1);
+        if (!fits(operand, width)) {
+            throw std::runtime_error(fmt::format("operand {} of {} does not fit {} bytes", operand, opcode, width));
+        }
+        switch (width) {
+            case 4:
+                write_uint32(instr, instr.size(), static_cast<std::uint32_t>(operand));
+                break;
             case 2:
-                write_uint16_big_endian(
-                    instr, static_cast<std::uint16_t>(instr.size()), static_cast<std::uint16_t>(operand));
+                write_uint16(instr, instr.size(), static_cast<std::uint16_t>(operand));
                 break;
             case 1:
                 instr.push_back(static_cast<uint8_t>(operand));
@@ -156,7 +284,7 @@ auto read_operands(const definition& def, const instructions& instr) -> std::pai
     for (size_t idx = 0; const auto width : def.operand_widths) {
         switch (width) {
             case 2:
-                result.first[idx] = read_uint16_big_endian(instr, offset);
+                result.first[idx] = read_uint16(instr, offset);
                 break;
             case 1:
                 result.first[idx] = instr[offset];
@@ -206,42 +334,258 @@ auto fmt_instruction(const definition& def, const operands& operands) -> std::st
 auto to_string(const instructions& code) -> std::string
 {
     std::string result;
-    auto read = 0U;
-    for (size_t idx = 0; idx < code.size(); idx += 1 + read) {
-        auto def = lookup(static_cast<opcodes>(code[idx]));
+    for (size_t idx = 0; idx < code.size();) {
+        auto def = lookup(opcode_at(code, idx));
         if (!def.has_value()) {
+            idx++;
             continue;
         }
-        auto operand = read_operands(def.value(), {code.begin() + static_cast<int64_t>(idx) + 1, code.end()});
-        result += fmt::format("{:04d} {}\n", idx, fmt_instruction(def.value(), operand.first));
-        read = static_cast<unsigned>(operand.second);
+        result += fmt::format("{:04d} {}{}\n",
+                              idx,
+                              code[idx] == static_cast<uint8_t>(opcodes::wide) ? "OpWide " : "",
+                              fmt_instruction(def.value(), operands_at(code, idx)));
+        idx += instruction_length(code, idx);
     }
     return result;
 }
 
-constexpr auto bits_in_byte = 8U;
-constexpr auto byte_mask = 0xFFU;
+auto opcode_at(const instructions& code, const std::size_t ip) -> opcodes
+{
+    const auto opcode = static_cast<opcodes>(code.at(ip));
+    return opcode == opcodes::wide ? static_cast<opcodes>(code.at(ip + 1)) : opcode;
+}
 
-auto read_uint16_big_endian(const std::vector<uint8_t>& bytes, const size_t offset) -> uint16_t
+auto instruction_length(const instructions& code, const std::size_t ip) -> std::size_t
 {
-    if (offset + 2 > bytes.size()) {
-        throw std::out_of_range("Offset is out of bounds");
+    const auto is_wide = static_cast<opcodes>(code.at(ip)) == opcodes::wide;
+    const auto& widths = definitions.at(opcode_at(code, ip)).operand_widths;
+    const auto length = std::accumulate(widths.begin(), widths.end(), std::size_t {});
+    return is_wide ? 2 + (2 * length) : 1 + length;
+}
+
+auto operand_at(const instructions& code, const std::size_t ip, const std::size_t index) -> std::size_t
+{
+    const auto is_wide = static_cast<opcodes>(code.at(ip)) == opcodes::wide;
+    const auto scale = is_wide ? std::size_t {2} : std::size_t {1};
+    const auto& widths = definitions.at(opcode_at(code, ip)).operand_widths;
+    auto offset = ip + scale;
+    for (std::size_t idx = 0; idx < index; ++idx) {
+        offset += widths[idx] * scale;
+    }
+    switch (widths.at(index) * scale) {
+        case 4:
+            return read_uint32(code, offset);
+        case 2:
+            return read_uint16(code, offset);
+        default:
+            return code.at(offset);
     }
+}
+
+auto operands_at(const instructions& code, const std::size_t ip) -> operands
+{
+    operands result(definitions.at(opcode_at(code, ip)).operand_widths.size());
+    for (std::size_t idx = 0; idx < result.size(); ++idx) {
+        result[idx] = operand_at(code, ip, idx);
+    }
+    return result;
+}
 
-    auto result = static_cast<uint16_t>((bytes[offset]) << bits_in_byte);
-    result |= bytes[offset + 1];
+namespace
+{
+auto is_jump(const opcodes opcode) -> bool
+{
+    return opcode == opcodes::jump || opcode == opcodes::jump_not_truthy;
+}
+}  // namespace
+
+auto reencode(const instructions& code, const bool compact, const std::map<std::size_t, std::size_t>& far_targets)
+    -> instructions
+{
+    struct decoded final
+    {
+        opcodes opcode {};
+        operands rands;
+    };
+    std::vector<decoded> instrs;
+    std::map<std::size_t, std::size_t> index_at;
+    for (std::size_t ip = 0; ip < code.size(); ip += instruction_length(code, ip)) {
+        index_at.emplace(ip, instrs.size());
+        instrs.push_back({.opcode = opcode_at(code, ip), .rands = operands_at(code, ip)});
+    }
+    index_at.emplace(code.size(), instrs.size());
+    for (const auto& [ip, idx] : index_at) {
+        if (idx == instrs.size()) {
+            continue;
+        }
+        auto& [opcode, rands] = instrs[idx];
+        if (is_jump(opcode)) {
+            const auto far = far_targets.find(ip);
+            rands.front() = index_at.at(far != far_targets.end() ? far->second : rands.front());
+        } else if (compact && opcode == opcodes::constant && fits(rands.front(), 1)) {
+            opcode = opcodes::constant_small;
+        }
+    }
 
+    // jumps start out short, making one wide moves the instructions after it, so that others may need to be too
+    constexpr auto far_jump = std::size_t {std::numeric_limits<std::uint16_t>::max()} + 1;
+    std::vector<bool> wide_jumps(instrs.size());
+    const auto length = [&](const std::size_t idx)
+    {
+        const auto& [opcode, rands] = instrs[idx];
+        return is_jump(opcode) ? make(opcode, wide_jumps[idx] ? far_jump : 0).size() : make(opcode, rands).size();
+    };
+    std::vector<std::size_t> starts(instrs.size() + 1);
+    for (auto changed = true; changed;) {
+        changed = false;
+        for (std::size_t idx = 0; idx < instrs.size(); ++idx) {
+            starts[idx + 1] = starts[idx] + length(idx);
+        }
+        for (std::size_t idx = 0; idx < instrs.size(); ++idx) {
+            if (is_jump(instrs[idx].opcode) && !wide_jumps[idx] && !fits(starts[instrs[idx].rands.front()], 2)) {
+                wide_jumps[idx] = changed = true;
+            }
+        }
+    }
+    instructions result;
+    for (const auto& [opcode, rands] : instrs) {
+        const auto instr = is_jump(opcode) ? make(opcode, starts[rands.front()]) : make(opcode, rands);
+        result.insert(result.end(), instr.begin(), instr.end());
+    }
     return result;
 }
 
-void write_uint16_big_endian(std::vector<uint8_t>& bytes, const size_t offset, const uint16_t value)
+namespace
+{
+auto ends_block(const opcodes opcode) -> bool
 {
-    if (offset + 2 > bytes.size()) {
-        bytes.resize(offset + 2);
+    using enum opcodes;
+    return opcode == jump || opcode == brake || opcode == cont || opcode == return_value || opcode == ret;
+}
+}  // namespace
+
+auto stack_use_at(const instructions& code, const std::size_t ip) -> stack_use
+{
+    using enum opcodes;
+    const auto opcode = opcode_at(code, ip);
+    if (!lookup(opcode).has_value() || opcode == wide) {
+        throw std::runtime_error(fmt::format("invalid opcode {} at offset {}", code[ip], ip));
     }
+    const auto operand = [&](const std::size_t index) { return operand_at(code, ip, index); };
+    switch (opcode) {
+        case constant:
+        case constant_small:
+        case tru:
+        case fals:
+        case null:
+        case get_global:
+        case get_local:
+        case get_free:
+        case get_outer:
+        case get_builtin:
+        case current_closure:
+            return {.pops = 0, .pushes = 1};
+        case array:
+        case hash:
+        case frame_array:
+            return {.pops = operand(0), .pushes = 1};
+        case closure:
+        case frame_closure:
+            return {.pops = operand(1), .pushes = 1};
+        case call:
+        case tail_call:
+            return {.pops = operand(0) + 1, .pushes = 1};
+        case minus:
+        case bang:
+            return {.pops = 1, .pushes = 1};
+        case jump:
+        case brake:
+        case cont:
+        case ret:
+            return {.pops = 0, .pushes = 0};
+        case pop:
+        case set_global:
+        case set_local:
+        case set_free:
+        case set_outer:
+        case jump_not_truthy:
+        case return_value:
+            return {.pops = 1, .pushes = 0};
+        default:
+            // binary operators and index
+            return {.pops = 2, .pushes = 1};
+    }
+}
+
+// Walks the code once. Code after an unconditional transfer of control is only reachable through a jump, so the
+// depth there is taken from the jumps to it, the only backwards jumps are those of loops, whose start is reached
+// first by falling through.
+auto max_stack_depth(const instructions& code) -> int
+{
+    std::map<std::size_t, std::int64_t> depths_at_targets;
+    std::int64_t depth = 0;
+    std::int64_t max_depth = 0;
+    for (std::size_t ip = 0; ip < code.size();) {
+        if (const auto itr = depths_at_targets.find(ip); itr != depths_at_targets.end()) {
+            depth = std::max(depth, itr->second);
+        }
+        const auto use = stack_use_at(code, ip);
+        const auto opcode = opcode_at(code, ip);
+        depth += static_cast<std::int64_t>(use.pushes) - static_cast<std::int64_t>(use.pops);
+        max_depth = std::max(max_depth, depth);
+        if (is_jump(opcode)) {
+            auto& target_depth = depths_at_targets[operand_at(code, ip, 0)];
+            target_depth = std::max(target_depth, depth);
+        }
+        if (ends_block(opcode)) {
+            depth = 0;
+        }
+        ip += instruction_length(code, ip);
+    }
+    return static_cast<int>(max_depth);
+}
+
+namespace
+{
+template<typename T>
+auto read_native(const std::vector<uint8_t>& bytes, const size_t offset) -> T
+{
+    if (offset + sizeof(T) > bytes.size()) {
+        throw std::out_of_range("Offset is out of bounds");
+    }
+    T result {};
+    std::memcpy(&result, bytes.data() + offset, sizeof(T));
+    return result;
+}
 
-    bytes[offset] = static_cast<uint8_t>(value >> bits_in_byte);
-    bytes[offset + 1] = static_cast<uint8_t>(value & byte_mask);
+template<typename T>
+void write_native(std::vector<uint8_t>& bytes, const size_t offset, const T value)
+{
+    if (offset + sizeof(T) > bytes.size()) {
+        bytes.resize(offset + sizeof(T));
+    }
+    std::memcpy(bytes.data() + offset, &value, sizeof(T));
+}
+}  // namespace
+
+auto read_uint16(const std::vector<uint8_t>& bytes, const size_t offset) -> uint16_t
+{
+    return read_native<uint16_t>(bytes, offset);
+}
+
+void write_uint16(std::vector<uint8_t>& bytes, const size_t offset, const uint16_t value)
+{
+    write_native(bytes, offset, value);
+}
+
+auto read_uint32(const std::vector<uint8_t>& bytes, const size_t offset) -> uint32_t
+{
+    return read_native<uint32_t>(bytes, offset);
+}
+
+void write_uint32(std::vector<uint8_t>& bytes, const size_t offset, const uint32_t value)
+{
+    write_native(bytes, offset, value);
 }
 
 namespace
@@ -258,6 +602,20 @@ auto flatten(const std::vector<std::vector<T>>& arrs) -> std::vector<T>
     return result;
 }
 
+auto native_uint16(const std::uint16_t value) -> instructions
+{
+    instructions bytes;
+    write_uint16(bytes, 0, value);
+    return bytes;
+}
+
+auto native_uint32(const std::uint32_t value) -> instructions
+{
+    instructions bytes;
+    write_uint32(bytes, 0, value);
+    return bytes;
+}
+
 TEST_SUITE("code")
 {
     TEST_CASE("make")
@@ -275,7 +633,7 @@ TEST_SUITE("code")
             test {
                 constant,
                 {65534},
-                {static_cast<uint8_t>(constant), 255, 254},
+                flatten<uint8_t>({{static_cast<uint8_t>(constant)}, native_uint16(65534)}),
             },
             test {
                 add,
@@ -295,13 +653,26 @@ TEST_SUITE("code")
             test {
                 closure,
                 {65534, 255},
-                {static_cast<uint8_t>(closure), 255, 254, 255},
+                flatten<uint8_t>({{static_cast<uint8_t>(closure)}, native_uint16(65534), {255}}),
+            },
+            test {
+                get_local,
+                {256},
+                flatten<uint8_t>({{static_cast<uint8_t>(wide), static_cast<uint8_t>(get_local)}, native_uint16(256)}),
+            },
+            test {
+                closure,
+                {1, 300},
+                flatten<uint8_t>({{static_cast<uint8_t>(wide), static_cast<uint8_t>(closure)},
+                                  native_uint32(1),
+                                  native_uint16(300)}),
             },
         };
         for (auto&& [opcode, operands, expected] : tests) {
             auto actual = make(opcode, operands);
             REQUIRE_EQ(actual, expected);
         }
+        CHECK_THROWS_WITH(make(get_local, 65536), "operand 65536 of get_local does not fit 2 bytes");
     }
 
     TEST_CASE("instructionsToString")
@@ -311,6 +682,9 @@ TEST_SUITE("code")
 0003 OpConstant 2
 0006 OpConstant 65535
 0009 OpClosure 65535 255
+0013 OpWide OpConstant 65536
+0019 OpWide OpGetOuter 1 2 256
+0027 OpConstantSmall 3
 )";
         const std::vector<instructions> instrs {
             make(opcodes::add),
@@ -318,6 +692,9 @@ TEST_SUITE("code")
             make(opcodes::constant, 2),
             make(opcodes::constant, 65535),
             make(opcodes::closure, {65535, 255}),
+            make(opcodes::constant, 65536),
+            make(opcodes::get_outer, {1, 2, 256}),
+            make(opcodes::constant_small, 3),
         };
         const auto concatenated = flatten(instrs);
         const auto actual = to_string(concatenated);
@@ -356,6 +733,61 @@ TEST_SUITE("code")
             }
         }
     }
+
+    TEST_CASE("maxStackDepth")
+    {
+        using enum opcodes;
+        // 1 + (true ? [2, 3] : 4)[0] as an if expression
+        const std::vector<instructions> instrs {
+            make(constant, 0),
+            make(tru),
+            make(jump_not_truthy, 19),
+            make(constant, 1),
+            make(constant, 2),
+            make(array, 2),
+            make(jump, 22),
+            make(constant, 3),
+            make(constant, 4),
+            make(index),
+            make(add),
+            make(return_value),
+        };
+        CHECK_EQ(max_stack_depth(flatten(instrs)), 3);
+        CHECK_EQ(max_stack_depth({}), 0);
+        const std::vector<instructions> call_instrs {make(get_builtin, 0), make(get_local, 0), make(call, 1), make(pop)};
+        CHECK_EQ(max_stack_depth(flatten(call_instrs)), 2);
+        const std::vector<instructions> wide_instrs {make(constant_small, 0), make(get_local, 300), make(array, 70000)};
+        CHECK_EQ(max_stack_depth(flatten(wide_instrs)), 2);
+    }
+
+    TEST_CASE("reencode")
+    {
+        using enum opcodes;
+        // the jump over the constants was cut off when it was written
+        std::vector<instructions> instrs {make(tru), make(jump_not_truthy, 0)};
+        for (auto idx = 0; idx < 30000; ++idx) {
+            instrs.push_back(make(constant, 300));
+            instrs.push_back(make(pop));
+        }
+        instrs.push_back(make(constant, 1));
+        const auto code = flatten(instrs);
+        const auto far_target = code.size() - 3;
+        const auto widened = reencode(code, false, {{1, far_target}});
+        CHECK_EQ(widened.size(), code.size() + 3);
+        CHECK_EQ(opcode_at(widened, 1), jump_not_truthy);
+        CHECK_EQ(instruction_length(widened, 1), 6);
+        CHECK_EQ(operand_at(widened, 1, 0), far_target + 3);
+        CHECK_EQ(opcode_at(widened, far_target + 3), constant);
+
+        const auto compacted = reencode(widened, true);
+        CHECK_EQ(compacted.size(), widened.size() - 1);
+        CHECK_EQ(to_string({compacted.end() - 2, compacted.end()}), "0000 OpConstantSmall 1\n");
+        CHECK_EQ(operand_at(compacted, 1, 0), far_target + 3);
+
+        const instructions loop = flatten<uint8_t>({make(constant, 2), make(jump_not_truthy, 9), make(jump, 0)});
+        CHECK_EQ(reencode(loop, true),
+                 flatten<uint8_t>({make(constant_small, 2), make(jump_not_truthy, 8), make(jump, 0)}));
+    }
 }
 
 // NOLINTEND(*)
@@ -47,6 +47,7 @@ enum class opcodes : uint8_t
     hash,
     index,
     call,
+    tail_call,
     brake,
     cont,
     return_value,
@@ -60,6 +61,29 @@ enum class opcodes : uint8_t
     get_builtin,
     closure,
     current_closure,
+    // binary operators specialized for the operand types the compiler inferred, the vm checks them and falls back
+    // to the generic operator where they do not hold
+    add_int,
+    sub_int,
+    mul_int,
+    equal_int,
+    not_equal_int,
+    greater_than_int,
+    greater_equal_int,
+    add_dec,
+    sub_dec,
+    mul_dec,
+    div_dec,
+    greater_than_dec,
+    greater_equal_dec,
+    // closures and arrays which do not outlive the instruction consuming them, kept in a slot of the current frame
+    // which is reused each time the instruction runs
+    frame_closure,
+    frame_array,
+    // prefixes an instruction whose operands are twice as wide, for the operands which do not fit the short form
+    wide,
+    // a constant with an index below 256
+    constant_small,
 };
 
 auto operator<<(std::ostream& ostream, opcodes opcode) -> std::ostream&;
@@ -113,6 +137,7 @@ const definition_type definitions {
     {opcodes::hash, definition {.name = "OpHash", .operand_widths = {2}}},
     {opcodes::index, definition {.name = "OpIndex", .operand_widths = {}}},
     {opcodes::call, definition {.name = "OpCall", .operand_widths = {1}}},
+    {opcodes::tail_call, definition {.name = "OpTailCall", .operand_widths = {1}}},
     {opcodes::brake, definition {.name = "OpBreak", .operand_widths = {}}},
     {opcodes::cont, definition {.name = "OpContinue", .operand_widths = {}}},
     {opcodes::return_value, definition {.name = "OpReturnValue", .operand_widths = {}}},
@@ -126,13 +151,65 @@ const definition_type definitions {
     {opcodes::get_builtin, definition {.name = "OpGetBuiltin", .operand_widths = {1}}},
     {opcodes::closure, definition {.name = "OpClosure", .operand_widths = {2, 1}}},
     {opcodes::current_closure, definition {.name = "OpCurrentClosure", .operand_widths = {}}},
+    {opcodes::add_int, definition {.name = "OpAddInt", .operand_widths = {}}},
+    {opcodes::sub_int, definition {.name = "OpSubInt", .operand_widths = {}}},
+    {opcodes::mul_int, definition {.name = "OpMulInt", .operand_widths = {}}},
+    {opcodes::equal_int, definition {.name = "OpEqualInt", .operand_widths = {}}},
+    {opcodes::not_equal_int, definition {.name = "OpNotEqualInt", .operand_widths = {}}},
+    {opcodes::greater_than_int, definition {.name = "OpGreaterThanInt", .operand_widths = {}}},
+    {opcodes::greater_equal_int, definition {.name = "OpGreaterEqualInt", .operand_widths = {}}},
+    {opcodes::add_dec, definition {.name = "OpAddDec", .operand_widths = {}}},
+    {opcodes::sub_dec, definition {.name = "OpSubDec", .operand_widths = {}}},
+    {opcodes::mul_dec, definition {.name = "OpMulDec", .operand_widths = {}}},
+    {opcodes::div_dec, definition {.name = "OpDivDec", .operand_widths = {}}},
+    {opcodes::greater_than_dec, definition {.name = "OpGreaterThanDec", .operand_widths = {}}},
+    {opcodes::greater_equal_dec, definition {.name = "OpGreaterEqualDec", .operand_widths = {}}},
+    {opcodes::frame_closure, definition {.name = "OpFrameClosure", .operand_widths = {2, 1, 1}}},
+    {opcodes::frame_array, definition {.name = "OpFrameArray", .operand_widths = {2, 1}}},
+    {opcodes::wide, definition {.name = "OpWide", .operand_widths = {}}},
+    {opcodes::constant_small, definition {.name = "OpConstantSmall", .operand_widths = {1}}},
 };
 
+// the generic operator of a specialized one, any other opcode itself
+[[nodiscard]] auto generic_opcode(opcodes opcode) -> opcodes;
+// the operator specialized for integer or decimal operands, nullopt if there is none
+[[nodiscard]] auto integer_opcode(opcodes opcode) -> std::optional<opcodes>;
+[[nodiscard]] auto decimal_opcode(opcodes opcode) -> std::optional<opcodes>;
+
+// prefixes the instruction with wide if an operand does not fit its width
 [[nodiscard]] auto make(opcodes opcode, const operands& operands = {}) -> instructions;
 [[nodiscard]] auto make(opcodes opcode, size_t operand) -> instructions;
 [[nodiscard]] auto lookup(opcodes opcode) -> std::optional<definition>;
 [[nodiscard]] auto read_operands(const definition& def, const instructions& instr)
     -> std::pair<operands, operands::size_type>;
 [[nodiscard]] auto to_string(const instructions& code) -> std::string;
-[[nodiscard]] auto read_uint16_big_endian(const instructions& bytes, size_t offset) -> uint16_t;
-void write_uint16_big_endian(instructions& bytes, size_t offset, uint16_t value);
+
+// the opcode of the instruction at `ip`, the prefixed one for a wide instruction
+[[nodiscard]] auto opcode_at(const instructions& code, std::size_t ip) -> opcodes;
+// the length of the instruction at `ip`, including its operands and a wide prefix
+[[nodiscard]] auto instruction_length(const instructions& code, std::size_t ip) -> std::size_t;
+[[nodiscard]] auto operand_at(const instructions& code, std::size_t ip, std::size_t index) -> std::size_t;
+[[nodiscard]] auto operands_at(const instructions& code, std::size_t ip) -> operands;
+
+// Encodes the code again, with the jumps moved along with their targets. A jump whose target does not fit its
+// operand gets a wide prefix, `far_targets` are the targets of such jumps which were cut off when the code was
+// written, by position. Compacting turns constants into the short form where their index fits it.
+[[nodiscard]] auto reencode(const instructions& code,
+                            bool compact,
+                            const std::map<std::size_t, std::size_t>& far_targets = {}) -> instructions;
+
+struct stack_use final
+{
+    std::size_t pops {};
+    std::size_t pushes {};
+};
+
+// the number of values the instruction at `ip` takes from and leaves on the operand stack
+[[nodiscard]] auto stack_use_at(const instructions& code, std::size_t ip) -> stack_use;
+// the maximum number of values the code keeps on the operand stack, above the locals of its frame
+[[nodiscard]] auto max_stack_depth(const instructions& code) -> int;
+// operands are stored in the byte order of the host
+[[nodiscard]] auto read_uint16(const instructions& bytes, size_t offset) -> uint16_t;
+void write_uint16(instructions& bytes, size_t offset, uint16_t value);
+[[nodiscard]] auto read_uint32(const instructions& bytes, size_t offset) -> uint32_t;
+void write_uint32(instructions& bytes, size_t offset, uint32_t value);
@@ -0,0 +1,111 @@
+// Copyright 2023-2025 hrzlgnm
+// SPDX-License-Identifier: MIT-0
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <ostream>
+#include <string>
+
+#include "register_code.hpp"
+
+#include <doctest/doctest.h>
+#include <fmt/format.h>
+
+auto operator<<(std::ostream& ostream, const register_opcodes opcode) -> std::ostream&
+{
+    if (const auto def = lookup(opcode); def.has_value()) {
+        return ostream << def->name;
+    }
+    return ostream << "unknown register opcode " << static_cast<std::uint16_t>(opcode);
+}
+
+auto lookup(const register_opcodes opcode) -> std::optional<register_definition>
+{
+    if (const auto itr = register_definitions.find(opcode); itr != register_definitions.end()) {
+        return itr->second;
+    }
+    return std::nullopt;
+}
+
+namespace
+{
+auto fmt_operand(const char kind, const std::uint16_t operand) -> std::string
+{
+    switch (kind) {
+        case 'd':
+            return fmt::format("r{}", operand);
+        case 'r':
+        case 'a':
+        case 'b':
+            if ((operand & constant_operand) != 0) {
+                return fmt::format("k{}", operand & ~constant_operand);
+            }
+            return fmt::format("r{}", operand);
+        case 'k':
+            return fmt::format("k{}", operand);
+        default:
+            return fmt::format("{}", operand);
+    }
+}
+}  // namespace
+
+auto to_string(const register_instructions& code) -> std::string
+{
+    std::string result;
+    for (std::size_t idx = 0; idx < code.size();) {
+        const auto def = lookup(static_cast<register_opcodes>(code[idx]));
+        if (!def.has_value() || idx + def->operands.size() >= code.size()) {
+            result += fmt::format("{:04d} ERROR: invalid instruction {}\n", idx, code[idx]);
+            break;
+        }
+        result += fmt::format("{:04d} {}", idx, def->name);
+        for (std::size_t opnd = 0; opnd < def->operands.size(); ++opnd) {
+            result += " " + fmt_operand(def->operands[opnd], code[idx + 1 + opnd]);
+        }
+        result += '\n';
+        idx += 1 + def->operands.size();
+    }
+    return result;
+}
+
+namespace
+{
+// NOLINTBEGIN(*)
+TEST_SUITE("code")
+{
+    TEST_CASE("registerInstructionsToString")
+    {
+        using enum register_opcodes;
+        const register_instructions code {
+            static_cast<std::uint16_t>(add),
+            2,
+            0,
+            constant_operand | 1,
+            static_cast<std::uint16_t>(jump_not_truthy),
+            2,
+            9,
+            static_cast<std::uint16_t>(return_value),
+            constant_operand | 3,
+            static_cast<std::uint16_t>(ret),
+        };
+        const auto* const expected = R"(0000 RAdd r2 r0 k1
+0004 RJumpNotTruthy r2 9
+0007 RReturnValue k3
+0009 RReturn
+)";
+        CHECK_EQ(to_string(code), expected);
+    }
+
+    TEST_CASE("everyRegisterOpcodeHasADefinition")
+    {
+        using enum register_opcodes;
+        for (auto op = static_cast<std::uint16_t>(move); op <= static_cast<std::uint16_t>(pop); ++op) {
+            INFO("opcode ", op);
+            CHECK(lookup(static_cast<register_opcodes>(op)).has_value());
+        }
+    }
+}
+
+// NOLINTEND(*)
+}  // namespace
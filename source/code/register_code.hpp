@@ -0,0 +1,140 @@
+// Copyright 2023-2025 hrzlgnm
+// SPDX-License-Identifier: MIT-0
+
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <fmt/ostream.h>
+
+// Every opcode and every operand of the register format occupies one 16-bit unit.
+using register_instructions = std::vector<std::uint16_t>;
+
+// Operands marked as `rk` in the definitions name either a register of the current frame or, with this bit set,
+// an entry of the constant pool.
+inline constexpr std::uint16_t constant_operand = 0x8000U;
+
+enum class register_opcodes : std::uint16_t
+{
+    move,
+    load_constant,
+    load_true,
+    load_false,
+    load_null,
+    add,
+    sub,
+    mul,
+    div,
+    floor_div,
+    mod,
+    bit_and,
+    bit_or,
+    bit_xor,
+    bit_lsh,
+    bit_rsh,
+    logical_and,
+    logical_or,
+    equal,
+    not_equal,
+    greater_than,
+    greater_equal,
+    minus,
+    bang,
+    jump,
+    jump_not_truthy,
+    get_global,
+    set_global,
+    array,
+    hash,
+    index,
+    call,
+    brake,
+    cont,
+    return_value,
+    ret,
+    get_free,
+    set_free,
+    get_outer,
+    set_outer,
+    get_builtin,
+    closure,
+    current_closure,
+    pop,
+};
+
+auto operator<<(std::ostream& ostream, register_opcodes opcode) -> std::ostream&;
+
+template<>
+struct fmt::formatter<register_opcodes> : ostream_formatter
+{
+};
+
+struct register_definition final
+{
+    std::string_view name;
+    std::string_view operands;
+};
+
+// operand names: d = destination register, r/a/b = register or constant (rk), n = count, k = constant index,
+// t = jump target, i = index, l = level, s = scope
+const std::map<register_opcodes, register_definition> register_definitions {
+    {register_opcodes::move, register_definition {.name = "RMove", .operands = "dr"}},
+    {register_opcodes::load_constant, register_definition {.name = "RLoadConstant", .operands = "dk"}},
+    {register_opcodes::load_true, register_definition {.name = "RLoadTrue", .operands = "d"}},
+    {register_opcodes::load_false, register_definition {.name = "RLoadFalse", .operands = "d"}},
+    {register_opcodes::load_null, register_definition {.name = "RLoadNull", .operands = "d"}},
+    {register_opcodes::add, register_definition {.name = "RAdd", .operands = "dab"}},
+    {register_opcodes::sub, register_definition {.name = "RSub", .operands = "dab"}},
+    {register_opcodes::mul, register_definition {.name = "RMul", .operands = "dab"}},
+    {register_opcodes::div, register_definition {.name = "RDiv", .operands = "dab"}},
+    {register_opcodes::floor_div, register_definition {.name = "RFloorDiv", .operands = "dab"}},
+    {register_opcodes::mod, register_definition {.name = "RMod", .operands = "dab"}},
+    {register_opcodes::bit_and, register_definition {.name = "RBitAnd", .operands = "dab"}},
+    {register_opcodes::bit_or, register_definition {.name = "RBitOr", .operands = "dab"}},
+    {register_opcodes::bit_xor, register_definition {.name = "RBitXor", .operands = "dab"}},
+    {register_opcodes::bit_lsh, register_definition {.name = "RBitLsh", .operands = "dab"}},
+    {register_opcodes::bit_rsh, register_definition {.name = "RBitRsh", .operands = "dab"}},
+    {register_opcodes::logical_and, register_definition {.name = "RLogicalAnd", .operands = "dab"}},
+    {register_opcodes::logical_or, register_definition {.name = "RLogicalOr", .operands = "dab"}},
+    {register_opcodes::equal, register_definition {.name = "REqual", .operands = "dab"}},
+    {register_opcodes::not_equal, register_definition {.name = "RNotEqual", .operands = "dab"}},
+    {register_opcodes::greater_than, register_definition {.name = "RGreaterThan", .operands = "dab"}},
+    {register_opcodes::greater_equal, register_definition {.name = "RGreaterEqual", .operands = "dab"}},
+    {register_opcodes::minus, register_definition {.name = "RMinus", .operands = "da"}},
+    {register_opcodes::bang, register_definition {.name = "RBang", .operands = "da"}},
+    {register_opcodes::jump, register_definition {.name = "RJump", .operands = "t"}},
+    {register_opcodes::jump_not_truthy, register_definition {.name = "RJumpNotTruthy", .operands = "at"}},
+    {register_opcodes::get_global, register_definition {.name = "RGetGlobal", .operands = "di"}},
+    {register_opcodes::set_global, register_definition {.name = "RSetGlobal", .operands = "ia"}},
+    {register_opcodes::array, register_definition {.name = "RArray", .operands = "dn"}},
+    {register_opcodes::hash, register_definition {.name = "RHash", .operands = "dn"}},
+    {register_opcodes::index, register_definition {.name = "RIndex", .operands = "dab"}},
+    {register_opcodes::call, register_definition {.name = "RCall", .operands = "dn"}},
+    {register_opcodes::brake, register_definition {.name = "RBreak", .operands = ""}},
+    {register_opcodes::cont, register_definition {.name = "RContinue", .operands = ""}},
+    {register_opcodes::return_value, register_definition {.name = "RReturnValue", .operands = "a"}},
+    {register_opcodes::ret, register_definition {.name = "RReturn", .operands = ""}},
+    {register_opcodes::get_free, register_definition {.name = "RGetFree", .operands = "di"}},
+    {register_opcodes::set_free, register_definition {.name = "RSetFree", .operands = "ia"}},
+    {register_opcodes::get_outer, register_definition {.name = "RGetOuter", .operands = "dlsi"}},
+    {register_opcodes::set_outer, register_definition {.name = "RSetOuter", .operands = "lsia"}},
+    {register_opcodes::get_builtin, register_definition {.name = "RGetBuiltin", .operands = "di"}},
+    {register_opcodes::closure, register_definition {.name = "RClosure", .operands = "dkn"}},
+    {register_opcodes::current_closure, register_definition {.name = "RCurrentClosure", .operands = "d"}},
+    {register_opcodes::pop, register_definition {.name = "RPop", .operands = "a"}},
+};
+
+// The register form of one function: locals occupy the first registers of a frame, temporaries follow them.
+struct register_function final
+{
+    register_instructions instrs;
+    int num_registers {};
+};
+
+[[nodiscard]] auto lookup(register_opcodes opcode) -> std::optional<register_definition>;
+[[nodiscard]] auto to_string(const register_instructions& code) -> std::string;
@@ -0,0 +1,339 @@
+// Copyright 2023-2025 hrzlgnm
+// SPDX-License-Identifier: MIT-0
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <ios>
+#include <optional>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include "compilation_cache.hpp"
+
+#include <doctest/doctest.h>
+#include <fmt/format.h>
+#include <lexer/lexer.hpp>
+#include <object/object.hpp>
+#include <parser/parser.hpp>
+
+#include "compiler.hpp"
+#include "image.hpp"
+#include "symbol_table.hpp"
+
+namespace
+{
+// the compile time in microseconds and the size of the key, stored little endian in front of the key and the image
+constexpr std::size_t field_size = sizeof(std::uint64_t);
+constexpr std::size_t header_size = 2 * field_size;
+
+// FNV-1a, which only names the entry, the key stored in it decides whether it is used
+auto hash(const std::string_view key) -> std::uint64_t
+{
+    constexpr std::uint64_t offset_basis = 0xcbf29ce484222325ULL;
+    constexpr std::uint64_t prime = 0x100000001b3ULL;
+    auto result = offset_basis;
+    for (const auto chr : key) {
+        result = (result ^ static_cast<std::uint8_t>(chr)) * prime;
+    }
+    return result;
+}
+
+auto read_field(const std::array<char, header_size>& header, const std::size_t offset) -> std::uint64_t
+{
+    std::uint64_t result {};
+    for (std::size_t idx = 0; idx < field_size; ++idx) {
+        result |= std::uint64_t {static_cast<std::uint8_t>(header.at(offset + idx))} << (idx * 8U);
+    }
+    return result;
+}
+
+auto write_field(std::ostream& ofs, const std::uint64_t value) -> void
+{
+    for (std::size_t idx = 0; idx < field_size; ++idx) {
+        ofs.put(static_cast<char>(value >> (idx * 8U)));
+    }
+}
+
+auto environment_path(const char* name) -> std::optional<std::filesystem::path>
+{
+    // NOLINTNEXTLINE(concurrency-mt-unsafe)
+    if (const char* value = std::getenv(name); value != nullptr && *value != '\0') {
+        return std::filesystem::path {value};
+    }
+    return std::nullopt;
+}
+
+// the path, size and modification time of the running executable, which every build changes, so the code a changed
+// compiler generates is never mixed up with the entries of an older one
+auto executable_build() -> std::optional<std::string>
+{
+    std::error_code error;
+    const auto path = std::filesystem::read_symlink("/proc/self/exe", error);
+    if (error) {
+        return std::nullopt;
+    }
+    const auto size = std::filesystem::file_size(path, error);
+    if (error) {
+        return std::nullopt;
+    }
+    const auto modified = std::filesystem::last_write_time(path, error);
+    if (error) {
+        return std::nullopt;
+    }
+    return fmt::format("{} {} {}", path.string(), size, modified.time_since_epoch().count());
+}
+}  // namespace
+
+auto compilation_cache::open(const std::string_view options) -> compilation_cache
+{
+    const auto build = executable_build();
+    if (!build.has_value()) {
+        return compilation_cache {{}};
+    }
+    if (const auto cache_home = environment_path("XDG_CACHE_HOME"); cache_home.has_value()) {
+        return compilation_cache {*cache_home / "cappuchin", options, *build};
+    }
+    if (const auto home = environment_path("HOME"); home.has_value()) {
+        return compilation_cache {*home / ".cache" / "cappuchin", options, *build};
+    }
+    return compilation_cache {{}};
+}
+
+compilation_cache::compilation_cache(std::filesystem::path directory,
+                                     const std::string_view options,
+                                     const std::string_view build,
+                                     const std::uintmax_t max_bytes)
+    : m_directory {std::move(directory)}
+    , m_options {options}
+    , m_build {build}
+    , m_max_bytes {max_bytes}
+{
+}
+
+auto compilation_cache::key_of(const std::string_view source) const -> std::string
+{
+    return fmt::format("cappuchin {}\n{}\ncappuchin bytecode image {}\n{}\n{}",
+                       CAPPUCHIN_VERSION,
+                       m_build,
+                       image_version,
+                       m_options,
+                       source);
+}
+
+auto compilation_cache::path_of(const std::string_view source) const -> std::filesystem::path
+{
+    return m_directory / fmt::format("{:016x}{}", hash(key_of(source)), image_extension);
+}
+
+auto compilation_cache::lookup(const std::string_view source) const -> std::optional<entry>
+{
+    if (!enabled()) {
+        return std::nullopt;
+    }
+    const auto key = key_of(source);
+    const auto path = path_of(source);
+    std::ifstream ifs(path, std::ios::binary);
+    std::array<char, header_size> header {};
+    if (!ifs || !ifs.read(header.data(), header.size())) {
+        return std::nullopt;
+    }
+    const auto micros = read_field(header, 0);
+    if (read_field(header, field_size) != key.size()) {
+        return std::nullopt;
+    }
+    std::string stored(key.size(), '\0');
+    if (!ifs.read(stored.data(), static_cast<std::streamsize>(stored.size())) || stored != key) {
+        return std::nullopt;
+    }
+    ifs.close();
+    try {
+        auto result = entry {.img = load_image(path.string(), header_size + key.size()),
+                             .compile_time = std::chrono::microseconds {static_cast<std::int64_t>(micros)}};
+        // marks the entry as used, the least recently used ones are evicted first
+        std::error_code error;
+        std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), error);
+        return result;
+    } catch (const std::runtime_error&) {
+        return std::nullopt;
+    }
+}
+
+auto compilation_cache::store(const std::string_view source,
+                              const bytecode& code,
+                              const symbol_table* symbols,
+                              const std::chrono::microseconds compile_time) const -> void
+{
+    if (!enabled()) {
+        return;
+    }
+    std::error_code error;
+    std::filesystem::create_directories(m_directory, error);
+    if (error) {
+        return;
+    }
+    // written under a temporary name and renamed, so a concurrent run never maps a partial entry
+    const auto key = key_of(source);
+    const auto path = path_of(source);
+    auto temporary = path;
+    temporary += fmt::format(".{}", std::chrono::steady_clock::now().time_since_epoch().count());
+    {
+        std::ofstream ofs(temporary, std::ios::binary);
+        if (!ofs) {
+            return;
+        }
+        write_field(ofs, static_cast<std::uint64_t>(compile_time.count()));
+        write_field(ofs, key.size());
+        ofs.write(key.data(), static_cast<std::streamsize>(key.size()));
+        write_image(ofs, code, symbols);
+        if (!ofs) {
+            ofs.close();
+            std::filesystem::remove(temporary, error);
+            return;
+        }
+    }
+    std::filesystem::rename(temporary, path, error);
+    if (error) {
+        std::filesystem::remove(temporary, error);
+        return;
+    }
+    evict();
+}
+
+auto compilation_cache::evict() const -> void
+{
+    struct cached_file final
+    {
+        std::filesystem::path path;
+        std::filesystem::file_time_type used;
+        std::uintmax_t size {};
+    };
+
+    std::vector<cached_file> files;
+    std::uintmax_t total {};
+    std::error_code error;
+    for (auto it = std::filesystem::directory_iterator {m_directory, error};
+         !error && it != std::filesystem::directory_iterator {};
+         it.increment(error))
+    {
+        if (it->path().extension() != image_extension) {
+            continue;
+        }
+        const auto size = it->file_size(error);
+        const auto used = it->last_write_time(error);
+        if (error) {
+            return;
+        }
+        files.push_back({.path = it->path(), .used = used, .size = size});
+        total += size;
+    }
+    if (error || total <= m_max_bytes) {
+        return;
+    }
+    std::ranges::sort(files, {}, &cached_file::used);
+    for (const auto& file : files) {
+        if (total <= m_max_bytes) {
+            break;
+        }
+        if (std::filesystem::remove(file.path, error)) {
+            total -= file.size;
+        }
+    }
+}
+
+namespace
+{
+// NOLINTBEGIN(*)
+TEST_SUITE("compiler")
+{
+    TEST_CASE("compilationCache")
+    {
+        const auto directory = std::filesystem::temp_directory_path()
+            / fmt::format("cappuchin-cache-test-{}", std::chrono::steady_clock::now().time_since_epoch().count());
+        const compilation_cache cache {directory};
+        constexpr std::string_view source = "let f = fn(x) { x * 2 }; f(21)";
+        CHECK_FALSE(cache.lookup(source).has_value());
+
+        auto prsr = parser {lexer {source}};
+        auto prgrm = prsr.parse_program();
+        REQUIRE(prsr.errors().empty());
+        auto cmplr = compiler::create();
+        cmplr.compile(prgrm.get());
+        cache.store(source, cmplr.byte_code(), cmplr.all_symbols(), std::chrono::microseconds {1234});
+
+        const auto hit = cache.lookup(source);
+        REQUIRE(hit.has_value());
+        CHECK_EQ(hit->compile_time.count(), 1234);
+        CHECK_EQ(hit->img.code.instrs, cmplr.byte_code().instrs);
+        CHECK_EQ(hit->img.code.consts->size(), cmplr.byte_code().consts->size());
+        CHECK_FALSE(cache.lookup("f(20)").has_value());
+        CHECK_NE(cache.path_of(source), cache.path_of("f(20)"));
+        CHECK_NE(cache.path_of(source), compilation_cache {directory, "-O2"}.path_of(source));
+
+        const compilation_cache other_build {directory, {}, "another build"};
+        CHECK_NE(cache.path_of(source), other_build.path_of(source));
+        CHECK_FALSE(other_build.lookup(source).has_value());
+
+        // an entry whose name collides with that of another source is not used for it
+        std::filesystem::copy_file(cache.path_of(source), cache.path_of("f(20)"));
+        CHECK_FALSE(cache.lookup("f(20)").has_value());
+        CHECK(cache.lookup(source).has_value());
+
+        {
+            std::ofstream corrupt(cache.path_of(source), std::ios::binary | std::ios::trunc);
+            corrupt << "12345678garbage";
+        }
+        CHECK_FALSE(cache.lookup(source).has_value());
+
+        const compilation_cache disabled {{}};
+        CHECK_FALSE(disabled.enabled());
+        disabled.store(source, cmplr.byte_code(), cmplr.all_symbols(), {});
+        CHECK_FALSE(disabled.lookup(source).has_value());
+        std::filesystem::remove_all(directory);
+    }
+
+    TEST_CASE("compilationCacheEvictsLeastRecentlyUsed")
+    {
+        const auto directory = std::filesystem::temp_directory_path()
+            / fmt::format("cappuchin-cache-test-{}", std::chrono::steady_clock::now().time_since_epoch().count());
+        const auto store = [](const compilation_cache& cache, const std::string_view source)
+        {
+            auto prsr = parser {lexer {source}};
+            auto prgrm = prsr.parse_program();
+            REQUIRE(prsr.errors().empty());
+            auto cmplr = compiler::create();
+            cmplr.compile(prgrm.get());
+            cache.store(source, cmplr.byte_code(), cmplr.all_symbols(), {});
+        };
+        const compilation_cache unbounded {directory};
+        store(unbounded, "1 + 2");
+        const auto entry_size = std::filesystem::file_size(unbounded.path_of("1 + 2"));
+        std::filesystem::remove(unbounded.path_of("1 + 2"));
+
+        // room for two entries of about the same size
+        const compilation_cache cache {directory, {}, {}, (2 * entry_size) + (entry_size / 2)};
+        const auto past = std::filesystem::file_time_type::clock::now() - std::chrono::hours {1};
+        store(cache, "1 + 2");
+        std::filesystem::last_write_time(cache.path_of("1 + 2"), past);
+        store(cache, "3 + 4");
+        std::filesystem::last_write_time(cache.path_of("3 + 4"), past + std::chrono::minutes {1});
+        REQUIRE(cache.lookup("1 + 2").has_value());
+        store(cache, "5 + 6");
+        CHECK(std::filesystem::exists(cache.path_of("1 + 2")));
+        CHECK_FALSE(std::filesystem::exists(cache.path_of("3 + 4")));
+        CHECK(std::filesystem::exists(cache.path_of("5 + 6")));
+        std::filesystem::remove_all(directory);
+    }
+}
+
+// NOLINTEND(*)
+}  // namespace
@@ -0,0 +1,61 @@
+// Copyright 2023-2025 hrzlgnm
+// SPDX-License-Identifier: MIT-0
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "compiler.hpp"
+#include "image.hpp"
+#include "symbol_table.hpp"
+
+// Compiled programs stored as bytecode images, keyed by a hash of the source text, the build of the executable, the
+// image version and the options which change the generated code, so a script which did not change since its last run
+// is neither parsed nor compiled again. Entries hold the full key and are only used if it equals the one looked up,
+// so colliding hashes are misses. The cache is best effort: entries which cannot be read count as misses, failures to
+// store one are ignored, and the entries used least recently are removed once all of them exceed `max_bytes`.
+class compilation_cache final
+{
+  public:
+    struct entry final
+    {
+        image img;
+        // how long compiling the source took when the entry was stored
+        std::chrono::microseconds compile_time {};
+    };
+
+    static constexpr std::uintmax_t default_max_bytes = 64UL * 1024UL * 1024UL;
+
+    // the cache in $XDG_CACHE_HOME/cappuchin or $HOME/.cache/cappuchin, disabled if neither is set or the running
+    // executable can not be identified
+    [[nodiscard]] static auto open(std::string_view options = {}) -> compilation_cache;
+
+    explicit compilation_cache(std::filesystem::path directory,
+                               std::string_view options = {},
+                               std::string_view build = {},
+                               std::uintmax_t max_bytes = default_max_bytes);
+
+    [[nodiscard]] auto enabled() const -> bool { return !m_directory.empty(); }
+
+    [[nodiscard]] auto path_of(std::string_view source) const -> std::filesystem::path;
+    [[nodiscard]] auto lookup(std::string_view source) const -> std::optional<entry>;
+    auto store(std::string_view source,
+               const bytecode& code,
+               const symbol_table* symbols,
+               std::chrono::microseconds compile_time) const -> void;
+
+  private:
+    [[nodiscard]] auto key_of(std::string_view source) const -> std::string;
+    auto evict() const -> void;
+
+    std::filesystem::path m_directory;
+    std::string m_options;
+    // identifies the build of the executable, so entries of other builds are never used
+    std::string m_build;
+    std::uintmax_t m_max_bytes {};
+};
@@ -3,10 +3,17 @@
 
 #include <algorithm>
 #include <array>
+#include <atomic>
 #include <cassert>
 #include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <future>
 #include <iterator>
+#include <limits>
+#include <memory>
 #include <optional>
+#include <ranges>
 #include <stdexcept>
 #include <string>
 #include <utility>
@@ -15,6 +22,7 @@
 
 #include "compiler.hpp"
 
+#include <analyzer/analyzer.hpp>
 #include <ast/array_literal.hpp>
 #include <ast/assign_expression.hpp>
 #include <ast/binary_expression.hpp>
@@ -43,27 +51,57 @@
 #include <overloaded.hpp>
 #include <parser/parser.hpp>
 
+#include "dead_code.hpp"
+#include "inlining.hpp"
+#include "register_lowering.hpp"
+#include "ssa.hpp"
 #include "symbol_table.hpp"
 
-auto compiler::create() -> compiler
+auto compiler::create(const backend bkend) -> compiler
 {
     auto* symbols = symbol_table::create();
     for (auto idx = 0; const auto& builtin : builtin::builtins()) {
         symbols->define_builtin(idx++, builtin->name);
     }
-    return {allocate<constants>(), symbols};
+    return {allocate<constants>(), symbols, bkend, /*sees_whole_program=*/true};
 }
 
-compiler::compiler(constants* consts, symbol_table* symbols)
+compiler::compiler(constants* consts, symbol_table* symbols, const backend bkend, const bool sees_whole_program)
     : m_consts {consts}
     , m_symbols {symbols}
     , m_scopes {1}
+    , m_backend {bkend}
+    , m_sees_whole_program {sees_whole_program}
 {
 }
 
-auto compiler::compile(const program* program) -> void
+auto compiler::compile(const program* program, const name_resolution* resolution) -> void
 {
+    if (m_optimization_level > 0) {
+        m_used = used_names(program);
+    }
+    if (m_optimization_level > 1) {
+        m_assigned = assigned_names(program);
+    }
+    m_resolution = resolution != nullptr && resolution->nodes == program->nodes.get() ? resolution : nullptr;
+    m_bindings.assign(m_resolution != nullptr ? m_resolution->num_bindings : 0, std::nullopt);
     program->accept(*this);
+    m_resolution = nullptr;
+    finish_functions();
+}
+
+auto compiler::compile_input(const program* program, const name_resolution* resolution) -> void
+{
+    // an input which failed to compile may have left its scopes behind
+    m_scopes.assign(1, {});
+    m_scope_index = 0;
+    while (!m_symbols->is_global()) {
+        m_symbols = m_symbols->outer();
+    }
+    m_unfinished.clear();
+    // a later input may assign the function
+    m_inline_candidates.clear();
+    compile(program, resolution);
 }
 
 auto compiler::add_constant(const object* obj) -> std::size_t
@@ -72,6 +110,92 @@ auto compiler::add_constant(const object* obj) -> std::size_t
     return m_consts->size() - 1;
 }
 
+auto compiler::add_literal(const literal_value& value) -> std::size_t
+{
+    if (const auto itr = m_literals.find(value); itr != m_literals.end()) {
+        return itr->second;
+    }
+    const auto* obj = std::visit(
+        overloaded {
+            [](const std::monostate&) -> const object* { return null(); },
+            [](const std::int64_t val) -> const object* { return allocate<integer_object>(val); },
+            [](const double val) -> const object* { return allocate<decimal_object>(val); },
+            [](const std::string& val) -> const object* { return allocate<string_object>(val); },
+        },
+        value);
+    const auto idx = add_constant(obj);
+    m_literals.emplace(value, idx);
+    return idx;
+}
+
+auto compiler::add_function(compiled_function_object* func) -> std::size_t
+{
+    if (m_jobs > 1) {
+        m_unfinished.push_back({.depth = m_scope_index, .func = func});
+    } else {
+        finish_function(*func);
+    }
+    return add_constant(func);
+}
+
+// only reads the constants, so that functions can be finished concurrently once no more constants are added
+auto compiler::finish_function(compiled_function_object& func) const -> void
+{
+    if (m_optimization_level > 0) {
+        if (auto optimized = optimize_code(func.instrs, func.num_locals, false, 0, m_consts, m_optimization_level)) {
+            func.instrs = std::move(optimized->instrs);
+            func.num_locals += optimized->num_temporaries;
+        }
+        func.instrs = reencode(func.instrs, /*compact=*/true);
+    }
+    func.max_stack = max_stack_depth(func.instrs);
+    if (m_backend == backend::registers) {
+        func.register_code = lower_to_registers(func.instrs, func.num_locals, /*is_main=*/false);
+    }
+}
+
+namespace
+{
+// the bytes of code a thread gets at least, so small programs are not spread over threads which take longer to start
+// than to optimize their share
+constexpr std::size_t min_code_per_job = 1024;
+}  // namespace
+
+// Optimizing a function looks at the code of the functions nested in it, which are added in deeper scopes. So the
+// functions are finished by depth, the deepest first, and those of the same depth concurrently.
+auto compiler::finish_functions() -> void
+{
+    std::ranges::stable_sort(m_unfinished, std::ranges::greater {}, &unfinished_function::depth);
+    for (auto first = m_unfinished.begin(); first != m_unfinished.end();) {
+        const auto last = std::ranges::find_if(
+            first, m_unfinished.end(), [&](const auto& unfinished) { return unfinished.depth != first->depth; });
+        const auto count = static_cast<std::size_t>(std::distance(first, last));
+        std::size_t code_size = 0;
+        for (auto itr = first; itr != last; ++itr) {
+            code_size += itr->func->instrs.size();
+        }
+        const auto jobs =
+            std::min({static_cast<std::size_t>(m_jobs), count, std::max(code_size / min_code_per_job, 1UZ)});
+        std::atomic<std::size_t> next {0};
+        const auto work = [&]
+        {
+            for (auto idx = next++; idx < count; idx = next++) {
+                finish_function(*first[static_cast<std::ptrdiff_t>(idx)].func);
+            }
+        };
+        std::vector<std::future<void>> workers;
+        for (auto job = 1UZ; job < jobs; ++job) {
+            workers.push_back(std::async(std::launch::async, work));
+        }
+        work();
+        for (auto& worker : workers) {
+            worker.get();
+        }
+        first = last;
+    }
+    m_unfinished.clear();
+}
+
 auto compiler::add_instructions(const instructions& ins) -> std::size_t
 {
     auto& scope = m_scopes[m_scope_index];
@@ -113,6 +237,21 @@ auto compiler::replace_last_pop_with_return() -> void
     using enum opcodes;
     replace_instruction(last, make(return_value));
     m_scopes[m_scope_index].last_instr.opcode = return_value;
+    make_tail_call(m_scopes[m_scope_index].previous_instr);
+}
+
+// Turns a call which directly precedes a return_value into a tail call, which reuses the frame and returns by
+// itself. The return_value stays, since jumps may target it. Loop bodies return through their enclosing function,
+// so their frames cannot be reused.
+auto compiler::make_tail_call(const emitted_instruction& instr) -> void
+{
+    const auto& scope = m_scopes[m_scope_index];
+    if (m_scope_index == 0 || m_symbols->inside_loop() || instr.opcode != opcodes::call
+        || instr.position + make(opcodes::call, 0).size() != scope.last_instr.position)
+    {
+        return;
+    }
+    replace_instruction(instr.position, make(opcodes::tail_call, scope.instrs[instr.position + 1]));
 }
 
 auto compiler::replace_instruction(const std::size_t pos, const instructions& instr) -> void
@@ -125,10 +264,24 @@ auto compiler::replace_instruction(const std::size_t pos, const instructions& in
 
 auto compiler::change_operand(const std::size_t pos, const std::size_t operand) -> void
 {
-    const auto& scope = m_scopes[m_scope_index];
+    auto& scope = m_scopes[m_scope_index];
     const auto opcode = static_cast<opcodes>(scope.instrs[pos]);
-    const auto instr = make(opcode, operand);
-    replace_instruction(pos, instr);
+    // the jump grows when the code is encoded again, once all of it is known
+    if (operand > std::numeric_limits<std::uint16_t>::max()) {
+        scope.far_jumps[pos] = operand;
+        replace_instruction(pos, make(opcode, 0));
+        return;
+    }
+    replace_instruction(pos, make(opcode, operand));
+}
+
+auto compiler::scope_instrs() const -> instructions
+{
+    const auto& scope = m_scopes[m_scope_index];
+    if (scope.far_jumps.empty()) {
+        return scope.instrs;
+    }
+    return reencode(scope.instrs, /*compact=*/false, scope.far_jumps);
 }
 
 auto compiler::current_instrs() const -> const instructions&
@@ -138,7 +291,31 @@ auto compiler::current_instrs() const -> const instructions&
 
 auto compiler::byte_code() const -> bytecode
 {
-    return {.instrs = m_scopes[m_scope_index].instrs, .consts = m_consts};
+    const auto instrs = scope_instrs();
+    const auto* globals = m_symbols;
+    while (globals->outer() != nullptr) {
+        globals = globals->outer();
+    }
+    bytecode code {
+        .instrs = instrs,
+        .consts = m_consts,
+        .max_stack = {},
+        .num_globals = globals->num_definitions(),
+        .register_code = {},
+    };
+    if (m_optimization_level > 0) {
+        const auto first_temporary = static_cast<std::size_t>(code.num_globals);
+        if (auto optimized = optimize_code(instrs, 0, true, first_temporary, m_consts, m_optimization_level)) {
+            code.instrs = std::move(optimized->instrs);
+            code.num_globals += optimized->num_temporaries;
+        }
+        code.instrs = reencode(code.instrs, /*compact=*/true);
+    }
+    code.max_stack = max_stack_depth(code.instrs);
+    if (m_backend == backend::registers) {
+        code.register_code = lower_to_registers(code.instrs, 0, /*is_main=*/true);
+    }
+    return code;
 }
 
 auto compiler::enter_scope(const bool inside_loop) -> void
@@ -150,7 +327,7 @@ auto compiler::enter_scope(const bool inside_loop) -> void
 
 auto compiler::leave_scope() -> instructions
 {
-    auto instrs = m_scopes[m_scope_index].instrs;
+    auto instrs = scope_instrs();
     m_scopes.pop_back();
     m_scope_index--;
     m_symbols = m_symbols->outer();
@@ -205,6 +382,35 @@ auto compiler::resolve_symbol(const std::string& name) const -> std::optional<sy
     return m_symbols->resolve(name);
 }
 
+// A builtin, a global or a name defined in the current scope is taken from the resolution, which saves walking the
+// scopes. The names of enclosing functions, which may have to be captured, and those defined before the program are
+// resolved again.
+auto compiler::resolve_identifier(const identifier& expr) const -> std::optional<symbol>
+{
+    if (const auto* resolved = m_resolution != nullptr ? m_resolution->find(expr) : nullptr; resolved != nullptr) {
+        if (resolved->builtin.has_value()) {
+            return symbol {.name = expr.value, .scope = symbol_scope::builtin, .index = *resolved->builtin, .ptr = {}};
+        }
+        if (resolved->binding.has_value()) {
+            if (const auto& definition = m_bindings[*resolved->binding];
+                definition.has_value() && (definition->sym.is_global() || definition->table == m_symbols))
+            {
+                return definition->sym;
+            }
+        }
+    }
+    return resolve_symbol(expr.value);
+}
+
+auto compiler::note_binding(const identifier& name, const symbol& sym) -> void
+{
+    if (const auto* resolved = m_resolution != nullptr ? m_resolution->find(name) : nullptr;
+        resolved != nullptr && resolved->binding.has_value())
+    {
+        m_bindings[*resolved->binding] = symbol_definition {.table = m_symbols, .sym = sym};
+    }
+}
+
 auto compiler::free_symbols() const -> std::vector<symbol>
 {
     return m_symbols->free();
@@ -231,7 +437,7 @@ void compiler::visit(const array_literal& expr)
 void compiler::visit(const assign_expression& expr)
 {
     expr.value->accept(*this);
-    const auto maybe_symbol = resolve_symbol(expr.name->value);
+    const auto maybe_symbol = resolve_identifier(*expr.name);
     assert(maybe_symbol.has_value());
     if (const auto& sym = maybe_symbol.value(); sym.scope == symbol_scope::global) {
         emit(opcodes::set_global, sym.index);
@@ -338,7 +544,13 @@ void compiler::visit(const hash_literal& expr)
 
 void compiler::visit(const identifier& expr)
 {
-    const auto maybe_symbol = resolve_symbol(expr.value);
+    if (m_inline_arguments != nullptr) {
+        if (const auto itr = m_inline_arguments->find(expr.value); itr != m_inline_arguments->end()) {
+            load_symbol(itr->second);
+            return;
+        }
+    }
+    const auto maybe_symbol = resolve_identifier(expr);
     if (!maybe_symbol.has_value()) {
         throw std::runtime_error(fmt::format("undefined variable {}", expr.value));
     }
@@ -351,10 +563,7 @@ void compiler::visit(const if_expression& expr)
     expr.condition->accept(*this);
     using enum opcodes;
     const auto jump_not_truthy_pos = emit(jump_not_truthy, 0);
-    expr.consequence->accept(*this);
-    if (last_instruction_is(pop)) {
-        remove_last_pop();
-    }
+    compile_branch(*expr.consequence);
     const auto jump_pos = emit(jump, 0);
     const auto after_consequence = current_instrs().size();
     change_operand(jump_not_truthy_pos, after_consequence);
@@ -362,15 +571,30 @@ void compiler::visit(const if_expression& expr)
     if (expr.alternative == nullptr) {
         emit(null);
     } else {
-        expr.alternative->accept(*this);
-        if (last_instruction_is(pop)) {
-            remove_last_pop();
-        }
+        compile_branch(*expr.alternative);
     }
     const auto after_alternative = current_instrs().size();
     change_operand(jump_pos, after_alternative);
 }
 
+// A branch leaves the value of its last expression statement, one which is empty or ends in a definition or an
+// assignment leaves null.
+auto compiler::compile_branch(const block_statement& block) -> void
+{
+    using enum opcodes;
+    const auto start = current_instrs().size();
+    block.accept(*this);
+    if (last_instruction_is(pop)) {
+        remove_last_pop();
+        return;
+    }
+    if (current_instrs().size() == start || last_instruction_is(set_global) || last_instruction_is(set_local)
+        || last_instruction_is(set_free) || last_instruction_is(set_outer))
+    {
+        emit(null);
+    }
+}
+
 void compiler::visit(const while_statement& expr)
 {
     using enum opcodes;
@@ -390,8 +614,8 @@ void compiler::visit(const while_statement& expr)
     for (const auto& sym : free) {
         load_symbol(sym);
     }
-    const auto* compiled_fun = allocate<compiled_function_object>(std::move(instrs), num_locals, 0, true);
-    const auto function_index = add_constant(compiled_fun);
+    const auto function_index =
+        add_function(allocate<compiled_function_object>(std::move(instrs), num_locals, 0, true));
     emit(closure, {function_index, free.size()});
     emit(call, 0);
 
@@ -415,41 +639,184 @@ void compiler::visit(const index_expression& expr)
 
 void compiler::visit(const integer_literal& expr)
 {
-    emit(opcodes::constant, add_constant(allocate<integer_object>(expr.value)));
+    emit(opcodes::constant, add_literal(expr.value));
 }
 
 void compiler::visit(const decimal_literal& expr)
 {
-    emit(opcodes::constant, add_constant(allocate<decimal_object>(expr.value)));
+    emit(opcodes::constant, add_literal(expr.value));
 }
 
 void compiler::visit(const program& expr)
 {
-    for (const auto& stmt : expr.statements) {
+    compile_statements(expr.statements);
+}
+
+// Leaves out the statements after one which ends the block, the pure expression statements followed by another
+// one, which then leaves its value instead, and the bindings of names never used which are not the last statement.
+auto compiler::compile_statements(const expressions& statements) -> void
+{
+    for (std::size_t idx = 0; idx < statements.size(); ++idx) {
+        const auto* stmt = statements[idx];
+        if (m_optimization_level > 0 && is_dead(statements, idx)) {
+            m_eliminated_statements++;
+            continue;
+        }
         stmt->accept(*this);
+        if (m_optimization_level > 0 && ends_block(stmt)) {
+            m_eliminated_statements += static_cast<int>(statements.size() - idx - 1);
+            return;
+        }
+    }
+}
+
+auto compiler::is_dead(const expressions& statements, const std::size_t index) const -> bool
+{
+    const symbol_resolver resolve = [this](const std::string& name) -> std::optional<symbol>
+    {
+        if (const auto definition = m_symbols->definition(name)) {
+            return definition->sym;
+        }
+        return std::nullopt;
+    };
+    const auto later = statements | std::views::drop(index + 1);
+    if (const auto* stmt = dynamic_cast<const expression_statement*>(statements[index]); stmt != nullptr) {
+        const auto is_expression_statement = [](const expression* later_stmt)
+        { return dynamic_cast<const expression_statement*>(later_stmt) != nullptr; };
+        return std::ranges::any_of(later, is_expression_statement) && is_pure(stmt->expr, resolve);
     }
+    if (const auto* let = dynamic_cast<const let_statement*>(statements[index]); let != nullptr) {
+        return !later.empty() && !m_used.contains(let->name->value) && (m_scope_index != 0 || m_sees_whole_program)
+            && is_pure(let->value, resolve);
+    }
+    return false;
 }
 
 void compiler::visit(const let_statement& expr)
 {
     const auto sym = define_symbol(expr.name->value);
+    note_binding(*expr.name, sym);
     expr.value->accept(*this);
     if (sym.is_local()) {
         emit(opcodes::set_local, sym.index);
     } else {
         emit(opcodes::set_global, sym.index);
     }
+    if (m_optimization_level > 1) {
+        note_inline_candidate(expr, sym);
+    }
+}
+
+// Calls through the binding are inlined while it is neither assigned nor defined again. The values a closure
+// captures are copies, so the body may only read a variable of an enclosing function which is never assigned.
+auto compiler::note_inline_candidate(const let_statement& stmt, const symbol& sym) -> void
+{
+    const auto key = std::pair {static_cast<const symbol_table*>(m_symbols), stmt.name->value};
+    m_inline_candidates.erase(key);
+    const auto* func = dynamic_cast<const function_literal*>(stmt.value);
+    if (func == nullptr || m_assigned.contains(stmt.name->value) || (sym.is_global() && !m_sees_whole_program)) {
+        return;
+    }
+    auto body = inlinable_body(*func);
+    if (!body.has_value()) {
+        return;
+    }
+    inline_candidate candidate {.func = func, .body = {}, .binding = sym, .definitions = {}};
+    for (const auto& name : body->names) {
+        const auto definition = m_symbols->definition(name);
+        if (!definition.has_value()) {
+            return;
+        }
+        const auto scope = definition->sym.scope;
+        if (scope != symbol_scope::global && scope != symbol_scope::builtin && m_assigned.contains(name)) {
+            return;
+        }
+        candidate.definitions.push_back(definition.value());
+    }
+    candidate.body = std::move(body.value());
+    m_inline_candidates.emplace(key, std::move(candidate));
+}
+
+// Evaluates the arguments into temporaries and the body of the function in their place, where the call goes to a
+// candidate whose binding and the definitions of the names its body reads are the same as at the let.
+auto compiler::inline_call(const call_expression& expr) -> bool
+{
+    constexpr auto max_inline_depth = 4;
+    const auto* callee = dynamic_cast<const identifier*>(expr.function);
+    if (callee == nullptr || m_inline_candidates.empty() || m_inline_depth >= max_inline_depth
+        || (m_inline_arguments != nullptr && m_inline_arguments->contains(callee->value)))
+    {
+        return false;
+    }
+    const auto binding = m_symbols->definition(callee->value);
+    if (!binding.has_value()) {
+        return false;
+    }
+    const auto itr = m_inline_candidates.find(std::pair {binding->table, callee->value});
+    if (itr == m_inline_candidates.end() || itr->second.binding != binding->sym) {
+        return false;
+    }
+    const auto& candidate = itr->second;
+    const auto& params = candidate.func->parameters;
+    if (expr.arguments.size() != params.size()) {
+        return false;
+    }
+    for (std::size_t idx = 0; idx < candidate.body.names.size(); ++idx) {
+        const auto definition = m_symbols->definition(candidate.body.names[idx]);
+        const auto& expected = candidate.definitions[idx];
+        if (!definition.has_value() || definition->table != expected.table || definition->sym != expected.sym) {
+            return false;
+        }
+    }
+    const auto max_slots = m_symbols->is_global() ? std::size_t {std::numeric_limits<std::uint16_t>::max()} + 1
+                                                  : std::size_t {std::numeric_limits<std::uint8_t>::max()} + 1;
+    if (static_cast<std::size_t>(number_symbol_definitions()) + params.size() > max_slots) {
+        return false;
+    }
+
+    for (const auto* arg : expr.arguments) {
+        arg->accept(*this);
+    }
+    string_map<symbol> arguments;
+    for (auto idx = params.size(); idx-- > 0;) {
+        const auto temporary = inline_temporary(idx);
+        emit(temporary.is_local() ? opcodes::set_local : opcodes::set_global, temporary.index);
+        arguments.try_emplace(params[idx]->value, temporary);
+    }
+    const auto* outer_arguments = std::exchange(m_inline_arguments, &arguments);
+    m_inline_depth++;
+    if (candidate.body.value == nullptr) {
+        emit(opcodes::null);
+    } else {
+        candidate.body.value->accept(*this);
+    }
+    m_inline_depth--;
+    m_inline_arguments = outer_arguments;
+    m_inlined_calls++;
+    return true;
+}
+
+// Temporaries are named so that no identifier can refer to them and are reused by the calls inlined at the same
+// depth within a scope.
+auto compiler::inline_temporary(const std::size_t index) -> symbol
+{
+    const auto name = fmt::format("{}#{}", m_inline_depth, index);
+    if (const auto itr = m_symbols->symbols().find(name); itr != m_symbols->symbols().end()) {
+        return itr->second;
+    }
+    return define_symbol(name);
 }
 
 void compiler::visit(const null_literal& /*expr*/)
 {
-    emit(opcodes::constant, add_constant(null()));
+    emit(opcodes::constant, add_literal(std::monostate {}));
 }
 
 void compiler::visit(const return_statement& expr)
 {
     expr.value->accept(*this);
     emit(opcodes::return_value);
+    make_tail_call(m_scopes[m_scope_index].previous_instr);
 }
 
 void compiler::visit(const break_statement& /*expr*/)
@@ -470,14 +837,12 @@ void compiler::visit(const expression_statement& expr)
 
 void compiler::visit(const block_statement& expr)
 {
-    for (const auto& stmt : expr.statements) {
-        stmt->accept(*this);
-    }
+    compile_statements(expr.statements);
 }
 
 void compiler::visit(const string_literal& expr)
 {
-    emit(opcodes::constant, add_constant(allocate<string_object>(expr.value)));
+    emit(opcodes::constant, add_literal(expr.value));
 }
 
 void compiler::visit(const unary_expression& expr)
@@ -502,7 +867,7 @@ void compiler::visit(const function_literal& expr)
         define_function_name(expr.name);
     }
     for (const auto* param : expr.parameters) {
-        define_symbol(param->value);
+        note_binding(*param, define_symbol(param->value));
     }
     expr.body->accept(*this);
 
@@ -519,13 +884,16 @@ void compiler::visit(const function_literal& expr)
     for (const auto& sym : free) {
         load_symbol(sym);
     }
-    const auto function_index = add_constant(
+    const auto function_index = add_function(
         allocate<compiled_function_object>(std::move(instrs), num_locals, static_cast<int>(expr.parameters.size())));
     emit(closure, {function_index, free.size()});
 }
 
 void compiler::visit(const call_expression& expr)
 {
+    if (m_optimization_level > 1 && inline_call(expr)) {
+        return;
+    }
     expr.function->accept(*this);
     for (const auto& arg : expr.arguments) {
         arg->accept(*this);
@@ -559,15 +927,15 @@ auto check_no_parse_errors(const parser& prsr) -> bool
     return prsr.errors().empty();
 }
 
-using parsed_program = std::pair<const program*, parser>;
+using parsed_program = std::pair<std::unique_ptr<program>, parser>;
 
 auto check_program(const std::string_view input) -> parsed_program
 {
     auto prsr = parser {lexer {input}};
-    const auto prgrm = prsr.parse_program();
+    auto prgrm = prsr.parse_program();
     INFO("while parsing: `", input, "`");
     CHECK(check_no_parse_errors(prsr));
-    return {prgrm, std::move(prsr)};
+    return {std::move(prgrm), std::move(prsr)};
 }
 
 using expected_value = std::variant<int64_t, std::string, std::vector<instructions>, std::monostate>;
@@ -611,7 +979,7 @@ auto run(std::array<ctc, N>&& tests)
     for (const auto& [input, constants, instructions] : tests) {
         auto [prgrm, _] = check_program(input);
         auto cmplr = compiler::create();
-        cmplr.compile(prgrm);
+        cmplr.compile(prgrm.get());
         check_instructions(instructions, cmplr.current_instrs());
         check_constants(constants, *cmplr.consts());
     }
@@ -998,6 +1366,25 @@ TEST_CASE("conditionals")
                 make(pop),
             },
         },
+        ctc {
+            R"(if (true) { let a = 10; }; 3333)",
+            {{
+                10,
+                3333,
+            }},
+            {
+                make(tru),
+                make(jump_not_truthy, 14),
+                make(constant, 0),
+                make(set_global, 0),
+                make(null),
+                make(jump, 15),
+                make(null),
+                make(pop),
+                make(constant, 1),
+                make(pop),
+            },
+        },
         ctc {
             R"(if (true) { 10 } else { 20 }; 3333)",
             {{
@@ -1233,14 +1620,14 @@ TEST_CASE("indexExpression")
     std::array tests {
         ctc {
             R"([1, 2, 3][1 + 1])",
-            {1, 2, 3, 1, 1},
+            {1, 2, 3},
             {
                 make(constant, 0),
                 make(constant, 1),
                 make(constant, 2),
                 make(array, 3),
-                make(constant, 3),
-                make(constant, 4),
+                make(constant, 0),
+                make(constant, 0),
                 make(add),
                 make(index),
                 make(pop),
@@ -1248,13 +1635,13 @@ TEST_CASE("indexExpression")
         },
         ctc {
             R"({1: 2}[2 - 1])",
-            {1, 2, 2, 1},
+            {1, 2},
             {
                 make(constant, 0),
                 make(constant, 1),
                 make(hash, 2),
-                make(constant, 2),
-                make(constant, 3),
+                make(constant, 1),
+                make(constant, 0),
                 make(sub),
                 make(index),
                 make(pop),
@@ -1526,7 +1913,7 @@ TEST_CASE("builtins")
             {maker({
                 make(get_builtin, 0),
                 make(array, 0),
-                make(call, 1),
+                make(tail_call, 1),
                 make(return_value),
             })},
             {
@@ -1671,11 +2058,9 @@ TEST_CASE("closures")
                     make(add),
                     make(return_value),
                 }),
-                0,
-                1,
                 maker({
                     make(get_outer, {1, 1, 0}),
-                    make(constant, 6),
+                    make(constant, 2),
                     make(sub),
                     make(set_outer, {1, 1, 0}),
                     make(get_builtin, 1),
@@ -1698,10 +2083,10 @@ TEST_CASE("closures")
                     make(closure, {4, 1}),
                     make(set_local, 1),
                     make(get_local, 0),
-                    make(constant, 5),
+                    make(constant, 1),
                     make(greater_than),
                     make(jump_not_truthy, 44),
-                    make(closure, {7, 0}),
+                    make(closure, {5, 0}),
                     make(call, 0),
                     make(jump_not_truthy, 44),
                     make(jump, 23),
@@ -1717,7 +2102,7 @@ TEST_CASE("closures")
                 make(constant, 1),
                 make(greater_than),
                 make(jump_not_truthy, 28),
-                make(closure, {8, 0}),
+                make(closure, {6, 0}),
                 make(call, 0),
                 make(jump_not_truthy, 28),
                 make(jump, 6),
@@ -1773,11 +2158,9 @@ TEST_CASE("closures")
                     make(add),
                     make(return_value),
                 }),
-                0,
-                1,
                 maker({
                     make(get_outer, {1, 1, 0}),
-                    make(constant, 6),
+                    make(constant, 2),
                     make(sub),
                     make(set_outer, {1, 1, 0}),
                     make(get_builtin, 1),
@@ -1800,10 +2183,10 @@ TEST_CASE("closures")
                     make(closure, {4, 1}),
                     make(set_local, 1),
                     make(get_local, 0),
-                    make(constant, 5),
+                    make(constant, 1),
                     make(greater_than),
                     make(jump_not_truthy, 44),
-                    make(closure, {7, 0}),
+                    make(closure, {5, 0}),
                     make(call, 0),
                     make(jump_not_truthy, 44),
                     make(jump, 23),
@@ -1819,7 +2202,7 @@ TEST_CASE("closures")
                 make(constant, 1),
                 make(greater_than),
                 make(jump_not_truthy, 28),
-                make(closure, {8, 0}),
+                make(closure, {6, 0}),
                 make(call, 0),
                 make(jump_not_truthy, 28),
                 make(jump, 6),
@@ -1844,14 +2227,13 @@ TEST_CASE("recursiveFunctions")
                     make(get_local, 0),
                     make(constant, 0),
                     make(sub),
-                    make(call, 1),
-                    make(return_value)}),
-             1},
+                    make(tail_call, 1),
+                    make(return_value)})},
             {
                 make(closure, {1, 0}),
                 make(set_global, 0),
                 make(get_global, 0),
-                make(constant, 2),
+                make(constant, 0),
                 make(call, 1),
                 make(pop),
             },
@@ -1869,19 +2251,18 @@ TEST_CASE("recursiveFunctions")
                     make(get_local, 0),
                     make(constant, 0),
                     make(sub),
-                    make(call, 1),
+                    make(tail_call, 1),
                     make(return_value)}),
-             1,
              maker({
                  make(closure, {1, 0}),
                  make(set_local, 0),
                  make(get_local, 0),
-                 make(constant, 2),
-                 make(call, 1),
+                 make(constant, 0),
+                 make(tail_call, 1),
                  make(return_value),
              })},
             {
-                make(closure, {3, 0}),
+                make(closure, {2, 0}),
                 make(set_global, 0),
                 make(get_global, 0),
                 make(call, 0),
@@ -1892,6 +2273,130 @@ TEST_CASE("recursiveFunctions")
     run(std::move(tests));
 }
 
+TEST_CASE("tailCalls")
+{
+    using enum opcodes;
+    std::array tests {
+        ctc {
+            R"(fn(f) { return f(); })",
+            {maker({make(get_local, 0), make(tail_call, 0), make(return_value)})},
+            {
+                make(closure, {0, 0}),
+                make(pop),
+            },
+        },
+        ctc {
+            R"(fn(f) { f() + 1 })",
+            {1, maker({make(get_local, 0), make(call, 0), make(constant, 0), make(add), make(return_value)})},
+            {
+                make(closure, {1, 0}),
+                make(pop),
+            },
+        },
+        ctc {
+            R"(fn(f) { while (true) { return f(); } })",
+            {maker({make(get_outer, {1, 1, 0}), make(call, 0), make(return_value), make(cont)}),
+             maker({make(tru),
+                    make(jump_not_truthy, 16),
+                    make(closure, {0, 0}),
+                    make(call, 0),
+                    make(jump_not_truthy, 16),
+                    make(jump, 0),
+                    make(null),
+                    make(return_value)})},
+            {
+                make(closure, {1, 0}),
+                make(pop),
+            },
+        },
+    };
+    run(std::move(tests));
+}
+
+auto check_same_code(const compiler& expected_cmplr, const compiler& actual_cmplr)
+{
+    CHECK_EQ(expected_cmplr.byte_code().instrs, actual_cmplr.byte_code().instrs);
+    REQUIRE_EQ(expected_cmplr.consts()->size(), actual_cmplr.consts()->size());
+    for (std::size_t idx = 0; idx < expected_cmplr.consts()->size(); ++idx) {
+        const auto* expected = expected_cmplr.consts()->at(idx);
+        const auto* actual = actual_cmplr.consts()->at(idx);
+        REQUIRE_EQ(expected->type(), actual->type());
+        if (!expected->is(object::object_type::compiled_function)) {
+            continue;
+        }
+        const auto* expected_func = expected->as<compiled_function_object>();
+        const auto* actual_func = actual->as<compiled_function_object>();
+        CHECK_EQ(expected_func->instrs, actual_func->instrs);
+        CHECK_EQ(expected_func->num_locals, actual_func->num_locals);
+        CHECK_EQ(expected_func->max_stack, actual_func->max_stack);
+        CHECK_EQ(expected_func->register_code.instrs, actual_func->register_code.instrs);
+    }
+}
+
+TEST_CASE("functionsFinishedInParallel")
+{
+    constexpr auto input = R"(
+let outer = fn(a) {
+    let inner = fn(b) { let c = fn() { a + b }; c() * 2 };
+    let loop = fn(n) { let i = 0; while (i < n) { i = i + inner(i); } i };
+    loop(a) + inner(a)
+};
+let other = fn(x) { if (x > 1) { x = x - 1; } else { x = 0; } x };
+outer(3) + other(4)
+)";
+    // enough code for more than one thread
+    std::string many;
+    for (auto idx = 0; idx < 300; ++idx) {
+        many += fmt::format("let f_{}{} = fn(a) {{ let b = a * {}; if (b > 3) {{ b - 1 }} else {{ [b, a][0] }} }};\n",
+                            static_cast<char>('a' + (idx / 26)),
+                            static_cast<char>('a' + (idx % 26)),
+                            idx);
+    }
+    for (const std::string_view program : {std::string_view {input}, std::string_view {many}}) {
+        auto [prgrm, _] = check_program(program);
+        for (const auto bkend : {backend::stack, backend::registers}) {
+            for (auto level = 0; level <= 2; ++level) {
+                INFO("level ", level);
+                auto serial = compiler::create(bkend);
+                serial.set_optimization_level(level);
+                serial.compile(prgrm.get());
+                auto parallel = compiler::create(bkend);
+                parallel.set_optimization_level(level);
+                parallel.set_jobs(4);
+                parallel.compile(prgrm.get());
+                check_same_code(serial, parallel);
+            }
+        }
+    }
+}
+
+TEST_CASE("resolvedNames")
+{
+    for (const auto* input : {
+             "let a = 1; let f = fn(x) { let y = x + a; let g = fn(z) { z + y + x + a }; g(len([y])) }; f(2)",
+             "let fib = fn(n) { if (n < 2) { return n; } fib(n - 1) + fib(n - 2) }; fib(10)",
+             "let c = 0; let i = 0; while (i < 9) { let j = i; while (j > 0) { c = c + j; j = j - 1; } i = i + 1; } c",
+             "let sq = fn(x) { x * x }; let b = 3; let u = fn() { b }; let f = fn(y) { let t = sq(y); sq(t) + b }; f(2)",
+             "let f = fn() { let x = 1; return x; let y = 2; y }; f()",
+             "let x = 1; let f = fn() { let y = x; let x = 2; x + y }; let len = fn(a) { 1 }; len([1]) + f()",
+             "let f = fn(n) { let g = fn() { f }; while (n > 0) { n = n - 1; let h = fn() { n + g }; } g }; f(3)",
+         })
+    {
+        auto [prgrm, _] = check_program(input);
+        const auto resolution = analyze_program(prgrm.get(), nullptr);
+        for (auto level = 0; level <= 2; ++level) {
+            INFO(input, " level ", level);
+            auto resolving = compiler::create();
+            resolving.set_optimization_level(level);
+            resolving.compile(prgrm.get());
+            auto resolved = compiler::create();
+            resolved.set_optimization_level(level);
+            resolved.compile(prgrm.get(), &resolution);
+            check_same_code(resolving, resolved);
+        }
+    }
+}
+
 TEST_SUITE_END();
 // NOLINTEND(*)
 }  // namespace
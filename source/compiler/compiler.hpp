@@ -4,12 +4,24 @@
 #pragma once
 
 #include <cstddef>
-
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include <analyzer/name_resolution.hpp>
+#include <ast/identifier.hpp>
 #include <ast/program.hpp>
 #include <ast/visitor.hpp>
 #include <code/code.hpp>
+#include <code/register_code.hpp>
 #include <object/object.hpp>
 
+#include "inlining.hpp"
 #include "symbol_table.hpp"
 
 using constants = std::vector<const object*>;
@@ -18,6 +30,17 @@ struct bytecode final
 {
     instructions instrs;
     const constants* consts {};
+    int max_stack {};
+    // the number of global slots the code uses
+    int num_globals {};
+    register_function register_code;
+};
+
+// The stack code is always generated, the register backend additionally lowers every function to registers.
+enum class backend : std::uint8_t
+{
+    stack,
+    registers,
 };
 
 struct emitted_instruction final
@@ -31,19 +54,51 @@ struct compilation_scope final
     instructions instrs;
     emitted_instruction last_instr;
     emitted_instruction previous_instr;
+    // the jumps whose target did not fit their operand when they were patched, by position
+    std::map<std::size_t, std::size_t> far_jumps;
 };
 
-struct compiler final : visitor
+// the value of a null, integer, decimal or string literal
+using literal_value = std::variant<std::monostate, std::int64_t, double, std::string>;
+
+// a function bound with let whose calls can be replaced by its body
+struct inline_candidate final
+{
+    const function_literal* func {};
+    inline_body body;
+    symbol binding;
+    // where the names the body reads are defined at the let, a call site has to see the same definitions
+    std::vector<symbol_definition> definitions;
+};
+
+// a function whose optimization and lowering waits until the whole program is compiled
+struct unfinished_function final
 {
-    auto compile(const program* program) -> void;
-    [[nodiscard]] static auto create() -> compiler;
+    // of the scope it was added in
+    std::size_t depth {};
+    compiled_function_object* func {};
+};
 
-    [[nodiscard]] static auto create_with_state(constants* constants, symbol_table* symbols) -> compiler
+struct compiler final : visitor
+{
+    // With the names of the program resolved by the analyzer, only the names of enclosing functions are looked up
+    // again, as their capture is up to the compiler.
+    auto compile(const program* program, const name_resolution* resolution = nullptr) -> void;
+    // Compiles the next input of a repl, dropping the code of the previous one, whose definitions and constants
+    // stay. Equal literals of all inputs share a constant.
+    auto compile_input(const program* program, const name_resolution* resolution = nullptr) -> void;
+    [[nodiscard]] static auto create(backend bkend = backend::stack) -> compiler;
+
+    [[nodiscard]] static auto create_with_state(constants* constants,
+                                                symbol_table* symbols,
+                                                backend bkend = backend::stack) -> compiler
     {
-        return compiler {constants, symbols};
+        return compiler {constants, symbols, bkend};
     }
 
     [[nodiscard]] auto add_constant(const object* obj) -> std::size_t;
+    // the constant of a literal, added only once per value
+    [[nodiscard]] auto add_literal(const literal_value& value) -> std::size_t;
     [[nodiscard]] auto add_instructions(const instructions& ins) -> std::size_t;
 
     auto emit(opcodes opcode, const operands& operands = {}) -> std::size_t;
@@ -61,8 +116,11 @@ struct compiler final : visitor
     [[nodiscard]] auto last_instruction_is(opcodes opcode) const -> bool;
     auto remove_last_pop() -> void;
     auto replace_last_pop_with_return() -> void;
+    auto make_tail_call(const emitted_instruction& instr) -> void;
     auto replace_instruction(std::size_t pos, const instructions& instr) -> void;
     auto change_operand(std::size_t pos, std::size_t operand) -> void;
+    // the instructions of the current scope, with the far jumps widened
+    [[nodiscard]] auto scope_instrs() const -> instructions;
     [[nodiscard]] auto byte_code() const -> bytecode;
     [[nodiscard]] auto current_instrs() const -> const instructions&;
     auto enter_scope(bool inside_loop = false) -> void;
@@ -71,12 +129,26 @@ struct compiler final : visitor
     auto define_function_name(const std::string& name) -> symbol;
     auto load_symbol(const symbol& sym) -> void;
     [[nodiscard]] auto resolve_symbol(const std::string& name) const -> std::optional<symbol>;
+    [[nodiscard]] auto resolve_identifier(const identifier& expr) const -> std::optional<symbol>;
     [[nodiscard]] auto free_symbols() const -> std::vector<symbol>;
     [[nodiscard]] auto number_symbol_definitions() const -> int;
     [[nodiscard]] auto consts() const -> constants*;
 
     [[nodiscard]] auto all_symbols() const -> const symbol_table* { return m_symbols; }
 
+    // functions are optimized as they are added, the main program by byte_code(), see optimize(). Level 1 and above
+    // also leave out dead statements, level 2 and above inline calls to small functions.
+    auto set_optimization_level(const int level) -> void { m_optimization_level = level; }
+
+    // The number of threads the functions are optimized and lowered on, at most one per kilobyte of their code. With
+    // more than one, they are finished together at the end of compile() instead of as they are added, the constants
+    // they get are the same.
+    auto set_jobs(const int jobs) -> void { m_jobs = jobs; }
+
+    [[nodiscard]] auto inlined_calls() const -> int { return m_inlined_calls; }
+
+    [[nodiscard]] auto eliminated_statements() const -> int { return m_eliminated_statements; }
+
   protected:
     void visit(const array_literal& expr) override;
     void visit(const assign_expression& expr) override;
@@ -107,5 +179,33 @@ struct compiler final : visitor
     symbol_table* m_symbols;
     std::vector<compilation_scope> m_scopes;
     std::size_t m_scope_index {0};
-    compiler(constants* consts, symbol_table* symbols);
+    backend m_backend {};
+    int m_optimization_level {};
+    // false where later inputs may assign the globals of this one, as in the repl
+    bool m_sees_whole_program {};
+    name_set m_assigned;
+    name_set m_used;
+    std::map<std::pair<const symbol_table*, std::string>, inline_candidate> m_inline_candidates;
+    // the temporaries holding the arguments of the call whose body is being inlined
+    const string_map<symbol>* m_inline_arguments {};
+    int m_inline_depth {};
+    int m_inlined_calls {};
+    int m_eliminated_statements {};
+    int m_jobs {1};
+    std::vector<unfinished_function> m_unfinished;
+    std::unordered_map<literal_value, std::size_t> m_literals;
+    const name_resolution* m_resolution {};
+    // where the bindings of the resolution are defined, once they are
+    std::vector<std::optional<symbol_definition>> m_bindings;
+    compiler(constants* consts, symbol_table* symbols, backend bkend, bool sees_whole_program = false);
+    auto add_function(compiled_function_object* func) -> std::size_t;
+    auto finish_function(compiled_function_object& func) const -> void;
+    auto finish_functions() -> void;
+    auto note_binding(const identifier& name, const symbol& sym) -> void;
+    auto compile_statements(const expressions& statements) -> void;
+    auto compile_branch(const block_statement& block) -> void;
+    [[nodiscard]] auto is_dead(const expressions& statements, std::size_t index) const -> bool;
+    auto note_inline_candidate(const let_statement& stmt, const symbol& sym) -> void;
+    auto inline_call(const call_expression& expr) -> bool;
+    auto inline_temporary(std::size_t index) -> symbol;
 };
@@ -0,0 +1,220 @@
+// Copyright 2023-2025 hrzlgnm
+// SPDX-License-Identifier: MIT-0
+
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include "dead_code.hpp"
+
+#include <ast/array_literal.hpp>
+#include <ast/assign_expression.hpp>
+#include <ast/binary_expression.hpp>
+#include <ast/boolean_literal.hpp>
+#include <ast/call_expression.hpp>
+#include <ast/decimal_literal.hpp>
+#include <ast/function_literal.hpp>
+#include <ast/hash_literal.hpp>
+#include <ast/identifier.hpp>
+#include <ast/integer_literal.hpp>
+#include <ast/program.hpp>
+#include <ast/statements.hpp>
+#include <ast/string_literal.hpp>
+#include <ast/unary_expression.hpp>
+#include <builtin/builtin.hpp>
+#include <doctest/doctest.h>
+#include <lexer/lexer.hpp>
+#include <lexer/token_type.hpp>
+#include <parser/parser.hpp>
+
+#include "symbol_table.hpp"
+
+namespace
+{
+struct name_collector final : tree_walker
+{
+    using tree_walker::visit;
+
+    void visit(const assign_expression& expr) override
+    {
+        names.insert(expr.name->value);
+        tree_walker::visit(expr);
+    }
+
+    void visit(const identifier& expr) override { names.insert(expr.value); }
+
+    name_set names;
+};
+
+template<typename... T>
+auto is_one_of(const expression* expr) -> bool
+{
+    return ((dynamic_cast<const T*>(expr) != nullptr) || ...);
+}
+
+struct purity_checker final : tree_walker
+{
+    explicit purity_checker(const symbol_resolver& resolve)
+        : m_resolve {resolve}
+    {
+    }
+
+    using tree_walker::visit;
+
+    void visit(const assign_expression& /*expr*/) override { pure = false; }
+
+    void visit(const binary_expression& /*expr*/) override { pure = false; }
+
+    void visit(const break_statement& /*expr*/) override { pure = false; }
+
+    void visit(const continue_statement& /*expr*/) override { pure = false; }
+
+    void visit(const let_statement& /*expr*/) override { pure = false; }
+
+    void visit(const return_statement& /*expr*/) override { pure = false; }
+
+    void visit(const while_statement& /*expr*/) override { pure = false; }
+
+    // the body does not run
+    void visit(const function_literal& /*expr*/) override {}
+
+    void visit(const call_expression& expr) override
+    {
+        const auto* callee = dynamic_cast<const identifier*>(expr.function);
+        const auto sym = callee != nullptr ? m_resolve(callee->value) : std::nullopt;
+        if (!sym.has_value() || sym->scope != symbol_scope::builtin
+            || !builtin::builtins().at(static_cast<std::size_t>(sym->index))->pure)
+        {
+            pure = false;
+            return;
+        }
+        for (const auto* arg : expr.arguments) {
+            arg->accept(*this);
+        }
+    }
+
+    // keys which are not hashable raise an error
+    void visit(const hash_literal& expr) override
+    {
+        for (const auto& [key, value] : expr.pairs) {
+            if (!is_one_of<string_literal, integer_literal, boolean_literal>(key)) {
+                pure = false;
+                return;
+            }
+            value->accept(*this);
+        }
+    }
+
+    void visit(const identifier& expr) override { pure = pure && m_resolve(expr.value).has_value(); }
+
+    // negating anything but a number raises an error
+    void visit(const unary_expression& expr) override
+    {
+        if (expr.op == token_type::minus && !is_one_of<integer_literal, decimal_literal>(expr.right)) {
+            pure = false;
+            return;
+        }
+        expr.right->accept(*this);
+    }
+
+    bool pure {true};
+
+  private:
+    const symbol_resolver& m_resolve;
+};
+}  // namespace
+
+auto used_names(const program* prgrm) -> name_set
+{
+    name_collector collector;
+    prgrm->accept(collector);
+    return std::move(collector.names);
+}
+
+auto is_pure(const expression* expr, const symbol_resolver& resolve) -> bool
+{
+    purity_checker checker {resolve};
+    expr->accept(checker);
+    return checker.pure;
+}
+
+auto ends_block(const expression* stmt) -> bool
+{
+    return is_one_of<return_statement, break_statement, continue_statement>(stmt);
+}
+
+namespace
+{
+// NOLINTBEGIN(*)
+auto parse(const std::string_view input) -> std::unique_ptr<program>
+{
+    auto prsr = parser {lexer {input}};
+    auto prgrm = prsr.parse_program();
+    REQUIRE(prsr.errors().empty());
+    return prgrm;
+}
+
+TEST_SUITE("compiler")
+{
+    TEST_CASE("pureExpressions")
+    {
+        auto* symbols = symbol_table::create();
+        for (auto idx = 0; const auto& bltn : builtin::builtins()) {
+            symbols->define_builtin(idx++, bltn->name);
+        }
+        symbols->define("a");
+        const symbol_resolver resolve = [symbols](const std::string& name) { return symbols->resolve(name); };
+        const auto pure = [&](const std::string_view input)
+        {
+            const auto prgrm = parse(input);
+            return is_pure(prgrm->statements.front(), resolve);
+        };
+        for (const auto* input : {
+                 "1",
+                 "-2.5",
+                 "!a",
+                 "a",
+                 "[a, \"b\", [1]]",
+                 "{\"a\": a, 1: [a], true: null}",
+                 "a[1][a]",
+                 "fn() { puts(a) }",
+                 "len(a)",
+                 "first(rest(a))",
+                 "type(push(a, 1))",
+                 "if (a) { len(a) } else { 1 }",
+             })
+        {
+            INFO(std::string {input});
+            CHECK(pure(input));
+        }
+        for (const auto* input : {
+                 "puts(a)",
+                 "b",
+                 "-a",
+                 "a + 1",
+                 "a = 1",
+                 "a(1)",
+                 "len(puts(1))",
+                 "{a: 1}",
+                 "[1, puts(1)]",
+                 "if (a) { let b = 1; b }",
+                 "fn() { 1 }()",
+             })
+        {
+            INFO(std::string {input});
+            CHECK_FALSE(pure(input));
+        }
+    }
+
+    TEST_CASE("usedNames")
+    {
+        const auto prgrm = parse("let a = 1; let b = fn(x) { c = x; d }; let e = a; b(a)[f]");
+        CHECK_EQ(used_names(prgrm.get()), name_set {"a", "b", "c", "d", "f", "x"});
+    }
+}
+
+// NOLINTEND(*)
+}  // namespace
@@ -0,0 +1,27 @@
+// Copyright 2023-2025 hrzlgnm
+// SPDX-License-Identifier: MIT-0
+
+#pragma once
+
+#include <functional>
+#include <optional>
+#include <string>
+
+#include <ast/expression.hpp>
+#include <ast/program.hpp>
+
+#include "symbol_table.hpp"
+#include "tree_walker.hpp"
+
+// the names read or assigned anywhere in the program, a binding of any other name is never used
+[[nodiscard]] auto used_names(const program* prgrm) -> name_set;
+
+using symbol_resolver = std::function<std::optional<symbol>(const std::string& name)>;
+
+// Whether evaluating the expression has no side effect and raises no error, so that it can be dropped when its
+// value is unused. Literals, defined names, function literals, indexing and calls to pure builtins with such
+// operands are, operators are not, as they raise errors for unsupported operands.
+[[nodiscard]] auto is_pure(const expression* expr, const symbol_resolver& resolve) -> bool;
+
+// whether no statement of the same block after this one runs
+[[nodiscard]] auto ends_block(const expression* stmt) -> bool;
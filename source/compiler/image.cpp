@@ -0,0 +1,429 @@
+// Copyright 2023-2025 hrzlgnm
+// SPDX-License-Identifier: MIT-0
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <optional>
+#include <ostream>
+#include <span>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "image.hpp"
+
+#include <doctest/doctest.h>
+#include <fmt/format.h>
+#include <gc.hpp>
+#include <lexer/lexer.hpp>
+#include <object/object.hpp>
+#include <parser/parser.hpp>
+
+#include "compiler.hpp"
+#include "symbol_table.hpp"
+
+#if defined(__unix__) || defined(__APPLE__)
+#    include <fcntl.h>
+#    include <sys/mman.h>
+#    include <sys/stat.h>
+#    include <unistd.h>
+#    define CAPPUCHIN_MMAP
+#endif
+
+namespace
+{
+constexpr std::array<std::uint8_t, 4> magic {'C', 'P', 'C', 0};
+// locals are addressed by operands of at most 16 bits
+constexpr int max_locals = std::numeric_limits<std::uint16_t>::max() + 1;
+
+enum class constant_tag : std::uint8_t
+{
+    integer,
+    decimal,
+    null,
+    string,
+    compiled_function,
+};
+
+class image_writer final
+{
+  public:
+    explicit image_writer(std::ostream& out)
+        : m_out {out}
+    {
+    }
+
+    auto bytes(const std::span<const std::uint8_t> data) -> void
+    {
+        m_out.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
+    }
+
+    auto u8(const std::uint8_t value) -> void { m_out.put(static_cast<char>(value)); }
+
+    auto u32(const std::uint32_t value) -> void { u64_bytes(value, sizeof(value)); }
+
+    auto u64(const std::uint64_t value) -> void { u64_bytes(value, sizeof(value)); }
+
+    auto blob(const std::span<const std::uint8_t> data) -> void
+    {
+        u32(static_cast<std::uint32_t>(data.size()));
+        bytes(data);
+    }
+
+    auto text(const std::string_view str) -> void
+    {
+        blob({reinterpret_cast<const std::uint8_t*>(str.data()), str.size()});
+    }
+
+  private:
+    auto u64_bytes(const std::uint64_t value, const std::size_t size) -> void
+    {
+        for (std::size_t idx = 0; idx < size; ++idx) {
+            u8(static_cast<std::uint8_t>(value >> (idx * 8U)));
+        }
+    }
+
+    std::ostream& m_out;
+};
+
+class image_reader final
+{
+  public:
+    explicit image_reader(const std::span<const std::uint8_t> data)
+        : m_data {data}
+    {
+    }
+
+    auto bytes(const std::size_t size) -> std::span<const std::uint8_t>
+    {
+        if (size > m_data.size() - m_offset) {
+            throw std::runtime_error(fmt::format("truncated bytecode image at offset {}", m_offset));
+        }
+        const auto result = m_data.subspan(m_offset, size);
+        m_offset += size;
+        return result;
+    }
+
+    auto u8() -> std::uint8_t { return bytes(1)[0]; }
+
+    auto u32() -> std::uint32_t { return static_cast<std::uint32_t>(u64_bytes(sizeof(std::uint32_t))); }
+
+    auto u64() -> std::uint64_t { return u64_bytes(sizeof(std::uint64_t)); }
+
+    // the fields the vm uses as sizes have to fit an int
+    auto size() -> int
+    {
+        const auto value = u32();
+        if (value > static_cast<std::uint32_t>(std::numeric_limits<int>::max())) {
+            throw std::runtime_error(fmt::format("invalid size {} in bytecode image", value));
+        }
+        return static_cast<int>(value);
+    }
+
+    auto blob() -> instructions
+    {
+        const auto data = bytes(u32());
+        return {data.begin(), data.end()};
+    }
+
+    auto text() -> std::string
+    {
+        const auto data = bytes(u32());
+        return {data.begin(), data.end()};
+    }
+
+    [[nodiscard]] auto at_end() const -> bool { return m_offset == m_data.size(); }
+
+  private:
+    auto u64_bytes(const std::size_t size) -> std::uint64_t
+    {
+        std::uint64_t value {};
+        for (std::size_t idx = 0; const auto byte : bytes(size)) {
+            value |= std::uint64_t {byte} << (idx++ * 8U);
+        }
+        return value;
+    }
+
+    std::span<const std::uint8_t> m_data;
+    std::size_t m_offset {};
+};
+
+auto write_constant(image_writer& writer, const object* constant) -> void
+{
+    if (constant->is_null()) {
+        writer.u8(static_cast<std::uint8_t>(constant_tag::null));
+        return;
+    }
+    switch (constant->type()) {
+        case object::object_type::integer:
+            writer.u8(static_cast<std::uint8_t>(constant_tag::integer));
+            writer.u64(static_cast<std::uint64_t>(constant->as<integer_object>()->value));
+            break;
+        case object::object_type::decimal:
+            writer.u8(static_cast<std::uint8_t>(constant_tag::decimal));
+            writer.u64(std::bit_cast<std::uint64_t>(constant->as<decimal_object>()->value));
+            break;
+        case object::object_type::string:
+            writer.u8(static_cast<std::uint8_t>(constant_tag::string));
+            writer.text(constant->as<string_object>()->value);
+            break;
+        case object::object_type::compiled_function: {
+            const auto* func = constant->as<compiled_function_object>();
+            writer.u8(static_cast<std::uint8_t>(constant_tag::compiled_function));
+            writer.u32(static_cast<std::uint32_t>(func->num_locals));
+            writer.u32(static_cast<std::uint32_t>(func->num_arguments));
+            writer.u32(static_cast<std::uint32_t>(func->max_stack));
+            writer.u8(func->inside_loop ? 1 : 0);
+            writer.blob(func->instrs);
+        } break;
+        default:
+            throw std::runtime_error(fmt::format("cannot store a constant of type {}", constant->type()));
+    }
+}
+
+auto read_constant(image_reader& reader) -> const object*
+{
+    switch (const auto tag = reader.u8(); static_cast<constant_tag>(tag)) {
+        case constant_tag::integer:
+            return allocate<integer_object>(static_cast<std::int64_t>(reader.u64()));
+        case constant_tag::decimal:
+            return allocate<decimal_object>(std::bit_cast<double>(reader.u64()));
+        case constant_tag::null:
+            return null();
+        case constant_tag::string:
+            return allocate<string_object>(reader.text());
+        case constant_tag::compiled_function: {
+            const auto num_locals = reader.size();
+            const auto num_arguments = reader.size();
+            const auto max_stack = reader.size();
+            const auto inside_loop = reader.u8() != 0;
+            auto instrs = reader.blob();
+            // the arguments are the first locals, and no instruction leaves more than one value more on the stack,
+            // so a frame never has to be larger than its code
+            if (num_locals > max_locals || num_arguments > num_locals || std::cmp_greater(max_stack, instrs.size())) {
+                throw std::runtime_error(
+                    fmt::format("invalid function in bytecode image: {} locals, {} arguments, maximum stack depth {}",
+                                num_locals,
+                                num_arguments,
+                                max_stack));
+            }
+            auto* func = allocate<compiled_function_object>(std::move(instrs), num_locals, num_arguments, inside_loop);
+            func->max_stack = max_stack;
+            return func;
+        }
+        default:
+            throw std::runtime_error(fmt::format("invalid constant tag {} in bytecode image", tag));
+    }
+}
+}  // namespace
+
+auto write_image(std::ostream& out, const bytecode& code, const symbol_table* symbols) -> void
+{
+    image_writer writer {out};
+    writer.bytes(magic);
+    writer.u32(image_version);
+    writer.u32(static_cast<std::uint32_t>(code.max_stack));
+    writer.u32(static_cast<std::uint32_t>(code.num_globals));
+    writer.blob(code.instrs);
+    writer.u32(static_cast<std::uint32_t>(code.consts->size()));
+    for (const auto* constant : *code.consts) {
+        write_constant(writer, constant);
+    }
+    std::vector<const symbol*> globals;
+    for (const auto& [name, sym] : symbols->symbols()) {
+        if (sym.is_global()) {
+            globals.push_back(&sym);
+        }
+    }
+    writer.u32(static_cast<std::uint32_t>(globals.size()));
+    for (const auto* sym : globals) {
+        writer.text(sym->name);
+        writer.u32(static_cast<std::uint32_t>(sym->index));
+    }
+}
+
+auto read_image(const std::span<const std::uint8_t> data) -> image
+{
+    image_reader reader {data};
+    if (data.size() < magic.size() || !std::ranges::equal(reader.bytes(magic.size()), magic)) {
+        throw std::runtime_error("not a bytecode image");
+    }
+    if (const auto version = reader.u32(); version != image_version) {
+        throw std::runtime_error(
+            fmt::format("unsupported bytecode image version {}, expected {}", version, image_version));
+    }
+    image img;
+    img.code.max_stack = reader.size();
+    img.code.num_globals = reader.size();
+    img.code.instrs = reader.blob();
+    if (std::cmp_greater(img.code.max_stack, img.code.instrs.size())) {
+        throw std::runtime_error(fmt::format("invalid maximum stack depth {} in bytecode image", img.code.max_stack));
+    }
+    const auto num_consts = reader.u32();
+    auto* consts = allocate<constants>();
+    for (std::uint32_t idx = 0; idx < num_consts; ++idx) {
+        consts->push_back(read_constant(reader));
+    }
+    img.code.consts = consts;
+    const auto num_symbols = reader.u32();
+    for (std::uint32_t idx = 0; idx < num_symbols; ++idx) {
+        auto name = reader.text();
+        img.symbols.push_back(
+            {.name = std::move(name), .scope = symbol_scope::global, .index = reader.size(), .ptr = std::nullopt});
+    }
+    if (!reader.at_end()) {
+        throw std::runtime_error("trailing data in bytecode image");
+    }
+    return img;
+}
+
+auto load_image(const std::string_view path, const std::size_t offset) -> image
+{
+#if defined(CAPPUCHIN_MMAP)
+    const auto file = std::string {path};
+    const int fd = open(file.c_str(), O_RDONLY);  // NOLINT(*-vararg)
+    if (fd < 0) {
+        throw std::runtime_error(fmt::format("could not open file: {}", path));
+    }
+    struct stat info {};
+    if (fstat(fd, &info) != 0 || std::cmp_less_equal(info.st_size, offset)) {
+        close(fd);
+        throw std::runtime_error(fmt::format("could not read file: {}", path));
+    }
+    const auto size = static_cast<std::size_t>(info.st_size);
+    void* memory = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (memory == MAP_FAILED) {
+        throw std::runtime_error(fmt::format("could not map file: {}", path));
+    }
+    try {
+        auto img = read_image(std::span {static_cast<const std::uint8_t*>(memory), size}.subspan(offset));
+        munmap(memory, size);
+        return img;
+    } catch (...) {
+        munmap(memory, size);
+        throw;
+    }
+#else
+    std::ifstream ifs(std::string {path}, std::ios::binary);
+    if (!ifs) {
+        throw std::runtime_error(fmt::format("could not open file: {}", path));
+    }
+    const std::vector<std::uint8_t> contents {(std::istreambuf_iterator(ifs)), (std::istreambuf_iterator<char>())};
+    if (contents.size() <= offset) {
+        throw std::runtime_error(fmt::format("could not read file: {}", path));
+    }
+    return read_image(std::span {contents}.subspan(offset));
+#endif
+}
+
+namespace
+{
+// NOLINTBEGIN(*)
+auto to_bytes(const std::string& str) -> std::vector<std::uint8_t>
+{
+    return {str.begin(), str.end()};
+}
+
+// returns the code of the input and its image
+auto compile(const std::string_view input) -> std::pair<bytecode, std::vector<std::uint8_t>>
+{
+    auto prsr = parser {lexer {input}};
+    auto prgrm = prsr.parse_program();
+    REQUIRE(prsr.errors().empty());
+    auto cmplr = compiler::create();
+    cmplr.compile(prgrm.get());
+    std::ostringstream out;
+    write_image(out, cmplr.byte_code(), cmplr.all_symbols());
+    return {cmplr.byte_code(), to_bytes(out.str())};
+}
+
+TEST_SUITE("compiler")
+{
+    TEST_CASE("imageRoundTrip")
+    {
+        const auto [code, data] = compile(R"(
+            let answer = 42;
+            let pi = 3.25;
+            let greet = fn(name) { "hello " + name };
+            let loop = fn() { let i = 0; while (i < 3) { i = i + 1; } null };
+            greet("world");
+        )");
+        const auto img = read_image(data);
+        CHECK_EQ(img.code.instrs, code.instrs);
+        CHECK_EQ(img.code.max_stack, code.max_stack);
+        CHECK_EQ(img.code.num_globals, 4);
+        REQUIRE_EQ(img.code.consts->size(), code.consts->size());
+        for (std::size_t idx = 0; idx < code.consts->size(); ++idx) {
+            const auto* expected = (*code.consts)[idx];
+            const auto* actual = (*img.code.consts)[idx];
+            REQUIRE_EQ(actual->type(), expected->type());
+            if (expected->is(object::object_type::compiled_function)) {
+                const auto* expected_fn = expected->as<compiled_function_object>();
+                const auto* actual_fn = actual->as<compiled_function_object>();
+                CHECK_EQ(actual_fn->instrs, expected_fn->instrs);
+                CHECK_EQ(actual_fn->num_locals, expected_fn->num_locals);
+                CHECK_EQ(actual_fn->num_arguments, expected_fn->num_arguments);
+                CHECK_EQ(actual_fn->max_stack, expected_fn->max_stack);
+                CHECK_EQ(actual_fn->inside_loop, expected_fn->inside_loop);
+            } else {
+                CHECK_EQ(actual->inspect(), expected->inspect());
+            }
+        }
+        REQUIRE_EQ(img.symbols.size(), 4);
+        CHECK(std::ranges::any_of(img.symbols, [](const symbol& sym) { return sym.name == "greet" && sym.index == 2; }));
+    }
+
+    TEST_CASE("invalidImages")
+    {
+        const auto [_, valid] = compile("1");
+
+        CHECK_THROWS_WITH(read_image(to_bytes("#!cappuchin")), "not a bytecode image");
+        auto other_version = valid;
+        other_version[4] = 99;
+        CHECK_THROWS_WITH(read_image(other_version), "unsupported bytecode image version 99, expected 5");
+        const auto truncated = std::vector<std::uint8_t>(valid.begin(), valid.end() - 3);
+        CHECK_THROWS_WITH(read_image(truncated), "truncated bytecode image at offset 37");
+        auto trailing = valid;
+        trailing.push_back(0);
+        CHECK_THROWS_WITH(read_image(trailing), "trailing data in bytecode image");
+        auto deep_main = valid;
+        deep_main[8] = 0xFF;
+        CHECK_THROWS_WITH(read_image(deep_main), "invalid maximum stack depth 255 in bytecode image");
+
+        // the locals, arguments and maximum stack depth of the function follow the main code and its tag
+        const auto [code, function] = compile("fn(a, b) { a + b }");
+        REQUIRE(code.consts->front()->is(object::object_type::compiled_function));
+        const auto header = 16 + 4 + code.instrs.size() + 4 + 1;
+        REQUIRE_EQ(function[header], 2);
+        struct test
+        {
+            std::size_t field;
+            std::uint8_t value;
+            std::string expected;
+        };
+        const std::array tests {
+            test {0, 1, "invalid function in bytecode image: 1 locals, 2 arguments, maximum stack depth 2"},
+            test {2, 0x01, "invalid function in bytecode image: 65538 locals, 2 arguments, maximum stack depth 2"},
+            test {8, 0xFF, "invalid function in bytecode image: 2 locals, 2 arguments, maximum stack depth 255"},
+        };
+        for (const auto& [field, value, expected] : tests) {
+            auto invalid = function;
+            invalid[header + field] = value;
+            CHECK_THROWS_WITH(read_image(invalid), expected.c_str());
+        }
+    }
+}
+
+// NOLINTEND(*)
+}  // namespace
@@ -0,0 +1,40 @@
+// Copyright 2023-2025 hrzlgnm
+// SPDX-License-Identifier: MIT-0
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <span>
+#include <string_view>
+#include <vector>
+
+#include "compiler.hpp"
+#include "symbol_table.hpp"
+
+// The extension of bytecode images written with `-c`, which the executable runs without compiling.
+inline constexpr std::string_view image_extension = ".cpc";
+
+// Bumped whenever the layout of the image or the numbering of the opcodes changes, images of another version are
+// rejected.
+inline constexpr std::uint32_t image_version = 5;
+
+struct image final
+{
+    bytecode code;
+    // the symbols of the global scope, for debugging
+    std::vector<symbol> symbols;
+};
+
+// Writes the main code, the constants including all compiled functions, and the global symbols. All numbers are
+// stored little endian.
+auto write_image(std::ostream& out, const bytecode& code, const symbol_table* symbols) -> void;
+
+// Throws std::runtime_error if the data is not an image of the current version or is truncated. The code itself
+// is left to the verifier of the vm.
+[[nodiscard]] auto read_image(std::span<const std::uint8_t> data) -> image;
+
+// Maps the file into memory where supported and reads the image from there, skipping `offset` bytes of a header
+// written in front of it.
+[[nodiscard]] auto load_image(std::string_view path, std::size_t offset = 0) -> image;
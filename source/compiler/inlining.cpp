@@ -0,0 +1,194 @@
+// Copyright 2023-2025 hrzlgnm
+// SPDX-License-Identifier: MIT-0
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "inlining.hpp"
+
+#include <ast/array_literal.hpp>
+#include <ast/assign_expression.hpp>
+#include <ast/binary_expression.hpp>
+#include <ast/call_expression.hpp>
+#include <ast/function_literal.hpp>
+#include <ast/hash_literal.hpp>
+#include <ast/identifier.hpp>
+#include <ast/if_expression.hpp>
+#include <ast/index_expression.hpp>
+#include <ast/program.hpp>
+#include <ast/statements.hpp>
+#include <ast/unary_expression.hpp>
+#include <ast/visitor.hpp>
+#include <doctest/doctest.h>
+#include <lexer/lexer.hpp>
+#include <parser/parser.hpp>
+
+namespace
+{
+// the most nodes a body may have, the parameters and the body statement included
+constexpr std::size_t max_inline_nodes = 24;
+
+struct assignment_collector final : tree_walker
+{
+    using tree_walker::visit;
+
+    void visit(const assign_expression& expr) override
+    {
+        names.insert(expr.name->value);
+        tree_walker::visit(expr);
+    }
+
+    name_set names;
+};
+
+struct body_checker final : tree_walker
+{
+    explicit body_checker(const function_literal& func)
+        : m_func {func}
+    {
+        m_nodes = 1 + func.parameters.size();
+    }
+
+    using tree_walker::visit;
+
+    void visit(const assign_expression& /*expr*/) override { inlinable = false; }
+
+    void visit(const break_statement& /*expr*/) override { inlinable = false; }
+
+    void visit(const continue_statement& /*expr*/) override { inlinable = false; }
+
+    void visit(const function_literal& /*expr*/) override { inlinable = false; }
+
+    void visit(const let_statement& /*expr*/) override { inlinable = false; }
+
+    void visit(const return_statement& /*expr*/) override { inlinable = false; }
+
+    void visit(const while_statement& /*expr*/) override { inlinable = false; }
+
+    void visit(const identifier& expr) override
+    {
+        tree_walker::visit(expr);
+        if (expr.value == m_func.name) {
+            inlinable = false;
+            return;
+        }
+        const auto is_parameter = std::ranges::any_of(m_func.parameters,
+                                                      [&](const auto* param) { return param->value == expr.value; });
+        if (!is_parameter && std::ranges::find(names, expr.value) == names.end()) {
+            names.push_back(expr.value);
+        }
+    }
+
+    [[nodiscard]] auto small_enough() const -> bool { return m_nodes <= max_inline_nodes; }
+
+    bool inlinable {true};
+    std::vector<std::string> names;
+
+  private:
+    const function_literal& m_func;
+};
+}  // namespace
+
+auto assigned_names(const program* prgrm) -> name_set
+{
+    assignment_collector collector;
+    prgrm->accept(collector);
+    return std::move(collector.names);
+}
+
+auto inlinable_body(const function_literal& func) -> std::optional<inline_body>
+{
+    const auto& statements = func.body->statements;
+    if (statements.size() > 1) {
+        return std::nullopt;
+    }
+    if (statements.empty()) {
+        return inline_body {};
+    }
+    const expression* value = nullptr;
+    if (const auto* stmt = dynamic_cast<const expression_statement*>(statements.front()); stmt != nullptr) {
+        value = stmt->expr;
+    } else if (const auto* ret = dynamic_cast<const return_statement*>(statements.front()); ret != nullptr) {
+        value = ret->value;
+    } else {
+        return std::nullopt;
+    }
+    body_checker checker {func};
+    value->accept(checker);
+    if (!checker.inlinable || !checker.small_enough()) {
+        return std::nullopt;
+    }
+    return inline_body {.value = value, .names = std::move(checker.names)};
+}
+
+namespace
+{
+// NOLINTBEGIN(*)
+struct parsed_function
+{
+    std::unique_ptr<program> prgrm;
+    std::optional<inline_body> body;
+};
+
+auto first_function(const std::string_view input) -> parsed_function
+{
+    auto prsr = parser {lexer {input}};
+    auto prgrm = prsr.parse_program();
+    REQUIRE(prsr.errors().empty());
+    const auto* let = dynamic_cast<const let_statement*>(prgrm->statements.front());
+    REQUIRE(let != nullptr);
+    auto body = inlinable_body(*dynamic_cast<const function_literal*>(let->value));
+    return {std::move(prgrm), std::move(body)};
+}
+
+TEST_SUITE("compiler")
+{
+    TEST_CASE("inlinableBodies")
+    {
+        const auto square = first_function("let sq = fn(x) { x * x }");
+        REQUIRE(square.body.has_value());
+        CHECK(square.body->names.empty());
+        CHECK_EQ(square.body->value->string(), "(x * x)");
+
+        const auto reads = first_function("let f = fn(x) { return len(x) + y + x + len(x); }");
+        REQUIRE(reads.body.has_value());
+        CHECK_EQ(reads.body->names, std::vector<std::string> {"len", "y"});
+
+        const auto empty = first_function("let f = fn() {}");
+        REQUIRE(empty.body.has_value());
+        CHECK_EQ(empty.body->value, nullptr);
+
+        CHECK(first_function("let f = fn(x) { if (x) { 1 } else { 2 } }").body.has_value());
+
+        for (const auto* input : {
+                 "let f = fn(x) { f(x) }",
+                 "let f = fn(x) { let y = x; y }",
+                 "let f = fn(x) { x = 1 }",
+                 "let f = fn(x) { fn() { x } }",
+                 "let f = fn(x) { if (x) { return 1; } }",
+                 "let f = fn(x) { x; x }",
+                 "let f = fn(x) { while (x) { x } }",
+                 "let f = fn(x) { [x, x, x, x, x, x, x, x, x, x, x, x, x, x, x, x, x, x, x, x, x, x] }",
+             })
+        {
+            INFO(input);
+            CHECK_FALSE(first_function(input).body.has_value());
+        }
+    }
+
+    TEST_CASE("assignedNames")
+    {
+        auto prsr = parser {lexer {"let a = 1; let f = fn() { b = a; while (true) { c = 2; } }; f();"}};
+        auto prgrm = prsr.parse_program();
+        REQUIRE(prsr.errors().empty());
+        CHECK_EQ(assigned_names(prgrm.get()), name_set {"b", "c"});
+    }
+}
+
+// NOLINTEND(*)
+}  // namespace
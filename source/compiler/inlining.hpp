@@ -0,0 +1,31 @@
+// Copyright 2023-2025 hrzlgnm
+// SPDX-License-Identifier: MIT-0
+
+#pragma once
+
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <ast/expression.hpp>
+#include <ast/function_literal.hpp>
+#include <ast/program.hpp>
+
+#include "tree_walker.hpp"
+
+// the names assigned to anywhere in the program, a binding of such a name may change after a call through it was
+// inlined
+[[nodiscard]] auto assigned_names(const program* prgrm) -> name_set;
+
+struct inline_body final
+{
+    // the value of the call, nullptr for an empty body, whose call results in null
+    const expression* value {};
+    // the names it reads besides the parameters, in the order of their first use
+    std::vector<std::string> names;
+};
+
+// The body of a function which is small enough to be substituted for a call to it: a single expression or return
+// statement without loops, definitions, assignments, returns or function literals in it, which does not refer to
+// the function itself.
+[[nodiscard]] auto inlinable_body(const function_literal& func) -> std::optional<inline_body>;
@@ -0,0 +1,512 @@
+// Copyright 2023-2025 hrzlgnm
+// SPDX-License-Identifier: MIT-0
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "register_lowering.hpp"
+
+#include <code/code.hpp>
+#include <code/register_code.hpp>
+#include <doctest/doctest.h>
+#include <fmt/format.h>
+
+namespace
+{
+constexpr std::size_t max_register_code_size = std::numeric_limits<std::uint16_t>::max();
+
+auto register_opcode_for(const opcodes opcode) -> register_opcodes
+{
+    // the register vm has no type specialized operators, its operators have inline caches instead
+    switch (generic_opcode(opcode)) {
+        case opcodes::add:
+            return register_opcodes::add;
+        case opcodes::sub:
+            return register_opcodes::sub;
+        case opcodes::mul:
+            return register_opcodes::mul;
+        case opcodes::div:
+            return register_opcodes::div;
+        case opcodes::floor_div:
+            return register_opcodes::floor_div;
+        case opcodes::mod:
+            return register_opcodes::mod;
+        case opcodes::bit_and:
+            return register_opcodes::bit_and;
+        case opcodes::bit_or:
+            return register_opcodes::bit_or;
+        case opcodes::bit_xor:
+            return register_opcodes::bit_xor;
+        case opcodes::bit_lsh:
+            return register_opcodes::bit_lsh;
+        case opcodes::bit_rsh:
+            return register_opcodes::bit_rsh;
+        case opcodes::logical_and:
+            return register_opcodes::logical_and;
+        case opcodes::logical_or:
+            return register_opcodes::logical_or;
+        case opcodes::equal:
+            return register_opcodes::equal;
+        case opcodes::not_equal:
+            return register_opcodes::not_equal;
+        case opcodes::greater_than:
+            return register_opcodes::greater_than;
+        case opcodes::greater_equal:
+            return register_opcodes::greater_equal;
+        case opcodes::minus:
+            return register_opcodes::minus;
+        case opcodes::bang:
+            return register_opcodes::bang;
+        default:
+            throw std::invalid_argument(fmt::format("no register form for opcode {}", opcode));
+    }
+}
+
+// Walks the stack code once, simulating the operand stack. Each stack entry is the operand that currently holds
+// its value: a local, a constant, or the temporary register of that stack position, its home. Entries that are
+// not yet home are moved there only when something needs them there, e.g. at control flow merges or calls.
+struct lowering final
+{
+    lowering(const instructions& code, const int num_locals, const bool is_main)
+        : m_code {code}
+        , m_num_locals {static_cast<std::size_t>(num_locals)}
+        , m_is_main {is_main}
+        , m_targets(code.size() + 1)
+        , m_offsets(code.size() + 1)
+        , m_max_registers {m_num_locals}
+    {
+    }
+
+    auto run() -> register_function
+    {
+        collect_jump_targets();
+        for (std::size_t ip = 0; ip < m_code.size(); ip += instruction_length(m_code, ip)) {
+            enter_label(ip);
+            if (m_reachable) {
+                lower(ip);
+            }
+        }
+        enter_label(m_code.size());
+        for (const auto& [position, target] : m_fixups) {
+            m_out.instrs[position] = m_offsets[target];
+        }
+        if (m_out.instrs.size() > max_register_code_size) {
+            throw std::runtime_error("function too large for the register format");
+        }
+        m_out.num_registers = static_cast<int>(m_max_registers);
+        return std::move(m_out);
+    }
+
+  private:
+    [[nodiscard]] auto operand(const std::size_t ip, const std::size_t idx) const -> std::uint16_t
+    {
+        const auto value = operand_at(m_code, ip, idx);
+        if (value > std::numeric_limits<std::uint16_t>::max()) {
+            throw std::runtime_error("operand too wide for the register format");
+        }
+        return static_cast<std::uint16_t>(value);
+    }
+
+    auto collect_jump_targets() -> void
+    {
+        for (std::size_t ip = 0; ip < m_code.size(); ip += instruction_length(m_code, ip)) {
+            const auto opcode = opcode_at(m_code, ip);
+            if (opcode == opcodes::jump || opcode == opcodes::jump_not_truthy) {
+                m_targets.at(operand(ip, 0)) = true;
+            }
+        }
+    }
+
+    [[nodiscard]] auto home(const std::size_t position) const -> std::uint16_t
+    {
+        const auto reg = m_num_locals + position;
+        if (reg >= constant_operand) {
+            throw std::runtime_error("too many registers required");
+        }
+        return static_cast<std::uint16_t>(reg);
+    }
+
+    auto emit(const register_opcodes opcode, const std::initializer_list<std::uint16_t> operands) -> std::size_t
+    {
+        const auto position = m_out.instrs.size();
+        m_out.instrs.push_back(static_cast<std::uint16_t>(opcode));
+        m_out.instrs.insert(m_out.instrs.end(), operands);
+        return position;
+    }
+
+    auto push(const std::uint16_t operand) -> void
+    {
+        m_stack.push_back(operand);
+        m_max_registers = std::max(m_max_registers, m_num_locals + m_stack.size());
+    }
+
+    auto push_temporary() -> std::uint16_t
+    {
+        const auto reg = home(m_stack.size());
+        push(reg);
+        return reg;
+    }
+
+    auto pop_operand() -> std::uint16_t
+    {
+        if (m_stack.empty()) {
+            throw std::runtime_error("stack underflow while lowering to registers");
+        }
+        const auto operand = m_stack.back();
+        m_stack.pop_back();
+        return operand;
+    }
+
+    auto materialize(const std::size_t position) -> void
+    {
+        if (const auto reg = home(position); m_stack[position] != reg) {
+            emit(register_opcodes::move, {reg, m_stack[position]});
+            m_stack[position] = reg;
+        }
+    }
+
+    auto materialize_top(const std::size_t count) -> void
+    {
+        if (count > m_stack.size()) {
+            throw std::runtime_error("stack underflow while lowering to registers");
+        }
+        for (auto position = m_stack.size() - count; position < m_stack.size(); ++position) {
+            materialize(position);
+        }
+    }
+
+    auto flush() -> void { materialize_top(m_stack.size()); }
+
+    // the entries still reading a local must see its value from before the store
+    auto flush_local(const std::uint16_t local) -> void
+    {
+        for (std::size_t position = 0; position < m_stack.size(); ++position) {
+            if (m_stack[position] == local) {
+                materialize(position);
+            }
+        }
+    }
+
+    auto record_depth(const std::size_t target) -> void
+    {
+        if (const auto [itr, inserted] = m_depths.try_emplace(target, m_stack.size());
+            !inserted && itr->second != m_stack.size())
+        {
+            throw std::runtime_error(fmt::format("inconsistent stack depth at offset {}", target));
+        }
+    }
+
+    auto enter_label(const std::size_t ip) -> void
+    {
+        if (!m_targets[ip]) {
+            return;
+        }
+        if (m_reachable) {
+            flush();
+            record_depth(ip);
+        } else if (const auto itr = m_depths.find(ip); itr != m_depths.end()) {
+            m_stack.clear();
+            for (std::size_t position = 0; position < itr->second; ++position) {
+                push(home(position));
+            }
+            m_reachable = true;
+        }
+        m_offsets[ip] = static_cast<std::uint16_t>(std::min(m_out.instrs.size(), max_register_code_size));
+    }
+
+    auto jump_to(const std::size_t target) -> void
+    {
+        record_depth(target);
+        m_fixups.emplace_back(m_out.instrs.size() - 1, target);
+    }
+
+    auto lower(const std::size_t ip) -> void
+    {
+        using enum opcodes;
+        switch (const auto opcode = opcode_at(m_code, ip)) {
+            case constant:
+            case constant_small: {
+                const auto const_idx = operand(ip, 0);
+                if (const_idx < constant_operand) {
+                    push(constant_operand | const_idx);
+                } else {
+                    const auto dst = push_temporary();
+                    emit(register_opcodes::load_constant, {dst, const_idx});
+                }
+            } break;
+            case add:
+            case sub:
+            case mul:
+            case div:
+            case floor_div:
+            case mod:
+            case bit_and:
+            case bit_or:
+            case bit_xor:
+            case bit_lsh:
+            case bit_rsh:
+            case logical_and:
+            case logical_or:
+            case equal:
+            case not_equal:
+            case greater_than:
+            case greater_equal:
+            case add_int:
+            case sub_int:
+            case mul_int:
+            case equal_int:
+            case not_equal_int:
+            case greater_than_int:
+            case greater_equal_int:
+            case add_dec:
+            case sub_dec:
+            case mul_dec:
+            case div_dec:
+            case greater_than_dec:
+            case greater_equal_dec: {
+                const auto right = pop_operand();
+                const auto left = pop_operand();
+                const auto dst = push_temporary();
+                emit(register_opcode_for(opcode), {dst, left, right});
+            } break;
+            case minus:
+            case bang: {
+                const auto right = pop_operand();
+                const auto dst = push_temporary();
+                emit(register_opcode_for(opcode), {dst, right});
+            } break;
+            case pop: {
+                const auto value = pop_operand();
+                if (m_is_main) {
+                    emit(register_opcodes::pop, {value});
+                }
+            } break;
+            case tru:
+                emit(register_opcodes::load_true, {push_temporary()});
+                break;
+            case fals:
+                emit(register_opcodes::load_false, {push_temporary()});
+                break;
+            case null:
+                emit(register_opcodes::load_null, {push_temporary()});
+                break;
+            case jump:
+                flush();
+                emit(register_opcodes::jump, {0});
+                jump_to(operand(ip, 0));
+                m_reachable = false;
+                break;
+            case jump_not_truthy: {
+                const auto condition = pop_operand();
+                flush();
+                emit(register_opcodes::jump_not_truthy, {condition, 0});
+                jump_to(operand(ip, 0));
+            } break;
+            case get_global: {
+                const auto dst = push_temporary();
+                emit(register_opcodes::get_global, {dst, operand(ip, 0)});
+            } break;
+            case set_global:
+                emit(register_opcodes::set_global, {operand(ip, 0), pop_operand()});
+                break;
+            case array:
+            case frame_array:
+            case hash: {
+                const auto count = operand(ip, 0);
+                materialize_top(count);
+                m_stack.resize(m_stack.size() - count);
+                const auto dst = push_temporary();
+                emit(opcode == hash ? register_opcodes::hash : register_opcodes::array, {dst, count});
+            } break;
+            case index: {
+                const auto right = pop_operand();
+                const auto left = pop_operand();
+                const auto dst = push_temporary();
+                emit(register_opcodes::index, {dst, left, right});
+            } break;
+            case call:
+            case tail_call: {
+                // the register vm does plain calls, the return_value after a tail call returns the result
+                // the callee may assign to our locals through set_outer, so nothing may still refer to them
+                const auto num_args = operand(ip, 0);
+                materialize_top(num_args + 1U);
+                flush();
+                m_stack.resize(m_stack.size() - num_args - 1U);
+                const auto dst = push_temporary();
+                emit(register_opcodes::call, {dst, num_args});
+            } break;
+            case brake:
+                emit(register_opcodes::brake, {});
+                m_reachable = false;
+                break;
+            case cont:
+                emit(register_opcodes::cont, {});
+                m_reachable = false;
+                break;
+            case return_value:
+                emit(register_opcodes::return_value, {pop_operand()});
+                m_reachable = false;
+                break;
+            case ret:
+                emit(register_opcodes::ret, {});
+                m_reachable = false;
+                break;
+            case get_local:
+                push(operand(ip, 0));
+                break;
+            case set_local: {
+                const auto local = operand(ip, 0);
+                const auto value = pop_operand();
+                flush_local(local);
+                if (value != local) {
+                    emit(register_opcodes::move, {local, value});
+                }
+            } break;
+            case get_free: {
+                const auto dst = push_temporary();
+                emit(register_opcodes::get_free, {dst, operand(ip, 0)});
+            } break;
+            case set_free:
+                emit(register_opcodes::set_free, {operand(ip, 0), pop_operand()});
+                break;
+            case get_outer: {
+                const auto dst = push_temporary();
+                emit(register_opcodes::get_outer, {dst, operand(ip, 0), operand(ip, 1), operand(ip, 2)});
+            } break;
+            case set_outer:
+                emit(register_opcodes::set_outer, {operand(ip, 0), operand(ip, 1), operand(ip, 2), pop_operand()});
+                break;
+            case get_builtin: {
+                const auto dst = push_temporary();
+                emit(register_opcodes::get_builtin, {dst, operand(ip, 0)});
+            } break;
+            // the register vm allocates every closure and array on the heap
+            case closure:
+            case frame_closure: {
+                const auto num_free = operand(ip, 1);
+                materialize_top(num_free);
+                m_stack.resize(m_stack.size() - num_free);
+                const auto dst = push_temporary();
+                emit(register_opcodes::closure, {dst, operand(ip, 0), num_free});
+            } break;
+            case current_closure:
+                emit(register_opcodes::current_closure, {push_temporary()});
+                break;
+            // the prefix is decoded along with the instruction it prefixes
+            case wide:
+                break;
+        }
+    }
+
+    const instructions& m_code;
+    std::size_t m_num_locals {};
+    bool m_is_main {};
+    std::vector<bool> m_targets;
+    std::vector<std::uint16_t> m_offsets;
+    std::unordered_map<std::size_t, std::size_t> m_depths;
+    std::vector<std::pair<std::size_t, std::size_t>> m_fixups;
+    std::vector<std::uint16_t> m_stack;
+    std::size_t m_max_registers {};
+    bool m_reachable {true};
+    register_function m_out;
+};
+}  // namespace
+
+auto lower_to_registers(const instructions& code, const int num_locals, const bool is_main) -> register_function
+{
+    return lowering {code, num_locals, is_main}.run();
+}
+
+namespace
+{
+// NOLINTBEGIN(*)
+TEST_SUITE("compiler")
+{
+    TEST_CASE("lowerFunctionToRegisters")
+    {
+        using enum opcodes;
+        // fn(a, b) { let c = a + 1; c * b }
+        const auto code = [] {
+            instructions result;
+            for (const auto& instr : {make(get_local, 0),
+                                      make(constant, 0),
+                                      make(add),
+                                      make(set_local, 2),
+                                      make(get_local, 2),
+                                      make(get_local, 1),
+                                      make(mul),
+                                      make(return_value)})
+            {
+                result.insert(result.end(), instr.begin(), instr.end());
+            }
+            return result;
+        }();
+        const auto lowered = lower_to_registers(code, 3, false);
+        CHECK_EQ(to_string(lowered.instrs), R"(0000 RAdd r3 r0 k0
+0004 RMove r2 r3
+0007 RMul r3 r2 r1
+0011 RReturnValue r3
+)");
+        CHECK_EQ(lowered.num_registers, 5);
+    }
+
+    TEST_CASE("lowerBranchesToRegisters")
+    {
+        using enum opcodes;
+        // if (true) { 1 } else { 2 }; at top level
+        const auto code = [] {
+            instructions result;
+            for (const auto& instr : {make(tru),
+                                      make(jump_not_truthy, 10),
+                                      make(constant, 0),
+                                      make(jump, 13),
+                                      make(constant, 1),
+                                      make(pop)})
+            {
+                result.insert(result.end(), instr.begin(), instr.end());
+            }
+            return result;
+        }();
+        const auto lowered = lower_to_registers(code, 0, true);
+        CHECK_EQ(to_string(lowered.instrs), R"(0000 RLoadTrue r0
+0002 RJumpNotTruthy r0 10
+0005 RMove r0 k0
+0008 RJump 13
+0010 RMove r0 k1
+0013 RPop r0
+)");
+        CHECK_EQ(lowered.num_registers, 1);
+    }
+
+    TEST_CASE("lowerLoadsBeforeStoresToTheSameLocal")
+    {
+        using enum opcodes;
+        // a + (a = 1) is not expressible in the language, but the lowering must not reorder the load of a
+        const auto code = [] {
+            instructions result;
+            for (const auto& instr :
+                 {make(get_local, 0), make(constant, 0), make(set_local, 0), make(get_local, 0), make(add), make(ret)})
+            {
+                result.insert(result.end(), instr.begin(), instr.end());
+            }
+            return result;
+        }();
+        const auto lowered = lower_to_registers(code, 1, false);
+        CHECK_EQ(to_string(lowered.instrs), R"(0000 RMove r1 r0
+0003 RMove r0 k0
+0006 RAdd r1 r1 r0
+0010 RReturn
+)");
+    }
+}
+
+// NOLINTEND(*)
+}  // namespace
@@ -0,0 +1,13 @@
+// Copyright 2023-2025 hrzlgnm
+// SPDX-License-Identifier: MIT-0
+
+#pragma once
+
+#include <code/code.hpp>
+#include <code/register_code.hpp>
+
+// Lowers the stack code of one function to the register format. Locals keep their slot as register number,
+// every stack position above them becomes a temporary register. Loads of locals and constants are not copied
+// into temporaries but folded into the operands of the instruction consuming them.
+// The main program is lowered with `is_main` set, so its pops keep track of the last popped value.
+[[nodiscard]] auto lower_to_registers(const instructions& code, int num_locals, bool is_main) -> register_function;
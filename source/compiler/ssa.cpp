@@ -0,0 +1,1945 @@
+// Copyright 2023-2025 hrzlgnm
+// SPDX-License-Identifier: MIT-0
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <compare>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <map>
+#include <numeric>
+#include <optional>
+#include <ranges>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "ssa.hpp"
+
+#include <builtin/builtin.hpp>
+#include <code/code.hpp>
+#include <doctest/doctest.h>
+#include <fmt/format.h>
+#include <fmt/ranges.h>
+#include <lexer/lexer.hpp>
+#include <object/object.hpp>
+#include <parser/parser.hpp>
+
+#include "compiler.hpp"
+#include "symbol_table.hpp"
+
+namespace
+{
+constexpr auto no_block = std::numeric_limits<std::size_t>::max();
+constexpr std::size_t max_local_slots = std::numeric_limits<std::uint8_t>::max() + 1UL;
+constexpr std::size_t max_global_slots = std::numeric_limits<std::uint16_t>::max() + 1UL;
+
+auto is_binary_operator(const opcodes opcode) -> bool
+{
+    using enum opcodes;
+    switch (generic_opcode(opcode)) {
+        case add:
+        case sub:
+        case mul:
+        case div:
+        case floor_div:
+        case mod:
+        case bit_and:
+        case bit_or:
+        case bit_xor:
+        case bit_lsh:
+        case bit_rsh:
+        case logical_and:
+        case logical_or:
+        case equal:
+        case not_equal:
+        case greater_than:
+        case greater_equal:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// cheap enough to be emitted again wherever the value is needed
+auto is_rematerializable(const opcodes opcode) -> bool
+{
+    using enum opcodes;
+    return opcode == constant || opcode == tru || opcode == fals || opcode == null || opcode == get_builtin
+        || opcode == current_closure;
+}
+
+// the result only depends on the arguments
+auto is_pure(const opcodes opcode) -> bool
+{
+    using enum opcodes;
+    return is_binary_operator(opcode) || opcode == minus || opcode == bang || opcode == index
+        || is_rematerializable(opcode);
+}
+
+// pure, but raises an error for some arguments
+auto may_fail(const opcodes opcode) -> bool
+{
+    return is_binary_operator(opcode) || opcode == opcodes::minus || opcode == opcodes::index;
+}
+
+// no side effect and no error, so it is dropped when its value is unused
+auto is_removable(const opcodes opcode) -> bool
+{
+    using enum opcodes;
+    return is_rematerializable(opcode) || opcode == closure || opcode == array || opcode == frame_closure
+        || opcode == frame_array || opcode == bang || opcode == get_local || opcode == get_free || opcode == get_outer;
+}
+
+// calls may run loop bodies, which assign the variables of the enclosing frames
+auto kills_memory(const opcodes opcode) -> bool
+{
+    return opcode == opcodes::call || opcode == opcodes::tail_call;
+}
+
+auto is_store(const opcodes opcode) -> bool
+{
+    using enum opcodes;
+    return opcode == set_local || opcode == set_global || opcode == set_free || opcode == set_outer;
+}
+
+auto ends_block(const opcodes opcode) -> bool
+{
+    using enum opcodes;
+    return opcode == jump || opcode == jump_not_truthy || opcode == brake || opcode == cont || opcode == return_value
+        || opcode == ret;
+}
+
+// a variable, named by the opcode loading it and its operands
+struct memory_slot final
+{
+    opcodes load {};
+    std::vector<std::size_t> immediates;
+
+    auto operator<=>(const memory_slot&) const = default;
+};
+
+auto slot_of(const ssa_instruction& instr) -> std::optional<memory_slot>
+{
+    using enum opcodes;
+    switch (instr.opcode) {
+        case get_local:
+        case set_local:
+            return memory_slot {.load = get_local, .immediates = instr.immediates};
+        case get_global:
+        case set_global:
+            return memory_slot {.load = get_global, .immediates = instr.immediates};
+        case get_free:
+        case set_free:
+            return memory_slot {.load = get_free, .immediates = instr.immediates};
+        case get_outer:
+        case set_outer:
+            return memory_slot {.load = get_outer, .immediates = instr.immediates};
+        default:
+            return std::nullopt;
+    }
+}
+
+struct value_key final
+{
+    opcodes opcode {};
+    std::vector<value_id> args;
+    std::vector<std::size_t> immediates;
+
+    auto operator<=>(const value_key&) const = default;
+};
+
+// what makes constants equal, nullopt for those which are only equal to themselves
+using constant_value = std::variant<std::monostate, std::int64_t, std::uint64_t, std::string>;
+
+auto value_of(const object* constant) -> std::optional<constant_value>
+{
+    if (constant->is_null()) {
+        return constant_value {};
+    }
+    switch (constant->type()) {
+        case object::object_type::integer:
+            return constant->as<integer_object>()->value;
+        case object::object_type::decimal:
+            return std::bit_cast<std::uint64_t>(constant->as<decimal_object>()->value);
+        case object::object_type::string:
+            return constant->as<string_object>()->value;
+        default:
+            return std::nullopt;
+    }
+}
+
+auto replace_uses(ssa_function& func, const value_id from, const value_id to) -> void
+{
+    for (const auto& block : func.blocks) {
+        for (const auto id : block.instrs) {
+            std::ranges::replace(func.values[id].args, from, to);
+        }
+    }
+}
+
+auto remove_instruction(ssa_function& func, const value_id id) -> void
+{
+    auto& instrs = func.blocks[func.values[id].block].instrs;
+    instrs.erase(std::ranges::find(instrs, id));
+}
+
+// The values replaced by others during a pass, whose uses are updated and which are removed all at once in the end,
+// since doing so for each of them takes time linear in the size of the function.
+class value_replacements final
+{
+  public:
+    explicit value_replacements(const ssa_function& func)
+        : m_replacement(func.values.size())
+    {
+        std::iota(m_replacement.begin(), m_replacement.end(), value_id {});
+    }
+
+    // the value which `id` stands for once the replacements are applied
+    [[nodiscard]] auto find(value_id id) const -> value_id
+    {
+        while (m_replacement[id] != id) {
+            id = m_replacement[id];
+        }
+        return id;
+    }
+
+    auto replace(const value_id from, const value_id to) -> void { m_replacement[from] = find(to); }
+
+    auto apply(ssa_function& func) const -> void
+    {
+        for (auto& block : func.blocks) {
+            std::erase_if(block.instrs, [this](const value_id id) { return m_replacement[id] != id; });
+            for (const auto id : block.instrs) {
+                for (auto& arg : func.values[id].args) {
+                    arg = find(arg);
+                }
+            }
+        }
+    }
+
+  private:
+    std::vector<value_id> m_replacement;
+};
+
+auto use_counts(const ssa_function& func) -> std::vector<std::size_t>
+{
+    std::vector<std::size_t> counts(func.values.size());
+    for (const auto& block : func.blocks) {
+        for (const auto id : block.instrs) {
+            for (const auto arg : func.values[id].args) {
+                counts[arg]++;
+            }
+        }
+    }
+    return counts;
+}
+
+auto remove_trivial_phis(ssa_function& func) -> bool
+{
+    auto changed = false;
+    for (auto again = true; again;) {
+        again = false;
+        for (auto& block : func.blocks) {
+            for (const auto id : std::vector {block.instrs}) {
+                const auto& phi = func.values[id];
+                if (!phi.is_phi) {
+                    continue;
+                }
+                std::optional<value_id> single;
+                auto trivial = true;
+                for (const auto arg : phi.args) {
+                    if (arg == id || arg == single) {
+                        continue;
+                    }
+                    if (single.has_value()) {
+                        trivial = false;
+                        break;
+                    }
+                    single = arg;
+                }
+                if (trivial && single.has_value()) {
+                    remove_instruction(func, id);
+                    replace_uses(func, id, *single);
+                    again = changed = true;
+                }
+            }
+        }
+    }
+    return changed;
+}
+
+// immediate dominators by the iterative algorithm of Cooper, Harvey and Kennedy, no_block for unreachable blocks
+auto immediate_dominators(const ssa_function& func) -> std::vector<std::size_t>
+{
+    std::vector<std::size_t> order;
+    std::vector<bool> visited(func.blocks.size());
+    const auto visit = [&](const auto& self, const std::size_t block) -> void
+    {
+        visited[block] = true;
+        for (const auto succ : func.blocks[block].succs) {
+            if (!visited[succ]) {
+                self(self, succ);
+            }
+        }
+        order.push_back(block);
+    };
+    visit(visit, 0);
+    std::ranges::reverse(order);
+    std::vector<std::size_t> rpo_index(func.blocks.size(), no_block);
+    for (std::size_t idx = 0; idx < order.size(); ++idx) {
+        rpo_index[order[idx]] = idx;
+    }
+    std::vector<std::size_t> idom(func.blocks.size(), no_block);
+    idom[0] = 0;
+    const auto intersect = [&](std::size_t lhs, std::size_t rhs)
+    {
+        while (lhs != rhs) {
+            while (rpo_index[lhs] > rpo_index[rhs]) {
+                lhs = idom[lhs];
+            }
+            while (rpo_index[rhs] > rpo_index[lhs]) {
+                rhs = idom[rhs];
+            }
+        }
+        return lhs;
+    };
+    for (auto changed = true; changed;) {
+        changed = false;
+        for (const auto block : order | std::views::drop(1)) {
+            auto new_idom = no_block;
+            for (const auto pred : func.blocks[block].preds) {
+                if (idom[pred] != no_block) {
+                    new_idom = new_idom == no_block ? pred : intersect(pred, new_idom);
+                }
+            }
+            if (idom[block] != new_idom) {
+                idom[block] = new_idom;
+                changed = true;
+            }
+        }
+    }
+    return idom;
+}
+
+auto dominates(const std::vector<std::size_t>& idom, const std::size_t dominator, std::size_t block) -> bool
+{
+    while (block != dominator && block != 0 && idom[block] != no_block) {
+        block = idom[block];
+    }
+    return block == dominator;
+}
+
+// whether running the function, or a function nested in it, may get hold of the closure it runs in
+auto refers_to_own_closure(const constants& consts, const compiled_function_object& func) -> bool
+{
+    using enum opcodes;
+    const auto& code = func.instrs;
+    for (std::size_t ip = 0; ip < code.size(); ip += instruction_length(code, ip)) {
+        const auto opcode = opcode_at(code, ip);
+        if (opcode == current_closure) {
+            return true;
+        }
+        const auto operands = operands_at(code, ip);
+        if (opcode == get_outer && static_cast<symbol_scope>(operands[1]) == symbol_scope::function) {
+            return true;
+        }
+        if ((opcode == closure || opcode == frame_closure)
+            && refers_to_own_closure(consts, *consts[operands.front()]->as<compiled_function_object>()))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+auto make_instruction(const opcodes opcode, const std::vector<std::size_t>& immediates) -> instructions
+{
+    return make(opcode, operands {immediates.begin(), immediates.end()});
+}
+
+// Turns the SSA form back into stack code. Values used once, by a later instruction of their block which finds
+// them on top of the stack, simply stay there. Constants and the like are emitted again at every use. A value
+// stored into a variable right away and only used afterwards within its block, while the variable still holds
+// it, is loaded from that variable. All other values, and phis, get a temporary, shared by values which are
+// never live at the same time.
+class stack_lowering final
+{
+  public:
+    stack_lowering(const ssa_function& func, const std::size_t first_temporary)
+        : m_func {func}
+        , m_first_temporary {first_temporary}
+        , m_uses(func.values.size())
+        , m_index(func.values.size())
+        , m_resident(func.values.size())
+        , m_home(func.values.size(), std::nullopt)
+        , m_temporary(func.values.size(), std::nullopt)
+        , m_labels(func.blocks.size())
+        , m_position(func.blocks.size())
+    {
+    }
+
+    auto run() -> std::optional<lowered_function>
+    {
+        collect_uses();
+        choose_residents();
+        if (!assign_temporaries()) {
+            return std::nullopt;
+        }
+        lay_out_blocks();
+        for (const auto block : m_layout) {
+            emit_block(block);
+        }
+        // the jumps are written in the short form
+        if (m_out.size() > std::numeric_limits<std::uint16_t>::max()) {
+            return std::nullopt;
+        }
+        for (const auto& [position, block] : m_fixups) {
+            write_uint16(m_out, position, static_cast<std::uint16_t>(m_labels[block]));
+        }
+        return lowered_function {.instrs = std::move(m_out), .num_temporaries = static_cast<int>(m_num_temporaries)};
+    }
+
+  private:
+    [[nodiscard]] auto value(const value_id id) const -> const ssa_instruction& { return m_func.values[id]; }
+
+    auto collect_uses() -> void
+    {
+        for (const auto& block : m_func.blocks) {
+            for (std::size_t position = 0; position < block.instrs.size(); ++position) {
+                const auto id = block.instrs[position];
+                m_index[id] = position;
+                for (const auto arg : value(id).args) {
+                    m_uses[arg].push_back(id);
+                }
+            }
+        }
+    }
+
+    [[nodiscard]] auto position_in_block(const value_id id) const -> std::size_t { return m_index[id]; }
+
+    // the store right after the definition of `id`, if every other use of `id` can load it from that variable
+    [[nodiscard]] auto find_home(const value_id id) const -> std::optional<value_id>
+    {
+        const auto& instr = value(id);
+        const auto& instrs = m_func.blocks[instr.block].instrs;
+        const auto position = position_in_block(id);
+        if (position + 1 >= instrs.size()) {
+            return std::nullopt;
+        }
+        const auto store = instrs[position + 1];
+        const auto& store_instr = value(store);
+        const auto storable = store_instr.opcode == opcodes::set_local || store_instr.opcode == opcodes::set_global;
+        if (!storable || store_instr.args.front() != id
+            || std::ranges::count(m_uses[id], store) != 1)
+        {
+            return std::nullopt;
+        }
+        const auto slot = slot_of(store_instr);
+        for (const auto user : m_uses[id]) {
+            if (user == store) {
+                continue;
+            }
+            if (value(user).is_phi || value(user).block != instr.block) {
+                return std::nullopt;
+            }
+            const auto user_position = position_in_block(user);
+            if (user_position <= position + 1) {
+                return std::nullopt;
+            }
+            for (auto between = position + 2; between < user_position; ++between) {
+                const auto& other = value(instrs[between]);
+                if (kills_memory(other.opcode) || (is_store(other.opcode) && slot_of(other) == slot)) {
+                    return std::nullopt;
+                }
+            }
+        }
+        return store;
+    }
+
+    // whether `arg` is on top of the stack for `user` rather than loaded for it
+    [[nodiscard]] auto on_stack_for(const value_id arg, const value_id user) const -> bool
+    {
+        return m_resident[arg] || (m_home[arg].has_value() && *m_home[arg] == user);
+    }
+
+    auto choose_residents() -> void
+    {
+        for (const auto& block : m_func.blocks) {
+            for (const auto id : block.instrs) {
+                const auto& instr = value(id);
+                if (instr.is_phi || !instr.has_result) {
+                    continue;
+                }
+                const auto& users = m_uses[id];
+                if (users.size() == 1 && !value(users.front()).is_phi && value(users.front()).block == instr.block) {
+                    m_resident[id] = true;
+                } else if (users.size() > 1 && !is_rematerializable(instr.opcode)) {
+                    m_home[id] = find_home(id);
+                }
+            }
+        }
+        for (auto settled = false; !settled;) {
+            settled = true;
+            for (const auto& block : m_func.blocks) {
+                if (!simulate(block)) {
+                    settled = false;
+                }
+            }
+        }
+    }
+
+    auto demote(const value_id id) -> void
+    {
+        m_resident[id] = false;
+        m_home[id] = std::nullopt;
+    }
+
+    // checks that every value kept on the stack is found on top of it when needed, demotes those which are not
+    auto simulate(const ssa_block& block) -> bool
+    {
+        auto settled = true;
+        std::vector<value_id> stack;
+        for (const auto id : block.instrs) {
+            const auto& instr = value(id);
+            if (instr.is_phi || skipped(id)) {
+                continue;
+            }
+            std::size_t count = 0;
+            while (count < instr.args.size() && on_stack_for(instr.args[count], id)) {
+                count++;
+            }
+            auto valid = count <= stack.size()
+                && std::equal(instr.args.begin(),
+                              instr.args.begin() + static_cast<std::ptrdiff_t>(count),
+                              stack.end() - static_cast<std::ptrdiff_t>(std::min(count, stack.size())));
+            for (auto idx = count; idx < instr.args.size(); ++idx) {
+                valid = valid && !on_stack_for(instr.args[idx], id);
+            }
+            // the demoted values are no longer pushed where they are defined, the values above them are unaffected
+            if (!valid) {
+                std::set<value_id> demoted;
+                for (const auto arg : instr.args) {
+                    if (on_stack_for(arg, id)) {
+                        demoted.insert(arg);
+                        demote(arg);
+                    }
+                }
+                std::erase_if(stack, [&](const value_id other) { return demoted.contains(other); });
+                settled = false;
+                count = 0;
+            }
+            stack.resize(stack.size() - count);
+            if (instr.has_result && (m_resident[id] || m_home[id].has_value())) {
+                stack.push_back(id);
+            }
+        }
+        for (const auto id : stack) {
+            demote(id);
+        }
+        return settled && stack.empty();
+    }
+
+    // rematerializable values which are not kept on the stack are only emitted where they are used
+    [[nodiscard]] auto skipped(const value_id id) const -> bool
+    {
+        return is_rematerializable(value(id).opcode) && !m_resident[id];
+    }
+
+    [[nodiscard]] auto needs_temporary(const value_id id) const -> bool
+    {
+        const auto& instr = value(id);
+        if (!instr.has_result || m_uses[id].empty()) {
+            return false;
+        }
+        return instr.is_phi || (!m_resident[id] && !m_home[id].has_value() && !is_rematerializable(instr.opcode));
+    }
+
+    // the values of the phis of `succ`, as seen from its predecessor `block`
+    [[nodiscard]] auto phi_inputs(const std::size_t block, const std::size_t succ) const
+        -> std::vector<std::pair<value_id, value_id>>
+    {
+        const auto& succ_block = m_func.blocks[succ];
+        const auto pred_index = static_cast<std::size_t>(std::ranges::find(succ_block.preds, block)
+                                                         - succ_block.preds.begin());
+        std::vector<std::pair<value_id, value_id>> result;
+        for (const auto id : succ_block.instrs) {
+            if (value(id).is_phi && needs_temporary(id)) {
+                result.emplace_back(id, value(id).args[pred_index]);
+            }
+        }
+        return result;
+    }
+
+    // The fall through successor of a block follows it once the blocks jumping forward to it are placed, otherwise
+    // the first block left does, so that only the jumps to loop headers go backwards.
+    auto lay_out_blocks() -> void
+    {
+        const auto num_blocks = m_func.blocks.size();
+        std::vector<bool> placed(num_blocks);
+        const auto ready = [&](const std::size_t block)
+        {
+            return !placed[block]
+                && std::ranges::all_of(m_func.blocks[block].preds,
+                                       [&](const std::size_t pred) { return pred >= block || placed[pred]; });
+        };
+        for (auto block = std::size_t {0}; block != no_block;) {
+            placed[block] = true;
+            m_position[block] = m_layout.size();
+            m_layout.push_back(block);
+            const auto& succs = m_func.blocks[block].succs;
+            if (!succs.empty() && ready(succs.front())) {
+                block = succs.front();
+                continue;
+            }
+            block = no_block;
+            for (std::size_t next = 0; next < num_blocks; ++next) {
+                if (m_func.blocks[next].reachable && !placed[next]) {
+                    block = next;
+                    break;
+                }
+            }
+        }
+    }
+
+    // liveness of the values in temporaries, and a greedy coloring of their interference graph
+    auto assign_temporaries() -> bool
+    {
+        const auto num_blocks = m_func.blocks.size();
+        std::vector<std::set<value_id>> live_in(num_blocks);
+        std::map<value_id, std::set<value_id>> interference;
+        const auto scan = [&](const std::size_t block, std::set<value_id> live, const bool record)
+        {
+            std::set<value_id> copies_defined;
+            std::set<value_id> copies_used;
+            for (const auto succ : m_func.blocks[block].succs) {
+                for (const auto& [phi, input] : phi_inputs(block, succ)) {
+                    copies_defined.insert(phi);
+                    if (needs_temporary(input)) {
+                        copies_used.insert(input);
+                    }
+                }
+            }
+            const auto define = [&](const value_id def)
+            {
+                if (record) {
+                    interference[def];
+                    for (const auto other : live) {
+                        if (other != def) {
+                            interference[def].insert(other);
+                            interference[other].insert(def);
+                        }
+                    }
+                }
+            };
+            for (const auto phi : copies_defined) {
+                define(phi);
+                for (const auto other : copies_defined) {
+                    if (record && other != phi) {
+                        interference[phi].insert(other);
+                    }
+                }
+            }
+            for (const auto phi : copies_defined) {
+                live.erase(phi);
+            }
+            live.insert(copies_used.begin(), copies_used.end());
+            const auto& instrs = m_func.blocks[block].instrs;
+            for (auto itr = instrs.rbegin(); itr != instrs.rend(); ++itr) {
+                const auto& instr = value(*itr);
+                if (instr.is_phi) {
+                    continue;
+                }
+                if (needs_temporary(*itr)) {
+                    define(*itr);
+                    live.erase(*itr);
+                }
+                for (const auto arg : instr.args) {
+                    if (needs_temporary(arg) && !on_stack_for(arg, *itr)) {
+                        live.insert(arg);
+                    }
+                }
+            }
+            return live;
+        };
+        const auto live_out = [&](const std::size_t block)
+        {
+            std::set<value_id> live;
+            for (const auto succ : m_func.blocks[block].succs) {
+                live.insert(live_in[succ].begin(), live_in[succ].end());
+            }
+            return live;
+        };
+        for (auto changed = true; changed;) {
+            changed = false;
+            for (auto block = num_blocks; block-- > 0;) {
+                if (!m_func.blocks[block].reachable) {
+                    continue;
+                }
+                auto live = scan(block, live_out(block), false);
+                if (live != live_in[block]) {
+                    live_in[block] = std::move(live);
+                    changed = true;
+                }
+            }
+        }
+        for (std::size_t block = 0; block < num_blocks; ++block) {
+            if (m_func.blocks[block].reachable) {
+                scan(block, live_out(block), true);
+            }
+        }
+        for (const auto& [id, neighbours] : interference) {
+            std::size_t color = 0;
+            while (std::ranges::any_of(neighbours,
+                                       [&](const value_id other) { return m_temporary[other] == color; }))
+            {
+                color++;
+            }
+            m_temporary[id] = color;
+            m_num_temporaries = std::max(m_num_temporaries, color + 1);
+        }
+        const auto limit = m_func.is_main ? max_global_slots : max_local_slots;
+        const auto base = m_func.is_main ? m_first_temporary : static_cast<std::size_t>(m_func.num_locals);
+        return base + m_num_temporaries <= limit;
+    }
+
+    auto emit(const opcodes opcode, const std::vector<std::size_t>& immediates = {}) -> void
+    {
+        const auto instr = make_instruction(opcode, immediates);
+        m_out.insert(m_out.end(), instr.begin(), instr.end());
+    }
+
+    auto emit_jump(const opcodes opcode, const std::size_t block) -> void
+    {
+        emit(opcode, {0});
+        m_fixups.emplace_back(m_out.size() - 2, block);
+    }
+
+    [[nodiscard]] auto temporary_slot(const value_id id) const -> std::size_t
+    {
+        return *m_temporary[id] + (m_func.is_main ? m_first_temporary : static_cast<std::size_t>(m_func.num_locals));
+    }
+
+    auto emit_load(const value_id id) -> void
+    {
+        const auto& instr = value(id);
+        if (m_home[id].has_value()) {
+            const auto& store = value(*m_home[id]);
+            emit(store.opcode == opcodes::set_local ? opcodes::get_local : opcodes::get_global, store.immediates);
+        } else if (is_rematerializable(instr.opcode) && !instr.is_phi) {
+            emit(instr.opcode, instr.immediates);
+        } else {
+            emit(m_func.is_main ? opcodes::get_global : opcodes::get_local, {temporary_slot(id)});
+        }
+    }
+
+    auto emit_store(const value_id id) -> void
+    {
+        emit(m_func.is_main ? opcodes::set_global : opcodes::set_local, {temporary_slot(id)});
+    }
+
+    // the phi inputs which are not already in the temporary of their phi
+    [[nodiscard]] auto copies(const std::size_t block, const std::size_t succ) const
+        -> std::vector<std::pair<value_id, value_id>>
+    {
+        auto inputs = phi_inputs(block, succ);
+        std::erase_if(inputs,
+                      [&](const auto& copy)
+                      { return needs_temporary(copy.second) && m_temporary[copy.second] == m_temporary[copy.first]; });
+        return inputs;
+    }
+
+    // all inputs are loaded before any phi is stored, as inputs may be phis of the same block
+    auto emit_copies(const std::size_t block, const std::size_t succ) -> void
+    {
+        const auto inputs = copies(block, succ);
+        for (const auto& [phi, input] : inputs) {
+            emit_load(input);
+        }
+        for (auto itr = inputs.rbegin(); itr != inputs.rend(); ++itr) {
+            emit_store(itr->first);
+        }
+    }
+
+    [[nodiscard]] auto next_block(const std::size_t block) const -> std::size_t
+    {
+        const auto next = m_position[block] + 1;
+        return next < m_layout.size() ? m_layout[next] : no_block;
+    }
+
+    auto emit_goto(const std::size_t block, const std::size_t succ) -> void
+    {
+        emit_copies(block, succ);
+        if (succ != next_block(block)) {
+            emit_jump(opcodes::jump, succ);
+        }
+    }
+
+    auto emit_block(const std::size_t block) -> void
+    {
+        using enum opcodes;
+        m_labels[block] = m_out.size();
+        const auto& current = m_func.blocks[block];
+        auto terminated = false;
+        for (const auto id : current.instrs) {
+            const auto& instr = value(id);
+            if (instr.is_phi || skipped(id)) {
+                continue;
+            }
+            for (const auto arg : instr.args) {
+                if (!on_stack_for(arg, id)) {
+                    emit_load(arg);
+                }
+            }
+            switch (instr.opcode) {
+                case jump:
+                    emit_goto(block, current.succs.front());
+                    terminated = true;
+                    break;
+                case jump_not_truthy:
+                    terminated = true;
+                    if (current.succs.size() == 1) {
+                        emit(pop);
+                        emit_goto(block, current.succs.front());
+                    } else if (copies(block, current.succs[1]).empty()) {
+                        emit_jump(jump_not_truthy, current.succs[1]);
+                        emit_goto(block, current.succs[0]);
+                    } else {
+                        // the copies of the taken branch go between the two successors
+                        const auto branch = m_out.size();
+                        emit(jump_not_truthy, {0});
+                        emit_goto(block, current.succs[0]);
+                        if (next_block(block) == current.succs[0]) {
+                            emit_jump(jump, current.succs[0]);
+                        }
+                        write_uint16(m_out, branch + 1, static_cast<std::uint16_t>(m_out.size()));
+                        emit_copies(block, current.succs[1]);
+                        emit_jump(jump, current.succs[1]);
+                    }
+                    break;
+                default:
+                    emit(instr.opcode, instr.immediates);
+                    terminated = ends_block(instr.opcode);
+                    if (!instr.has_result || m_resident[id] || m_home[id].has_value()) {
+                        break;
+                    }
+                    if (needs_temporary(id)) {
+                        emit_store(id);
+                    } else {
+                        emit(pop);
+                    }
+                    break;
+            }
+        }
+        if (!terminated && !current.succs.empty()) {
+            emit_goto(block, current.succs.front());
+        }
+    }
+
+    const ssa_function& m_func;
+    std::size_t m_first_temporary {};
+    std::vector<std::vector<value_id>> m_uses;
+    std::vector<std::size_t> m_index;
+    std::vector<bool> m_resident;
+    std::vector<std::optional<value_id>> m_home;
+    std::vector<std::optional<std::size_t>> m_temporary;
+    std::size_t m_num_temporaries {};
+    std::vector<std::size_t> m_labels;
+    std::vector<std::size_t> m_layout;
+    std::vector<std::size_t> m_position;
+    std::vector<std::pair<std::size_t, std::size_t>> m_fixups;
+    instructions m_out;
+};
+}  // namespace
+
+auto build_ssa(const instructions& code, const int num_locals, const bool is_main, const constants* consts)
+    -> ssa_function
+{
+    using enum opcodes;
+    ssa_function func {.values = {}, .blocks = {}, .num_locals = num_locals, .is_main = is_main, .consts = consts};
+
+    std::vector<bool> leaders(code.size() + 1);
+    std::vector<bool> targets(code.size() + 1);
+    leaders[0] = true;
+    for (std::size_t ip = 0; ip < code.size(); ip += instruction_length(code, ip)) {
+        const auto opcode = opcode_at(code, ip);
+        if (opcode == jump || opcode == jump_not_truthy) {
+            const auto target = operands_at(code, ip).front();
+            leaders.at(target) = targets.at(target) = true;
+        }
+        if (ends_block(opcode)) {
+            leaders[ip + instruction_length(code, ip)] = true;
+        }
+    }
+    // the end of the code only is a block if something jumps there
+    leaders[code.size()] = targets[code.size()];
+    std::vector<std::size_t> starts;
+    std::vector<std::size_t> block_at(code.size() + 1, no_block);
+    for (std::size_t ip = 0; ip <= code.size(); ++ip) {
+        if (leaders[ip] && (ip < code.size() || targets[ip] || ip == 0)) {
+            block_at[ip] = starts.size();
+            starts.push_back(ip);
+        }
+    }
+    const auto block_end = [&](const std::size_t block)
+    { return block + 1 < starts.size() ? starts[block + 1] : code.size(); };
+    func.blocks.resize(starts.size());
+    for (std::size_t block = 0; block < starts.size(); ++block) {
+        auto last = no_block;
+        for (auto ip = starts[block]; ip < block_end(block); ip += instruction_length(code, ip)) {
+            last = ip;
+        }
+        auto& succs = func.blocks[block].succs;
+        const auto opcode = last == no_block ? null : opcode_at(code, last);
+        if (last != no_block && (opcode == jump || opcode == jump_not_truthy)) {
+            const auto target = block_at[operands_at(code, last).front()];
+            if (opcode == jump_not_truthy && block + 1 != target) {
+                succs.push_back(block + 1);
+            }
+            succs.push_back(target);
+        } else if ((last == no_block || !ends_block(opcode)) && block + 1 < starts.size()) {
+            succs.push_back(block + 1);
+        }
+    }
+    const auto mark = [&](const auto& self, const std::size_t block) -> void
+    {
+        func.blocks[block].reachable = true;
+        for (const auto succ : func.blocks[block].succs) {
+            if (!func.blocks[succ].reachable) {
+                self(self, succ);
+            }
+        }
+    };
+    mark(mark, 0);
+    for (std::size_t block = 0; block < func.blocks.size(); ++block) {
+        if (!func.blocks[block].reachable) {
+            func.blocks[block].succs.clear();
+        }
+        for (const auto succ : func.blocks[block].succs) {
+            func.blocks[succ].preds.push_back(block);
+        }
+    }
+
+    std::map<constant_value, std::size_t> first_equal;
+    std::vector<std::vector<value_id>> exit_stacks(func.blocks.size());
+    const auto add_value = [&](ssa_instruction instr) -> value_id
+    {
+        const auto id = static_cast<value_id>(func.values.size());
+        func.blocks[instr.block].instrs.push_back(id);
+        func.values.push_back(std::move(instr));
+        return id;
+    };
+    for (std::size_t block = 0; block < func.blocks.size(); ++block) {
+        auto& current = func.blocks[block];
+        if (!current.reachable) {
+            continue;
+        }
+        std::vector<value_id> stack;
+        if (current.preds.size() == 1 && current.preds.front() < block) {
+            stack = exit_stacks[current.preds.front()];
+        } else if (block != 0 && starts[block] < code.size()) {
+            const auto pred = std::ranges::find_if(current.preds, [block](const auto prd) { return prd < block; });
+            if (pred == current.preds.end()) {
+                throw std::runtime_error(fmt::format("unstructured control flow at offset {}", starts[block]));
+            }
+            for (std::size_t slot = 0; slot < exit_stacks[*pred].size(); ++slot) {
+                stack.push_back(add_value({
+                    .opcode = null,
+                    .is_phi = true,
+                    .has_result = true,
+                    .args = {},
+                    .immediates = {},
+                    .block = block,
+                }));
+            }
+        }
+        for (auto ip = starts[block]; ip < block_end(block); ip += instruction_length(code, ip)) {
+            // the short form of a constant is only chosen when encoding
+            const auto opcode = opcode_at(code, ip) == constant_small ? constant : opcode_at(code, ip);
+            const auto use = stack_use_at(code, ip);
+            ssa_instruction instr {
+                .opcode = opcode,
+                .is_phi = false,
+                .has_result = use.pushes == 1,
+                .args = {},
+                .immediates = {},
+                .block = block,
+            };
+            instr.args.assign(stack.end() - static_cast<std::ptrdiff_t>(use.pops), stack.end());
+            stack.resize(stack.size() - use.pops);
+            if (opcode != jump && opcode != jump_not_truthy) {
+                instr.immediates = operands_at(code, ip);
+            }
+            // equal constants of the function share the index of the first one, so that their values are numbered alike
+            if (opcode == constant && consts != nullptr) {
+                auto& idx = instr.immediates.front();
+                if (const auto value = value_of((*consts)[idx]); value.has_value()) {
+                    idx = first_equal.try_emplace(*value, idx).first->second;
+                }
+            }
+            const auto id = add_value(std::move(instr));
+            if (func.values[id].has_result) {
+                stack.push_back(id);
+            }
+        }
+        exit_stacks[block] = std::move(stack);
+    }
+    for (auto& current : func.blocks) {
+        for (const auto id : current.instrs) {
+            auto& phi = func.values[id];
+            if (!phi.is_phi) {
+                continue;
+            }
+            const auto slot = static_cast<std::size_t>(std::ranges::find(current.instrs, id) - current.instrs.begin());
+            for (const auto pred : current.preds) {
+                if (slot >= exit_stacks[pred].size()) {
+                    throw std::runtime_error("inconsistent stack depth at a merge");
+                }
+                phi.args.push_back(exit_stacks[pred][slot]);
+            }
+        }
+    }
+    remove_trivial_phis(func);
+    return func;
+}
+
+auto propagate_copies(ssa_function& func) -> bool
+{
+    auto changed = remove_trivial_phis(func);
+    value_replacements replaced {func};
+    for (auto& block : func.blocks) {
+        std::map<memory_slot, value_id> known;
+        for (const auto id : block.instrs) {
+            const auto& instr = func.values[id];
+            if (kills_memory(instr.opcode)) {
+                known.clear();
+            }
+            const auto slot = slot_of(instr);
+            if (!slot.has_value()) {
+                continue;
+            }
+            if (is_store(instr.opcode)) {
+                known[*slot] = replaced.find(instr.args.front());
+            } else if (const auto itr = known.find(*slot); itr != known.end()) {
+                replaced.replace(id, itr->second);
+                changed = true;
+            }
+        }
+    }
+    replaced.apply(func);
+    return changed;
+}
+
+auto number_values(ssa_function& func) -> bool
+{
+    const auto idom = immediate_dominators(func);
+    std::vector<std::vector<std::size_t>> children(func.blocks.size());
+    for (std::size_t block = 1; block < func.blocks.size(); ++block) {
+        if (idom[block] != no_block) {
+            children[idom[block]].push_back(block);
+        }
+    }
+    auto changed = false;
+    std::map<value_key, value_id> available;
+    value_replacements replaced {func};
+    const auto visit = [&](const auto& self, const std::size_t block) -> void
+    {
+        std::vector<value_key> inserted;
+        std::map<memory_slot, value_id> loaded;
+        for (const auto id : func.blocks[block].instrs) {
+            auto& instr = func.values[id];
+            if (instr.is_phi) {
+                continue;
+            }
+            // the arguments are defined in dominating blocks, which were visited already
+            for (auto& arg : instr.args) {
+                arg = replaced.find(arg);
+            }
+            if (kills_memory(instr.opcode)) {
+                loaded.clear();
+            }
+            if (const auto slot = slot_of(instr); slot.has_value()) {
+                if (is_store(instr.opcode)) {
+                    loaded[*slot] = instr.args.front();
+                } else if (const auto [itr, fresh] = loaded.try_emplace(*slot, id); !fresh) {
+                    replaced.replace(id, itr->second);
+                    changed = true;
+                }
+                continue;
+            }
+            if (!is_pure(instr.opcode) || !instr.has_result) {
+                continue;
+            }
+            auto key = value_key {.opcode = instr.opcode, .args = instr.args, .immediates = instr.immediates};
+            if (const auto [itr, fresh] = available.try_emplace(key, id); !fresh) {
+                replaced.replace(id, itr->second);
+                changed = true;
+            } else {
+                inserted.push_back(std::move(key));
+            }
+        }
+        for (const auto child : children[block]) {
+            self(self, child);
+        }
+        for (const auto& key : inserted) {
+            available.erase(key);
+        }
+    };
+    visit(visit, 0);
+    replaced.apply(func);
+    return changed;
+}
+
+auto hoist_loop_invariants(ssa_function& func) -> bool
+{
+    const auto idom = immediate_dominators(func);
+    auto changed = false;
+    for (std::size_t latch = 0; latch < func.blocks.size(); ++latch) {
+        for (const auto header : func.blocks[latch].succs) {
+            if (header > latch || !dominates(idom, header, latch)) {
+                continue;
+            }
+            std::set<std::size_t> loop {header};
+            std::vector<std::size_t> work {latch};
+            while (!work.empty()) {
+                const auto block = work.back();
+                work.pop_back();
+                if (loop.insert(block).second) {
+                    work.insert(work.end(), func.blocks[block].preds.begin(), func.blocks[block].preds.end());
+                }
+            }
+            std::vector<std::size_t> entries;
+            std::ranges::copy_if(
+                func.blocks[header].preds, std::back_inserter(entries), [&](auto pred) { return !loop.contains(pred); });
+            if (entries.size() != 1 || func.blocks[entries.front()].succs.size() != 1) {
+                continue;
+            }
+            auto& preheader = func.blocks[entries.front()];
+            auto seen_effect = false;
+            for (const auto id : std::vector {func.blocks[header].instrs}) {
+                auto& instr = func.values[id];
+                if (instr.is_phi) {
+                    continue;
+                }
+                const auto invariant = std::ranges::none_of(
+                    instr.args, [&](const value_id arg) { return loop.contains(func.values[arg].block); });
+                if (is_pure(instr.opcode) && instr.has_result && invariant
+                    && (!may_fail(instr.opcode) || !seen_effect))
+                {
+                    remove_instruction(func, id);
+                    const auto has_jump =
+                        !preheader.instrs.empty() && func.values[preheader.instrs.back()].opcode == opcodes::jump;
+                    preheader.instrs.insert(preheader.instrs.end() - (has_jump ? 1 : 0), id);
+                    instr.block = entries.front();
+                    changed = true;
+                } else if (!is_removable(instr.opcode)) {
+                    seen_effect = true;
+                }
+            }
+        }
+    }
+    return changed;
+}
+
+auto eliminate_dead_code(ssa_function& func) -> bool
+{
+    auto changed = false;
+    for (auto again = true; again;) {
+        again = false;
+        const auto counts = use_counts(func);
+        for (auto& block : func.blocks) {
+            for (const auto id : std::vector {block.instrs}) {
+                const auto& instr = func.values[id];
+                const auto unused = instr.has_result && counts[id] == 0
+                    && (instr.is_phi || is_removable(instr.opcode));
+                // the main program keeps its pops, the last one is the result of the program. Popping a phi, as
+                // after an if whose value is unused, leaves the values it merges to their blocks.
+                const auto useless_pop = instr.opcode == opcodes::pop && !func.is_main
+                    && (is_removable(func.values[instr.args.front()].opcode) || func.values[instr.args.front()].is_phi);
+                if (unused || useless_pop) {
+                    remove_instruction(func, id);
+                    again = changed = true;
+                }
+            }
+        }
+    }
+    return changed;
+}
+
+namespace
+{
+// drops the negation of a condition used by nothing else by swapping the successors
+auto invert_negated_branches(ssa_function& func) -> bool
+{
+    auto changed = false;
+    const auto counts = use_counts(func);
+    for (auto& block : func.blocks) {
+        if (block.instrs.empty() || block.succs.size() != 2) {
+            continue;
+        }
+        auto& branch = func.values[block.instrs.back()];
+        const auto condition = branch.args.front();
+        if (func.values[condition].opcode != opcodes::bang || func.values[condition].is_phi
+            || counts[condition] != 1)
+        {
+            continue;
+        }
+        branch.args.front() = func.values[condition].args.front();
+        remove_instruction(func, condition);
+        std::swap(block.succs[0], block.succs[1]);
+        changed = true;
+    }
+    return changed;
+}
+
+// Whether `block` only passes control on to its single successor, with phis used by nothing but the phis of the
+// successor for the edge from `block`, which then can take its predecessors.
+auto is_forwarder(const ssa_function& func, const std::size_t block, const std::vector<std::size_t>& counts) -> bool
+{
+    const auto& current = func.blocks[block];
+    if (block == 0 || !current.reachable || current.succs.size() != 1 || current.succs.front() == block) {
+        return false;
+    }
+    const auto& succ = func.blocks[current.succs.front()];
+    const auto joins_succ = [&](const std::size_t pred)
+    { return pred == current.succs.front() || std::ranges::find(succ.preds, pred) != succ.preds.end(); };
+    if (std::ranges::any_of(current.preds, joins_succ)) {
+        return false;
+    }
+    const auto edge = static_cast<std::size_t>(std::ranges::find(succ.preds, block) - succ.preds.begin());
+    std::map<value_id, std::size_t> merged;
+    for (const auto id : succ.instrs) {
+        if (func.values[id].is_phi) {
+            merged[func.values[id].args[edge]]++;
+        }
+    }
+    return std::ranges::all_of(current.instrs,
+                               [&](const value_id id)
+                               {
+                                   const auto& instr = func.values[id];
+                                   return instr.opcode == opcodes::jump
+                                       || (instr.is_phi && merged[id] == counts[id]);
+                               });
+}
+
+// makes the predecessors of a forwarder predecessors of its successor
+auto thread_through(ssa_function& func, const std::size_t block) -> void
+{
+    auto& current = func.blocks[block];
+    const auto target = current.succs.front();
+    auto& succ = func.blocks[target];
+    const auto edge = static_cast<std::size_t>(std::ranges::find(succ.preds, block) - succ.preds.begin());
+    for (const auto id : succ.instrs) {
+        auto& phi = func.values[id];
+        if (!phi.is_phi) {
+            continue;
+        }
+        const auto input = phi.args[edge];
+        phi.args.erase(phi.args.begin() + static_cast<std::ptrdiff_t>(edge));
+        for (std::size_t pred = 0; pred < current.preds.size(); ++pred) {
+            const auto& instr = func.values[input];
+            phi.args.push_back(instr.is_phi && instr.block == block ? instr.args[pred] : input);
+        }
+    }
+    succ.preds.erase(succ.preds.begin() + static_cast<std::ptrdiff_t>(edge));
+    for (const auto pred : current.preds) {
+        std::ranges::replace(func.blocks[pred].succs, block, target);
+        succ.preds.push_back(pred);
+    }
+    current.instrs.clear();
+    current.preds.clear();
+    current.succs.clear();
+    current.reachable = false;
+}
+}  // namespace
+
+auto thread_jumps(ssa_function& func) -> bool
+{
+    auto changed = invert_negated_branches(func);
+    for (auto again = true; again;) {
+        again = false;
+        for (std::size_t block = 0; block < func.blocks.size(); ++block) {
+            if (is_forwarder(func, block, use_counts(func))) {
+                thread_through(func, block);
+                again = changed = true;
+            }
+        }
+    }
+    return changed;
+}
+
+auto fold_array_indexes(ssa_function& func) -> bool
+{
+    using enum opcodes;
+    if (func.consts == nullptr) {
+        return false;
+    }
+    const auto counts = use_counts(func);
+    auto changed = false;
+    for (const auto& block : func.blocks) {
+        for (const auto id : std::vector {block.instrs}) {
+            auto& instr = func.values[id];
+            if (instr.opcode != index) {
+                continue;
+            }
+            const auto& arr = func.values[instr.args[0]];
+            const auto& key = func.values[instr.args[1]];
+            if (arr.is_phi || arr.opcode != array || counts[instr.args[0]] != 1 || key.is_phi || key.opcode != constant)
+            {
+                continue;
+            }
+            const auto* position = (*func.consts)[key.immediates.front()];
+            if (!position->is(object::object_type::integer)) {
+                continue;
+            }
+            const auto idx = position->as<integer_object>()->value;
+            if (idx >= 0 && std::cmp_less(idx, arr.args.size())) {
+                const auto element = arr.args[static_cast<std::size_t>(idx)];
+                remove_instruction(func, id);
+                replace_uses(func, id, element);
+            } else {
+                instr.opcode = null;
+                instr.args.clear();
+            }
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+auto allocate_in_frames(ssa_function& func) -> bool
+{
+    using enum opcodes;
+    constexpr std::size_t max_frame_slots = std::numeric_limits<std::uint8_t>::max() + 1UL;
+    std::vector<std::vector<value_id>> uses(func.values.size());
+    for (const auto& block : func.blocks) {
+        for (const auto id : block.instrs) {
+            for (const auto arg : func.values[id].args) {
+                uses[arg].push_back(id);
+            }
+        }
+    }
+    std::size_t slots = 0;
+    for (const auto& block : func.blocks) {
+        for (const auto id : block.instrs) {
+            auto& instr = func.values[id];
+            if (instr.is_phi || uses[id].size() != 1 || slots == max_frame_slots) {
+                continue;
+            }
+            // consumed right away, before the instruction defining it can run again in the same frame
+            const auto& user = func.values[uses[id].front()];
+            if (user.is_phi || user.block != instr.block || user.args.front() != id
+                || std::ranges::count(user.args, id) != 1)
+            {
+                continue;
+            }
+            if (instr.opcode == array && user.opcode == index) {
+                instr.opcode = frame_array;
+            } else if (instr.opcode == closure && user.opcode == call && func.consts != nullptr
+                       && !refers_to_own_closure(*func.consts,
+                                                 *(*func.consts)[instr.immediates.front()]->as<compiled_function_object>()))
+            {
+                instr.opcode = frame_closure;
+            } else {
+                continue;
+            }
+            instr.immediates.push_back(slots++);
+        }
+    }
+    return slots > 0;
+}
+
+namespace
+{
+// what a value is known to be, `unknown` until a definition of it has been seen
+enum class value_type : std::uint8_t
+{
+    unknown,
+    integer,
+    decimal,
+    any,
+};
+
+auto join(const value_type lhs, const value_type rhs) -> value_type
+{
+    if (lhs == value_type::unknown || lhs == rhs) {
+        return rhs;
+    }
+    return rhs == value_type::unknown ? lhs : value_type::any;
+}
+
+// the variables of known type, any other variable may hold anything
+using memory_types = std::map<memory_slot, value_type>;
+
+auto join(const memory_types& lhs, const memory_types& rhs) -> memory_types
+{
+    memory_types result;
+    for (const auto& [slot, type] : lhs) {
+        if (const auto itr = rhs.find(slot); itr != rhs.end() && join(type, itr->second) != value_type::any) {
+            result.emplace(slot, join(type, itr->second));
+        }
+    }
+    return result;
+}
+
+auto constant_type(const object* constant) -> value_type
+{
+    if (constant->is(object::object_type::integer)) {
+        return value_type::integer;
+    }
+    if (constant->is(object::object_type::decimal)) {
+        return value_type::decimal;
+    }
+    return value_type::any;
+}
+
+auto arithmetic_type(const opcodes opcode, const value_type lhs, const value_type rhs) -> value_type
+{
+    using enum opcodes;
+    const auto numeric = [](const value_type type) { return type == value_type::integer || type == value_type::decimal; };
+    switch (opcode) {
+        case add:
+        case sub:
+        case mul:
+            if (lhs == value_type::integer && rhs == value_type::integer) {
+                return value_type::integer;
+            }
+            return numeric(lhs) && numeric(rhs) ? value_type::decimal : value_type::any;
+        case div:
+            // dividing integers raises an error on zero
+            return numeric(lhs) && numeric(rhs) && (lhs == value_type::decimal || rhs == value_type::decimal)
+                ? value_type::decimal
+                : value_type::any;
+        case bit_and:
+        case bit_or:
+        case bit_xor:
+            return lhs == value_type::integer && rhs == value_type::integer ? value_type::integer : value_type::any;
+        default:
+            return value_type::any;
+    }
+}
+
+class type_inference final
+{
+  public:
+    explicit type_inference(const ssa_function& func)
+        : m_func {func}
+        , m_types(func.values.size())
+        , m_exit(func.blocks.size())
+    {
+        const auto& builtins = builtin::builtins();
+        m_len = static_cast<std::size_t>(
+            std::ranges::find(builtins, std::string_view {"len"}, &builtin::name) - builtins.begin());
+    }
+
+    // iterates over the blocks until neither the types of the values nor those of the variables change
+    auto run() -> const std::vector<value_type>&
+    {
+        for (auto changed = true; changed;) {
+            changed = false;
+            for (std::size_t block = 0; block < m_func.blocks.size(); ++block) {
+                if (m_func.blocks[block].reachable) {
+                    changed = visit_block(block) || changed;
+                }
+            }
+        }
+        return m_types;
+    }
+
+  private:
+    auto visit_block(const std::size_t block) -> bool
+    {
+        auto changed = false;
+        std::optional<memory_types> memory;
+        for (const auto pred : m_func.blocks[block].preds) {
+            if (m_exit[pred].has_value()) {
+                memory = memory.has_value() ? join(*memory, *m_exit[pred]) : *m_exit[pred];
+            }
+        }
+        auto state = memory.value_or(memory_types {});
+        for (const auto id : m_func.blocks[block].instrs) {
+            const auto& instr = m_func.values[id];
+            if (kills_memory(instr.opcode)) {
+                state.clear();
+            }
+            if (const auto slot = slot_of(instr); slot.has_value() && is_store(instr.opcode)) {
+                if (const auto type = m_types[instr.args.front()]; type == value_type::any) {
+                    state.erase(*slot);
+                } else {
+                    state[*slot] = type;
+                }
+            }
+            if (!instr.has_result) {
+                continue;
+            }
+            const auto type = type_of(instr, state);
+            if (type != m_types[id]) {
+                m_types[id] = type;
+                changed = true;
+            }
+        }
+        if (m_exit[block] != state) {
+            m_exit[block] = std::move(state);
+            changed = true;
+        }
+        return changed;
+    }
+
+    [[nodiscard]] auto type_of(const ssa_instruction& instr, const memory_types& state) const -> value_type
+    {
+        using enum opcodes;
+        if (instr.is_phi) {
+            auto result = value_type::unknown;
+            for (const auto arg : instr.args) {
+                result = join(result, m_types[arg]);
+            }
+            return result;
+        }
+        if (const auto slot = slot_of(instr); slot.has_value()) {
+            const auto itr = state.find(*slot);
+            return itr == state.end() ? value_type::any : itr->second;
+        }
+        switch (instr.opcode) {
+            case constant:
+                return m_func.consts == nullptr ? value_type::any
+                                                : constant_type((*m_func.consts)[instr.immediates.front()]);
+            case minus:
+                return m_types[instr.args.front()];
+            case call: {
+                // len() results in an integer unless its argument is unsupported, the guard catches that
+                const auto& callee = m_func.values[instr.args.front()];
+                return callee.opcode == get_builtin && callee.immediates.front() == m_len ? value_type::integer
+                                                                                           : value_type::any;
+            }
+            default:
+                if (is_binary_operator(instr.opcode)) {
+                    return arithmetic_type(instr.opcode, m_types[instr.args[0]], m_types[instr.args[1]]);
+                }
+                return value_type::any;
+        }
+    }
+
+    const ssa_function& m_func;
+    std::vector<value_type> m_types;
+    std::vector<std::optional<memory_types>> m_exit;
+    std::size_t m_len {};
+};
+}  // namespace
+
+auto specialize_types(ssa_function& func) -> bool
+{
+    const auto types = type_inference {func}.run();
+    auto changed = false;
+    for (const auto& block : func.blocks) {
+        for (const auto id : block.instrs) {
+            auto& instr = func.values[id];
+            if (instr.is_phi || !is_binary_operator(instr.opcode) || generic_opcode(instr.opcode) != instr.opcode) {
+                continue;
+            }
+            const auto lhs = types[instr.args[0]];
+            const auto rhs = types[instr.args[1]];
+            std::optional<opcodes> specialized;
+            if (lhs == value_type::integer && rhs == value_type::integer) {
+                specialized = integer_opcode(instr.opcode);
+            } else if (lhs == value_type::decimal && rhs == value_type::decimal) {
+                specialized = decimal_opcode(instr.opcode);
+            }
+            if (specialized.has_value()) {
+                instr.opcode = *specialized;
+                changed = true;
+            }
+        }
+    }
+    return changed;
+}
+
+auto optimize(ssa_function& func, const int level) -> void
+{
+    constexpr auto max_rounds = 8;
+    for (auto round = 0; round < max_rounds && level > 0; ++round) {
+        auto changed = propagate_copies(func);
+        if (level > 1) {
+            changed = fold_array_indexes(func) || changed;
+            changed = number_values(func) || changed;
+            changed = hoist_loop_invariants(func) || changed;
+        }
+        changed = eliminate_dead_code(func) || changed;
+        if (!changed) {
+            break;
+        }
+    }
+    if (level > 1) {
+        specialize_types(func);
+        allocate_in_frames(func);
+    }
+    if (level > 0) {
+        thread_jumps(func);
+    }
+}
+
+auto lower_ssa(const ssa_function& func, const std::size_t first_temporary) -> std::optional<lowered_function>
+{
+    return stack_lowering {func, first_temporary}.run();
+}
+
+auto optimize_code(const instructions& code,
+                   const int num_locals,
+                   const bool is_main,
+                   const std::size_t first_temporary,
+                   const constants* consts,
+                   const int level) -> std::optional<lowered_function>
+{
+    auto func = build_ssa(code, num_locals, is_main, consts);
+    optimize(func, level);
+    return lower_ssa(func, first_temporary);
+}
+
+auto to_string(const ssa_function& func) -> std::string
+{
+    std::string result;
+    for (std::size_t block = 0; block < func.blocks.size(); ++block) {
+        const auto& current = func.blocks[block];
+        if (!current.reachable) {
+            continue;
+        }
+        result += fmt::format("block{} preds [{}] succs [{}]\n",
+                              block,
+                              fmt::join(current.preds, ", "),
+                              fmt::join(current.succs, ", "));
+        for (const auto id : current.instrs) {
+            const auto& instr = func.values[id];
+            result += "  ";
+            if (instr.has_result) {
+                result += fmt::format("v{} = ", id);
+            }
+            result += instr.is_phi ? std::string {"phi"} : std::string {definitions.at(instr.opcode).name};
+            for (const auto immediate : instr.immediates) {
+                result += fmt::format(" {}", immediate);
+            }
+            for (const auto arg : instr.args) {
+                result += fmt::format(" v{}", arg);
+            }
+            result += '\n';
+        }
+    }
+    return result;
+}
+
+namespace
+{
+// NOLINTBEGIN(*)
+auto lift(const std::string_view input, const int level) -> ssa_function
+{
+    auto prsr = parser {lexer {input}};
+    auto prgrm = prsr.parse_program();
+    REQUIRE(prsr.errors().empty());
+    auto cmplr = compiler::create();
+    cmplr.compile(prgrm.get());
+    const auto code = cmplr.byte_code();
+    const auto* func = code.consts->back()->as<compiled_function_object>();
+    auto result = build_ssa(func->instrs, func->num_locals, false, code.consts);
+    optimize(result, level);
+    return result;
+}
+
+TEST_SUITE("compiler")
+{
+    TEST_CASE("ssaConstruction")
+    {
+        const auto func = lift("fn(a) { 1 + if (a) { 2 } else { 3 } }", 0);
+        CHECK_EQ(to_string(func), R"(block0 preds [] succs [1, 2]
+  v0 = OpConstant 0
+  v1 = OpGetLocal 0
+  OpJumpNotTruthy v1
+block1 preds [0] succs [3]
+  v3 = OpConstant 1
+  OpJump
+block2 preds [0] succs [3]
+  v5 = OpConstant 2
+block3 preds [1, 2] succs []
+  v7 = phi v3 v5
+  v8 = OpAdd v0 v7
+  OpReturnValue v8
+)");
+    }
+
+    TEST_CASE("ssaOptimizations")
+    {
+        struct test
+        {
+            std::string_view input;
+            int level;
+            std::string_view expected;
+        };
+        const std::array tests {
+            test {"fn(a) { let b = a; b + b }", 1, R"(block0 preds [] succs []
+  v0 = OpGetLocal 0
+  OpSetLocal 1 v0
+  v4 = OpAdd v0 v0
+  OpReturnValue v4
+)"},
+            test {"fn(a, b) { let x = a * b; let y = a * b; x - y }", 2, R"(block0 preds [] succs []
+  v0 = OpGetLocal 0
+  v1 = OpGetLocal 1
+  v2 = OpMul v0 v1
+  OpSetLocal 2 v2
+  OpSetLocal 3 v2
+  v10 = OpSub v2 v2
+  OpReturnValue v10
+)"},
+            test {"fn(a) { a; 1; a + 1 }", 1, R"(block0 preds [] succs []
+  v4 = OpGetLocal 0
+  v5 = OpConstant 0
+  v6 = OpAdd v4 v5
+  OpReturnValue v6
+)"},
+            test {"fn() { let i = 0; while (i < 10 * 10) { i = i + 1; } i }", 2, R"(block0 preds [] succs [1]
+  v0 = OpConstant 0
+  OpSetLocal 0 v0
+  v2 = OpConstant 1
+  v4 = OpMulInt v2 v2
+block1 preds [0, 2] succs [2, 4]
+  v5 = OpGetLocal 0
+  v6 = OpGreaterThan v4 v5
+  OpJumpNotTruthy v6
+block2 preds [1] succs [1, 4]
+  v8 = OpFrameClosure 3 0 0
+  v9 = OpCall 0 v8
+  OpJumpNotTruthy v9
+block4 preds [1, 2] succs []
+  v14 = OpGetLocal 0
+  OpReturnValue v14
+)"},
+        };
+        for (const auto& [input, level, expected] : tests) {
+            INFO(input);
+            CHECK_EQ(to_string(lift(input, level)), expected);
+        }
+    }
+
+    TEST_CASE("ssaJumpThreading")
+    {
+        const auto dump = [](const std::string_view input)
+        {
+            const auto func = lift(input, 1);
+            const auto lowered = lower_ssa(func, 0);
+            REQUIRE(lowered.has_value());
+            return to_string(func) + to_string(lowered->instrs);
+        };
+        CHECK_EQ(dump("fn(a) { if (!a) { 1 } else { 2 } }"), R"(block0 preds [] succs [2, 1]
+  v0 = OpGetLocal 0
+  OpJumpNotTruthy v0
+block1 preds [0] succs [3]
+  v3 = OpConstant 0
+  OpJump
+block2 preds [0] succs [3]
+  v5 = OpConstant 1
+block3 preds [1, 2] succs []
+  v6 = phi v3 v5
+  OpReturnValue v6
+0000 OpGetLocal 0
+0002 OpJumpNotTruthy 13
+0005 OpConstant 1
+0008 OpSetLocal 1
+0010 OpJump 18
+0013 OpConstant 0
+0016 OpSetLocal 1
+0018 OpGetLocal 1
+0020 OpReturnValue
+)");
+        CHECK_EQ(dump("fn(a, b) { if (a) { puts(a) }; if (a) { if (b) { 1 } else { 2 } } else { 3 } }"), R"(block0 preds [] succs [1, 3]
+  v0 = OpGetLocal 0
+  OpJumpNotTruthy v0
+block1 preds [0] succs [3]
+  v2 = OpGetBuiltin 1
+  v3 = OpGetLocal 0
+  v4 = OpCall 1 v2 v3
+  OpJump
+block3 preds [1, 0] succs [4, 8]
+  v9 = OpGetLocal 0
+  OpJumpNotTruthy v9
+block4 preds [3] succs [5, 6]
+  v11 = OpGetLocal 1
+  OpJumpNotTruthy v11
+block5 preds [4] succs [9]
+  v13 = OpConstant 0
+  OpJump
+block6 preds [4] succs [9]
+  v15 = OpConstant 1
+block8 preds [3] succs [9]
+  v18 = OpConstant 2
+block9 preds [8, 5, 6] succs []
+  v19 = phi v18 v13 v15
+  OpReturnValue v19
+0000 OpGetLocal 0
+0002 OpJumpNotTruthy 12
+0005 OpGetBuiltin 1
+0007 OpGetLocal 0
+0009 OpCall 1
+0011 OpPop
+0012 OpGetLocal 0
+0014 OpJumpNotTruthy 38
+0017 OpGetLocal 1
+0019 OpJumpNotTruthy 30
+0022 OpConstant 0
+0025 OpSetLocal 2
+0027 OpJump 43
+0030 OpConstant 1
+0033 OpSetLocal 2
+0035 OpJump 43
+0038 OpConstant 2
+0041 OpSetLocal 2
+0043 OpGetLocal 2
+0045 OpReturnValue
+)");
+    }
+
+    TEST_CASE("ssaTypeSpecialization")
+    {
+        struct test
+        {
+            std::string_view input;
+            std::vector<opcodes> expected;
+        };
+        using enum opcodes;
+        const std::array tests {
+            test {"fn() { let a = 1; let b = a * 2; b - a > 0 }", {mul_int, sub_int, greater_than_int}},
+            test {"fn() { let x = 1.5; let y = x / 2; y * 2.5 }", {div, mul_dec}},
+            test {"fn() { 1.5 / 0.5 + 1 }", {div_dec, add}},
+            test {"fn(a) { let n = len(a); n + 1 == 3 }", {add_int, equal_int}},
+            test {"fn(a) { a + 1 }", {add}},
+            test {"fn() { let i = 1 / 2; i + 1 }", {div, add}},
+            test {"fn(a) { let i = if (a) { 1 } else { 2 }; i + 1 }", {add_int}},
+            test {"fn(a) { let i = if (a) { 1 } else { 2.5 }; i + 1 }", {add}},
+            test {"fn(f) { let i = 1; f(); i + 1 }", {add}},
+            test {"fn() { \"a\" + \"b\" }", {add}},
+        };
+        for (const auto& [input, expected] : tests) {
+            INFO(input);
+            const auto func = lift(input, 2);
+            std::vector<opcodes> operators;
+            for (const auto& block : func.blocks) {
+                for (const auto id : block.instrs) {
+                    if (is_binary_operator(func.values[id].opcode)) {
+                        operators.push_back(func.values[id].opcode);
+                    }
+                }
+            }
+            CHECK_EQ(operators, expected);
+        }
+    }
+
+    TEST_CASE("ssaFrameAllocation")
+    {
+        struct test
+        {
+            std::string_view input;
+            std::vector<opcodes> expected;
+        };
+        using enum opcodes;
+        const std::array tests {
+            test {"fn(a, i) { [a, a + 1][i] }", {frame_array}},
+            test {"fn(a) { [a, 2][1] + [a, 2][5] }", {}},
+            test {"fn(a, i) { let x = [a, 2]; x[i] + x[0] }", {array}},
+            test {"fn(a, i) { [a, 2][i][i] }", {frame_array}},
+            test {"fn(a) { fn(x) { x + a }(1) + 1 }", {frame_closure}},
+            // the frame of a tail call replaces the one the closure would be kept in
+            test {"fn(a) { fn(x) { x + a }(1) }", {closure}},
+            test {"fn(a) { fn(x) { fn() { x } }(1)() }", {frame_closure}},
+            test {"fn(a) { let f = fn(x) { x + a }; f(1) }", {closure}},
+            test {"fn(a) { fn(x) { x + a } }", {closure}},
+            test {"fn(a) { a(fn(x) { x }) }", {closure}},
+            test {"fn(a) { fn() { fn() { 1 } }()() }", {frame_closure}},
+        };
+        for (const auto& [input, expected] : tests) {
+            INFO(input);
+            const auto func = lift(input, 2);
+            std::vector<opcodes> allocations;
+            for (const auto& block : func.blocks) {
+                for (const auto id : block.instrs) {
+                    const auto opcode = func.values[id].opcode;
+                    if (opcode == array || opcode == closure || opcode == frame_array || opcode == frame_closure) {
+                        allocations.push_back(opcode);
+                    }
+                }
+            }
+            CHECK_EQ(allocations, expected);
+        }
+        CHECK_EQ(to_string(lift("fn(a) { [a, 2][0] + [a, 2][5] }", 2)), R"(block0 preds [] succs []
+  v0 = OpGetLocal 0
+  v9 = OpNull
+  v10 = OpAdd v0 v9
+  OpReturnValue v10
+)");
+    }
+
+    TEST_CASE("ssaLowering")
+    {
+        using enum opcodes;
+        const auto code = [](std::vector<instructions> instrs)
+        {
+            instructions result;
+            for (const auto& instr : instrs) {
+                result.insert(result.end(), instr.begin(), instr.end());
+            }
+            return result;
+        };
+        // a value used twice and not stored into a variable is kept in a temporary after the locals
+        auto func = lift("fn(a, b) { (a * b) + (a * b) }", 2);
+        auto lowered = lower_ssa(func, 0);
+        REQUIRE(lowered.has_value());
+        CHECK_EQ(lowered->num_temporaries, 1);
+        CHECK_EQ(to_string(lowered->instrs),
+                 to_string(code({make(get_local, 0),
+                                 make(get_local, 1),
+                                 make(mul),
+                                 make(set_local, 2),
+                                 make(get_local, 2),
+                                 make(get_local, 2),
+                                 make(add),
+                                 make(return_value)})));
+
+        // a value stored into a local is loaded from there
+        func = lift("fn(a, b) { let x = a * b; x + x }", 1);
+        lowered = lower_ssa(func, 0);
+        REQUIRE(lowered.has_value());
+        CHECK_EQ(lowered->num_temporaries, 0);
+        CHECK_EQ(to_string(lowered->instrs),
+                 to_string(code({make(get_local, 0),
+                                 make(get_local, 1),
+                                 make(mul),
+                                 make(set_local, 2),
+                                 make(get_local, 2),
+                                 make(get_local, 2),
+                                 make(add),
+                                 make(return_value)})));
+
+        // phis live in temporaries, their inputs are stored at the end of each predecessor
+        func = lift("fn(a) { 1 + if (a) { 2 } else { 3 } }", 2);
+        lowered = lower_ssa(func, 0);
+        REQUIRE(lowered.has_value());
+        CHECK_EQ(lowered->num_temporaries, 1);
+        CHECK_EQ(to_string(lowered->instrs),
+                 to_string(code({make(get_local, 0),
+                                 make(jump_not_truthy, 13),
+                                 make(constant, 1),
+                                 make(set_local, 1),
+                                 make(jump, 18),
+                                 make(constant, 2),
+                                 make(set_local, 1),
+                                 make(constant, 0),
+                                 make(get_local, 1),
+                                 make(add_int),
+                                 make(return_value)})));
+    }
+}
+
+// NOLINTEND(*)
+}  // namespace
@@ -0,0 +1,106 @@
+// Copyright 2023-2025 hrzlgnm
+// SPDX-License-Identifier: MIT-0
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <code/code.hpp>
+
+#include "compiler.hpp"
+
+using value_id = std::uint32_t;
+
+// One instruction of the stack code with its stack operands made explicit: `args` are the values it pops, in the
+// order they were pushed, `immediates` the operands encoded in the instruction. Jump targets are not immediates
+// but the successors of the block. Phis merge the values a stack slot holds at the start of a block, with one
+// argument per predecessor.
+struct ssa_instruction final
+{
+    opcodes opcode {};
+    bool is_phi {};
+    bool has_result {};
+    std::vector<value_id> args;
+    std::vector<std::size_t> immediates;
+    std::size_t block {};
+};
+
+struct ssa_block final
+{
+    // phis first, a jump, return or loop exit last
+    std::vector<value_id> instrs;
+    std::vector<std::size_t> preds;
+    // the fall through successor first
+    std::vector<std::size_t> succs;
+    bool reachable {};
+};
+
+// Locals, globals and free variables stay memory, only the operand stack is in SSA form. Every instruction defines
+// the value of the same id, removed instructions keep their id but are no longer part of any block.
+struct ssa_function final
+{
+    std::vector<ssa_instruction> values;
+    std::vector<ssa_block> blocks;
+    int num_locals {};
+    bool is_main {};
+    // the constants the code loads, if known
+    const constants* consts {};
+};
+
+// Lifts the code of one function. Constants of equal value are loaded by the index of the first of them, if the
+// constants are given.
+[[nodiscard]] auto build_ssa(const instructions& code, int num_locals, bool is_main, const constants* consts = {})
+    -> ssa_function;
+
+// The passes return whether they changed anything.
+
+// forwards stored values to later loads of the same variable and removes phis merging a single value
+auto propagate_copies(ssa_function& func) -> bool;
+// global value numbering of operators and constants along the dominator tree, of loads within a block
+auto number_values(ssa_function& func) -> bool;
+// moves invariant operators of a loop header into the block entering the loop
+auto hoist_loop_invariants(ssa_function& func) -> bool;
+// removes unused values that have no side effects and cannot fail
+auto eliminate_dead_code(ssa_function& func) -> bool;
+// Threads the jumps to blocks which only pass control on, and their phis, to the final target, and branches on
+// the operand of a negated condition with the successors swapped.
+auto thread_jumps(ssa_function& func) -> bool;
+
+// replaces indexing an array literal used nowhere else with a constant by the element, or null if out of range
+auto fold_array_indexes(ssa_function& func) -> bool;
+// Turns closures only called and arrays only indexed, right after they were made, into ones kept in a slot of the
+// frame instead of on the heap. Closures whose function may refer to the closure itself stay on the heap.
+auto allocate_in_frames(ssa_function& func) -> bool;
+// Replaces operators whose operands are known to be integers or decimals by the specialized ones. The types come
+// from constants, len(), arithmetic and the variables of the function, which are followed through its blocks until
+// a call. Parameters, globals read before being assigned and the results of other calls are of unknown type.
+auto specialize_types(ssa_function& func) -> bool;
+
+// level 1 propagates copies, eliminates dead code and threads jumps, level 2 and above also folds array indexes,
+// numbers values, hoists invariants, specializes operators by type and allocates closures and arrays in frames
+auto optimize(ssa_function& func, int level) -> void;
+
+struct lowered_function final
+{
+    instructions instrs;
+    int num_temporaries {};
+};
+
+// Values which cannot stay on the operand stack until their use are kept in temporaries: locals after the
+// locals of the function, or globals from `first_temporary` in the main program. Returns nullopt if the
+// temporaries do not fit the operands.
+[[nodiscard]] auto lower_ssa(const ssa_function& func, std::size_t first_temporary) -> std::optional<lowered_function>;
+
+// lifts, optimizes and lowers the code of one function, nullopt where it is better kept as it is
+[[nodiscard]] auto optimize_code(const instructions& code,
+                                 int num_locals,
+                                 bool is_main,
+                                 std::size_t first_temporary,
+                                 const constants* consts,
+                                 int level) -> std::optional<lowered_function>;
+
+[[nodiscard]] auto to_string(const ssa_function& func) -> std::string;
@@ -157,6 +157,19 @@ auto symbol_table::resolve(const std::string& name, int level) -> std::optional<
     return std::nullopt;
 }
 
+auto symbol_table::definition(const std::string& name) const -> std::optional<symbol_definition>
+{
+    using enum symbol_scope;
+    for (const auto* table = this; table != nullptr; table = table->m_outer) {
+        if (const auto itr = table->m_store.find(name); itr != table->m_store.end()) {
+            if (itr->second.scope != free && itr->second.scope != outer) {
+                return symbol_definition {.table = table, .sym = itr->second};
+            }
+        }
+    }
+    return std::nullopt;
+}
+
 auto symbol_table::free() const -> const std::vector<symbol>&
 {
     return m_free;
@@ -333,6 +346,31 @@ TEST_CASE("shadowFunctionNames")
     REQUIRE_EQ(resolved.value(), expected);
 }
 
+TEST_CASE("definitionFollowsFreeAndOuterSymbols")
+{
+    using enum symbol_scope;
+    auto globals = symbol_table::create();
+    globals->define("a");
+    auto locals = symbol_table::create_enclosed(globals);
+    locals->define("b");
+    auto nested = symbol_table::create_enclosed(locals);
+    auto loop = symbol_table::create_enclosed(nested, /*inside_loop=*/true);
+
+    REQUIRE_EQ(loop->resolve("b"), symbol {"b", outer, 0, symbol_pointer {1, free, 0}});
+    REQUIRE_EQ(nested->free().size(), 1);
+
+    const auto definition = loop->definition("b");
+    REQUIRE(definition.has_value());
+    CHECK_EQ(definition->table, locals);
+    CHECK_EQ(definition->sym, symbol {"b", local, 0, std::nullopt});
+    CHECK_EQ(loop->definition("a")->table, globals);
+    CHECK_FALSE(loop->definition("c").has_value());
+
+    locals->define("c");
+    CHECK_EQ(nested->definition("c")->table, locals);
+    CHECK_EQ(nested->free().size(), 1);
+}
+
 TEST_SUITE_END();
 // NOLINTEND(*)
 }  // namespace
@@ -72,6 +72,15 @@ struct fmt::formatter<symbol> : ostream_formatter
 {
 };
 
+struct symbol_table;
+
+// where a name is defined, rather than how a scope refers to it
+struct symbol_definition final
+{
+    const symbol_table* table {};
+    symbol sym;
+};
+
 struct symbol_table final
 {
     static auto create() -> symbol_table*;
@@ -82,6 +91,8 @@ struct symbol_table final
     auto define_builtin(int index, const std::string& name) -> symbol;
     auto define_function_name(const std::string& name) -> symbol;
     auto resolve(const std::string& name, int level = 0) -> std::optional<symbol>;
+    // follows free and outer symbols to the definition of `name`, unlike resolve() without defining any
+    [[nodiscard]] auto definition(const std::string& name) const -> std::optional<symbol_definition>;
 
     [[nodiscard]] auto is_global() const -> bool { return m_outer == nullptr; }
 
@@ -92,6 +103,9 @@ struct symbol_table final
     [[nodiscard]] auto num_definitions() const -> int { return m_defs; }
 
     [[nodiscard]] auto free() const -> const std::vector<symbol>&;
+
+    [[nodiscard]] auto symbols() const -> const string_map<symbol>& { return m_store; }
+
     auto debug() const -> void;
 
   private:
@@ -0,0 +1,165 @@
+// Copyright 2023-2025 hrzlgnm
+// SPDX-License-Identifier: MIT-0
+
+#include "tree_walker.hpp"
+
+#include <ast/array_literal.hpp>
+#include <ast/assign_expression.hpp>
+#include <ast/binary_expression.hpp>
+#include <ast/call_expression.hpp>
+#include <ast/function_literal.hpp>
+#include <ast/hash_literal.hpp>
+#include <ast/identifier.hpp>
+#include <ast/if_expression.hpp>
+#include <ast/index_expression.hpp>
+#include <ast/program.hpp>
+#include <ast/statements.hpp>
+#include <ast/unary_expression.hpp>
+
+void tree_walker::visit(const array_literal& expr)
+{
+    m_nodes++;
+    for (const auto* element : expr.elements) {
+        element->accept(*this);
+    }
+}
+
+void tree_walker::visit(const assign_expression& expr)
+{
+    m_nodes++;
+    expr.value->accept(*this);
+}
+
+void tree_walker::visit(const binary_expression& expr)
+{
+    m_nodes++;
+    expr.left->accept(*this);
+    expr.right->accept(*this);
+}
+
+void tree_walker::visit(const block_statement& expr)
+{
+    m_nodes++;
+    for (const auto* stmt : expr.statements) {
+        stmt->accept(*this);
+    }
+}
+
+void tree_walker::visit(const boolean_literal& /*expr*/)
+{
+    m_nodes++;
+}
+
+void tree_walker::visit(const break_statement& /*expr*/)
+{
+    m_nodes++;
+}
+
+void tree_walker::visit(const call_expression& expr)
+{
+    m_nodes++;
+    expr.function->accept(*this);
+    for (const auto* arg : expr.arguments) {
+        arg->accept(*this);
+    }
+}
+
+void tree_walker::visit(const continue_statement& /*expr*/)
+{
+    m_nodes++;
+}
+
+void tree_walker::visit(const decimal_literal& /*expr*/)
+{
+    m_nodes++;
+}
+
+void tree_walker::visit(const expression_statement& expr)
+{
+    m_nodes++;
+    expr.expr->accept(*this);
+}
+
+void tree_walker::visit(const function_literal& expr)
+{
+    m_nodes += 1 + expr.parameters.size();
+    expr.body->accept(*this);
+}
+
+void tree_walker::visit(const hash_literal& expr)
+{
+    m_nodes++;
+    for (const auto& [key, value] : expr.pairs) {
+        key->accept(*this);
+        value->accept(*this);
+    }
+}
+
+void tree_walker::visit(const identifier& /*expr*/)
+{
+    m_nodes++;
+}
+
+void tree_walker::visit(const if_expression& expr)
+{
+    m_nodes++;
+    expr.condition->accept(*this);
+    expr.consequence->accept(*this);
+    if (expr.alternative != nullptr) {
+        expr.alternative->accept(*this);
+    }
+}
+
+void tree_walker::visit(const index_expression& expr)
+{
+    m_nodes++;
+    expr.left->accept(*this);
+    expr.index->accept(*this);
+}
+
+void tree_walker::visit(const integer_literal& /*expr*/)
+{
+    m_nodes++;
+}
+
+void tree_walker::visit(const let_statement& expr)
+{
+    m_nodes++;
+    expr.value->accept(*this);
+}
+
+void tree_walker::visit(const null_literal& /*expr*/)
+{
+    m_nodes++;
+}
+
+void tree_walker::visit(const program& expr)
+{
+    for (const auto* stmt : expr.statements) {
+        stmt->accept(*this);
+    }
+}
+
+void tree_walker::visit(const return_statement& expr)
+{
+    m_nodes++;
+    expr.value->accept(*this);
+}
+
+void tree_walker::visit(const string_literal& /*expr*/)
+{
+    m_nodes++;
+}
+
+void tree_walker::visit(const unary_expression& expr)
+{
+    m_nodes++;
+    expr.right->accept(*this);
+}
+
+void tree_walker::visit(const while_statement& expr)
+{
+    m_nodes++;
+    expr.condition->accept(*this);
+    expr.body->accept(*this);
+}
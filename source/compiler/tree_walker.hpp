@@ -0,0 +1,44 @@
+// Copyright 2023-2025 hrzlgnm
+// SPDX-License-Identifier: MIT-0
+
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <set>
+#include <string>
+
+#include <ast/visitor.hpp>
+
+using name_set = std::set<std::string, std::less<>>;
+
+// visits every node of a tree, counting them
+struct tree_walker : visitor
+{
+    void visit(const array_literal& expr) override;
+    void visit(const assign_expression& expr) override;
+    void visit(const binary_expression& expr) override;
+    void visit(const block_statement& expr) override;
+    void visit(const boolean_literal& expr) override;
+    void visit(const break_statement& expr) override;
+    void visit(const call_expression& expr) override;
+    void visit(const continue_statement& expr) override;
+    void visit(const decimal_literal& expr) override;
+    void visit(const expression_statement& expr) override;
+    void visit(const function_literal& expr) override;
+    void visit(const hash_literal& expr) override;
+    void visit(const identifier& expr) override;
+    void visit(const if_expression& expr) override;
+    void visit(const index_expression& expr) override;
+    void visit(const integer_literal& expr) override;
+    void visit(const let_statement& expr) override;
+    void visit(const null_literal& expr) override;
+    void visit(const program& expr) override;
+    void visit(const return_statement& expr) override;
+    void visit(const string_literal& expr) override;
+    void visit(const unary_expression& expr) override;
+    void visit(const while_statement& expr) override;
+
+  protected:
+    std::size_t m_nodes {};
+};
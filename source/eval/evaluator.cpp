@@ -3,6 +3,7 @@
 
 #include <cstddef>
 #include <deque>
+#include <memory>
 #include <string>
 #include <unordered_map>
 #include <utility>
@@ -11,6 +12,7 @@
 
 #include "evaluator.hpp"
 
+#include <analyzer/analyzer.hpp>
 #include <ast/array_literal.hpp>
 #include <ast/assign_expression.hpp>
 #include <ast/binary_expression.hpp>
@@ -45,12 +47,30 @@ evaluator::evaluator(environment* existing_env)
 {
 }
 
-auto evaluator::evaluate(const program* prgrm) -> const object*
+auto evaluator::evaluate(const program* prgrm, const name_resolution* resolution) -> const object*
 {
+    m_nodes = prgrm->nodes;
+    m_resolution = resolution;
     prgrm->accept(*this);
     return m_result;
 }
 
+// The lookup continues outwards from there. The names of a function defined by an earlier program are not in the
+// resolution, they are looked up from the innermost environment.
+auto evaluator::environment_of(const identifier& expr) const -> environment*
+{
+    auto* env = m_env;
+    if (m_resolution == nullptr || m_resolution->nodes != m_nodes.get()) {
+        return env;
+    }
+    if (const auto* resolved = m_resolution->find(expr); resolved != nullptr) {
+        for (auto depth = resolved->depth; depth > 0 && env->outer != nullptr; --depth) {
+            env = env->outer;
+        }
+    }
+    return env;
+}
+
 void evaluator::visit(const array_literal& expr)
 {
     array_object::value_type arr;
@@ -70,7 +90,7 @@ void evaluator::visit(const assign_expression& expr)
     if (m_result->is_error()) {
         return;
     }
-    m_env->reassign(expr.name->value, m_result);
+    environment_of(*expr.name)->reassign(expr.name->value, m_result);
 }
 
 namespace
@@ -179,7 +199,7 @@ void evaluator::visit(const hash_literal& expr)
 
 void evaluator::visit(const identifier& expr)
 {
-    const auto* val = m_env->get(expr.value);
+    const auto* val = environment_of(expr)->get(expr.value);
     if (val->is_null()) {
         m_result = make_error("identifier not found: {}", expr.value);
         return;
@@ -415,7 +435,7 @@ void evaluator::visit(const call_expression& expr)
 
 void evaluator::visit(const function_literal& expr)
 {
-    m_result = allocate<function_object>(expr.parameters, expr.body, m_env);
+    m_result = allocate<function_object>(expr.parameters, expr.body, m_env, m_nodes);
 }
 
 void evaluator::apply_function(const object* function_or_builtin, array_object::value_type&& args)
@@ -428,6 +448,8 @@ void evaluator::apply_function(const object* function_or_builtin, array_object::
         }
         {
             evaluator local(locals);
+            local.m_nodes = func->nodes;
+            local.m_resolution = m_resolution;
             func->body->accept(local);
             m_result = local.m_result;
         }
@@ -549,15 +571,15 @@ auto check_no_parse_errors(const parser& prsr) -> bool
     return prsr.errors().empty();
 }
 
-using parsed_program = std::pair<const program*, parser>;
+using parsed_program = std::pair<std::unique_ptr<program>, parser>;
 
 auto check_program(const std::string_view input) -> parsed_program
 {
     auto prsr = parser {lexer {input}};
-    const auto prgrm = prsr.parse_program();
+    auto prgrm = prsr.parse_program();
     INFO("while parsing: `", input, "`");
     CHECK(check_no_parse_errors(prsr));
-    return {prgrm, std::move(prsr)};
+    return {std::move(prgrm), std::move(prsr)};
 }
 
 auto run(const std::string_view input) -> const object*
@@ -568,7 +590,7 @@ auto run(const std::string_view input) -> const object*
         env.set(builtin->name, allocate<builtin_object>(builtin));
     }
     evaluator ev(&env);
-    const auto result = ev.evaluate(prgrm);
+    const auto result = ev.evaluate(prgrm.get());
     REQUIRE(result);
     return result;
 }
@@ -580,7 +602,7 @@ auto run_multi(std::deque<std::string>& inputs) -> const object*
     while (!inputs.empty()) {
         const auto [prgrm, _] = check_program(inputs.front());
         evaluator ev {&env};
-        result = ev.evaluate(prgrm);
+        result = ev.evaluate(prgrm.get());
         inputs.pop_front();
     }
     return result;
@@ -1378,6 +1400,62 @@ TEST_CASE("nullLiteral")
     REQUIRE(evaluated->is_null());
 }
 
+TEST_CASE("functionsKeepTheirNodesAlive")
+{
+    environment env;
+    std::weak_ptr<const ast_arena> defining_nodes;
+    std::weak_ptr<const ast_arena> other_nodes;
+    {
+        auto [prgrm, _] = check_program("let adder = fn(x) { fn(y) { x + y } };");
+        defining_nodes = prgrm->nodes;
+        evaluator ev {&env};
+        ev.evaluate(prgrm.get());
+    }
+    REQUIRE_FALSE(defining_nodes.expired());
+    {
+        auto [prgrm, _] = check_program("let add_two = adder(2); 1;");
+        other_nodes = prgrm->nodes;
+        evaluator ev {&env};
+        ev.evaluate(prgrm.get());
+    }
+    CHECK(other_nodes.expired());
+    auto [prgrm, _] = check_program("add_two(3);");
+    evaluator ev {&env};
+    const auto* result = ev.evaluate(prgrm.get());
+    REQUIRE(result->is(object::object_type::integer));
+    CHECK_EQ(result->as<integer_object>()->value, 5);
+}
+
+TEST_CASE("resolvedNames")
+{
+    struct test
+    {
+        std::string_view input;
+        int64_t expected;
+    };
+
+    const std::array tests {
+        test {"let a = 1; let f = fn(x) { let g = fn(y) { a + x + y }; g(2) }; f(3)", 6},
+        test {"let fib = fn(n) { if (n < 2) { return n; } fib(n - 1) + fib(n - 2) }; fib(10)", 55},
+        test {"let c = 0; let f = fn(n) { while (n > 0) { c = c + n; n = n - 1; } c }; f(4) + len([1])", 11},
+        test {"let x = 1; let f = fn() { let y = x; let x = 2; x + y }; let len = fn(a) { 5 }; len([]) + f()", 8},
+        test {"let adder = fn(x) { fn(y) { x = x + y; x } }; let add = adder(2); add(3); add(4)", 9},
+    };
+    for (const auto& [input, expected] : tests) {
+        INFO(input);
+        const auto [prgrm, _] = check_program(input);
+        const auto resolution = analyze_program(prgrm.get(), nullptr);
+        environment env;
+        for (const auto& builtin : builtin::builtins()) {
+            env.set(builtin->name, allocate<builtin_object>(builtin));
+        }
+        evaluator ev {&env};
+        const auto* result = ev.evaluate(prgrm.get(), &resolution);
+        REQUIRE(result->is(object::object_type::integer));
+        CHECK_EQ(result->as<integer_object>()->value, expected);
+    }
+}
+
 TEST_SUITE_END();
 
 // NOLINTEND(*)
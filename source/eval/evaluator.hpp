@@ -3,6 +3,10 @@
 
 #pragma once
 
+#include <memory>
+
+#include <analyzer/name_resolution.hpp>
+#include <ast/arena.hpp>
 #include <ast/expression.hpp>
 #include <ast/program.hpp>
 #include <ast/visitor.hpp>
@@ -13,7 +17,8 @@
 struct evaluator final : visitor
 {
     explicit evaluator(environment* existing_env = nullptr);
-    auto evaluate(const program* prgrm) -> const object*;
+    // with the names of the program resolved, a name is looked up starting from the environment it is bound in
+    auto evaluate(const program* prgrm, const name_resolution* resolution = nullptr) -> const object*;
 
   protected:
     void visit(const array_literal& expr) override;
@@ -43,6 +48,9 @@ struct evaluator final : visitor
   private:
     void apply_function(const object* function_or_builtin, array_object::value_type&& args);
     auto evaluate_expressions(const expressions& exprs) -> array_object::value_type;
+    [[nodiscard]] auto environment_of(const identifier& expr) const -> environment*;
     environment* m_env {};
+    const name_resolution* m_resolution {};
     const object* m_result {};
+    std::shared_ptr<const ast_arena> m_nodes;
 };
@@ -51,15 +51,6 @@ auto allocate(Args&&... args) -> T*
     return p;
 }
 
-template<typename T, typename... Args>
-    requires std::derived_from<T, struct expression>
-auto allocate(Args&&... args) -> T*
-{
-    T* p = new T(std::forward<Args>(args)...);
-    gc<expression>::track(p);
-    return p;
-}
-
 template<typename T, typename... Args>
 auto allocate(Args&&... args) -> T*
 {
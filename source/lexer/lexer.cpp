@@ -3,25 +3,35 @@
 
 #include <algorithm>
 #include <array>
-#include <cctype>
+#include <bit>
+#include <cstddef>
 #include <cstdint>
 #include <limits>
+#include <memory>
+#include <stdexcept>
 #include <string_view>
-#include <unordered_map>
 #include <utility>
 
 #include "lexer.hpp"
 
 #include <doctest/doctest.h>
+#include <fmt/format.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#    include <emmintrin.h>
+#    define CAPPUCHIN_LEXER_SSE2
+#endif
 
 #include "location.hpp"
 #include "token.hpp"
 #include "token_type.hpp"
 
-using char_literal_lookup_table = std::array<token_type, std::numeric_limits<unsigned char>::max()>;
-
 namespace
 {
+constexpr auto byte_count = static_cast<std::size_t>(std::numeric_limits<unsigned char>::max()) + 1;
+
+using char_literal_lookup_table = std::array<token_type, byte_count>;
+
 constexpr auto build_char_to_token_type_map() -> char_literal_lookup_table
 {
     auto arr = char_literal_lookup_table {};
@@ -56,266 +66,304 @@ constexpr auto build_char_to_token_type_map() -> char_literal_lookup_table
 }
 
 constexpr auto char_literal_tokens = build_char_to_token_type_map();
-constexpr auto keyword_count = 11;
-using keyword_pair = std::pair<std::string_view, token_type>;
-using keyword_lookup_table = std::array<keyword_pair, keyword_count>;
 
-constexpr auto build_keyword_to_token_type_map() -> keyword_lookup_table
+enum class char_class : std::uint8_t
 {
-    return {
-        std::pair {"fn", token_type::function},
-        std::pair {"let", token_type::let},
-        std::pair {"true", token_type::tru},
-        std::pair {"false", token_type::fals},
-        std::pair {"if", token_type::eef},
-        std::pair {"else", token_type::elze},
-        std::pair {"while", token_type::hwile},
-        std::pair {"return", token_type::ret},
-        std::pair {"break", token_type::brake},
-        std::pair {"continue", token_type::cont},
-        std::pair {"null", token_type::null},
-    };
+    other,
+    end,
+    whitespace,
+    letter,
+    digit,
+    quote,
+    punctuation,
+};
+
+using char_class_lookup_table = std::array<char_class, byte_count>;
+
+constexpr auto build_char_class_map() -> char_class_lookup_table
+{
+    auto arr = char_class_lookup_table {};
+    using enum char_class;
+    arr.fill(other);
+    arr['\0'] = end;
+    for (const auto chr : {' ', '\t', '\n', '\r'}) {
+        arr[static_cast<unsigned char>(chr)] = whitespace;
+    }
+    for (auto chr = 'a'; chr <= 'z'; ++chr) {
+        arr[static_cast<unsigned char>(chr)] = letter;
+        arr[static_cast<unsigned char>(chr - 'a' + 'A')] = letter;
+    }
+    arr['_'] = letter;
+    for (auto chr = '0'; chr <= '9'; ++chr) {
+        arr[static_cast<unsigned char>(chr)] = digit;
+    }
+    arr['"'] = quote;
+    for (std::size_t chr = 0; chr < byte_count; ++chr) {
+        if (char_literal_tokens.at(chr) != token_type::illegal) {
+            arr.at(chr) = punctuation;
+        }
+    }
+    return arr;
 }
 
-constexpr auto keyword_tokens = build_keyword_to_token_type_map();
+constexpr auto char_classes = build_char_class_map();
+
+// keywords are distinguished by their first character and their length alone,
+// which makes (first + 4 * length) % 32 a collision free hash over all of them
+constexpr auto keyword_table_size = 32U;
+using keyword_pair = std::pair<std::string_view, token_type>;
+using keyword_lookup_table = std::array<keyword_pair, keyword_table_size>;
 
-using token_pair = std::pair<token_type, token_type>;
+constexpr auto keyword_hash(const char first, const std::size_t length) -> std::size_t
+{
+    return (static_cast<unsigned char>(first) + (4 * length)) % keyword_table_size;
+}
 
-struct token_pair_hash
+constexpr auto build_keyword_to_token_type_map() -> keyword_lookup_table
 {
-    auto operator()(const std::pair<token_type, token_type>& pair) const -> size_t
+    auto table = keyword_lookup_table {};
+    for (const auto& [keyword, type] : {
+             std::pair {std::string_view {"fn"}, token_type::function},
+             std::pair {std::string_view {"let"}, token_type::let},
+             std::pair {std::string_view {"true"}, token_type::tru},
+             std::pair {std::string_view {"false"}, token_type::fals},
+             std::pair {std::string_view {"if"}, token_type::eef},
+             std::pair {std::string_view {"else"}, token_type::elze},
+             std::pair {std::string_view {"while"}, token_type::hwile},
+             std::pair {std::string_view {"return"}, token_type::ret},
+             std::pair {std::string_view {"break"}, token_type::brake},
+             std::pair {std::string_view {"continue"}, token_type::cont},
+             std::pair {std::string_view {"null"}, token_type::null},
+         })
     {
-        return static_cast<uint8_t>(pair.first) ^ static_cast<uint8_t>(static_cast<uint8_t>(pair.second) << 4U);
+        auto& slot = table.at(keyword_hash(keyword.front(), keyword.size()));
+        if (!slot.first.empty()) {
+            throw std::logic_error("keyword hash collision");
+        }
+        slot = {keyword, type};
     }
-};
+    return table;
+}
 
-using two_token_lookup = std::unordered_map<token_pair, token, token_pair_hash>;
+constexpr auto keyword_tokens = build_keyword_to_token_type_map();
 
-auto build_two_token_lookup() -> two_token_lookup
+constexpr auto two_char_operator(const char first, const char second) -> token_type
 {
     using enum token_type;
-    two_token_lookup lookup;
+    switch (first) {
+        case '=':
+            return second == '=' ? equals : illegal;
+        case '!':
+            return second == '=' ? not_equals : illegal;
+        case '<':
+            return second == '<' ? shift_left : second == '=' ? less_equal : illegal;
+        case '>':
+            return second == '>' ? shift_right : second == '=' ? greater_equal : illegal;
+        case '&':
+            return second == '&' ? logical_and : illegal;
+        case '|':
+            return second == '|' ? logical_or : illegal;
+        case '/':
+            return second == '/' ? double_slash : illegal;
+        default:
+            return illegal;
+    }
+}
+
+inline auto class_of(const char chr) -> char_class
+{
+    return char_classes[static_cast<unsigned char>(chr)];
+}
+
+// most runs are only a few bytes long and cheaper to scan one byte at a time, chunks only pay off beyond that
+constexpr auto short_run = 8U;
 
-    lookup.insert({{assign, assign},
-                   {
-                       .type = equals,
-                       .literal = "==",
-                       .loc = {},
-                   }});
-    lookup.insert({{exclamation, assign},
-                   {
-                       .type = not_equals,
-                       .literal = "!=",
-                       .loc = {},
-                   }});
-    lookup.insert({{exclamation, assign},
-                   {
-                       .type = not_equals,
-                       .literal = "!=",
-                       .loc = {},
-                   }});
-    lookup.insert({{less_than, less_than},
-                   {
-                       .type = shift_left,
-                       .literal = "<<",
-                       .loc = {},
-                   }});
-    lookup.insert({{greater_than, greater_than},
-                   {
-                       .type = shift_right,
-                       .literal = ">>",
-                       .loc = {},
-                   }});
-    lookup.insert({{ampersand, ampersand},
-                   {
-                       .type = logical_and,
-                       .literal = "&&",
-                       .loc = {},
-                   }});
-    lookup.insert({{pipe, pipe},
-                   {
-                       .type = logical_or,
-                       .literal = "||",
-                       .loc = {},
-                   }});
-    lookup.insert({{slash, slash},
-                   {
-                       .type = double_slash,
-                       .literal = "//",
-                       .loc = {},
-                   }});
-    lookup.insert({{greater_than, assign},
-                   {
-                       .type = greater_equal,
-                       .literal = ">=",
-                       .loc = {},
-                   }});
-    lookup.insert({{less_than, assign},
-                   {
-                       .type = less_equal,
-                       .literal = "<=",
-                       .loc = {},
-                   }});
-    return lookup;
+#if defined(CAPPUCHIN_LEXER_SSE2)
+constexpr auto chunk_width = sizeof(__m128i);
+constexpr auto all_bytes = 0xFFFFU;
+
+inline auto load_chunk(const std::string_view input, const std::size_t position) -> __m128i
+{
+    // NOLINTNEXTLINE(*-reinterpret-cast)
+    return _mm_loadu_si128(reinterpret_cast<const __m128i*>(input.data() + position));
+}
+
+inline auto byte_mask(const __m128i chunk, const char chr) -> unsigned
+{
+    return static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, _mm_set1_epi8(chr))));
 }
 
-inline auto is_letter(const char chr) -> bool
+inline auto letter_mask(const __m128i chunk) -> unsigned
 {
-    return std::isalpha(static_cast<unsigned char>(chr)) != 0 || chr == '_';
+    // bytes above 0x7f compare as negative and therefore never fall into the range
+    const auto lower = _mm_or_si128(chunk, _mm_set1_epi8(0x20));
+    const auto from_a = _mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1));
+    const auto to_z = _mm_cmplt_epi8(lower, _mm_set1_epi8('z' + 1));
+    return static_cast<unsigned>(_mm_movemask_epi8(_mm_and_si128(from_a, to_z))) | byte_mask(chunk, '_');
 }
 
-inline auto is_digit(const char chr) -> bool
+inline auto whitespace_mask(const __m128i chunk) -> unsigned
 {
-    return std::isdigit(static_cast<unsigned char>(chr)) != 0;
+    return byte_mask(chunk, ' ') | byte_mask(chunk, '\n') | byte_mask(chunk, '\t') | byte_mask(chunk, '\r');
+}
+#endif
+
+// returns the end of the run of bytes starting at position that all belong to cls
+inline auto scan_run(const std::string_view input, std::size_t position, const char_class cls) -> std::size_t
+{
+    auto limit = std::min(input.size(), position + short_run);
+    while (true) {
+        while (position < limit && class_of(input[position]) == cls) {
+            ++position;
+        }
+        if (position < limit || limit == input.size()) {
+            return position;
+        }
+#if defined(CAPPUCHIN_LEXER_SSE2)
+        for (; position + chunk_width <= input.size(); position += chunk_width) {
+            const auto chunk = load_chunk(input, position);
+            const auto matches = cls == char_class::letter ? letter_mask(chunk) : whitespace_mask(chunk);
+            if (const auto mismatches = matches ^ all_bytes; mismatches != 0) {
+                return position + static_cast<std::size_t>(std::countr_zero(mismatches));
+            }
+        }
+#endif
+        limit = input.size();
+    }
 }
 
 }  // namespace
 
 lexer::lexer(const std::string_view input, const std::string_view filename)
     : m_input {input}
-    , m_filename {filename}
+    , m_source {std::make_shared<source_file>(filename, input)}
+{
+    // one past the end is still a valid offset, it is where an unterminated string leaves the eof token
+    if (input.size() >= std::numeric_limits<std::uint32_t>::max()) {
+        throw std::length_error(fmt::format("{}: input of {} bytes is too large", filename, input.size()));
+    }
+}
+
+auto lexer::source() const -> const std::shared_ptr<const source_file>&
 {
-    read_char();
+    return m_source;
 }
 
 auto lexer::next_token() -> token
 {
     using enum token_type;
     skip_whitespace();
-    const auto loc = current_loc();
-    if (m_byte == '\0') {
-        return token {.type = eof, .literal = "", .loc = loc};
-    }
-    const auto as_uchar = static_cast<unsigned char>(m_byte);
-    const auto char_token_type = char_literal_tokens[as_uchar];
-    const static auto two_token = build_two_token_lookup();
-    if (char_token_type != illegal) {
-        const auto peek_token_type = char_literal_tokens[static_cast<unsigned char>(peek_char())];
-        if (const auto itr = two_token.find({char_token_type, peek_token_type}); itr != two_token.end()) {
-            return read_char(), read_char(), itr->second.with_loc(loc);
+    const auto position = m_position;
+    const auto chr = byte_at(position);
+    switch (class_of(chr)) {
+        case char_class::end:
+            return token {.type = eof, .literal = "", .loc = current_loc()};
+        case char_class::letter:
+            return read_identifier_or_keyword();
+        case char_class::digit:
+            return read_number();
+        case char_class::quote:
+            return read_string();
+        case char_class::punctuation: {
+            if (const auto type = two_char_operator(chr, byte_at(position + 1)); type != illegal) {
+                m_position += 2;
+                return token {.type = type, .literal = m_input.substr(position, 2), .loc = current_loc(position)};
+            }
+            ++m_position;
+            return token {
+                .type = char_literal_tokens[static_cast<unsigned char>(chr)],
+                .literal = m_input.substr(position, 1),
+                .loc = current_loc(position),
+            };
         }
-        return read_char(),
-               token {
-                   .type = char_token_type,
-                   .literal = std::string_view {&m_input[m_position - 1], 1},
-                   .loc = loc,
-               };
-    }
-    if (m_byte == '"') {
-        return read_string();
-    }
-    if (is_letter(m_byte)) {
-        return read_identifier_or_keyword();
+        default:
+            ++m_position;
+            return token {.type = illegal, .literal = m_input.substr(position, 1), .loc = current_loc(position)};
     }
-    if (is_digit(m_byte)) {
-        return read_number();
-    }
-    return read_char(),
-           token {
-               .type = token_type::illegal,
-               .literal = m_input.substr(m_position - 1, 1),
-               .loc = loc,
-           };
 }
 
-auto lexer::read_char() -> void
+auto lexer::byte_at(const std::size_t position) const -> char
 {
-    if (m_read_position >= m_input.size()) {
-        m_byte = '\0';
-    } else {
-        m_byte = m_input[m_read_position];
-    }
-    if (m_byte == '\n') {
-        m_row++;
-        m_bol = m_read_position;
-    }
-    m_position = m_read_position;
-    m_read_position++;
+    return position < m_input.size() ? m_input[position] : '\0';
 }
 
 auto lexer::skip_whitespace() -> void
 {
-    while (m_byte == ' ' || m_byte == '\t' || m_byte == '\n' || m_byte == '\r') {
-        read_char();
-    }
-}
-
-auto lexer::peek_char() const -> std::string_view::value_type
-{
-    if (m_read_position >= m_input.size()) {
-        return '\0';
-    }
-    return m_input[m_read_position];
+    m_position = scan_run(m_input, m_position, char_class::whitespace);
 }
 
 auto lexer::read_identifier_or_keyword() -> token
 {
-    const auto loc = current_loc();
     const auto position = m_position;
-    while (is_letter(m_byte)) {
-        read_char();
+    m_position = scan_run(m_input, position + 1, char_class::letter);
+    const auto identifier_or_keyword = m_input.substr(position, m_position - position);
+    const auto hash = keyword_hash(identifier_or_keyword.front(), identifier_or_keyword.size());
+    if (const auto& [keyword, type] = keyword_tokens[hash]; keyword == identifier_or_keyword) {
+        return token {.type = type, .literal = keyword, .loc = current_loc(position)};
     }
-    const auto end = m_position;
-    const auto count = end - position;
-    const auto identifier_or_keyword = m_input.substr(position, count);
-    // MSVC compiler will not be happy with a const auto* const itr here
-    // NOLINTBEGIN(*-qualified-auto)
-    const auto itr =
-        std::find_if(keyword_tokens.cbegin(),
-                     keyword_tokens.cend(),
-                     [&identifier_or_keyword](auto pair) -> bool { return pair.first == identifier_or_keyword; });
-    if (itr != keyword_tokens.end()) {
-        return token {.type = itr->second, .literal = itr->first, .loc = loc};
-    }
-    // NOLINTEND(*-qualified-auto)
-    return token {.type = token_type::ident, .literal = identifier_or_keyword, .loc = loc};
+    return token {.type = token_type::ident, .literal = identifier_or_keyword, .loc = current_loc(position)};
 }
 
 auto lexer::read_number() -> token
 {
-    const auto loc = current_loc();
     const auto position = m_position;
     int dot_count = 0;
-    while (is_digit(m_byte) || m_byte == '.') {
-        if (m_byte == '.') {
+    for (auto chr = byte_at(m_position); class_of(chr) == char_class::digit || chr == '.'; chr = byte_at(m_position)) {
+        if (chr == '.') {
             dot_count++;
         }
-        read_char();
+        ++m_position;
     }
-    const auto end = m_position;
-    const auto count = end - position;
+    const auto literal = m_input.substr(position, m_position - position);
+    const auto loc = current_loc(position);
     if (dot_count == 0) {
-        return token {.type = token_type::integer, .literal = m_input.substr(position, count), .loc = loc};
+        return token {.type = token_type::integer, .literal = literal, .loc = loc};
     }
     if (dot_count == 1) {
-        return token {.type = token_type::decimal, .literal = m_input.substr(position, count), .loc = loc};
+        return token {.type = token_type::decimal, .literal = literal, .loc = loc};
     }
-    return token {.type = token_type::illegal, .literal = m_input.substr(position, count), .loc = loc};
+    return token {.type = token_type::illegal, .literal = literal, .loc = loc};
 }
 
 auto lexer::read_string() -> token
 {
     const auto loc = current_loc();
     const auto position = m_position + 1;
-    while (true) {
-        read_char();
-        if (m_byte == '"' || m_byte == '\0') {
-            break;
-        }
+    auto end = position;
+    while (end < m_input.size() && m_input[end] != '"' && m_input[end] != '\0') {
+        ++end;
     }
-    auto end = m_position;
-    auto count = end - position;
-    return read_char(), token {.type = token_type::string, .literal = m_input.substr(position, count), .loc = loc};
+    // an unterminated string swallows the end of input just like a terminated one its closing quote
+    m_position = end + 1;
+    return token {.type = token_type::string, .literal = m_input.substr(position, end - position), .loc = loc};
 }
 
 auto lexer::current_loc() const -> location
 {
-    const auto column = m_row == 0 ? m_read_position - m_bol : m_read_position - m_bol - 1;
-    return location {.filename = m_filename, .line = m_row + 1, .column = column};
+    return current_loc(m_position);
+}
+
+auto lexer::current_loc(const std::size_t position) const -> location
+{
+    return location {.file = m_source.get(), .offset = static_cast<std::uint32_t>(position)};
 }
 
 namespace
 {
+struct expected_token
+{
+    token_type type;
+    std::string_view literal;
+    resolved_location loc;
+};
+
+auto check_token(const token& actual, const expected_token& expected) -> void
+{
+    CHECK_EQ(actual.type, expected.type);
+    CHECK_EQ(actual.literal, expected.literal);
+    CHECK_EQ(actual.loc.resolve(), expected.loc);
+}
+
 TEST_CASE("lexing")
 {
     using enum token_type;
@@ -357,742 +405,742 @@ null
 >=
 )"};
     constexpr std::array expected_tokens {
-        token {.type = let,
+        expected_token {.type = let,
                .literal = "let",
                .loc {
                    .filename = "<stdin>",
                    .line = 1,
                    .column = 1,
                }},
-        token {.type = ident,
+        expected_token {.type = ident,
                .literal = "five",
                .loc {
                    .filename = "<stdin>",
                    .line = 1,
                    .column = 5,
                }},
-        token {.type = assign,
+        expected_token {.type = assign,
                .literal = "=",
                .loc {
                    .filename = "<stdin>",
                    .line = 1,
                    .column = 10,
                }},
-        token {.type = integer,
+        expected_token {.type = integer,
                .literal = "5",
                .loc {
                    .filename = "<stdin>",
                    .line = 1,
                    .column = 12,
                }},
-        token {.type = semicolon,
+        expected_token {.type = semicolon,
                .literal = ";",
                .loc {
                    .filename = "<stdin>",
                    .line = 1,
                    .column = 13,
                }},
-        token {.type = let,
+        expected_token {.type = let,
                .literal = "let",
                .loc {
                    .filename = "<stdin>",
                    .line = 2,
                    .column = 1,
                }},
-        token {.type = ident,
+        expected_token {.type = ident,
                .literal = "ten",
                .loc {
                    .filename = "<stdin>",
                    .line = 2,
                    .column = 5,
                }},
-        token {.type = assign,
+        expected_token {.type = assign,
                .literal = "=",
                .loc {
                    .filename = "<stdin>",
                    .line = 2,
                    .column = 9,
                }},
-        token {.type = integer,
+        expected_token {.type = integer,
                .literal = "10",
                .loc {
                    .filename = "<stdin>",
                    .line = 2,
                    .column = 11,
                }},
-        token {.type = semicolon,
+        expected_token {.type = semicolon,
                .literal = ";",
                .loc {
                    .filename = "<stdin>",
                    .line = 2,
                    .column = 13,
                }},
-        token {.type = let,
+        expected_token {.type = let,
                .literal = "let",
                .loc {
                    .filename = "<stdin>",
                    .line = 3,
                    .column = 1,
                }},
-        token {.type = ident,
+        expected_token {.type = ident,
                .literal = "add",
                .loc {
                    .filename = "<stdin>",
                    .line = 3,
                    .column = 5,
                }},
-        token {.type = assign,
+        expected_token {.type = assign,
                .literal = "=",
                .loc {
                    .filename = "<stdin>",
                    .line = 3,
                    .column = 9,
                }},
-        token {.type = function,
+        expected_token {.type = function,
                .literal = "fn",
                .loc {
                    .filename = "<stdin>",
                    .line = 3,
                    .column = 11,
                }},
-        token {.type = lparen,
+        expected_token {.type = lparen,
                .literal = "(",
                .loc {
                    .filename = "<stdin>",
                    .line = 3,
                    .column = 13,
                }},
-        token {.type = ident,
+        expected_token {.type = ident,
                .literal = "x",
                .loc {
                    .filename = "<stdin>",
                    .line = 3,
                    .column = 14,
                }},
-        token {.type = comma,
+        expected_token {.type = comma,
                .literal = ",",
                .loc {
                    .filename = "<stdin>",
                    .line = 3,
                    .column = 15,
                }},
-        token {.type = ident,
+        expected_token {.type = ident,
                .literal = "y",
                .loc {
                    .filename = "<stdin>",
                    .line = 3,
                    .column = 17,
                }},
-        token {.type = rparen,
+        expected_token {.type = rparen,
                .literal = ")",
                .loc {
                    .filename = "<stdin>",
                    .line = 3,
                    .column = 18,
                }},
-        token {.type = lsquirly,
+        expected_token {.type = lsquirly,
                .literal = "{",
                .loc {
                    .filename = "<stdin>",
                    .line = 3,
                    .column = 20,
                }},
-        token {.type = ident,
+        expected_token {.type = ident,
                .literal = "x",
                .loc {
                    .filename = "<stdin>",
                    .line = 4,
                    .column = 1,
                }},
-        token {.type = plus,
+        expected_token {.type = plus,
                .literal = "+",
                .loc {
                    .filename = "<stdin>",
                    .line = 4,
                    .column = 3,
                }},
-        token {.type = ident,
+        expected_token {.type = ident,
                .literal = "y",
                .loc {
                    .filename = "<stdin>",
                    .line = 4,
                    .column = 5,
                }},
-        token {.type = semicolon,
+        expected_token {.type = semicolon,
                .literal = ";",
                .loc {
                    .filename = "<stdin>",
                    .line = 4,
                    .column = 6,
                }},
-        token {.type = rsquirly,
+        expected_token {.type = rsquirly,
                .literal = "}",
                .loc {
                    .filename = "<stdin>",
                    .line = 5,
                    .column = 1,
                }},
-        token {.type = semicolon,
+        expected_token {.type = semicolon,
                .literal = ";",
                .loc {
                    .filename = "<stdin>",
                    .line = 5,
                    .column = 2,
                }},
-        token {.type = let,
+        expected_token {.type = let,
                .literal = "let",
                .loc {
                    .filename = "<stdin>",
                    .line = 6,
                    .column = 1,
                }},
-        token {.type = ident,
+        expected_token {.type = ident,
                .literal = "result",
                .loc {
                    .filename = "<stdin>",
                    .line = 6,
                    .column = 5,
                }},
-        token {.type = assign,
+        expected_token {.type = assign,
                .literal = "=",
                .loc {
                    .filename = "<stdin>",
                    .line = 6,
                    .column = 12,
                }},
-        token {.type = ident,
+        expected_token {.type = ident,
                .literal = "add",
                .loc {
                    .filename = "<stdin>",
                    .line = 6,
                    .column = 14,
                }},
-        token {.type = lparen,
+        expected_token {.type = lparen,
                .literal = "(",
                .loc {
                    .filename = "<stdin>",
                    .line = 6,
                    .column = 17,
                }},
-        token {.type = ident,
+        expected_token {.type = ident,
                .literal = "five",
                .loc {
                    .filename = "<stdin>",
                    .line = 6,
                    .column = 18,
                }},
-        token {.type = comma,
+        expected_token {.type = comma,
                .literal = ",",
                .loc {
                    .filename = "<stdin>",
                    .line = 6,
                    .column = 22,
                }},
-        token {.type = ident,
+        expected_token {.type = ident,
                .literal = "ten",
                .loc {
                    .filename = "<stdin>",
                    .line = 6,
                    .column = 24,
                }},
-        token {.type = rparen,
+        expected_token {.type = rparen,
                .literal = ")",
                .loc {
                    .filename = "<stdin>",
                    .line = 6,
                    .column = 27,
                }},
-        token {.type = semicolon,
+        expected_token {.type = semicolon,
                .literal = ";",
                .loc {
                    .filename = "<stdin>",
                    .line = 6,
                    .column = 28,
                }},
-        token {.type = exclamation,
+        expected_token {.type = exclamation,
                .literal = "!",
                .loc {
                    .filename = "<stdin>",
                    .line = 7,
                    .column = 1,
                }},
-        token {.type = minus,
+        expected_token {.type = minus,
                .literal = "-",
                .loc {
                    .filename = "<stdin>",
                    .line = 7,
                    .column = 2,
                }},
-        token {.type = slash,
+        expected_token {.type = slash,
                .literal = "/",
                .loc {
                    .filename = "<stdin>",
                    .line = 7,
                    .column = 3,
                }},
-        token {.type = asterisk,
+        expected_token {.type = asterisk,
                .literal = "*",
                .loc {
                    .filename = "<stdin>",
                    .line = 7,
                    .column = 4,
                }},
-        token {.type = integer,
+        expected_token {.type = integer,
                .literal = "5",
                .loc {
                    .filename = "<stdin>",
                    .line = 7,
                    .column = 5,
                }},
-        token {.type = semicolon,
+        expected_token {.type = semicolon,
                .literal = ";",
                .loc {
                    .filename = "<stdin>",
                    .line = 7,
                    .column = 6,
                }},
-        token {.type = integer,
+        expected_token {.type = integer,
                .literal = "5",
                .loc {
                    .filename = "<stdin>",
                    .line = 8,
                    .column = 1,
                }},
-        token {.type = less_than,
+        expected_token {.type = less_than,
                .literal = "<",
                .loc {
                    .filename = "<stdin>",
                    .line = 8,
                    .column = 3,
                }},
-        token {.type = integer,
+        expected_token {.type = integer,
                .literal = "10",
                .loc {
                    .filename = "<stdin>",
                    .line = 8,
                    .column = 5,
                }},
-        token {.type = greater_than,
+        expected_token {.type = greater_than,
                .literal = ">",
                .loc {
                    .filename = "<stdin>",
                    .line = 8,
                    .column = 8,
                }},
-        token {.type = integer,
+        expected_token {.type = integer,
                .literal = "5",
                .loc {
                    .filename = "<stdin>",
                    .line = 8,
                    .column = 10,
                }},
-        token {.type = semicolon,
+        expected_token {.type = semicolon,
                .literal = ";",
                .loc {
                    .filename = "<stdin>",
                    .line = 8,
                    .column = 11,
                }},
-        token {.type = eef,
+        expected_token {.type = eef,
                .literal = "if",
                .loc {
                    .filename = "<stdin>",
                    .line = 9,
                    .column = 1,
                }},
-        token {.type = lparen,
+        expected_token {.type = lparen,
                .literal = "(",
                .loc {
                    .filename = "<stdin>",
                    .line = 9,
                    .column = 4,
                }},
-        token {.type = integer,
+        expected_token {.type = integer,
                .literal = "5",
                .loc {
                    .filename = "<stdin>",
                    .line = 9,
                    .column = 5,
                }},
-        token {.type = less_than,
+        expected_token {.type = less_than,
                .literal = "<",
                .loc {
                    .filename = "<stdin>",
                    .line = 9,
                    .column = 7,
                }},
-        token {.type = integer,
+        expected_token {.type = integer,
                .literal = "10",
                .loc {
                    .filename = "<stdin>",
                    .line = 9,
                    .column = 9,
                }},
-        token {.type = rparen,
+        expected_token {.type = rparen,
                .literal = ")",
                .loc {
                    .filename = "<stdin>",
                    .line = 9,
                    .column = 11,
                }},
-        token {.type = lsquirly,
+        expected_token {.type = lsquirly,
                .literal = "{",
                .loc {
                    .filename = "<stdin>",
                    .line = 9,
                    .column = 13,
                }},
-        token {.type = ret,
+        expected_token {.type = ret,
                .literal = "return",
                .loc {
                    .filename = "<stdin>",
                    .line = 10,
                    .column = 1,
                }},
-        token {.type = tru,
+        expected_token {.type = tru,
                .literal = "true",
                .loc {
                    .filename = "<stdin>",
                    .line = 10,
                    .column = 8,
                }},
-        token {.type = semicolon,
+        expected_token {.type = semicolon,
                .literal = ";",
                .loc {
                    .filename = "<stdin>",
                    .line = 10,
                    .column = 12,
                }},
-        token {.type = rsquirly,
+        expected_token {.type = rsquirly,
                .literal = "}",
                .loc {
                    .filename = "<stdin>",
                    .line = 11,
                    .column = 1,
                }},
-        token {.type = elze,
+        expected_token {.type = elze,
                .literal = "else",
                .loc {
                    .filename = "<stdin>",
                    .line = 11,
                    .column = 3,
                }},
-        token {.type = lsquirly,
+        expected_token {.type = lsquirly,
                .literal = "{",
                .loc {
                    .filename = "<stdin>",
                    .line = 11,
                    .column = 8,
                }},
-        token {.type = ret,
+        expected_token {.type = ret,
                .literal = "return",
                .loc {
                    .filename = "<stdin>",
                    .line = 12,
                    .column = 1,
                }},
-        token {.type = fals,
+        expected_token {.type = fals,
                .literal = "false",
                .loc {
                    .filename = "<stdin>",
                    .line = 12,
                    .column = 8,
                }},
-        token {.type = semicolon,
+        expected_token {.type = semicolon,
                .literal = ";",
                .loc {
                    .filename = "<stdin>",
                    .line = 12,
                    .column = 13,
                }},
-        token {.type = rsquirly,
+        expected_token {.type = rsquirly,
                .literal = "}",
                .loc {
                    .filename = "<stdin>",
                    .line = 13,
                    .column = 1,
                }},
-        token {.type = integer,
+        expected_token {.type = integer,
                .literal = "10",
                .loc {
                    .filename = "<stdin>",
                    .line = 14,
                    .column = 1,
                }},
-        token {.type = equals,
+        expected_token {.type = equals,
                .literal = "==",
                .loc {
                    .filename = "<stdin>",
                    .line = 14,
                    .column = 4,
                }},
-        token {.type = integer,
+        expected_token {.type = integer,
                .literal = "10",
                .loc {
                    .filename = "<stdin>",
                    .line = 14,
                    .column = 7,
                }},
-        token {.type = semicolon,
+        expected_token {.type = semicolon,
                .literal = ";",
                .loc {
                    .filename = "<stdin>",
                    .line = 14,
                    .column = 9,
                }},
-        token {.type = integer,
+        expected_token {.type = integer,
                .literal = "10",
                .loc {
                    .filename = "<stdin>",
                    .line = 15,
                    .column = 1,
                }},
-        token {.type = not_equals,
+        expected_token {.type = not_equals,
                .literal = "!=",
                .loc {
                    .filename = "<stdin>",
                    .line = 15,
                    .column = 4,
                }},
-        token {.type = integer,
+        expected_token {.type = integer,
                .literal = "9",
                .loc {
                    .filename = "<stdin>",
                    .line = 15,
                    .column = 7,
                }},
-        token {.type = semicolon,
+        expected_token {.type = semicolon,
                .literal = ";",
                .loc {
                    .filename = "<stdin>",
                    .line = 15,
                    .column = 8,
                }},
-        token {.type = string,
+        expected_token {.type = string,
                .literal = "foobar",
                .loc {
                    .filename = "<stdin>",
                    .line = 16,
                    .column = 1,
                }},
-        token {.type = string,
+        expected_token {.type = string,
                .literal = "foo bar",
                .loc {
                    .filename = "<stdin>",
                    .line = 17,
                    .column = 1,
                }},
-        token {.type = string,
+        expected_token {.type = string,
                .literal = "",
                .loc {
                    .filename = "<stdin>",
                    .line = 18,
                    .column = 1,
                }},
-        token {.type = lbracket,
+        expected_token {.type = lbracket,
                .literal = "[",
                .loc {
                    .filename = "<stdin>",
                    .line = 19,
                    .column = 1,
                }},
-        token {.type = integer,
+        expected_token {.type = integer,
                .literal = "1",
                .loc {
                    .filename = "<stdin>",
                    .line = 19,
                    .column = 2,
                }},
-        token {.type = comma,
+        expected_token {.type = comma,
                .literal = ",",
                .loc {
                    .filename = "<stdin>",
                    .line = 19,
                    .column = 3,
                }},
-        token {.type = integer,
+        expected_token {.type = integer,
                .literal = "2",
                .loc {
                    .filename = "<stdin>",
                    .line = 19,
                    .column = 4,
                }},
-        token {.type = rbracket,
+        expected_token {.type = rbracket,
                .literal = "]",
                .loc {
                    .filename = "<stdin>",
                    .line = 19,
                    .column = 5,
                }},
-        token {.type = semicolon,
+        expected_token {.type = semicolon,
                .literal = ";",
                .loc {
                    .filename = "<stdin>",
                    .line = 19,
                    .column = 6,
                }},
-        token {.type = lsquirly,
+        expected_token {.type = lsquirly,
                .literal = "{",
                .loc {
                    .filename = "<stdin>",
                    .line = 20,
                    .column = 1,
                }},
-        token {.type = string,
+        expected_token {.type = string,
                .literal = "foo",
                .loc {
                    .filename = "<stdin>",
                    .line = 20,
                    .column = 2,
                }},
-        token {.type = colon,
+        expected_token {.type = colon,
                .literal = ":",
                .loc {
                    .filename = "<stdin>",
                    .line = 20,
                    .column = 7,
                }},
-        token {.type = string,
+        expected_token {.type = string,
                .literal = "bar",
                .loc {
                    .filename = "<stdin>",
                    .line = 20,
                    .column = 9,
                }},
-        token {.type = rsquirly,
+        expected_token {.type = rsquirly,
                .literal = "}",
                .loc {
                    .filename = "<stdin>",
                    .line = 20,
                    .column = 14,
                }},
-        token {.type = semicolon,
+        expected_token {.type = semicolon,
                .literal = ";",
                .loc {
                    .filename = "<stdin>",
                    .line = 20,
                    .column = 15,
                }},
-        token {.type = decimal,
+        expected_token {.type = decimal,
                .literal = "5.5",
                .loc {
                    .filename = "<stdin>",
                    .line = 21,
                    .column = 1,
                }},
-        token {.type = double_slash,
+        expected_token {.type = double_slash,
                .literal = "//",
                .loc {
                    .filename = "<stdin>",
                    .line = 21,
                    .column = 5,
                }},
-        token {.type = percent,
+        expected_token {.type = percent,
                .literal = "%",
                .loc {
                    .filename = "<stdin>",
                    .line = 21,
                    .column = 8,
                }},
-        token {.type = ampersand,
+        expected_token {.type = ampersand,
                .literal = "&",
                .loc {
                    .filename = "<stdin>",
                    .line = 22,
                    .column = 1,
                }},
-        token {.type = pipe,
+        expected_token {.type = pipe,
                .literal = "|",
                .loc {
                    .filename = "<stdin>",
                    .line = 23,
                    .column = 1,
                }},
-        token {.type = caret,
+        expected_token {.type = caret,
                .literal = "^",
                .loc {
                    .filename = "<stdin>",
                    .line = 24,
                    .column = 1,
                }},
-        token {.type = shift_left,
+        expected_token {.type = shift_left,
                .literal = "<<",
                .loc {
                    .filename = "<stdin>",
                    .line = 25,
                    .column = 1,
                }},
-        token {.type = shift_right,
+        expected_token {.type = shift_right,
                .literal = ">>",
                .loc {
                    .filename = "<stdin>",
                    .line = 26,
                    .column = 1,
                }},
-        token {.type = logical_and,
+        expected_token {.type = logical_and,
                .literal = "&&",
                .loc {
                    .filename = "<stdin>",
                    .line = 27,
                    .column = 1,
                }},
-        token {.type = logical_or,
+        expected_token {.type = logical_or,
                .literal = "||",
                .loc {
                    .filename = "<stdin>",
                    .line = 28,
                    .column = 1,
                }},
-        token {.type = ident,
+        expected_token {.type = ident,
                .literal = "a_b",
                .loc {
                    .filename = "<stdin>",
                    .line = 29,
                    .column = 1,
                }},
-        token {.type = hwile,
+        expected_token {.type = hwile,
                .literal = "while",
                .loc {
                    .filename = "<stdin>",
                    .line = 30,
                    .column = 1,
                }},
-        token {.type = brake,
+        expected_token {.type = brake,
                .literal = "break",
                .loc {
                    .filename = "<stdin>",
                    .line = 31,
                    .column = 1,
                }},
-        token {.type = cont,
+        expected_token {.type = cont,
                .literal = "continue",
                .loc {
                    .filename = "<stdin>",
                    .line = 32,
                    .column = 1,
                }},
-        token {.type = null,
+        expected_token {.type = null,
                .literal = "null",
                .loc {
                    .filename = "<stdin>",
                    .line = 33,
                    .column = 1,
                }},
-        token {.type = less_equal,
+        expected_token {.type = less_equal,
                .literal = "<=",
                .loc {
                    .filename = "<stdin>",
                    .line = 34,
                    .column = 1,
                }},
-        token {.type = greater_equal,
+        expected_token {.type = greater_equal,
                .literal = ">=",
                .loc {
                    .filename = "<stdin>",
                    .line = 35,
                    .column = 1,
                }},
-        token {.type = eof,
+        expected_token {.type = eof,
                .literal = "",
                .loc {
                    .filename = "<stdin>",
@@ -1101,9 +1149,49 @@ null
                }},
     };
 
-    for (const auto& expected_token : expected_tokens) {
-        auto token = lxr.next_token();
-        CHECK_EQ(token, expected_token);
+    for (const auto& expected : expected_tokens) {
+        check_token(lxr.next_token(), expected);
     }
 }
+
+TEST_CASE("lexingLongRunsAndEdgeCases")
+{
+    using enum token_type;
+    const auto* input = "  \t\r\n                    a_very_long_identifier_spanning_chunks fx nulls\n"
+                        "\n                  continue_ \"unterminated";
+    auto lxr = lexer {input};
+    const auto expected_tokens = std::array {
+        expected_token {.type = ident,
+               .literal = "a_very_long_identifier_spanning_chunks",
+               .loc {.filename = "<stdin>", .line = 2, .column = 21}},
+        expected_token {.type = ident, .literal = "fx", .loc {.filename = "<stdin>", .line = 2, .column = 60}},
+        expected_token {.type = ident, .literal = "nulls", .loc {.filename = "<stdin>", .line = 2, .column = 63}},
+        expected_token {.type = ident, .literal = "continue_", .loc {.filename = "<stdin>", .line = 4, .column = 19}},
+        expected_token {.type = string, .literal = "unterminated", .loc {.filename = "<stdin>", .line = 4, .column = 29}},
+        expected_token {.type = eof, .literal = "", .loc {.filename = "<stdin>", .line = 4, .column = 43}},
+    };
+    for (const auto& expected : expected_tokens) {
+        check_token(lxr.next_token(), expected);
+    }
+    CHECK_EQ(lxr.next_token().type, eof);
+
+    auto newlines_in_chunk = lexer {"x          \n    \n  y                                "};
+    newlines_in_chunk.next_token();
+    const auto last = newlines_in_chunk.next_token();
+    CHECK_EQ(last.literal, "y");
+    CHECK_EQ(last.loc.resolve().line, 3);
+    CHECK_EQ(last.loc.resolve().column, 3);
+}
+
+TEST_CASE("lexingNonAsciiBytesAsIllegal")
+{
+    using enum token_type;
+    auto lxr = lexer {"abc\xc3\xa4" "def"};
+    CHECK_EQ(lxr.next_token().literal, "abc");
+    CHECK_EQ(lxr.next_token().type, illegal);
+    CHECK_EQ(lxr.next_token().type, illegal);
+    const auto last = lxr.next_token();
+    CHECK_EQ(last.literal, "def");
+    CHECK_EQ(last.loc.resolve().column, 6);
+}
 }  // namespace
@@ -2,8 +2,11 @@
 // SPDX-License-Identifier: MIT-0
 
 #pragma once
+#include <cstddef>
+#include <memory>
 #include <string_view>
 
+#include "location.hpp"
 #include "token.hpp"
 
 class lexer final
@@ -12,21 +15,18 @@ class lexer final
     explicit lexer(std::string_view input, std::string_view filename = "<stdin>");
 
     auto next_token() -> token;
+    [[nodiscard]] auto source() const -> const std::shared_ptr<const source_file>&;
 
   private:
-    auto read_char() -> void;
+    auto byte_at(std::size_t position) const -> std::string_view::value_type;
     auto skip_whitespace() -> void;
-    auto peek_char() const -> std::string_view::value_type;
     auto read_identifier_or_keyword() -> token;
     auto read_number() -> token;
     auto read_string() -> token;
     auto current_loc() const -> location;
+    auto current_loc(std::size_t position) const -> location;
 
     std::string_view m_input;
-    std::string_view m_filename;
+    std::shared_ptr<const source_file> m_source;
     std::string_view::size_type m_position {0};
-    std::string_view::size_type m_bol {0};
-    std::string_view::size_type m_row {0};
-    std::string_view::size_type m_read_position {0};
-    std::string_view::value_type m_byte {0};
 };
@@ -1,10 +1,77 @@
 // Copyright 2023-2025 hrzlgnm
 // SPDX-License-Identifier: MIT-0
 
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
 #include "location.hpp"
 
-auto operator<<(std::ostream& os, const location& l) -> std::ostream&
+#include <doctest/doctest.h>
+#include <fmt/format.h>
+
+source_file::source_file(const std::string_view filename, const std::string_view text)
+    : m_filename {filename}
+    , m_text {text}
+{
+}
+
+auto source_file::line_starts() const -> const std::vector<std::uint32_t>&
+{
+    if (m_line_starts.empty()) {
+        m_line_starts.push_back(0);
+        for (std::size_t idx = 0; idx < m_text.size(); ++idx) {
+            if (m_text[idx] == '\n') {
+                m_line_starts.push_back(static_cast<std::uint32_t>(idx + 1));
+            }
+        }
+    }
+    return m_line_starts;
+}
+
+auto source_file::line_of(const std::uint32_t offset) const -> std::size_t
+{
+    const auto& starts = line_starts();
+    return static_cast<std::size_t>(std::ranges::upper_bound(starts, offset) - starts.begin());
+}
+
+auto source_file::column_of(const std::uint32_t offset) const -> std::size_t
+{
+    return offset - line_starts()[line_of(offset) - 1] + 1;
+}
+
+auto location::resolve() const -> resolved_location
+{
+    if (file == nullptr) {
+        return {.filename = {}, .line = 0, .column = 0};
+    }
+    return {.filename = file->filename(), .line = file->line_of(offset), .column = file->column_of(offset)};
+}
+
+auto operator<<(std::ostream& os, const resolved_location& l) -> std::ostream&
 {
     os << l.filename << ':' << l.line << ':' << l.column;
     return os;
 }
+
+auto operator<<(std::ostream& os, const location& l) -> std::ostream&
+{
+    return os << l.resolve();
+}
+
+namespace
+{
+TEST_CASE("resolvesOffsetsToLinesAndColumns")
+{
+    const auto file = source_file {"<stdin>", "let a = 1;\n\nlet b = 2;\n"};
+    CHECK_EQ(location {.file = &file, .offset = 0}.resolve(), resolved_location {"<stdin>", 1, 1});
+    CHECK_EQ(location {.file = &file, .offset = 4}.resolve(), resolved_location {"<stdin>", 1, 5});
+    CHECK_EQ(location {.file = &file, .offset = 10}.resolve(), resolved_location {"<stdin>", 1, 11});
+    CHECK_EQ(location {.file = &file, .offset = 11}.resolve(), resolved_location {"<stdin>", 2, 1});
+    CHECK_EQ(location {.file = &file, .offset = 16}.resolve(), resolved_location {"<stdin>", 3, 5});
+    CHECK_EQ(location {.file = &file, .offset = 23}.resolve(), resolved_location {"<stdin>", 4, 1});
+    CHECK_EQ(fmt::format("{}", location {.file = &file, .offset = 12}), "<stdin>:3:1");
+}
+}  // namespace
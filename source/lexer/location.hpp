@@ -2,21 +2,62 @@
 // SPDX-License-Identifier: MIT-0
 
 #pragma once
+#include <cstddef>
+#include <cstdint>
 #include <ostream>
 #include <string_view>
+#include <vector>
 
 #include <fmt/ostream.h>
 
-struct location final
+// A named source text. The index of line starts is only built once a location inside it is resolved,
+// which usually means an error is about to be reported.
+struct source_file final
+{
+    source_file(std::string_view filename, std::string_view text);
+
+    [[nodiscard]] auto filename() const -> std::string_view { return m_filename; }
+
+    [[nodiscard]] auto text() const -> std::string_view { return m_text; }
+
+    [[nodiscard]] auto line_of(std::uint32_t offset) const -> std::size_t;
+    [[nodiscard]] auto column_of(std::uint32_t offset) const -> std::size_t;
+
+  private:
+    auto line_starts() const -> const std::vector<std::uint32_t>&;
+
+    std::string_view m_filename;
+    std::string_view m_text;
+    mutable std::vector<std::uint32_t> m_line_starts;
+};
+
+// Human readable form of a location, with one based line and column.
+struct resolved_location final
 {
     std::string_view filename;
-    std::string::size_type line;
-    std::string::size_type column;
+    std::size_t line;
+    std::size_t column;
+    auto operator==(const resolved_location& other) const -> bool = default;
+};
+
+// Position of a token or node as a byte offset into its source file.
+struct location final
+{
+    const source_file* file {};
+    std::uint32_t offset {};
+
+    [[nodiscard]] auto resolve() const -> resolved_location;
     auto operator==(const location& other) const -> bool = default;
 };
 
+auto operator<<(std::ostream& os, const resolved_location& l) -> std::ostream&;
 auto operator<<(std::ostream& os, const location& l) -> std::ostream&;
 
+template<>
+struct fmt::formatter<resolved_location> : ostream_formatter
+{
+};
+
 template<>
 struct fmt::formatter<location> : ostream_formatter
 {
@@ -3,6 +3,7 @@
 
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
 #include <ostream>
 
@@ -72,6 +73,9 @@ enum class token_type : std::uint8_t
     null,
 };
 
+// number of token types, keep in sync with the last enumerator
+inline constexpr auto token_type_count = static_cast<std::size_t>(token_type::null) + 1;
+
 auto operator<<(std::ostream& ostream, token_type type) -> std::ostream&;
 
 template<>
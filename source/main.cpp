@@ -1,22 +1,34 @@
 // Copyright 2023-2025 hrzlgnm
 // SPDX-License-Identifier: MIT-0
 
+#include <algorithm>
+#include <chrono>
 #include <cstddef>
 #include <cstdint>
 #include <cstdlib>
 #include <exception>
+#include <filesystem>
 #include <fstream>
 #include <iostream>
 #include <iterator>
+#include <optional>
 #include <span>
+#include <stdexcept>
 #include <string>
 #include <string_view>
+#include <thread>
+#include <utility>
 #include <vector>
 
 #include <analyzer/analyzer.hpp>
 #include <builtin/builtin.hpp>
 #include <code/code.hpp>
+#include <code/register_code.hpp>
+#include <compiler/compilation_cache.hpp>
 #include <compiler/compiler.hpp>
+#include <compiler/image.hpp>
+#include <compiler/register_lowering.hpp>
+#include <compiler/ssa.hpp>
 #include <compiler/symbol_table.hpp>
 #include <eval/environment.hpp>
 #include <eval/evaluator.hpp>
@@ -26,6 +38,8 @@
 #include <lexer/lexer.hpp>
 #include <object/object.hpp>
 #include <parser/parser.hpp>
+#include <vm/register_vm.hpp>
+#include <vm/verifier.hpp>
 #include <vm/vm.hpp>
 
 namespace
@@ -80,6 +94,7 @@ enum class engine : std::uint8_t
 {
     vm,
     eval,
+    register_vm,
 };
 
 auto operator<<(std::ostream& strm, const engine en) -> std::ostream&
@@ -89,14 +104,25 @@ auto operator<<(std::ostream& strm, const engine en) -> std::ostream&
             return strm << "vm";
         case engine::eval:
             return strm << "eval";
+        case engine::register_vm:
+            return strm << "register vm";
     }
     return strm << "unknown";
 }
 
+constexpr auto max_optimization_level = 2;
+
 struct command_line_args
 {
     bool help {};
     bool debug {};
+    bool jit {};
+    bool compile_only {};
+    // whether functions are optimized on all hardware threads
+    bool parallel {};
+    // whether the time each phase of the front-end takes is shown
+    bool timings {};
+    int optimization_level {};
     engine mode {};
     std::string_view file;
 };
@@ -131,7 +157,7 @@ auto get_build_type() -> std::string
         std::cerr << "Error: " << error_msg << "\n";
         exit_code = EXIT_FAILURE;
     }
-    std::cout << "Usage: " << program << " [-d] [-i] [-h] [<file>]\n\n";
+    std::cout << "Usage: " << program << " [-d] [-i] [-r] [-j] [-c] [-p] [-t] [-O[level]] [-h] [<file>]\n\n";
     // NOLINTBEGIN(concurrency-mt-unsafe)
     exit(exit_code);
     // NOLINTEND(concurrency-mt-unsafe)
@@ -144,11 +170,34 @@ auto parse_command_line(const std::string_view program, const int argc, char** a
         if (arg[0] == '-' && arg.size() == 1) {
             show_usage(program, "invalid option `-`");
         }
-        if (arg[0] == '-' && arg.size() == 2) {
+        if (arg.starts_with("-O")) {
+            if (arg == "-O") {
+                opts.optimization_level = max_optimization_level;
+            } else if (arg.size() == 3 && arg[2] >= '0' && arg[2] <= '0' + max_optimization_level) {
+                opts.optimization_level = arg[2] - '0';
+            } else {
+                show_usage(program, std::string("invalid optimization level `") + std::string(arg) + "`");
+            }
+        } else if (arg[0] == '-' && arg.size() == 2) {
             switch (arg[1]) {
                 case 'i':
                     opts.mode = engine::eval;
                     break;
+                case 'r':
+                    opts.mode = engine::register_vm;
+                    break;
+                case 'j':
+                    opts.jit = true;
+                    break;
+                case 'c':
+                    opts.compile_only = true;
+                    break;
+                case 'p':
+                    opts.parallel = true;
+                    break;
+                case 't':
+                    opts.timings = true;
+                    break;
                 case 'h':
                     opts.help = true;
                     break;
@@ -171,43 +220,227 @@ auto parse_command_line(const std::string_view program, const int argc, char** a
     return opts;
 }
 
-void debug_byte_code(const bytecode& byte_code, const symbol_table* symbols)
+void debug_byte_code(const bytecode& byte_code)
 {
     std::cout << "Instructions: \n" << to_string(byte_code.instrs);
+    if (!byte_code.register_code.instrs.empty()) {
+        std::cout << "Register instructions: \n" << to_string(byte_code.register_code.instrs);
+    }
     std::cout << "Constants:\n";
     for (auto idx = 0; const auto* constant : *byte_code.consts) {
         std::cout << idx << ": " << constant->inspect() << '\n';
         idx++;
     }
     std::cout << "Symbols:\n";
-    symbols->debug();
+}
+
+auto compiler_backend(const engine mode) -> backend
+{
+    return mode == engine::register_vm ? backend::registers : backend::stack;
+}
+
+// The main program is shown as optimized from its stack code, functions are optimized when they are compiled, so
+// theirs is lifted from the code they got.
+void debug_ssa(const compiler& cmplr, const int level)
+{
+    auto main_func = build_ssa(cmplr.current_instrs(), 0, /*is_main=*/true, cmplr.consts());
+    optimize(main_func, level);
+    std::cout << "SSA of the main program:\n" << to_string(main_func);
+    for (auto idx = 0; const auto* constant : *cmplr.consts()) {
+        if (constant->is(object::object_type::compiled_function)) {
+            const auto* func = constant->as<compiled_function_object>();
+            auto lifted = build_ssa(func->instrs, func->num_locals, /*is_main=*/false, cmplr.consts());
+            optimize(lifted, level);
+            std::cout << "SSA of constant " << idx << ":\n" << to_string(lifted);
+        }
+        idx++;
+    }
+}
+
+void debug_vm(const vm& machine)
+{
+    const auto& stats = machine.cache_stats();
+    const auto total = stats.hits + stats.misses;
+    fmt::println("Inline caches: {} hits, {} misses, hit rate {:.1f}%",
+                 stats.hits,
+                 stats.misses,
+                 total == 0 ? 0.0 : 100.0 * static_cast<double>(stats.hits) / static_cast<double>(total));
+    fmt::println("Deoptimized operators: {}", machine.deoptimizations());
+    fmt::println("Instructions executed: {}", machine.instructions_executed());
+}
+
+auto run_byte_code(const command_line_args& opts, bytecode&& byte_code, constants* globals) -> const object*
+{
+    if (opts.mode == engine::register_vm) {
+        auto machine = register_vm::create_with_state(std::move(byte_code), globals);
+        machine.run();
+        return machine.last_popped();
+    }
+    auto machine = vm::create_verified(std::move(byte_code), globals);
+    if (opts.jit) {
+        machine.enable_jit();
+    }
+    machine.run();
+    if (opts.debug) {
+        debug_vm(machine);
+    }
+    return machine.last_popped();
+}
+
+// The verified vm only needs the global slots the script uses, which saves clearing the full globals of the
+// repl on every start. The register vm does not check global indices, so it keeps the full size.
+auto script_globals(const command_line_args& opts, const bytecode& byte_code) -> constants*
+{
+    if (opts.mode == engine::register_vm) {
+        return allocate<constants>(globals_size);
+    }
+    return allocate<constants>(static_cast<std::size_t>(byte_code.num_globals));
+}
+
+// images carry only the stack code, the register code is lowered from it
+auto lower_image_to_registers(bytecode& byte_code) -> void
+{
+    byte_code.register_code = lower_to_registers(byte_code.instrs, 0, /*is_main=*/true);
+    for (const auto* constant : *byte_code.consts) {
+        if (constant->is(object::object_type::compiled_function)) {
+            auto* func = constant->as<compiled_function_object>()->as_mutable();
+            func->register_code = lower_to_registers(func->instrs, func->num_locals, /*is_main=*/false);
+        }
+    }
+}
+
+auto run_image(const command_line_args& opts, image&& img) -> int
+{
+    if (opts.mode == engine::register_vm) {
+        lower_image_to_registers(img.code);
+    }
+    if (opts.debug) {
+        debug_byte_code(img.code);
+        for (const auto& sym : img.symbols) {
+            fmt::println("{}", sym);
+        }
+    }
+    auto* globals = script_globals(opts, img.code);
+    const auto* result = run_byte_code(opts, std::move(img.code), globals);
+    if (!result->is_null()) {
+        std::cout << result->inspect() << '\n';
+    }
+    return 0;
+}
+
+auto write_image_file(const command_line_args& opts, const compiler& cmplr) -> int
+{
+    const auto path = std::filesystem::path {opts.file}.replace_extension(image_extension);
+    std::ofstream ofs(path, std::ios::binary);
+    if (!ofs) {
+        std::cerr << "ERROR: could not write file: " << path.string() << '\n';
+        return 1;
+    }
+    write_image(ofs, cmplr.byte_code(), cmplr.all_symbols());
+    return 0;
+}
+
+auto milliseconds(const std::chrono::duration<double> duration) -> double
+{
+    return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+// on stderr, so that the output of the program stays the same
+auto show_phase_time(const std::string_view phase, const std::chrono::duration<double> duration) -> void
+{
+    fmt::println(stderr, "{:<12} {:10.3f} ms", phase, milliseconds(duration));
 }
 
 auto run_file(const command_line_args& opts) -> int
 {
+    if (opts.file.ends_with(image_extension)) {
+        if (opts.mode == engine::eval) {
+            std::cerr << "ERROR: bytecode images can not be evaluated: " << opts.file << '\n';
+            return 1;
+        }
+        return run_image(opts, load_image(opts.file));
+    }
     std::ifstream ifs(std::string {opts.file});
     if (!ifs) {
         std::cerr << "ERROR: could not open file: " << opts.file << '\n';
         return 1;
     }
     const std::string contents {(std::istreambuf_iterator(ifs)), (std::istreambuf_iterator<char>())};
+    const auto use_cache = opts.mode != engine::eval && !opts.compile_only;
+    const auto cache =
+        use_cache ? compilation_cache::open(fmt::format("-O{}", opts.optimization_level)) : compilation_cache {{}};
+    const auto start = std::chrono::steady_clock::now();
+    auto cached = cache.lookup(contents);
+    // an entry which does not verify is compiled again and replaced, instead of failing the run
+    if (cached.has_value()) {
+        try {
+            verify(cached->img.code, static_cast<std::size_t>(cached->img.code.num_globals));
+        } catch (const std::runtime_error& error) {
+            if (opts.debug) {
+                fmt::println("Compilation cache entry rejected: {}", error.what());
+            }
+            cached.reset();
+        }
+    }
+    if (cached.has_value()) {
+        if (opts.debug) {
+            const std::chrono::duration<double> load_time = std::chrono::steady_clock::now() - start;
+            fmt::println("Compilation cache hit: {}, loaded in {:.3f} ms, saved {:.3f} ms",
+                         cache.path_of(contents).string(),
+                         milliseconds(load_time),
+                         milliseconds(cached->compile_time - load_time));
+        }
+        return run_image(opts, std::move(cached->img));
+    }
+    const auto parse_start = std::chrono::steady_clock::now();
     auto lxr = lexer {contents, opts.file};
     auto prsr = parser {lxr};
-    const auto* prgrm = prsr.parse_program();
+    const auto prgrm = prsr.parse_program();
     if (!prsr.errors().empty()) {
         print_parse_errors(prsr.errors());
         return 1;
     }
-    analyze_program(prgrm, nullptr, nullptr);
-    if (opts.mode == engine::vm) {
-        auto cmplr = compiler::create();
-        cmplr.compile(prgrm);
+    const auto parsed = std::chrono::steady_clock::now();
+    const auto resolution = analyze_program(prgrm.get(), nullptr);
+    const auto analyzed = std::chrono::steady_clock::now();
+    if (opts.timings) {
+        show_phase_time("parse", parsed - parse_start);
+        show_phase_time("analysis", analyzed - parsed);
+    }
+    if (opts.mode != engine::eval) {
+        auto cmplr = compiler::create(compiler_backend(opts.mode));
+        cmplr.set_optimization_level(opts.optimization_level);
+        if (opts.parallel) {
+            cmplr.set_jobs(static_cast<int>(std::max(std::thread::hardware_concurrency(), 1U)));
+        }
+        cmplr.compile(prgrm.get(), &resolution);
+        if (opts.timings) {
+            show_phase_time("compilation", std::chrono::steady_clock::now() - analyzed);
+        }
+        if (opts.compile_only) {
+            return write_image_file(opts, cmplr);
+        }
+        auto byte_code = cmplr.byte_code();
+        const auto compile_time =
+            std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+        cache.store(contents, byte_code, cmplr.all_symbols(), compile_time);
         if (opts.debug) {
-            debug_byte_code(cmplr.byte_code(), cmplr.all_symbols());
+            if (cache.enabled()) {
+                fmt::println("Compilation cache miss: {}, compiled in {:.3f} ms",
+                             cache.path_of(contents).string(),
+                             milliseconds(compile_time));
+            }
+            if (opts.optimization_level > 0) {
+                fmt::println("Inlined call sites: {}", cmplr.inlined_calls());
+                fmt::println("Eliminated statements: {}", cmplr.eliminated_statements());
+                debug_ssa(cmplr, opts.optimization_level);
+            }
+            debug_byte_code(byte_code);
+            cmplr.all_symbols()->debug();
         }
-        auto machine = vm::create(cmplr.byte_code());
-        machine.run();
-        if (const auto* result = machine.last_popped(); !result->is_null()) {
+        auto* globals = script_globals(opts, byte_code);
+        const auto* result = run_byte_code(opts, std::move(byte_code), globals);
+        if (!result->is_null()) {
             std::cout << result->inspect() << '\n';
         }
     } else {
@@ -216,7 +449,7 @@ auto run_file(const command_line_args& opts) -> int
             global_env->set(builtin->name, allocate<builtin_object>(builtin));
         }
         evaluator ev {global_env};
-        if (const auto* result = ev.evaluate(prgrm); !result->is_null()) {
+        if (const auto* result = ev.evaluate(prgrm.get(), &resolution); !result->is_null()) {
             std::cout << result->inspect() << '\n';
         }
         if (opts.debug) {
@@ -232,18 +465,32 @@ auto run_repl(const command_line_args& opts) -> int
     std::cout << get_build_type() << " built with " << get_compiler_identifier() << '\n';
     std::cout << "Feel free to type in commands\n";
     auto* global_env = opts.mode == engine::eval ? allocate<environment>() : nullptr;
-    auto* symbols = opts.mode == engine::vm ? symbol_table::create() : nullptr;
+    // the names defined by earlier inputs, the compiler adds them, for the evaluator they are added once bound
+    auto* symbols = symbol_table::create();
     constants consts;
     constants globals(globals_size);
     for (auto idx = 0; const auto& builtin : builtin::builtins()) {
         if (global_env != nullptr) {
             global_env->set(builtin->name, allocate<builtin_object>(builtin));
         }
-        if (symbols != nullptr) {
-            symbols->define_builtin(idx, builtin->name);
-        }
+        symbols->define_builtin(idx, builtin->name);
         idx++;
     }
+    // every input is compiled by the same compiler and runs on the same machine
+    auto cmplr = compiler::create_with_state(&consts, symbols, compiler_backend(opts.mode));
+    cmplr.set_optimization_level(opts.optimization_level);
+    // the inputs are run one by one, the machines start out with the shared constants only
+    const bytecode shared {.instrs = {}, .consts = &consts, .max_stack = 0, .num_globals = 0, .register_code = {}};
+    std::optional<vm> machine;
+    std::optional<register_vm> reg_machine;
+    if (opts.mode == engine::vm) {
+        machine.emplace(vm::create_verified(shared, &globals));
+        if (opts.jit) {
+            machine->enable_jit();
+        }
+    } else if (opts.mode == engine::register_vm) {
+        reg_machine.emplace(register_vm::create_with_state(shared, &globals));
+    }
 
     auto show_prompt = [] { std::cout << prompt; };
     auto input = std::string {};
@@ -251,31 +498,50 @@ auto run_repl(const command_line_args& opts) -> int
     while (getline(std::cin, input)) {
         auto lxr = lexer {input};
         auto prsr = parser {lxr};
-        const auto* prgrm = prsr.parse_program();
+        const auto prgrm = prsr.parse_program();
         if (!prsr.errors().empty()) {
             print_parse_errors(prsr.errors());
             show_prompt();
             continue;
         }
+        if (prgrm->statements.empty()) {
+            show_prompt();
+            continue;
+        }
 
+        name_resolution resolution;
         try {
-            analyze_program(prgrm, symbols, global_env);
+            resolution = analyze_program(prgrm.get(), symbols);
         } catch (const std::exception& e) {
             fmt::println("{}", e.what());
             show_prompt();
             continue;
         }
 
-        if (opts.mode == engine::vm) {
+        if (opts.mode != engine::eval) {
             try {
-                auto cmplr = compiler::create_with_state(&consts, symbols);
-                cmplr.compile(prgrm);
+                cmplr.compile_input(prgrm.get(), &resolution);
                 if (opts.debug) {
-                    debug_byte_code(cmplr.byte_code(), cmplr.all_symbols());
+                    if (opts.optimization_level > 0) {
+                        fmt::println("Inlined call sites: {}", cmplr.inlined_calls());
+                        fmt::println("Eliminated statements: {}", cmplr.eliminated_statements());
+                        debug_ssa(cmplr, opts.optimization_level);
+                    }
+                    debug_byte_code(cmplr.byte_code());
+                    cmplr.all_symbols()->debug();
+                }
+                const object* result = nullptr;
+                if (reg_machine.has_value()) {
+                    reg_machine->run_input(cmplr.byte_code());
+                    result = reg_machine->last_popped();
+                } else {
+                    machine->run_input(cmplr.byte_code());
+                    if (opts.debug) {
+                        debug_vm(*machine);
+                    }
+                    result = machine->last_popped();
                 }
-                auto machine = vm::create_with_state(cmplr.byte_code(), &globals);
-                machine.run();
-                if (const auto* result = machine.last_popped(); !result->is_null()) {
+                if (!result->is_null()) {
                     std::cout << result->inspect() << '\n';
                 }
             } catch (const std::exception& e) {
@@ -287,7 +553,7 @@ auto run_repl(const command_line_args& opts) -> int
             try {
                 evaluator ev {global_env};
 
-                if (const auto* result = ev.evaluate(prgrm); !result->is_null()) {
+                if (const auto* result = ev.evaluate(prgrm.get(), &resolution); !result->is_null()) {
                     std::cout << result->inspect() << '\n';
                 }
             } catch (const std::exception& e) {
@@ -295,6 +561,11 @@ auto run_repl(const command_line_args& opts) -> int
                 show_prompt();
                 continue;
             }
+            for (const auto& name : resolution.defined) {
+                if (global_env->store.contains(name) && !symbols->symbols().contains(name)) {
+                    symbols->define(name);
+                }
+            }
             if (opts.debug) {
                 global_env->debug();
             }
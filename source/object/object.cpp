@@ -874,6 +874,13 @@ auto compiled_function_object::inspect() const -> std::string
     return "{<code...>}";
 }
 
+[[nodiscard]] auto compiled_function_object::as_mutable() const -> compiled_function_object*
+{
+    // NOLINTBEGIN(cppcoreguidelines-pro-type-const-cast)
+    return const_cast<compiled_function_object*>(this);
+    // NOLINTEND(cppcoreguidelines-pro-type-const-cast)
+}
+
 [[nodiscard]] auto closure_object::as_mutable() const -> closure_object*
 {
     // NOLINTBEGIN(cppcoreguidelines-pro-type-const-cast)
@@ -1206,7 +1213,7 @@ TEST_SUITE("object tests")
     const array_object array_obj {{&int_obj, &int2_obj}};
     const hash_object hash_obj {{{1, &str_obj}, {2, &true_obj}}};
     const return_value_object ret_obj {&array_obj};
-    const function_object function_obj {{}, nullptr, nullptr};
+    const function_object function_obj {{}, nullptr, nullptr, nullptr};
     const builtin_object builtin_obj {builtin::builtins()[0]};
     const compiled_function_object cmpld_obj {{}, 0, 0};
     const closure_object clsr_obj {&cmpld_obj, {}};
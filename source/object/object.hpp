@@ -6,16 +6,19 @@
 #include <cassert>
 #include <cstdint>
 #include <limits>
+#include <memory>
 #include <string>
 #include <unordered_map>
 #include <utility>
 #include <variant>
 #include <vector>
 
+#include <ast/arena.hpp>
 #include <ast/identifier.hpp>
 #include <ast/statements.hpp>
 #include <ast/util.hpp>
 #include <code/code.hpp>
+#include <code/register_code.hpp>
 #include <compiler/symbol_table.hpp>
 #include <eval/environment.hpp>
 #include <fmt/ostream.h>
@@ -23,6 +26,8 @@
 #include <sys/types.h>
 
 struct object;
+class native_code;
+enum class operand_types : std::uint8_t;
 auto tru() -> const object*;
 auto fals() -> const object*;
 auto object_floor_div(const object* lhs, const object* rhs) -> const object*;
@@ -409,10 +414,14 @@ struct return_value_object final : object
 
 struct function_object final : object
 {
-    function_object(const std::vector<const identifier*>& params, const block_statement* bod, environment* env)
+    function_object(const std::vector<const identifier*>& params,
+                    const block_statement* bod,
+                    environment* env,
+                    std::shared_ptr<const ast_arena> arena)
         : parameters {params}
         , body {bod}
         , closure_env {env}
+        , nodes {std::move(arena)}
     {
     }
 
@@ -425,6 +434,7 @@ struct function_object final : object
     std::vector<const identifier*> parameters;
     const block_statement* body {};
     environment* closure_env {};
+    std::shared_ptr<const ast_arena> nodes;  // keeps parameters and body alive after the program is released
 };
 
 struct compiled_function_object final : object
@@ -442,15 +452,28 @@ struct compiled_function_object final : object
     [[nodiscard]] auto type() const -> object_type override { return object_type::compiled_function; }
 
     [[nodiscard]] auto inspect() const -> std::string override;
+    [[nodiscard]] auto as_mutable() const -> compiled_function_object*;
 
     instructions instrs;
     int num_locals {};
     int num_arguments {};
+    int max_stack {};
     bool inside_loop {};
+    // only filled in by the register backend of the compiler
+    register_function register_code;
+    // maintained by the vm while its jit is enabled
+    std::uint32_t call_count {};
+    std::shared_ptr<const native_code> native;
+    // operand types seen by the vm, indexed by instruction position
+    mutable std::vector<operand_types> type_feedback;
+    // set once the verifier accepted the function
+    bool verified {};
 };
 
 struct closure_object final : object
 {
+    closure_object() = default;
+
     explicit closure_object(const compiled_function_object* compiled, std::vector<const object*> frees = {})
         : fn {compiled}
         , free {std::move(frees)}
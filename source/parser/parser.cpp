@@ -1,7 +1,10 @@
 // Copyright 2023-2025 hrzlgnm
 // SPDX-License-Identifier: MIT-0
 
+#include <cstddef>
 #include <cstdint>
+#include <initializer_list>
+#include <memory>
 #include <stdexcept>
 #include <string>
 #include <utility>
@@ -31,7 +34,6 @@
 #include <ast/util.hpp>
 #include <doctest/doctest.h>
 #include <fmt/ranges.h>
-#include <gc.hpp>
 #include <lexer/lexer.hpp>
 #include <lexer/location.hpp>
 #include <lexer/token.hpp>
@@ -102,58 +104,77 @@ auto precedence_of_token(const token_type type) -> std::uint8_t
 }
 }  // namespace
 
+constinit const parser::unary_parsers parser::unary_parser_table = []
+{
+    using enum token_type;
+    unary_parsers table {};
+    table[static_cast<std::size_t>(ident)] = &parser::parse_identifier_expression;
+    table[static_cast<std::size_t>(integer)] = &parser::parse_integer_literal;
+    table[static_cast<std::size_t>(decimal)] = &parser::parse_decimal_literal;
+    table[static_cast<std::size_t>(exclamation)] = &parser::parse_unary_expression;
+    table[static_cast<std::size_t>(minus)] = &parser::parse_unary_expression;
+    table[static_cast<std::size_t>(tru)] = &parser::parse_boolean;
+    table[static_cast<std::size_t>(fals)] = &parser::parse_boolean;
+    table[static_cast<std::size_t>(lparen)] = &parser::parse_grouped_expression;
+    table[static_cast<std::size_t>(eef)] = &parser::parse_if_expression;
+    table[static_cast<std::size_t>(function)] = &parser::parse_function_expression;
+    table[static_cast<std::size_t>(string)] = &parser::parse_string_literal;
+    table[static_cast<std::size_t>(lbracket)] = &parser::parse_array_expression;
+    table[static_cast<std::size_t>(lsquirly)] = &parser::parse_hash_literal;
+    table[static_cast<std::size_t>(null)] = &parser::parse_null_literal;
+    return table;
+}();
+
+constinit const parser::binary_parsers parser::binary_parser_table = []
+{
+    using enum token_type;
+    binary_parsers table {};
+    for (const auto type : {plus,
+                            minus,
+                            slash,
+                            asterisk,
+                            equals,
+                            not_equals,
+                            less_than,
+                            greater_than,
+                            double_slash,
+                            percent,
+                            ampersand,
+                            pipe,
+                            caret,
+                            shift_left,
+                            shift_right,
+                            logical_and,
+                            logical_or,
+                            greater_equal,
+                            less_equal})
+    {
+        table[static_cast<std::size_t>(type)] = &parser::parse_binary_expression;
+    }
+    table[static_cast<std::size_t>(lparen)] = &parser::parse_call_expression;
+    table[static_cast<std::size_t>(lbracket)] = &parser::parse_index_expression;
+    return table;
+}();
+
 parser::parser(const lexer& lxr)
     : m_lxr {lxr}
 {
     next_token();
     next_token();
-    using enum token_type;
-    register_unary(ident, [this] { return parse_identifier(); });
-    register_unary(integer, [this] { return parse_integer_literal(); });
-    register_unary(decimal, [this] { return parse_decimal_literal(); });
-    register_unary(exclamation, [this] { return parse_unary_expression(); });
-    register_unary(minus, [this] { return parse_unary_expression(); });
-    register_unary(tru, [this] { return parse_boolean(); });
-    register_unary(fals, [this] { return parse_boolean(); });
-    register_unary(lparen, [this] { return parse_grouped_expression(); });
-    register_unary(eef, [this] { return parse_if_expression(); });
-    register_unary(function, [this] { return parse_function_expression(); });
-    register_unary(string, [this] { return parse_string_literal(); });
-    register_unary(lbracket, [this] { return parse_array_expression(); });
-    register_unary(lsquirly, [this] { return parse_hash_literal(); });
-    register_unary(null, [this] { return parse_null_literal(); });
-    register_binary(plus, [this](expression* left) { return parse_binary_expression(left); });
-    register_binary(minus, [this](expression* left) { return parse_binary_expression(left); });
-    register_binary(slash, [this](expression* left) { return parse_binary_expression(left); });
-    register_binary(asterisk, [this](expression* left) { return parse_binary_expression(left); });
-    register_binary(equals, [this](expression* left) { return parse_binary_expression(left); });
-    register_binary(not_equals, [this](expression* left) { return parse_binary_expression(left); });
-    register_binary(less_than, [this](expression* left) { return parse_binary_expression(left); });
-    register_binary(greater_than, [this](expression* left) { return parse_binary_expression(left); });
-    register_binary(lparen, [this](expression* left) { return parse_call_expression(left); });
-    register_binary(lbracket, [this](expression* left) { return parse_index_expression(left); });
-    register_binary(double_slash, [this](expression* left) { return parse_binary_expression(left); });
-    register_binary(percent, [this](expression* left) { return parse_binary_expression(left); });
-    register_binary(ampersand, [this](expression* left) { return parse_binary_expression(left); });
-    register_binary(pipe, [this](expression* left) { return parse_binary_expression(left); });
-    register_binary(caret, [this](expression* left) { return parse_binary_expression(left); });
-    register_binary(shift_left, [this](expression* left) { return parse_binary_expression(left); });
-    register_binary(shift_right, [this](expression* left) { return parse_binary_expression(left); });
-    register_binary(logical_and, [this](expression* left) { return parse_binary_expression(left); });
-    register_binary(logical_or, [this](expression* left) { return parse_binary_expression(left); });
-    register_binary(greater_equal, [this](expression* left) { return parse_binary_expression(left); });
-    register_binary(less_equal, [this](expression* left) { return parse_binary_expression(left); });
-}
-
-auto parser::parse_program() -> program*
-{
-    auto* prog = allocate<program>(m_current_token.loc);
+}
+
+auto parser::parse_program() -> std::unique_ptr<program>
+{
+    auto prog = std::make_unique<program>(m_current_token.loc);
+    m_nodes = std::make_shared<ast_arena>(m_lxr.source());
     while (m_current_token.type != token_type::eof) {
         if (const auto* stmt = parse_statement(); stmt != nullptr) {
             prog->statements.push_back(stmt);
         }
         next_token();
     }
+    prog->nodes = std::move(m_nodes);
+    prog->num_identifiers = std::exchange(m_identifiers, 0);
     return prog;
 }
 
@@ -194,7 +215,7 @@ auto parser::parse_statement() -> statement*
 
 auto parser::parse_let_statement() -> statement*
 {
-    auto* stmt = allocate<let_statement>(m_current_token.loc);
+    auto* stmt = make<let_statement>(m_current_token.loc);
     using enum token_type;
     if (!get(ident)) {
         return {};
@@ -220,7 +241,7 @@ auto parser::parse_let_statement() -> statement*
 
 auto parser::parse_assign_statement() -> statement*
 {
-    auto* stmt = allocate<assign_expression>(m_current_token.loc);
+    auto* stmt = make<assign_expression>(m_current_token.loc);
     using enum token_type;
 
     stmt->name = parse_identifier();
@@ -241,7 +262,7 @@ auto parser::parse_assign_statement() -> statement*
 auto parser::parse_return_statement() -> statement*
 {
     using enum token_type;
-    auto* stmt = allocate<return_statement>(m_current_token.loc);
+    auto* stmt = make<return_statement>(m_current_token.loc);
 
     next_token();
     stmt->value = parse_expression(lowest);
@@ -254,7 +275,7 @@ auto parser::parse_return_statement() -> statement*
 
 auto parser::parse_expression_statement() -> statement*
 {
-    auto* expr_stmt = allocate<expression_statement>(m_current_token.loc);
+    auto* expr_stmt = make<expression_statement>(m_current_token.loc);
     expr_stmt->expr = parse_expression(lowest);
     if (peek_token_is(token_type::semicolon)) {
         next_token();
@@ -264,32 +285,37 @@ auto parser::parse_expression_statement() -> statement*
 
 auto parser::parse_expression(const int precedence) -> expression*
 {
-    const auto& unary = m_unary_parsers[m_current_token.type];
-    if (!unary) {
+    const auto unary = unary_parser_table[static_cast<std::size_t>(m_current_token.type)];
+    if (unary == nullptr) {
         no_unary_expression_error(m_current_token.type);
         return {};
     }
-    auto* left_expr = unary();
+    auto* left_expr = (this->*unary)();
     while (!peek_token_is(token_type::semicolon) && precedence < peek_precedence()) {
-        const auto& binary = m_binary_parsers[m_peek_token.type];
-        if (!binary) {
+        const auto binary = binary_parser_table[static_cast<std::size_t>(m_peek_token.type)];
+        if (binary == nullptr) {
             return left_expr;
         }
         next_token();
 
-        left_expr = binary(left_expr);
+        left_expr = (this->*binary)(left_expr);
     }
     return left_expr;
 }
 
-auto parser::parse_identifier() const -> identifier*
+auto parser::parse_identifier() -> identifier*
 {
-    return allocate<identifier>(std::string(m_current_token.literal), m_current_token.loc);
+    return make<identifier>(std::string(m_current_token.literal), m_current_token.loc, m_identifiers++);
+}
+
+auto parser::parse_identifier_expression() -> expression*
+{
+    return parse_identifier();
 }
 
 auto parser::parse_integer_literal() -> expression*
 {
-    auto* lit = allocate<integer_literal>(m_current_token.loc);
+    auto* lit = make<integer_literal>(m_current_token.loc);
     try {
         lit->value = std::stoll(std::string {m_current_token.literal});
     } catch (const std::out_of_range&) {
@@ -301,7 +327,7 @@ auto parser::parse_integer_literal() -> expression*
 
 auto parser::parse_decimal_literal() -> expression*
 {
-    auto* lit = allocate<decimal_literal>(m_current_token.loc);
+    auto* lit = make<decimal_literal>(m_current_token.loc);
     try {
         lit->value = std::stod(std::string {m_current_token.literal});
     } catch (const std::out_of_range&) {
@@ -313,7 +339,7 @@ auto parser::parse_decimal_literal() -> expression*
 
 auto parser::parse_unary_expression() -> expression*
 {
-    auto* unary = allocate<unary_expression>(m_current_token.loc);
+    auto* unary = make<unary_expression>(m_current_token.loc);
     unary->op = m_current_token.type;
 
     next_token();
@@ -323,7 +349,7 @@ auto parser::parse_unary_expression() -> expression*
 
 auto parser::parse_boolean() -> expression*
 {
-    return allocate<boolean_literal>(current_token_is(token_type::tru), m_current_token.loc);
+    return make<boolean_literal>(current_token_is(token_type::tru), m_current_token.loc);
 }
 
 auto parser::parse_grouped_expression() -> expression*
@@ -339,7 +365,7 @@ auto parser::parse_grouped_expression() -> expression*
 auto parser::parse_if_expression() -> expression*
 {
     using enum token_type;
-    auto* expr = allocate<if_expression>(m_current_token.loc);
+    auto* expr = make<if_expression>(m_current_token.loc);
     if (!get(lparen)) {
         return {};
     }
@@ -370,7 +396,7 @@ auto parser::parse_if_expression() -> expression*
 auto parser::parse_while_statement() -> expression*
 {
     using enum token_type;
-    auto* expr = allocate<while_statement>(m_current_token.loc);
+    auto* expr = make<while_statement>(m_current_token.loc);
     if (!get(lparen)) {
         return {};
     }
@@ -402,7 +428,7 @@ auto parser::parse_function_expression() -> expression*
         return {};
     }
     auto* body = parse_block_statement();
-    return allocate<function_literal>(std::move(parameters), body, loc);
+    return make<function_literal>(std::move(parameters), body, loc);
 }
 
 auto parser::parse_function_parameters() -> identifiers
@@ -431,7 +457,7 @@ auto parser::parse_function_parameters() -> identifiers
 auto parser::parse_block_statement() -> block_statement*
 {
     using enum token_type;
-    auto* block = allocate<block_statement>(m_current_token.loc);
+    auto* block = make<block_statement>(m_current_token.loc);
     next_token();
     while (!current_token_is(rsquirly) && !current_token_is(eof)) {
         if (const auto* stmt = parse_statement(); stmt != nullptr) {
@@ -446,7 +472,7 @@ auto parser::parse_block_statement() -> block_statement*
 auto parser::parse_break_statement() -> statement*
 {
     using enum token_type;
-    auto* b = allocate<break_statement>(m_current_token.loc);
+    auto* b = make<break_statement>(m_current_token.loc);
     if (peek_token_is(semicolon)) {
         next_token();
     }
@@ -456,7 +482,7 @@ auto parser::parse_break_statement() -> statement*
 auto parser::parse_continue_statement() -> statement*
 {
     using enum token_type;
-    auto* b = allocate<continue_statement>(m_current_token.loc);
+    auto* b = make<continue_statement>(m_current_token.loc);
     if (peek_token_is(semicolon)) {
         next_token();
     }
@@ -465,7 +491,7 @@ auto parser::parse_continue_statement() -> statement*
 
 auto parser::parse_call_expression(expression* function) -> expression*
 {
-    auto* call = allocate<call_expression>(m_current_token.loc);
+    auto* call = make<call_expression>(m_current_token.loc);
     call->function = function;
     call->arguments = parse_expressions(token_type::rparen);
     return call;
@@ -473,7 +499,7 @@ auto parser::parse_call_expression(expression* function) -> expression*
 
 auto parser::parse_binary_expression(expression* left) -> expression*
 {
-    auto* bin_expr = allocate<binary_expression>(m_current_token.loc);
+    auto* bin_expr = make<binary_expression>(m_current_token.loc);
     bin_expr->op = m_current_token.type;
     bin_expr->left = left;
 
@@ -484,9 +510,9 @@ auto parser::parse_binary_expression(expression* left) -> expression*
     return bin_expr;
 }
 
-auto parser::parse_string_literal() const -> expression*
+auto parser::parse_string_literal() -> expression*
 {
-    return allocate<string_literal>(std::string {m_current_token.literal}, m_current_token.loc);
+    return make<string_literal>(std::string {m_current_token.literal}, m_current_token.loc);
 }
 
 auto parser::parse_expressions(const token_type end) -> expressions
@@ -515,14 +541,14 @@ auto parser::parse_expressions(const token_type end) -> expressions
 
 auto parser::parse_array_expression() -> expression*
 {
-    auto* array_expr = allocate<array_literal>(m_current_token.loc);
+    auto* array_expr = make<array_literal>(m_current_token.loc);
     array_expr->elements = parse_expressions(token_type::rbracket);
     return array_expr;
 }
 
 auto parser::parse_index_expression(expression* left) -> expression*
 {
-    auto* index_expr = allocate<index_expression>(m_current_token.loc);
+    auto* index_expr = make<index_expression>(m_current_token.loc);
     index_expr->left = left;
     next_token();
     index_expr->index = parse_expression(lowest);
@@ -536,7 +562,7 @@ auto parser::parse_index_expression(expression* left) -> expression*
 
 auto parser::parse_hash_literal() -> expression*
 {
-    auto* hash = allocate<hash_literal>(m_current_token.loc);
+    auto* hash = make<hash_literal>(m_current_token.loc);
     using enum token_type;
     while (!peek_token_is(rsquirly)) {
         next_token();
@@ -560,7 +586,7 @@ auto parser::parse_hash_literal() -> expression*
 
 auto parser::parse_null_literal() -> expression*
 {
-    return allocate<null_literal>(m_current_token.loc);
+    return make<null_literal>(m_current_token.loc);
 }
 
 auto parser::get(const token_type type) -> bool
@@ -578,16 +604,6 @@ auto parser::peek_error(token_type type) -> void
     new_error("{}: expected next token to be {}, got {} instead", m_current_token.loc, type, m_peek_token.literal);
 }
 
-auto parser::register_binary(const token_type type, binary_parser binary) -> void
-{
-    m_binary_parsers[type] = std::move(binary);
-}
-
-auto parser::register_unary(const token_type type, unary_parser unary) -> void
-{
-    m_unary_parsers[type] = std::move(unary);
-}
-
 auto parser::current_token_is(const token_type type) const -> bool
 {
     return m_current_token.type == type;
@@ -625,7 +641,7 @@ auto check_no_parse_errors(const parser& prsr) -> bool
     return prsr.errors().empty();
 }
 
-using parsed_program = std::pair<program*, parser>;
+using parsed_program = std::pair<std::unique_ptr<program>, parser>;
 
 auto check_program(std::string_view input) -> parsed_program
 {
@@ -705,7 +721,7 @@ auto require_binary_expression(const expression* expr,
     require_literal_expression(binary->right, right);
 }
 
-auto require_expression_statement(const program* prgrm) -> const expression_statement*
+auto require_expression_statement(const std::unique_ptr<program>& prgrm) -> const expression_statement*
 {
     INFO("expected one statement, got: ", prgrm->statements.size());
     REQUIRE_EQ(prgrm->statements.size(), 1);
@@ -719,7 +735,7 @@ auto require_expression_statement(const program* prgrm) -> const expression_stat
 }
 
 template<typename E>
-auto require_expression(const program* prgrm) -> const E*
+auto require_expression(const std::unique_ptr<program>& prgrm) -> const E*
 {
     auto* expr_stmt = require_expression_statement(prgrm);
     auto* expr = dynamic_cast<const E*>(expr_stmt->expr);
@@ -729,7 +745,7 @@ auto require_expression(const program* prgrm) -> const E*
 }
 
 template<typename E>
-auto require_statement(const program* prgrm) -> const E*
+auto require_statement(const std::unique_ptr<program>& prgrm) -> const E*
 {
     INFO("expected one statement, got: ", prgrm->statements.size());
     REQUIRE_EQ(prgrm->statements.size(), 1);
@@ -879,12 +895,13 @@ return 993322;
 TEST_CASE("string")
 {
     using enum token_type;
-    const auto name = allocate<identifier>("myVar", location {"<stdin>", 1, 1});
-    const auto value = allocate<identifier>("anotherVar", location {"<stdin>", 1, 9});
+    ast_arena nodes;
+    const auto name = nodes.make<identifier>("myVar", location {});
+    const auto value = nodes.make<identifier>("anotherVar", location {});
 
-    program prgrm {location {"<stdin>", 1, 1}};
+    program prgrm {location {}};
 
-    const auto let_stmt = allocate<let_statement>(location {});
+    const auto let_stmt = nodes.make<let_statement>(location {});
 
     let_stmt->name = name;
     let_stmt->value = value;
@@ -1383,8 +1400,8 @@ TEST_CASE("emptyHashLiteral")
     auto [prgrm, _] = check_program(R"({})");
     auto* hash_lit = require_expression<hash_literal>(prgrm);
     REQUIRE(hash_lit->pairs.empty());
-    const auto expected_location = location {"<stdin>", 1, 1};
-    REQUIRE(hash_lit->loc() == expected_location);
+    const auto expected_location = resolved_location {"<stdin>", 1, 1};
+    REQUIRE(hash_lit->loc().resolve() == expected_location);
 }
 
 TEST_CASE("nullLiteral")
@@ -3,11 +3,13 @@
 
 #pragma once
 
-#include <functional>
+#include <array>
+#include <cstddef>
+#include <memory>
 #include <string>
-#include <unordered_map>
 #include <vector>
 
+#include <ast/arena.hpp>
 #include <ast/expression.hpp>
 #include <ast/identifier.hpp>
 #include <ast/program.hpp>
@@ -19,12 +21,14 @@ class parser final
 {
   public:
     explicit parser(const lexer& lxr);
-    auto parse_program() -> program*;
+    auto parse_program() -> std::unique_ptr<program>;
     auto errors() const -> const std::vector<std::string>&;
 
   private:
-    using binary_parser = std::function<expression*(expression*)>;
-    using unary_parser = std::function<expression*()>;
+    using binary_parser = auto (parser::*)(expression*) -> expression*;
+    using unary_parser = auto (parser::*)() -> expression*;
+    using binary_parsers = std::array<binary_parser, token_type_count>;
+    using unary_parsers = std::array<unary_parser, token_type_count>;
 
     auto next_token() -> void;
     auto parse_statement() -> statement*;
@@ -34,7 +38,8 @@ class parser final
     auto parse_expression_statement() -> statement*;
 
     auto parse_expression(int precedence) -> expression*;
-    auto parse_identifier() const -> identifier*;
+    auto parse_identifier() -> identifier*;
+    auto parse_identifier_expression() -> expression*;
     auto parse_integer_literal() -> expression*;
     auto parse_decimal_literal() -> expression*;
     auto parse_unary_expression() -> expression*;
@@ -49,7 +54,7 @@ class parser final
     auto parse_break_statement() -> statement*;
     auto parse_continue_statement() -> statement*;
     auto parse_call_expression(expression* function) -> expression*;
-    auto parse_string_literal() const -> expression*;
+    auto parse_string_literal() -> expression*;
     auto parse_array_expression() -> expression*;
     auto parse_index_expression(expression* left) -> expression*;
     auto parse_hash_literal() -> expression*;
@@ -60,12 +65,16 @@ class parser final
     auto current_token_is(token_type type) const -> bool;
     auto peek_token_is(token_type type) const -> bool;
     auto peek_error(token_type type) -> void;
-    auto register_binary(token_type type, binary_parser binary) -> void;
-    auto register_unary(token_type type, unary_parser unary) -> void;
     auto no_unary_expression_error(token_type type) -> void;
     auto peek_precedence() const -> int;
     auto current_precedence() const -> int;
 
+    template<typename T, typename... Args>
+    auto make(Args&&... args) const -> T*
+    {
+        return m_nodes->make<T>(std::forward<Args>(args)...);
+    }
+
     template<typename... T>
     auto new_error(fmt::format_string<T...> fmt, T&&... args)
     {
@@ -76,7 +85,10 @@ class parser final
     token m_current_token {};
     token m_peek_token {};
     std::vector<std::string> m_errors;
+    std::shared_ptr<ast_arena> m_nodes;
+    std::size_t m_identifiers {};
 
-    std::unordered_map<token_type, unary_parser> m_unary_parsers;
-    std::unordered_map<token_type, binary_parser> m_binary_parsers;
+    // dense dispatch tables indexed by token type, a null entry means the token has no such parse function
+    static const unary_parsers unary_parser_table;
+    static const binary_parsers binary_parser_table;
 };
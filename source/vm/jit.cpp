@@ -0,0 +1,784 @@
+// Copyright 2023-2025 hrzlgnm
+// SPDX-License-Identifier: MIT-0
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <utility>
+#include <string_view>
+#include <vector>
+
+#include "jit.hpp"
+
+#include <code/code.hpp>
+#include <compiler/compiler.hpp>
+#include <doctest/doctest.h>
+#include <gc.hpp>
+#include <lexer/lexer.hpp>
+#include <object/object.hpp>
+#include <parser/parser.hpp>
+
+#include "vm.hpp"
+
+#if defined(CAPPUCHIN_JIT_X86_64)
+#    include <sys/mman.h>
+#endif
+
+native_code::native_code(void* memory, const std::size_t size)
+    : m_memory {memory}
+    , m_size {size}
+{
+}
+
+native_code::~native_code()
+{
+#if defined(CAPPUCHIN_JIT_X86_64)
+    munmap(m_memory, m_size);
+#endif
+}
+
+auto native_code::run(jit_state* state, const std::size_t ip) const -> std::size_t
+{
+    // Casting an object pointer to a function pointer is only conditionally supported. POSIX, which dlsym relies on,
+    // and the x86-64 ABIs the jit targets give both the same size and representation, so the bits are reinterpreted.
+    return std::bit_cast<entry_point>(m_memory)(state, ip);
+}
+
+#if defined(CAPPUCHIN_JIT_X86_64)
+
+namespace
+{
+// runtime entry points called from the generated code, they must not throw through it
+
+auto jit_make_integer(const std::int64_t value) noexcept -> const object*
+{
+    try {
+        return allocate<integer_object>(value);
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+auto jit_is_truthy(const object* obj) noexcept -> bool
+{
+    return obj->is_truthy();
+}
+
+// returns false, leaving the stack untouched, when the interpreter has to report an error
+auto jit_binary(jit_state* state, const std::uint32_t opcode) noexcept -> bool
+{
+    try {
+        const auto sp = static_cast<std::size_t>(*state->sp);
+        const auto* result =
+            apply_binary_operator(static_cast<opcodes>(opcode), state->stack[sp - 2], state->stack[sp - 1]);
+        if (result == nullptr) {
+            return false;
+        }
+        state->stack[sp - 2] = result;
+        (*state->sp)--;
+        return true;
+    } catch (...) {
+        return false;
+    }
+}
+
+struct integer_layout final
+{
+    std::uint64_t vtable {};
+    std::int32_t value_offset {};
+};
+
+// integers are recognized by their vtable pointer, which is the first word of every integer_object
+auto integer_probe() -> const integer_layout&
+{
+    static const integer_layout layout = []
+    {
+        static const integer_object probe {0};
+        integer_layout result;
+        std::memcpy(&result.vtable, &probe, sizeof(result.vtable));
+        // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+        const auto* base = reinterpret_cast<const std::byte*>(&probe);
+        // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+        result.value_offset = static_cast<std::int32_t>(reinterpret_cast<const std::byte*>(&probe.value) - base);
+        return result;
+    }();
+    return layout;
+}
+
+auto address_of(const void* ptr) -> std::uint64_t
+{
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+    return reinterpret_cast<std::uint64_t>(ptr);
+}
+
+template<typename Function>
+auto address_of_function(Function* func) -> std::uint64_t
+{
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+    return reinterpret_cast<std::uint64_t>(func);
+}
+
+enum gpr : std::uint8_t
+{
+    rax,
+    rcx,
+    rdx,
+    rbx,
+    rsp,
+    rbp,
+    rsi,
+    rdi,
+    r8,
+    r9,
+    r10,
+    r11,
+    r12,
+    r13,
+    r14,
+    r15,
+};
+
+enum condition : std::uint8_t
+{
+    cc_b = 0x2,
+    cc_ae = 0x3,
+    cc_e = 0x4,
+    cc_ne = 0x5,
+    cc_l = 0xC,
+    cc_ge = 0xD,
+    cc_le = 0xE,
+    cc_g = 0xF,
+};
+
+// Encodes the handful of x86-64 instruction forms the templates need. Memory operands always use a 32-bit
+// displacement, which keeps the encoding uniform for every base register.
+struct assembler final
+{
+    auto byte(const std::uint8_t value) -> void { code.push_back(value); }
+
+    auto imm32(const std::uint32_t value) -> void
+    {
+        for (auto shift = 0U; shift < 32U; shift += 8U) {
+            byte(static_cast<std::uint8_t>(value >> shift));
+        }
+    }
+
+    auto imm64(const std::uint64_t value) -> void
+    {
+        for (auto shift = 0U; shift < 64U; shift += 8U) {
+            byte(static_cast<std::uint8_t>(value >> shift));
+        }
+    }
+
+    auto rex_w(const gpr reg, const gpr base, const gpr index = rax) -> void
+    {
+        byte(static_cast<std::uint8_t>(0x48U | ((reg & 8U) >> 1U) | ((index & 8U) >> 2U) | ((base & 8U) >> 3U)));
+    }
+
+    auto memory(const gpr reg, const gpr base, const std::int32_t disp) -> void
+    {
+        byte(static_cast<std::uint8_t>(0x80U | ((reg & 7U) << 3U) | (base & 7U)));
+        if ((base & 7U) == rsp) {
+            byte(0x24);
+        }
+        imm32(static_cast<std::uint32_t>(disp));
+    }
+
+    auto memory_indexed(const gpr reg, const gpr base, const gpr index, const std::int32_t disp) -> void
+    {
+        byte(static_cast<std::uint8_t>(0x80U | ((reg & 7U) << 3U) | 4U));
+        byte(static_cast<std::uint8_t>(0xC0U | ((index & 7U) << 3U) | (base & 7U)));
+        imm32(static_cast<std::uint32_t>(disp));
+    }
+
+    auto direct(const gpr reg, const gpr rm) -> void
+    {
+        byte(static_cast<std::uint8_t>(0xC0U | ((reg & 7U) << 3U) | (rm & 7U)));
+    }
+
+    auto push(const gpr reg) -> void
+    {
+        if (reg >= r8) {
+            byte(0x41);
+        }
+        byte(static_cast<std::uint8_t>(0x50U + (reg & 7U)));
+    }
+
+    auto pop(const gpr reg) -> void
+    {
+        if (reg >= r8) {
+            byte(0x41);
+        }
+        byte(static_cast<std::uint8_t>(0x58U + (reg & 7U)));
+    }
+
+    auto load(const gpr dst, const gpr base, const std::int32_t disp) -> void
+    {
+        rex_w(dst, base);
+        byte(0x8B);
+        memory(dst, base, disp);
+    }
+
+    auto store(const gpr base, const std::int32_t disp, const gpr src) -> void
+    {
+        rex_w(src, base);
+        byte(0x89);
+        memory(src, base, disp);
+    }
+
+    auto load_indexed(const gpr dst, const gpr base, const gpr index, const std::int32_t disp) -> void
+    {
+        rex_w(dst, base, index);
+        byte(0x8B);
+        memory_indexed(dst, base, index, disp);
+    }
+
+    auto store_indexed(const gpr base, const gpr index, const std::int32_t disp, const gpr src) -> void
+    {
+        rex_w(src, base, index);
+        byte(0x89);
+        memory_indexed(src, base, index, disp);
+    }
+
+    // movsxd dst, dword [base + disp]
+    auto load_int(const gpr dst, const gpr base, const std::int32_t disp) -> void
+    {
+        rex_w(dst, base);
+        byte(0x63);
+        memory(dst, base, disp);
+    }
+
+    // inc / dec dword [base + disp]
+    auto add_one(const gpr base, const std::int32_t disp, const bool decrement) -> void
+    {
+        if (base >= r8) {
+            byte(0x41);
+        }
+        byte(0xFF);
+        memory(decrement ? rcx : rax, base, disp);
+    }
+
+    auto mov_imm(const gpr dst, const std::uint64_t value) -> void
+    {
+        rex_w(rax, dst);
+        byte(static_cast<std::uint8_t>(0xB8U + (dst & 7U)));
+        imm64(value);
+    }
+
+    // mov r32, imm32 for the low registers
+    auto mov_imm32(const gpr dst, const std::uint32_t value) -> void
+    {
+        byte(static_cast<std::uint8_t>(0xB8U + (dst & 7U)));
+        imm32(value);
+    }
+
+    auto mov(const gpr dst, const gpr src) -> void
+    {
+        rex_w(src, dst);
+        byte(0x89);
+        direct(src, dst);
+    }
+
+    // cmp lhs, rhs
+    auto cmp(const gpr lhs, const gpr rhs) -> void
+    {
+        rex_w(rhs, lhs);
+        byte(0x39);
+        direct(rhs, lhs);
+    }
+
+    // cmp qword [base + disp], rhs
+    auto cmp_memory(const gpr base, const std::int32_t disp, const gpr rhs) -> void
+    {
+        rex_w(rhs, base);
+        byte(0x39);
+        memory(rhs, base, disp);
+    }
+
+    // cmp r32, imm32 for the low registers
+    auto cmp_imm32(const gpr lhs, const std::uint32_t value) -> void
+    {
+        byte(0x81);
+        direct(static_cast<gpr>(7), lhs);
+        imm32(value);
+    }
+
+    auto test(const gpr lhs, const gpr rhs) -> void
+    {
+        rex_w(rhs, lhs);
+        byte(0x85);
+        direct(rhs, lhs);
+    }
+
+    auto test_al() -> void
+    {
+        byte(0x84);
+        byte(0xC0);
+    }
+
+    auto add(const gpr dst, const gpr src) -> void
+    {
+        rex_w(src, dst);
+        byte(0x01);
+        direct(src, dst);
+    }
+
+    auto sub(const gpr dst, const gpr src) -> void
+    {
+        rex_w(src, dst);
+        byte(0x29);
+        direct(src, dst);
+    }
+
+    auto imul(const gpr dst, const gpr src) -> void
+    {
+        rex_w(dst, src);
+        byte(0x0F);
+        byte(0xAF);
+        direct(dst, src);
+    }
+
+    auto cmov(const condition cond, const gpr dst, const gpr src) -> void
+    {
+        rex_w(dst, src);
+        byte(0x0F);
+        byte(static_cast<std::uint8_t>(0x40U | cond));
+        direct(dst, src);
+    }
+
+    auto rsp_adjust(const std::int8_t amount) -> void
+    {
+        rex_w(rax, rsp);
+        byte(0x83);
+        direct(amount < 0 ? static_cast<gpr>(5) : rax, rsp);
+        byte(static_cast<std::uint8_t>(amount < 0 ? -amount : amount));
+    }
+
+    auto call(const std::uint64_t target) -> void
+    {
+        mov_imm(rax, target);
+        byte(0xFF);
+        byte(0xD0);
+    }
+
+    // returns the position of the rel32 to patch
+    auto jcc(const condition cond) -> std::size_t
+    {
+        byte(0x0F);
+        byte(static_cast<std::uint8_t>(0x80U | cond));
+        imm32(0);
+        return code.size() - 4;
+    }
+
+    auto jmp() -> std::size_t
+    {
+        byte(0xE9);
+        imm32(0);
+        return code.size() - 4;
+    }
+
+    auto patch(const std::size_t position, const std::size_t target) -> void
+    {
+        const auto rel = static_cast<std::int64_t>(target) - static_cast<std::int64_t>(position + 4);
+        for (auto idx = 0U; idx < 4U; ++idx) {
+            code[position + idx] = static_cast<std::uint8_t>(static_cast<std::uint64_t>(rel) >> (idx * 8U));
+        }
+    }
+
+    std::vector<std::uint8_t> code;
+};
+
+constexpr auto slot = static_cast<std::int32_t>(sizeof(const object*));
+
+// Register assignment of the generated code, all callee saved so they survive calls into the runtime:
+// rbx = jit_state, r12 = stack, r13 = &sp, r14 = locals, r15 = constants, rbp = globals.
+struct template_compiler final
+{
+    explicit template_compiler(const instructions& instrs)
+        : m_instrs {instrs}
+        , m_offsets(instrs.size() + 1, no_offset)
+    {
+    }
+
+    auto compile() -> std::shared_ptr<const native_code>
+    {
+        prologue();
+        for (std::size_t ip = 0; ip < m_instrs.size(); ip += instruction_length(m_instrs, ip)) {
+            m_offsets[ip] = m_asm.code.size();
+            instruction(ip);
+        }
+        m_offsets[m_instrs.size()] = m_asm.code.size();
+        exit_to(m_instrs.size());
+        for (const auto& [position, target] : m_jumps) {
+            m_asm.patch(position, m_offsets[target]);
+        }
+        for (const auto& [position, ip] : m_exits) {
+            m_asm.patch(position, exit_stub(ip));
+        }
+        const auto bad_entry = m_asm.code.size();
+        // mov eax, esi; returns the requested position unchanged
+        m_asm.byte(0x89);
+        m_asm.byte(0xF0);
+        m_asm.patch(m_asm.jmp(), m_epilogue);
+        return install(bad_entry);
+    }
+
+  private:
+    static constexpr auto no_offset = static_cast<std::size_t>(-1);
+
+    // wide instructions are left to the interpreter, so the operands are short
+    [[nodiscard]] auto operand(const std::size_t ip) const -> std::int32_t
+    {
+        return static_cast<std::int32_t>(operand_at(m_instrs, ip, 0));
+    }
+
+    auto prologue() -> void
+    {
+        for (const auto reg : {rbx, rbp, r12, r13, r14, r15}) {
+            m_asm.push(reg);
+        }
+        m_asm.rsp_adjust(-8);
+        m_asm.mov(rbx, rdi);
+        m_asm.load(r12, rdi, static_cast<std::int32_t>(offsetof(jit_state, stack)));
+        m_asm.load(r13, rdi, static_cast<std::int32_t>(offsetof(jit_state, sp)));
+        m_asm.load(r14, rdi, static_cast<std::int32_t>(offsetof(jit_state, locals)));
+        m_asm.load(r15, rdi, static_cast<std::int32_t>(offsetof(jit_state, consts)));
+        m_asm.load(rbp, rdi, static_cast<std::int32_t>(offsetof(jit_state, globals)));
+        // jmp qword [table + rsi * 8]
+        m_table_fixup = m_asm.code.size() + 2;
+        m_asm.mov_imm(rax, 0);
+        m_asm.byte(0xFF);
+        m_asm.byte(0x24);
+        m_asm.byte(0xF0);
+
+        m_epilogue = m_asm.code.size();
+        m_asm.rsp_adjust(8);
+        for (const auto reg : {r15, r14, r13, r12, rbp, rbx}) {
+            m_asm.pop(reg);
+        }
+        m_asm.byte(0xC3);
+    }
+
+    auto exit_to(const std::size_t ip) -> void { m_exits.emplace_back(m_asm.jmp(), ip); }
+
+    auto exit_if(const condition cond, const std::size_t ip) -> void { m_exits.emplace_back(m_asm.jcc(cond), ip); }
+
+    auto exit_stub(const std::size_t ip) -> std::size_t
+    {
+        if (const auto itr = m_stubs.find(ip); itr != m_stubs.end()) {
+            return itr->second;
+        }
+        const auto stub = m_asm.code.size();
+        m_asm.mov_imm32(rax, static_cast<std::uint32_t>(ip));
+        m_asm.patch(m_asm.jmp(), m_epilogue);
+        m_stubs.emplace(ip, stub);
+        return stub;
+    }
+
+    auto jump_to(const std::size_t position, const std::size_t target) -> void { m_jumps.emplace_back(position, target); }
+
+    // the vm reserves the maximum stack depth of the function when calling it, so there are no bounds checks
+    auto push_rax() -> void
+    {
+        load_sp();
+        m_asm.store_indexed(r12, rcx, 0, rax);
+        m_asm.add_one(r13, 0, /*decrement=*/false);
+    }
+
+    auto load_sp() -> void { m_asm.load_int(rcx, r13, 0); }
+
+    auto pop_rax() -> void
+    {
+        load_sp();
+        m_asm.load_indexed(rax, r12, rcx, -slot);
+        m_asm.add_one(r13, 0, /*decrement=*/true);
+    }
+
+    auto generic_binary(const opcodes opcode, const std::size_t ip) -> void
+    {
+        m_asm.mov(rdi, rbx);
+        m_asm.mov_imm32(rsi, static_cast<std::uint32_t>(opcode));
+        m_asm.call(address_of_function(&jit_binary));
+        m_asm.test_al();
+        exit_if(cc_e, ip);
+    }
+
+    // integer operands are unboxed inline, everything else goes through the runtime
+    auto binary(const opcodes opcode, const std::size_t ip) -> void
+    {
+        const auto& layout = integer_probe();
+        load_sp();
+        m_asm.load_indexed(rax, r12, rcx, -2 * slot);
+        m_asm.load_indexed(rdx, r12, rcx, -slot);
+        m_asm.mov_imm(r8, layout.vtable);
+        m_asm.cmp_memory(rax, 0, r8);
+        const auto left_not_integer = m_asm.jcc(cc_ne);
+        m_asm.cmp_memory(rdx, 0, r8);
+        const auto right_not_integer = m_asm.jcc(cc_ne);
+        m_asm.load(rax, rax, layout.value_offset);
+        m_asm.load(rdx, rdx, layout.value_offset);
+        switch (opcode) {
+            case opcodes::add:
+            case opcodes::sub:
+            case opcodes::mul:
+                if (opcode == opcodes::add) {
+                    m_asm.add(rax, rdx);
+                } else if (opcode == opcodes::sub) {
+                    m_asm.sub(rax, rdx);
+                } else {
+                    m_asm.imul(rax, rdx);
+                }
+                m_asm.mov(rdi, rax);
+                m_asm.call(address_of_function(&jit_make_integer));
+                m_asm.test(rax, rax);
+                exit_if(cc_e, ip);
+                m_asm.load_int(rcx, r13, 0);
+                break;
+            default: {
+                m_asm.cmp(rax, rdx);
+                m_asm.mov_imm(rax, address_of(fals()));
+                m_asm.mov_imm(rdx, address_of(tru()));
+                const auto cond = opcode == opcodes::equal ? cc_e
+                    : opcode == opcodes::not_equal         ? cc_ne
+                    : opcode == opcodes::greater_than      ? cc_g
+                                                           : cc_ge;
+                m_asm.cmov(cond, rax, rdx);
+            } break;
+        }
+        m_asm.store_indexed(r12, rcx, -2 * slot, rax);
+        m_asm.add_one(r13, 0, /*decrement=*/true);
+        const auto done = m_asm.jmp();
+        m_asm.patch(left_not_integer, m_asm.code.size());
+        m_asm.patch(right_not_integer, m_asm.code.size());
+        generic_binary(opcode, ip);
+        m_asm.patch(done, m_asm.code.size());
+    }
+
+    auto branch_not_truthy(const std::size_t target) -> void
+    {
+        pop_rax();
+        m_asm.mov_imm(rdx, address_of(tru()));
+        m_asm.cmp(rax, rdx);
+        const auto is_true = m_asm.jcc(cc_e);
+        for (const auto* falsy : {fals(), null()}) {
+            m_asm.mov_imm(rdx, address_of(falsy));
+            m_asm.cmp(rax, rdx);
+            jump_to(m_asm.jcc(cc_e), target);
+        }
+        m_asm.mov(rdi, rax);
+        m_asm.call(address_of_function(&jit_is_truthy));
+        m_asm.test_al();
+        jump_to(m_asm.jcc(cc_e), target);
+        m_asm.patch(is_true, m_asm.code.size());
+    }
+
+    auto instruction(const std::size_t ip) -> void
+    {
+        using enum opcodes;
+        switch (const auto opcode = static_cast<opcodes>(m_instrs[ip])) {
+            case constant:
+            case constant_small:
+                m_asm.load(rax, r15, operand(ip) * slot);
+                push_rax();
+                break;
+            case tru:
+            case fals:
+            case null:
+                m_asm.mov_imm(rax, address_of(opcode == tru ? ::tru() : opcode == fals ? ::fals() : ::null()));
+                push_rax();
+                break;
+            case get_local:
+                m_asm.load(rax, r14, operand(ip) * slot);
+                push_rax();
+                break;
+            case set_local:
+                pop_rax();
+                m_asm.store(r14, operand(ip) * slot, rax);
+                break;
+            case get_global:
+                m_asm.load(rax, rbp, operand(ip) * slot);
+                m_asm.test(rax, rax);
+                exit_if(cc_e, ip);
+                push_rax();
+                break;
+            case set_global:
+                pop_rax();
+                m_asm.store(rbp, operand(ip) * slot, rax);
+                break;
+            case current_closure:
+                m_asm.load(rax, rbx, static_cast<std::int32_t>(offsetof(jit_state, closure)));
+                push_rax();
+                break;
+            case pop:
+                m_asm.add_one(r13, 0, /*decrement=*/true);
+                break;
+            case jump:
+                jump_to(m_asm.jmp(), static_cast<std::size_t>(operand(ip)));
+                break;
+            case jump_not_truthy:
+                branch_not_truthy(static_cast<std::size_t>(operand(ip)));
+                break;
+            case add:
+            case sub:
+            case mul:
+            case equal:
+            case not_equal:
+            case greater_than:
+            case greater_equal:
+                binary(opcode, ip);
+                break;
+            case add_int:
+            case sub_int:
+            case mul_int:
+            case equal_int:
+            case not_equal_int:
+            case greater_than_int:
+            case greater_equal_int:
+                binary(generic_opcode(opcode), ip);
+                break;
+            case add_dec:
+            case sub_dec:
+            case mul_dec:
+            case div_dec:
+            case greater_than_dec:
+            case greater_equal_dec:
+                generic_binary(generic_opcode(opcode), ip);
+                break;
+            case div:
+            case floor_div:
+            case mod:
+            case bit_and:
+            case bit_or:
+            case bit_xor:
+            case bit_lsh:
+            case bit_rsh:
+            case logical_and:
+            case logical_or:
+                generic_binary(opcode, ip);
+                break;
+            default:
+                exit_to(ip);
+                break;
+        }
+    }
+
+    auto install(const std::size_t bad_entry) -> std::shared_ptr<const native_code>
+    {
+        while (m_asm.code.size() % sizeof(std::uint64_t) != 0) {
+            m_asm.byte(0xCC);
+        }
+        const auto table = m_asm.code.size();
+        const auto size = table + (m_offsets.size() * sizeof(std::uint64_t));
+        void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (memory == MAP_FAILED) {
+            return nullptr;
+        }
+        const auto base = address_of(memory);
+        for (std::size_t idx = 0; idx < sizeof(std::uint64_t); ++idx) {
+            m_asm.code[m_table_fixup + idx] = static_cast<std::uint8_t>((base + table) >> (idx * 8U));
+        }
+        for (const auto offset : m_offsets) {
+            m_asm.imm64(base + (offset == no_offset ? bad_entry : offset));
+        }
+        std::memcpy(memory, m_asm.code.data(), m_asm.code.size());
+        if (mprotect(memory, size, PROT_READ | PROT_EXEC) != 0) {
+            munmap(memory, size);
+            return nullptr;
+        }
+        return std::make_shared<const native_code>(memory, size);
+    }
+
+    const instructions& m_instrs;
+    std::vector<std::size_t> m_offsets;
+    assembler m_asm;
+    std::size_t m_table_fixup {};
+    std::size_t m_epilogue {};
+    std::vector<std::pair<std::size_t, std::size_t>> m_jumps;
+    std::vector<std::pair<std::size_t, std::size_t>> m_exits;
+    std::map<std::size_t, std::size_t> m_stubs;
+};
+}  // namespace
+
+auto jit_available() -> bool
+{
+    return true;
+}
+
+auto jit_compile(const compiled_function_object& func) -> std::shared_ptr<const native_code>
+{
+    return template_compiler {func.instrs}.compile();
+}
+
+#else
+
+auto jit_available() -> bool
+{
+    return false;
+}
+
+auto jit_compile(const compiled_function_object& /*func*/) -> std::shared_ptr<const native_code>
+{
+    return nullptr;
+}
+
+#endif
+
+namespace
+{
+// NOLINTBEGIN(*)
+auto run_program(const std::string_view input, const std::uint32_t jit_threshold) -> std::pair<std::int64_t, vm>
+{
+    auto prsr = parser {lexer {input}};
+    auto prgrm = prsr.parse_program();
+    REQUIRE(prsr.errors().empty());
+    auto cmplr = compiler::create();
+    cmplr.compile(prgrm.get());
+    auto mchn = vm::create(cmplr.byte_code());
+    if (jit_threshold != 0) {
+        mchn.enable_jit(jit_threshold);
+    }
+    mchn.run();
+    REQUIRE(mchn.last_popped()->is(object::object_type::integer));
+    return {mchn.last_popped()->as<integer_object>()->value, std::move(mchn)};
+}
+
+TEST_SUITE("jit")
+{
+    TEST_CASE("nativeCodeRunsHotFunctions")
+    {
+        if (!jit_available()) {
+            MESSAGE("no jit available on this platform");
+            return;
+        }
+        constexpr auto input = R"(
+let fib = fn(n) { if (n < 2) { return n; } fib(n - 1) + fib(n - 2) };
+let sum = fn() { let i = 0; let acc = 0; while (i < 100) { acc = acc + i; i = i + 1; } acc };
+fib(15) + sum())";
+        const auto [interpreted, interpreter] = run_program(input, 0);
+        const auto [native, jitted] = run_program(input, 2);
+        CHECK_EQ(interpreted, 610 + 4950);
+        CHECK_EQ(native, interpreted);
+        CHECK_LT(jitted.instructions_executed() * 2, interpreter.instructions_executed());
+    }
+
+    TEST_CASE("nativeCodeFallsBackToTheInterpreterOnErrors")
+    {
+        if (!jit_available()) {
+            MESSAGE("no jit available on this platform");
+            return;
+        }
+        auto prsr = parser {lexer {R"(let f = fn(a) { a - "x" }; f(1))"}};
+        auto prgrm = prsr.parse_program();
+        auto cmplr = compiler::create();
+        cmplr.compile(prgrm.get());
+        auto mchn = vm::create(cmplr.byte_code());
+        mchn.enable_jit(1);
+        CHECK_THROWS_WITH(mchn.run(), "unsupported types for binary operation: integer sub string");
+    }
+}
+
+// NOLINTEND(*)
+}  // namespace
@@ -0,0 +1,58 @@
+// Copyright 2023-2025 hrzlgnm
+// SPDX-License-Identifier: MIT-0
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#if defined(__x86_64__) && defined(__linux__)
+#    define CAPPUCHIN_JIT_X86_64
+#endif
+
+struct object;
+struct closure_object;
+struct compiled_function_object;
+
+// The part of a vm frame the generated code works on. The generated code addresses the members by offset,
+// so this has to stay a standard layout type.
+struct jit_state final
+{
+    const object** stack {};
+    int* sp {};
+    const object** locals {};
+    const object* const* consts {};
+    const object** globals {};
+    const closure_object* closure {};
+};
+
+// Native code of one compiled function. Opcodes which push or pop frames, and the slow paths of all others,
+// are left to the interpreter: the native code returns the position of such an instruction, the interpreter
+// executes it and enters the native code again at the next instruction.
+class native_code final
+{
+  public:
+    using entry_point = std::size_t (*)(jit_state* state, std::size_t ip);
+
+    native_code(void* memory, std::size_t size);
+    ~native_code();
+    native_code(const native_code&) = delete;
+    native_code(native_code&&) = delete;
+    auto operator=(const native_code&) -> native_code& = delete;
+    auto operator=(native_code&&) -> native_code& = delete;
+
+    // runs from the instruction at `ip` up to the first one for the interpreter, returns its position
+    auto run(jit_state* state, std::size_t ip) const -> std::size_t;
+
+    [[nodiscard]] auto size() const -> std::size_t { return m_size; }
+
+  private:
+    void* m_memory {};
+    std::size_t m_size {};
+};
+
+[[nodiscard]] auto jit_available() -> bool;
+
+// returns nullptr where no jit is available
+[[nodiscard]] auto jit_compile(const compiled_function_object& func) -> std::shared_ptr<const native_code>;
@@ -0,0 +1,413 @@
+// Copyright 2023-2025 hrzlgnm
+// SPDX-License-Identifier: MIT-0
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include "register_vm.hpp"
+
+#include <builtin/builtin.hpp>
+#include <code/code.hpp>
+#include <code/register_code.hpp>
+#include <compiler/compiler.hpp>
+#include <compiler/symbol_table.hpp>
+#include <doctest/doctest.h>
+#include <fmt/format.h>
+#include <gc.hpp>
+#include <lexer/lexer.hpp>
+#include <object/object.hpp>
+#include <parser/parser.hpp>
+
+#include "vm.hpp"
+
+namespace
+{
+constexpr auto as_size_t(const int value) -> std::size_t
+{
+    return static_cast<std::size_t>(value);
+}
+}  // namespace
+
+auto register_vm::create(bytecode code) -> register_vm
+{
+    return create_with_state(std::move(code), allocate<constants>(globals_size));
+}
+
+auto register_vm::create_with_state(bytecode code, constants* globals) -> register_vm
+{
+    if (code.register_code.instrs.empty() && !code.instrs.empty()) {
+        throw std::invalid_argument("byte code was not compiled for the register vm");
+    }
+    if (as_size_t(code.register_code.num_registers) > stack_size) {
+        throw std::runtime_error("stack overflow");
+    }
+    auto* main_fn = allocate<compiled_function_object>(std::move(code.instrs), 0, 0);
+    main_fn->register_code = std::move(code.register_code);
+    auto* main_closure = allocate<closure_object>(main_fn);
+    return register_vm {register_frame {.cl = main_closure}, code.consts, globals};
+}
+
+auto register_vm::run_input(bytecode code) -> void
+{
+    if (code.register_code.instrs.empty() && !code.instrs.empty()) {
+        throw std::invalid_argument("byte code was not compiled for the register vm");
+    }
+    if (as_size_t(code.register_code.num_registers) > stack_size) {
+        throw std::runtime_error("stack overflow");
+    }
+    auto* main_fn = m_frames[0].cl->fn->as_mutable();
+    main_fn->instrs = std::move(code.instrs);
+    main_fn->register_code = std::move(code.register_code);
+    m_constants = code.consts;
+    // an input which failed may have left frames behind
+    m_frames[0].ip = 0;
+    m_frame_index = 1;
+    m_last_popped = nullptr;
+    run();
+}
+
+register_vm::register_vm(const register_frame main_frame, const constants* consts, constants* globals)
+    : m_constants {consts}
+    , m_globals {globals}
+{
+    m_frames[0] = main_frame;
+}
+
+auto register_vm::run() -> void
+{
+    const object* const* consts = m_constants->data();
+    const std::uint16_t* code {};
+    std::size_t code_size {};
+    std::size_t ip {};
+    const object** regs {};
+    register_frame* frame {};
+    const auto load_frame = [&]
+    {
+        frame = &m_frames[m_frame_index - 1];
+        code = frame->cl->fn->register_code.instrs.data();
+        code_size = frame->cl->fn->register_code.instrs.size();
+        ip = frame->ip;
+        regs = &m_registers[frame->base];
+    };
+    const auto operand = [&](const std::uint16_t reg_or_const) -> const object*
+    {
+        if ((reg_or_const & constant_operand) != 0) {
+            return consts[reg_or_const & ~constant_operand];
+        }
+        return regs[reg_or_const];
+    };
+    const auto binary = [&](const opcodes opcode, const std::uint16_t* ins)
+    {
+        const auto* left = operand(ins[2]);
+        const auto* right = operand(ins[3]);
+        if (const auto* result = apply_binary_operator(opcode, left, right); result != nullptr) {
+            regs[ins[1]] = result;
+            return;
+        }
+        throw std::runtime_error(
+            fmt::format("unsupported types for binary operation: {} {} {}", left->type(), opcode, right->type()));
+    };
+
+    load_frame();
+    while (ip < code_size) {
+        m_executed++;
+        const auto* ins = code + ip;
+        const auto opcode = static_cast<register_opcodes>(ins[0]);
+        switch (opcode) {
+            case register_opcodes::move:
+                regs[ins[1]] = operand(ins[2]);
+                ip += 3;
+                break;
+            case register_opcodes::load_constant:
+                if (ins[2] >= m_constants->size() || consts[ins[2]] == nullptr) {
+                    throw std::runtime_error(fmt::format("constant at index {} does not exist", ins[2]));
+                }
+                regs[ins[1]] = consts[ins[2]];
+                ip += 3;
+                break;
+            case register_opcodes::load_true:
+                regs[ins[1]] = tru();
+                ip += 2;
+                break;
+            case register_opcodes::load_false:
+                regs[ins[1]] = fals();
+                ip += 2;
+                break;
+            case register_opcodes::load_null:
+                regs[ins[1]] = null();
+                ip += 2;
+                break;
+            case register_opcodes::add:
+                binary(opcodes::add, ins);
+                ip += 4;
+                break;
+            case register_opcodes::sub:
+                binary(opcodes::sub, ins);
+                ip += 4;
+                break;
+            case register_opcodes::mul:
+                binary(opcodes::mul, ins);
+                ip += 4;
+                break;
+            case register_opcodes::div:
+                binary(opcodes::div, ins);
+                ip += 4;
+                break;
+            case register_opcodes::floor_div:
+                binary(opcodes::floor_div, ins);
+                ip += 4;
+                break;
+            case register_opcodes::mod:
+                binary(opcodes::mod, ins);
+                ip += 4;
+                break;
+            case register_opcodes::bit_and:
+                binary(opcodes::bit_and, ins);
+                ip += 4;
+                break;
+            case register_opcodes::bit_or:
+                binary(opcodes::bit_or, ins);
+                ip += 4;
+                break;
+            case register_opcodes::bit_xor:
+                binary(opcodes::bit_xor, ins);
+                ip += 4;
+                break;
+            case register_opcodes::bit_lsh:
+                binary(opcodes::bit_lsh, ins);
+                ip += 4;
+                break;
+            case register_opcodes::bit_rsh:
+                binary(opcodes::bit_rsh, ins);
+                ip += 4;
+                break;
+            case register_opcodes::logical_and:
+                binary(opcodes::logical_and, ins);
+                ip += 4;
+                break;
+            case register_opcodes::logical_or:
+                binary(opcodes::logical_or, ins);
+                ip += 4;
+                break;
+            case register_opcodes::equal:
+                binary(opcodes::equal, ins);
+                ip += 4;
+                break;
+            case register_opcodes::not_equal:
+                binary(opcodes::not_equal, ins);
+                ip += 4;
+                break;
+            case register_opcodes::greater_than:
+                binary(opcodes::greater_than, ins);
+                ip += 4;
+                break;
+            case register_opcodes::greater_equal:
+                binary(opcodes::greater_equal, ins);
+                ip += 4;
+                break;
+            case register_opcodes::minus:
+                regs[ins[1]] = apply_minus(operand(ins[2]));
+                ip += 3;
+                break;
+            case register_opcodes::bang:
+                regs[ins[1]] = native_bool_to_object(!operand(ins[2])->is_truthy());
+                ip += 3;
+                break;
+            case register_opcodes::jump:
+                ip = ins[1];
+                break;
+            case register_opcodes::jump_not_truthy:
+                ip = operand(ins[1])->is_truthy() ? ip + 3 : ins[2];
+                break;
+            case register_opcodes::get_global: {
+                const auto* global = (*m_globals)[ins[2]];
+                if (global == nullptr) {
+                    throw std::runtime_error(fmt::format("global at index {} does not exits", ins[2]));
+                }
+                regs[ins[1]] = global;
+                ip += 3;
+            } break;
+            case register_opcodes::set_global:
+                (*m_globals)[ins[1]] = operand(ins[2]);
+                // the stack vm pops the value, so it is the result of an input ending in a let or an assignment
+                if (frame == m_frames.data()) {
+                    m_last_popped = (*m_globals)[ins[1]];
+                }
+                ip += 3;
+                break;
+            case register_opcodes::array:
+                regs[ins[1]] = build_array(frame->base + ins[1], ins[2]);
+                ip += 3;
+                break;
+            case register_opcodes::hash:
+                regs[ins[1]] = build_hash(frame->base + ins[1], ins[2]);
+                ip += 3;
+                break;
+            case register_opcodes::index:
+                regs[ins[1]] = apply_index(operand(ins[2]), operand(ins[3]));
+                ip += 4;
+                break;
+            case register_opcodes::call:
+                frame->ip = ip + 3;
+                exec_call(frame->base + ins[1], ins[2]);
+                load_frame();
+                break;
+            case register_opcodes::brake:
+                exec_return(fals(), /*unwind_loops=*/false);
+                load_frame();
+                break;
+            case register_opcodes::cont:
+                exec_return(tru(), /*unwind_loops=*/false);
+                load_frame();
+                break;
+            case register_opcodes::return_value:
+                exec_return(operand(ins[1]), /*unwind_loops=*/true);
+                load_frame();
+                break;
+            case register_opcodes::ret:
+                exec_return(null(), /*unwind_loops=*/false);
+                load_frame();
+                break;
+            case register_opcodes::get_free:
+                regs[ins[1]] = frame->cl->free[ins[2]];
+                ip += 3;
+                break;
+            case register_opcodes::set_free:
+                frame->cl->free[ins[1]] = operand(ins[2]);
+                ip += 3;
+                break;
+            case register_opcodes::get_outer: {
+                const auto& outer = outer_frame(ins[2]);
+                const auto scope = static_cast<symbol_scope>(ins[3]);
+                if (scope == symbol_scope::local) {
+                    regs[ins[1]] = m_registers[outer.base + ins[4]];
+                } else if (scope == symbol_scope::free) {
+                    regs[ins[1]] = outer.cl->free[ins[4]];
+                } else if (scope == symbol_scope::function) {
+                    regs[ins[1]] = outer.cl;
+                }
+                ip += 5;
+            } break;
+            case register_opcodes::set_outer: {
+                const auto& outer = outer_frame(ins[1]);
+                const auto scope = static_cast<symbol_scope>(ins[2]);
+                if (scope == symbol_scope::local) {
+                    m_registers[outer.base + ins[3]] = operand(ins[4]);
+                } else if (scope == symbol_scope::free) {
+                    outer.cl->free[ins[3]] = operand(ins[4]);
+                }
+                ip += 5;
+            } break;
+            case register_opcodes::get_builtin:
+                regs[ins[1]] = allocate<builtin_object>(builtin::builtins()[ins[2]]);
+                ip += 3;
+                break;
+            case register_opcodes::closure:
+                regs[ins[1]] = build_closure(frame->base + ins[1], ins[2], ins[3]);
+                ip += 4;
+                break;
+            case register_opcodes::current_closure:
+                regs[ins[1]] = frame->cl;
+                ip += 2;
+                break;
+            case register_opcodes::pop:
+                m_last_popped = operand(ins[1]);
+                ip += 2;
+                break;
+            default:
+                throw std::runtime_error(fmt::format("invalid register opcode {}", ins[0]));
+        }
+    }
+    frame->ip = ip;
+}
+
+auto register_vm::last_popped() const -> const object*
+{
+    return m_last_popped != nullptr ? m_last_popped : null();
+}
+
+auto register_vm::exec_call(const std::size_t callee, const std::size_t num_args) -> void
+{
+    using enum object::object_type;
+    const auto* fn = m_registers[callee];
+    if (fn->is(closure)) {
+        const auto* clsr = fn->as<closure_object>();
+        if (as_size_t(clsr->fn->num_arguments) != num_args) {
+            throw std::runtime_error(
+                fmt::format("wrong number of arguments: want={}, got={}", clsr->fn->num_arguments, num_args));
+        }
+        if (clsr->fn->register_code.instrs.empty()) {
+            throw std::runtime_error("function was not compiled for the register vm");
+        }
+        const auto base = callee + 1;
+        if (base + as_size_t(clsr->fn->register_code.num_registers) > stack_size || m_frame_index >= max_frames) {
+            throw std::runtime_error("stack overflow");
+        }
+        m_frames[m_frame_index] = register_frame {.cl = clsr->as_mutable(), .ip = 0, .base = base};
+        m_frame_index++;
+        return;
+    }
+    if (fn->is(builtin)) {
+        const auto* const builtin = fn->as<builtin_object>()->bltn;
+        array_object::value_type args;
+        for (auto idx = callee + 1; idx <= callee + num_args; idx++) {
+            args.push_back(m_registers[idx]);
+        }
+        m_registers[callee] = builtin->body(std::move(args));
+        return;
+    }
+    throw std::runtime_error("calling non-closure and non-builtin");
+}
+
+auto register_vm::exec_return(const object* value, const bool unwind_loops) -> void
+{
+    m_frame_index--;
+    while (unwind_loops && m_frames[m_frame_index].cl->fn->inside_loop) {
+        m_frame_index--;
+    }
+    m_registers[m_frames[m_frame_index].base - 1] = value;
+}
+
+auto register_vm::build_array(const std::size_t start, const std::size_t count) const -> const object*
+{
+    array_object::value_type arr;
+    for (auto idx = start; idx < start + count; idx++) {
+        arr.push_back(m_registers[idx]);
+    }
+    return allocate<array_object>(std::move(arr));
+}
+
+auto register_vm::build_hash(const std::size_t start, const std::size_t count) const -> const object*
+{
+    hash_object::value_type hsh;
+    for (auto idx = start; idx < start + count; idx += 2) {
+        const auto* key = m_registers[idx];
+        const auto* val = m_registers[idx + 1U];
+        hsh[key->as<hashable>()->hash_key()] = val;
+    }
+    return allocate<hash_object>(std::move(hsh));
+}
+
+auto register_vm::build_closure(const std::size_t start, const std::uint16_t const_idx, const std::size_t num_free) const
+    -> const object*
+{
+    const auto* constant = (*m_constants)[const_idx];
+    if (!constant->is(object::object_type::compiled_function)) {
+        throw std::runtime_error(
+            fmt::format("expected a compiled_function, got an object of type {}", constant->type()));
+    }
+    array_object::value_type free;
+    for (auto idx = start; idx < start + num_free; idx++) {
+        free.push_back(m_registers[idx]);
+    }
+    return allocate<closure_object>(constant->as<compiled_function_object>(), free);
+}
+
+auto register_vm::outer_frame(const std::size_t level) const -> const register_frame&
+{
+    return m_frames[m_frame_index - (level + 1U)];
+}
@@ -0,0 +1,55 @@
+// Copyright 2023-2025 hrzlgnm
+// SPDX-License-Identifier: MIT-0
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <code/register_code.hpp>
+#include <compiler/compiler.hpp>
+#include <object/object.hpp>
+
+#include "vm.hpp"
+
+struct register_frame final
+{
+    closure_object* cl {};
+    std::size_t ip {};
+    std::size_t base {};
+};
+
+// Executes the register form of the byte code, which requires compiling with `backend::registers`.
+// A frame owns the registers from its base up to the register count of its function, the callee and the
+// arguments of a call sit right below the base of the called frame, so the result replaces the callee.
+struct register_vm final
+{
+    static auto create(bytecode code) -> register_vm;
+    static auto create_with_state(bytecode code, constants* globals) -> register_vm;
+    auto run() -> void;
+    // runs the code of the next input of a repl in place of the main program, on the globals and frames the earlier
+    // inputs left
+    auto run_input(bytecode code) -> void;
+    [[nodiscard]] auto last_popped() const -> const object*;
+
+    [[nodiscard]] auto instructions_executed() const -> std::uint64_t { return m_executed; }
+
+  private:
+    register_vm(register_frame main_frame, const constants* consts, constants* globals);
+    auto exec_call(std::size_t callee, std::size_t num_args) -> void;
+    auto exec_return(const object* value, bool unwind_loops) -> void;
+    [[nodiscard]] auto build_array(std::size_t start, std::size_t count) const -> const object*;
+    [[nodiscard]] auto build_hash(std::size_t start, std::size_t count) const -> const object*;
+    [[nodiscard]] auto build_closure(std::size_t start, std::uint16_t const_idx, std::size_t num_free) const
+        -> const object*;
+    [[nodiscard]] auto outer_frame(std::size_t level) const -> const register_frame&;
+
+    const constants* m_constants {};
+    constants* m_globals {};
+    constants m_registers {stack_size};
+    std::vector<register_frame> m_frames {max_frames};
+    std::size_t m_frame_index {1};
+    const object* m_last_popped {};
+    std::uint64_t m_executed {};
+};
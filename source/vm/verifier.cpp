@@ -0,0 +1,692 @@
+// Copyright 2023-2025 hrzlgnm
+// SPDX-License-Identifier: MIT-0
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <sstream>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "verifier.hpp"
+
+#include <builtin/builtin.hpp>
+#include <code/code.hpp>
+#include <compiler/compiler.hpp>
+#include <compiler/image.hpp>
+#include <compiler/symbol_table.hpp>
+#include <doctest/doctest.h>
+#include <fmt/format.h>
+#include <gc.hpp>
+#include <lexer/lexer.hpp>
+#include <object/object.hpp>
+#include <parser/parser.hpp>
+
+#include "vm.hpp"
+
+namespace
+{
+// the constant index of a compiled function, none for the main code
+using code_owner = std::optional<std::size_t>;
+
+struct function_shape final
+{
+    const instructions& code;
+    std::size_t num_locals {};
+    // the first locals, written by the caller
+    std::size_t num_arguments {};
+    std::size_t num_free {};
+    std::size_t max_stack {};
+    bool is_main {};
+    code_owner owner;
+};
+
+// the length of the instruction at `ip` including its operands, nullopt if it is not a complete instruction
+auto instruction_length(const instructions& code, const std::size_t ip) -> std::optional<std::size_t>
+{
+    if (!definitions.contains(static_cast<opcodes>(code[ip]))) {
+        return std::nullopt;
+    }
+    // a wide prefix is only valid in front of an instruction with operands
+    if (static_cast<opcodes>(code[ip]) == opcodes::wide) {
+        if (ip + 1 >= code.size()) {
+            return std::nullopt;
+        }
+        const auto def = definitions.find(static_cast<opcodes>(code[ip + 1]));
+        if (def == definitions.end() || def->second.operand_widths.empty()) {
+            return std::nullopt;
+        }
+    }
+    const auto length = ::instruction_length(code, ip);
+    if (ip + length > code.size()) {
+        return std::nullopt;
+    }
+    return length;
+}
+
+class verifier final
+{
+  public:
+    verifier(const constants& consts, const std::size_t num_globals)
+        : m_consts {consts}
+        , m_num_globals {num_globals}
+    {
+    }
+
+    // The number of free variables of each function is given by the closure instructions creating it. A loop body
+    // runs in a frame right above the one of the code creating it, which is recorded for the loop bodies to verify to
+    // check the frames their returns unwind and their outer variables are taken from.
+    auto collect_closures(const instructions& code, const code_owner& owner) -> void
+    {
+        for (std::size_t ip = 0; ip < code.size();) {
+            const auto length = instruction_length(code, ip);
+            if (!length.has_value()) {
+                return;
+            }
+            if (const auto opcode = opcode_at(code, ip);
+                opcode == opcodes::closure || opcode == opcodes::frame_closure)
+            {
+                const auto const_idx = operand_at(code, ip, 0);
+                const auto [itr, inserted] = m_free_counts.try_emplace(const_idx, operand_at(code, ip, 1));
+                itr->second = std::min(itr->second, operand_at(code, ip, 1));
+                if (is_loop_body(const_idx) && !function_at(const_idx)->verified) {
+                    const auto [parent, added] = m_loop_parents.try_emplace(const_idx, owner);
+                    if (!added && parent->second != owner) {
+                        fail(ip, fmt::format("loop body {} is created by more than one function", const_idx));
+                    }
+                }
+            }
+            ip += *length;
+        }
+    }
+
+    [[nodiscard]] auto free_count(const std::size_t const_idx) const -> std::size_t
+    {
+        const auto itr = m_free_counts.find(const_idx);
+        return itr != m_free_counts.end() ? itr->second : 0;
+    }
+
+    auto verify(const function_shape& func) -> void
+    {
+        const auto& code = func.code;
+        std::vector<bool> boundaries(code.size() + 1);
+        std::vector<bool> targets(code.size() + 1);
+        for (std::size_t ip = 0; ip < code.size();) {
+            boundaries[ip] = true;
+            const auto length = instruction_length(code, ip);
+            if (!length.has_value()) {
+                fail(ip, fmt::format("invalid or truncated instruction {}", code[ip]));
+            }
+            if (const auto opcode = opcode_at(code, ip); opcode == opcodes::jump || opcode == opcodes::jump_not_truthy)
+            {
+                targets[std::min(operand_at(code, ip, 0), code.size())] = true;
+            }
+            ip += *length;
+        }
+        boundaries[code.size()] = true;
+
+        constexpr auto unknown = -1L;
+        std::vector<std::int64_t> depths(code.size() + 1, unknown);
+        std::int64_t depth = 0;
+        auto reachable = true;
+        for (std::size_t ip = 0; ip < code.size(); ip += *instruction_length(code, ip)) {
+            if (depths[ip] != unknown) {
+                if (reachable && depths[ip] != depth) {
+                    fail(ip, fmt::format("inconsistent stack depth {} and {}", depths[ip], depth));
+                }
+                depth = depths[ip];
+                reachable = true;
+            } else if (reachable) {
+                depths[ip] = depth;
+            }
+            verify_operands(func, ip, boundaries, targets);
+            if (!reachable) {
+                continue;
+            }
+            const auto use = stack_use_at(code, ip);
+            if (std::cmp_less(depth, use.pops)) {
+                fail(ip, "stack underflow");
+            }
+            depth += static_cast<std::int64_t>(use.pushes) - static_cast<std::int64_t>(use.pops);
+            if (std::cmp_greater(depth, func.max_stack)) {
+                fail(ip, fmt::format("stack depth exceeds the maximum of {}", func.max_stack));
+            }
+            using enum opcodes;
+            const auto opcode = opcode_at(code, ip);
+            if (opcode == jump || opcode == jump_not_truthy) {
+                record_depth(ip, operand_at(code, ip, 0), depth, depths);
+            }
+            reachable = opcode != jump && opcode != brake && opcode != cont && opcode != return_value && opcode != ret;
+        }
+        if (reachable && !func.is_main) {
+            fail(code.size(), "function does not end with a return");
+        }
+        // calls reserve frames of the maximum depth, which the compiler computes the same way
+        if (const auto needed = max_stack_depth(code); std::cmp_greater(func.max_stack, needed)) {
+            fail(0, fmt::format("maximum stack depth {} exceeds the {} the code needs", func.max_stack, needed));
+        }
+        verify_locals(func, depths);
+    }
+
+  private:
+    [[noreturn]] static auto fail(const std::size_t ip, const std::string_view what) -> void
+    {
+        throw std::runtime_error(fmt::format("invalid bytecode at offset {}: {}", ip, what));
+    }
+
+    static auto record_depth(const std::size_t ip,
+                             const std::size_t target,
+                             const std::int64_t depth,
+                             std::vector<std::int64_t>& depths) -> void
+    {
+        if (target <= ip && depths[target] == -1) {
+            fail(ip, fmt::format("backward jump to {}, which is not reached by falling through", target));
+        }
+        if (depths[target] != -1 && depths[target] != depth) {
+            fail(ip, fmt::format("inconsistent stack depth {} and {} at jump target {}", depths[target], depth, target));
+        }
+        depths[target] = depth;
+    }
+
+    // A call does not clear the slots of the locals, so each local has to be written on every path reaching a read of
+    // it. Writes only add to the locals written along a path, the pass is repeated until those written at the targets
+    // of backward jumps settle. Instructions without a stack depth are never reached.
+    static auto verify_locals(const function_shape& func, const std::vector<std::int64_t>& depths) -> void
+    {
+        if (func.num_locals == 0) {
+            return;
+        }
+        const auto& code = func.code;
+        std::map<std::size_t, std::vector<bool>> at_targets;
+        const auto record = [&](const std::size_t ip, const std::size_t target, const std::vector<bool>& written)
+        {
+            const auto [itr, added] = at_targets.try_emplace(target, written);
+            if (added) {
+                return true;
+            }
+            auto changed = false;
+            for (std::size_t idx = 0; idx < written.size(); ++idx) {
+                if (itr->second[idx] && !written[idx]) {
+                    itr->second[idx] = false;
+                    changed = true;
+                }
+            }
+            return !changed || target >= ip;
+        };
+        for (auto settled = false; !settled;) {
+            settled = true;
+            std::vector<bool> written(func.num_locals);
+            std::fill_n(written.begin(), std::min(func.num_arguments, func.num_locals), true);
+            auto reachable = true;
+            for (std::size_t ip = 0; ip < code.size(); ip += *instruction_length(code, ip)) {
+                if (depths[ip] == -1) {
+                    continue;
+                }
+                if (const auto target = at_targets.find(ip); target != at_targets.end()) {
+                    if (reachable) {
+                        settled = record(ip, ip, written) && settled;
+                    }
+                    written = target->second;
+                }
+                using enum opcodes;
+                const auto opcode = opcode_at(code, ip);
+                if (opcode == get_local && !written[operand_at(code, ip, 0)]) {
+                    fail(ip, fmt::format("local {} is read before it is written", operand_at(code, ip, 0)));
+                }
+                if (opcode == set_local) {
+                    written[operand_at(code, ip, 0)] = true;
+                }
+                if (opcode == jump || opcode == jump_not_truthy) {
+                    settled = record(ip, operand_at(code, ip, 0), written) && settled;
+                }
+                reachable =
+                    opcode != jump && opcode != brake && opcode != cont && opcode != return_value && opcode != ret;
+            }
+        }
+    }
+
+    [[nodiscard]] auto function_at(const std::size_t const_idx) const -> const compiled_function_object*
+    {
+        const auto* constant = const_idx < m_consts.size() ? m_consts[const_idx] : nullptr;
+        if (constant == nullptr || !constant->is(object::object_type::compiled_function)) {
+            return nullptr;
+        }
+        return constant->as<compiled_function_object>();
+    }
+
+    [[nodiscard]] auto is_loop_body(const code_owner& owner) const -> bool
+    {
+        const auto* func = owner.has_value() ? function_at(*owner) : nullptr;
+        return func != nullptr && func->inside_loop;
+    }
+
+    // The code whose frame lies `level` frames below the one of `owner`, every frame in between belongs to a loop
+    // body. Throws if a frame below that of a function which is no loop body is asked for, nullopt if `owner` is a
+    // loop body which is never created, so it never runs.
+    [[nodiscard]] auto enclosing(const std::size_t ip, code_owner owner, const std::size_t level) const
+        -> std::optional<code_owner>
+    {
+        for (std::size_t step = 0; step < level; ++step) {
+            if (!is_loop_body(owner)) {
+                fail(ip, fmt::format("outer level {} is not within an enclosing function", level));
+            }
+            const auto parent = m_loop_parents.find(*owner);
+            if (parent == m_loop_parents.end()) {
+                return std::nullopt;
+            }
+            owner = parent->second;
+        }
+        return owner;
+    }
+
+    // whether the returns of the code unwind past the frame of the main code, they pop the frames of the loop bodies
+    // and that of the first function which is none
+    [[nodiscard]] auto returns_from_main(code_owner owner) const -> bool
+    {
+        for (std::size_t step = 0; step <= m_loop_parents.size() && is_loop_body(owner); ++step) {
+            const auto parent = m_loop_parents.find(*owner);
+            if (parent == m_loop_parents.end()) {
+                return false;
+            }
+            owner = parent->second;
+        }
+        return !owner.has_value();
+    }
+
+    auto verify_operands(const function_shape& func,
+                         const std::size_t ip,
+                         const std::vector<bool>& boundaries,
+                         const std::vector<bool>& targets) const -> void
+    {
+        const auto& code = func.code;
+        const auto first = [&] { return operand_at(code, ip, 0); };
+        const auto in_range = [&](const std::size_t index, const std::size_t size, const std::string_view what)
+        {
+            if (index >= size) {
+                fail(ip, fmt::format("{} index {} out of range {}", what, index, size));
+            }
+        };
+        using enum opcodes;
+        switch (opcode_at(code, ip)) {
+            case constant:
+            case constant_small:
+                in_range(first(), m_consts.size(), "constant");
+                if (m_consts[first()] == nullptr) {
+                    fail(ip, fmt::format("constant at index {} does not exist", first()));
+                }
+                break;
+            case closure:
+            case frame_closure:
+                in_range(first(), m_consts.size(), "constant");
+                if (function_at(first()) == nullptr) {
+                    fail(ip, fmt::format("constant at index {} is not a compiled function", first()));
+                }
+                if (is_loop_body(first())) {
+                    verify_loop_call(func, ip, targets);
+                }
+                break;
+            case current_closure:
+                if (is_loop_body(func.owner)) {
+                    fail(ip, "the closure of a loop body is used as a value");
+                }
+                break;
+            case brake:
+            case cont:
+                if (!is_loop_body(func.owner)) {
+                    fail(ip, "break or continue outside of a loop body");
+                }
+                break;
+            case return_value:
+                if (returns_from_main(func.owner)) {
+                    fail(ip, "return outside of a function");
+                }
+                break;
+            case get_global:
+            case set_global:
+                in_range(first(), m_num_globals, "global");
+                break;
+            case get_local:
+            case set_local:
+                in_range(first(), func.num_locals, "local");
+                break;
+            case get_free:
+            case set_free:
+                in_range(first(), func.num_free, "free");
+                break;
+            case get_builtin:
+                in_range(first(), builtin::builtins().size(), "builtin");
+                break;
+            case hash:
+                if (first() % 2 != 0) {
+                    fail(ip, "odd number of hash elements");
+                }
+                break;
+            case get_outer:
+            case set_outer: {
+                const auto scope = static_cast<symbol_scope>(operand_at(code, ip, 1));
+                if (scope != symbol_scope::local && scope != symbol_scope::free
+                    && (scope != symbol_scope::function || opcode_at(code, ip) == set_outer))
+                {
+                    fail(ip, fmt::format("invalid outer scope {}", scope));
+                }
+                const auto outer = enclosing(ip, func.owner, first());
+                if (!outer.has_value()) {
+                    break;
+                }
+                // the main code keeps its variables in globals
+                const auto* outer_func = outer->has_value() ? function_at(**outer) : nullptr;
+                const auto outer_locals = outer_func != nullptr ? outer_func->num_locals : 0;
+                const auto index = operand_at(code, ip, 2);
+                if (scope == symbol_scope::local) {
+                    in_range(index, static_cast<std::size_t>(outer_locals), "outer local");
+                } else if (scope == symbol_scope::free) {
+                    in_range(index, outer->has_value() ? free_count(**outer) : 0, "outer free");
+                } else if (is_loop_body(*outer)) {
+                    fail(ip, "the closure of a loop body is used as a value");
+                }
+            } break;
+            case jump:
+            case jump_not_truthy:
+                if (first() >= boundaries.size() || !boundaries[first()]
+                    || (first() == code.size() && !func.is_main))
+                {
+                    fail(ip, fmt::format("jump target {} is not an instruction", first()));
+                }
+                break;
+            default:
+                break;
+        }
+    }
+
+    // A loop body has to be called right where it is created, in the frame of the code creating it, the call may
+    // not be reached by a jump with another callee. Its closure never becomes a value of the program. One which was
+    // verified before was checked against the frames of other code.
+    auto verify_loop_call(const function_shape& func, const std::size_t ip, const std::vector<bool>& targets) const
+        -> void
+    {
+        const auto& code = func.code;
+        const auto const_idx = operand_at(code, ip, 0);
+        const auto parent = m_loop_parents.find(const_idx);
+        if (parent == m_loop_parents.end() || parent->second != func.owner) {
+            fail(ip, fmt::format("loop body {} was verified with other code", const_idx));
+        }
+        const auto call_ip = ip + *instruction_length(code, ip);
+        if (call_ip >= code.size() || targets[call_ip] || opcode_at(code, call_ip) != opcodes::call
+            || operand_at(code, call_ip, 0) != 0)
+        {
+            fail(ip, fmt::format("loop body {} is not called where it is created", const_idx));
+        }
+    }
+
+    const constants& m_consts;
+    std::size_t m_num_globals {};
+    std::map<std::size_t, std::size_t> m_free_counts;
+    std::map<std::size_t, code_owner> m_loop_parents;
+};
+}  // namespace
+
+auto verify(const bytecode& code, const std::size_t num_globals, const std::size_t first_constant) -> void
+{
+    verifier vrfr {*code.consts, num_globals};
+    std::vector<std::pair<std::size_t, const compiled_function_object*>> pending;
+    for (auto idx = first_constant; idx < code.consts->size(); ++idx) {
+        const auto* constant = (*code.consts)[idx];
+        if (constant != nullptr && constant->is(object::object_type::compiled_function)
+            && !constant->as<compiled_function_object>()->verified)
+        {
+            pending.emplace_back(idx, constant->as<compiled_function_object>());
+        }
+    }
+    vrfr.collect_closures(code.instrs, std::nullopt);
+    for (const auto& [idx, func] : pending) {
+        vrfr.collect_closures(func->instrs, idx);
+    }
+    for (const auto& [idx, func] : pending) {
+        vrfr.verify({
+            .code = func->instrs,
+            .num_locals = static_cast<std::size_t>(func->num_locals),
+            .num_arguments = static_cast<std::size_t>(func->num_arguments),
+            .num_free = vrfr.free_count(idx),
+            .max_stack = static_cast<std::size_t>(func->max_stack),
+            .is_main = false,
+            .owner = idx,
+        });
+    }
+    vrfr.verify({
+        .code = code.instrs,
+        .num_locals = 0,
+        .num_arguments = 0,
+        .num_free = 0,
+        .max_stack = static_cast<std::size_t>(code.max_stack),
+        .is_main = true,
+        .owner = std::nullopt,
+    });
+    for (const auto& [idx, func] : pending) {
+        func->as_mutable()->verified = true;
+    }
+}
+
+namespace
+{
+// NOLINTBEGIN(*)
+auto compile(const std::string_view input) -> bytecode
+{
+    auto prsr = parser {lexer {input}};
+    auto prgrm = prsr.parse_program();
+    REQUIRE(prsr.errors().empty());
+    auto cmplr = compiler::create();
+    cmplr.compile(prgrm.get());
+    return cmplr.byte_code();
+}
+
+TEST_SUITE("verifier")
+{
+    TEST_CASE("compiledCodeVerifies")
+    {
+        const auto code = compile(R"(
+            let a = [1, 2, 3];
+            let h = {"a": 1};
+            let f = fn(x, y) { let z = x + y; if (z > 2) { return z; } z * 2 };
+            let g = fn() { let i = 0; while (i < 10) { if (i == 5) { break; } i = i + 1; } i };
+            let c = fn(x) { fn() { x } };
+            f(a[0], h["a"]) + g() + c(1)() + len(a);
+        )");
+        CHECK_NOTHROW(verify(code, static_cast<std::size_t>(code.num_globals)));
+    }
+
+    TEST_CASE("malformedCodeIsRejected")
+    {
+        using enum opcodes;
+        struct test
+        {
+            std::vector<instructions> instrs;
+            std::string expected;
+        };
+        const auto code = compile("1");
+        const std::array tests {
+            test {{make(constant, 0), {static_cast<std::uint8_t>(constant), 0}},
+                  "invalid bytecode at offset 3: invalid or truncated instruction 0"},
+            test {{{0xFF}}, "invalid bytecode at offset 0: invalid or truncated instruction 255"},
+            test {{make(constant, 7)}, "invalid bytecode at offset 0: constant index 7 out of range 1"},
+            test {{make(get_builtin, 200)}, "invalid bytecode at offset 0: builtin index 200 out of range 8"},
+            test {{make(get_local, 0)}, "invalid bytecode at offset 0: local index 0 out of range 0"},
+            test {{make(get_global, 1)}, "invalid bytecode at offset 0: global index 1 out of range 1"},
+            test {{make(add)}, "invalid bytecode at offset 0: stack underflow"},
+            test {{make(constant, 0), make(constant, 0)},
+                  "invalid bytecode at offset 3: stack depth exceeds the maximum of 1"},
+            test {{make(jump, 2), make(tru)}, "invalid bytecode at offset 0: jump target 2 is not an instruction"},
+            test {{make(tru), make(jump_not_truthy, 7), make(constant, 0), make(pop)},
+                  "invalid bytecode at offset 7: inconsistent stack depth 0 and 1"},
+            test {{make(closure, {0, 0})}, "invalid bytecode at offset 0: constant at index 0 is not a compiled function"},
+            test {{make(constant_small, 5)}, "invalid bytecode at offset 0: constant index 5 out of range 1"},
+            test {{make(get_local, 300)}, "invalid bytecode at offset 0: local index 300 out of range 0"},
+            test {{{static_cast<std::uint8_t>(wide), static_cast<std::uint8_t>(add)}},
+                  fmt::format("invalid bytecode at offset 0: invalid or truncated instruction {}",
+                              static_cast<std::uint8_t>(wide))},
+            test {{{static_cast<std::uint8_t>(wide)}},
+                  fmt::format("invalid bytecode at offset 0: invalid or truncated instruction {}",
+                              static_cast<std::uint8_t>(wide))},
+            test {{make(brake)}, "invalid bytecode at offset 0: break or continue outside of a loop body"},
+            test {{make(constant, 0), make(return_value)},
+                  "invalid bytecode at offset 3: return outside of a function"},
+            test {{make(get_outer, {1, 1, 0})},
+                  "invalid bytecode at offset 0: outer level 1 is not within an enclosing function"},
+            test {{}, "invalid bytecode at offset 0: maximum stack depth 1 exceeds the 0 the code needs"},
+        };
+        for (const auto& [instrs, expected] : tests) {
+            instructions flat;
+            for (const auto& instr : instrs) {
+                flat.insert(flat.end(), instr.begin(), instr.end());
+            }
+            const bytecode malformed {
+                .instrs = flat,
+                .consts = code.consts,
+                .max_stack = 1,
+                .num_globals = {},
+                .register_code = {},
+            };
+            INFO(to_string(flat));
+            CHECK_THROWS_WITH(verify(malformed, 1), expected.c_str());
+        }
+
+        // the slot of a local which is never written holds no value, with the write to b changed to one to a
+        auto unwritten = compile("let f = fn(a) { let b = a + 1; b }; f(1)");
+        auto* func = const_cast<compiled_function_object*>((*unwritten.consts)[1]->as<compiled_function_object>());
+        REQUIRE_EQ(func->instrs[6], static_cast<std::uint8_t>(set_local));
+        REQUIRE_EQ(func->instrs[7], 1);
+        func->instrs[7] = 0;
+        CHECK_THROWS_WITH(verify(unwritten, static_cast<std::size_t>(unwritten.num_globals)),
+                          "invalid bytecode at offset 8: local 1 is read before it is written");
+
+        const auto conditional = compile("let f = fn(a) { if (a) { let b = 1; }; b }; f(true)");
+        CHECK_THROWS_WITH(verify(conditional, static_cast<std::size_t>(conditional.num_globals)),
+                          "invalid bytecode at offset 16: local 1 is read before it is written");
+    }
+
+    TEST_CASE("outerVariablesOfLoopBodies")
+    {
+        using enum opcodes;
+        struct test
+        {
+            std::size_t operand;
+            std::uint8_t value;
+            std::string expected;
+        };
+        const std::array tests {
+            test {1, 2, "outer level 2 is not within an enclosing function"},
+            test {3, 5, "outer local index 5 out of range 1"},
+        };
+        for (const auto& [operand, value, expected] : tests) {
+            const auto code = compile("let f = fn() { let i = 0; while (i < 3) { i = i + 1; } i }; f()");
+            compiled_function_object* loop_body = nullptr;
+            for (const auto* constant : *code.consts) {
+                if (constant->is(object::object_type::compiled_function)
+                    && constant->as<compiled_function_object>()->inside_loop)
+                {
+                    loop_body = const_cast<compiled_function_object*>(constant->as<compiled_function_object>());
+                }
+            }
+            REQUIRE(loop_body != nullptr);
+            auto& instrs = loop_body->instrs;
+            std::size_t ip = 0;
+            while (opcode_at(instrs, ip) != get_outer) {
+                ip += ::instruction_length(instrs, ip);
+            }
+            instrs[ip + operand] = value;
+            CHECK_THROWS_WITH(verify(code, static_cast<std::size_t>(code.num_globals)),
+                              fmt::format("invalid bytecode at offset {}: {}", ip, expected).c_str());
+        }
+    }
+
+    TEST_CASE("fuzzedImagesAreRejected")
+    {
+        // images of this program with a single byte changed, each marks a function as a loop body, whose return then
+        // unwound the frames below that of the main code in the unchecked vm
+        constexpr auto input = R"(let counter = fn() { let c = 0; fn() { c = c + 1; c } };
+let f = counter();
+puts(f(), f(), f());
+let sq = fn(x) { x * x };
+let x = 3;
+puts(sq(x + 1), sq(sq(2)));
+let g = fn(a) { let sq = fn(y) { y + 100 }; sq(a) };
+puts(g(1), sq(2));
+let h = fn(n) { if (n == 0) { return 0; } h(n - 1) };
+puts(h(500));
+let acc = fn(n, a) { if (n == 0) { a } else { acc(n - 1, a + n) } };
+puts(acc(500, 0));
+let i = 0; let s = 0;
+while (i < 10) { i = i + 1; if (i % 2 == 0) { continue; } if (i > 7) { break; } s = s + i; }
+puts(i, s);
+let fs = [];
+let j = 0;
+while (j < 3) { let k = j; fs = push(fs, fn() { k * 10 }); j = j + 1; }
+puts(fs[0](), fs[1](), fs[2]());
+let arr = [1, 2, 3];
+puts([arr, 2][0][1], [1,2][5], [x, x+1][1]);
+let tt = fn(v) { [v, v * 2] };
+puts(tt(4)[1]);
+let z = 1;
+let m = fn() { z };
+z = 5;
+puts(m());
+let sqb = fn(x) { x * x };
+sqb = fn(x) { x + 1 };
+puts(sqb(5));
+let d = 1.5;
+puts(d + 2.5, 7 / 2, 7 // 2, len("abc") + 1, len([1]) > 0);
+let q = fn(v) { v + v };
+puts(q(1), q("a"), q(1.5));
+let w = fn(n) { let r = 0; while (n > 0) { r = r + n; n = n - 1; } r };
+puts(w(10));
+let deep = fn(n) { if (n == 0) { 0 } else { 1 + deep(n - 1) } };
+puts(deep(300));
+)";
+        struct test
+        {
+            std::size_t offset;
+            std::uint8_t value;
+            std::string expected;
+        };
+        const std::array tests {
+            test {599, 0113, "invalid bytecode at offset 7: loop body 2 is not called where it is created"},
+            test {1044, 0164, "invalid bytecode at offset 11: return outside of a function"},
+        };
+        auto prsr = parser {lexer {input}};
+        auto prgrm = prsr.parse_program();
+        REQUIRE(prsr.errors().empty());
+        auto cmplr = compiler::create();
+        cmplr.compile(prgrm.get());
+        std::ostringstream out;
+        write_image(out, cmplr.byte_code(), cmplr.all_symbols());
+        const auto str = out.str();
+        const std::vector<std::uint8_t> data {str.begin(), str.end()};
+        const auto img = read_image(data);
+        CHECK_NOTHROW(verify(img.code, static_cast<std::size_t>(img.code.num_globals)));
+        for (const auto& [offset, value, expected] : tests) {
+            auto corrupted = data;
+            REQUIRE_LT(offset, corrupted.size());
+            // the inside loop flag of a function
+            REQUIRE_EQ(corrupted[offset], 0);
+            corrupted[offset] = value;
+            const auto corrupted_img = read_image(corrupted);
+            CHECK_THROWS_WITH(verify(corrupted_img.code, static_cast<std::size_t>(corrupted_img.code.num_globals)),
+                              expected.c_str());
+        }
+    }
+
+    TEST_CASE("functionsMustReturn")
+    {
+        auto code = compile("fn() { 1 }");
+        auto* func = const_cast<compiled_function_object*>((*code.consts)[1]->as<compiled_function_object>());
+        func->instrs.pop_back();
+        CHECK_THROWS_WITH(verify(code, 0), "invalid bytecode at offset 3: function does not end with a return");
+    }
+}
+
+// NOLINTEND(*)
+}  // namespace
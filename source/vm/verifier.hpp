@@ -0,0 +1,18 @@
+// Copyright 2023-2025 hrzlgnm
+// SPDX-License-Identifier: MIT-0
+
+#pragma once
+
+#include <cstddef>
+
+#include <compiler/compiler.hpp>
+
+// Validates the main code and every compiled function among the constants before they run without the defensive
+// checks of the vm: opcodes and their operands lie within the code, jumps land on instruction boundaries,
+// constant, local, free and builtin indices are in range, global indices are below `num_globals`, locals are written
+// before they are read, the stack depth is consistent wherever control flow joins and stays within the maximum depth
+// computed by the compiler. Loop bodies are called where they are created, so the frames their returns unwind and
+// their outer variables are taken from are known, and no return unwinds the frame of the main code. Throws
+// std::runtime_error otherwise. Functions which passed once are marked and skipped, those before `first_constant` are
+// not looked at, so verifying the growing constants of a repl stays cheap.
+auto verify(const bytecode& code, std::size_t num_globals, std::size_t first_constant = 0) -> void;
@@ -1,14 +1,19 @@
 // Copyright 2023-2025 hrzlgnm
 // SPDX-License-Identifier: MIT-0
 
+#include <algorithm>
 #include <array>
 #include <cassert>
 #include <cstddef>
 #include <cstdint>
+#include <cstring>
 #include <initializer_list>
+#include <memory>
+#include <optional>
 #include <stdexcept>
 #include <string>
 #include <string_view>
+#include <typeinfo>
 #include <unordered_map>
 #include <utility>
 #include <variant>
@@ -30,6 +35,9 @@
 #include <overloaded.hpp>
 #include <parser/parser.hpp>
 
+#include "register_vm.hpp"
+#include "verifier.hpp"
+
 namespace
 {
 constexpr auto as_size_t(std::int64_t a) -> std::size_t
@@ -37,44 +45,145 @@ constexpr auto as_size_t(std::int64_t a) -> std::size_t
     assert(a >= 0);
     return static_cast<std::size_t>(a);
 }
+
+// verified code has all its operands, so they are read without the bounds check
+template<bool Checked>
+auto read_uint16(const instructions& instr, const std::size_t offset) -> std::uint16_t
+{
+    if constexpr (Checked) {
+        return ::read_uint16(instr, offset);
+    } else {
+        std::uint16_t value {};
+        std::memcpy(&value, instr.data() + offset, sizeof(value));
+        return value;
+    }
+}
 }  // namespace
 
-auto vm::create(bytecode code) -> vm
+auto vm::create(bytecode code, const stack_limits limits) -> vm
 {
-    return create_with_state(std::move(code), allocate<constants>(globals_size));
+    return create_with_state(std::move(code), allocate<constants>(globals_size), limits);
 }
 
-auto vm::create_with_state(bytecode code, constants* globals) -> vm
+auto vm::create_with_state(bytecode code, constants* globals, const stack_limits limits) -> vm
 {
+    // only wide instructions reach the globals beyond the default size
+    if (globals->size() < as_size_t(code.num_globals)) {
+        globals->resize(as_size_t(code.num_globals));
+    }
     auto* main_fn = allocate<compiled_function_object>(std::move(code.instrs), 0, 0);
+    main_fn->max_stack = code.max_stack;
     auto* main_closure = allocate<closure_object>(main_fn);
-    const frame main_frame {.cl = main_closure};
-    frames frms;
-    frms[0] = main_frame;
-    return vm {frms, code.consts, globals};
+    frames frms(std::clamp(limits.frames, std::size_t {1}, max_frames));
+    frms[0] = frame {.cl = main_closure};
+    auto machine = vm {std::move(frms), code.consts, globals, limits};
+    machine.reserve_stack(as_size_t(main_fn->max_stack));
+    return machine;
+}
+
+auto vm::create_verified(bytecode code, constants* globals, const stack_limits limits) -> vm
+{
+    verify(code, globals->size());
+    const auto num_constants = code.consts->size();
+    auto machine = create_with_state(std::move(code), globals, limits);
+    machine.m_verified = true;
+    machine.m_verified_constants = num_constants;
+    return machine;
 }
 
-vm::vm(const frames& frames, const constants* consts, constants* globals)
+vm::vm(frames&& frms, const constants* consts, constants* globals, const stack_limits limits)
     : m_constants {consts}
     , m_globals {globals}
-    , m_frames {frames}
+    , m_stack(std::min(stack_size, limits.stack))
+    , m_frames {std::move(frms)}
+    , m_limits {limits}
 {
 }
 
 auto vm::run() -> void
+{
+    if (m_verified) {
+        execute<false>();
+    } else {
+        execute<true>();
+    }
+}
+
+auto vm::run_input(bytecode code) -> void
+{
+    if (m_globals->size() < as_size_t(code.num_globals)) {
+        m_globals->resize(as_size_t(code.num_globals));
+    }
+    if (m_verified) {
+        verify(code, m_globals->size(), m_verified_constants);
+        m_verified_constants = code.consts->size();
+    }
+    auto* main_fn = m_frames[0].cl->fn->as_mutable();
+    main_fn->instrs = std::move(code.instrs);
+    main_fn->max_stack = code.max_stack;
+    main_fn->type_feedback.clear();
+    m_constants = code.consts;
+    // an input which failed may have left frames and values behind
+    m_frames[0].ip = 0;
+    m_frame_index = 1;
+    m_sp = 0;
+    // the result of an input which pops nothing
+    m_stack[0] = null();
+    reserve_stack(as_size_t(main_fn->max_stack));
+    run();
+}
+
+template<typename T>
+auto vm::frame_object(const std::size_t slot) -> T*
+{
+    const auto depth = as_size_t(m_frame_index) - 1U;
+    if (m_frame_objects.size() <= depth) {
+        m_frame_objects.resize(depth + 1);
+    }
+    auto& slots = m_frame_objects[depth];
+    if (slots.size() <= slot) {
+        slots.resize(slot + 1);
+    }
+    // another function may have used the slot at this depth for an object of the other kind
+    if (slots[slot] == nullptr || typeid(*slots[slot]) != typeid(T)) {
+        slots[slot] = std::make_unique<T>();
+    }
+    return static_cast<T*>(slots[slot].get());
+}
+
+template<bool Checked>
+auto vm::execute() -> void
 {
     for (; as_size_t(current_frame().ip) < current_frame().cl->fn->instrs.size(); current_frame().ip++) {
-        const auto ip = as_size_t(current_frame().ip);
+        auto ip = as_size_t(current_frame().ip);
         const auto& instr = current_frame().cl->fn->instrs;
+        if (m_jit_threshold != 0 && current_frame().cl->fn->native != nullptr) {
+            ip = run_native(*current_frame().cl->fn->native, ip);
+            if (ip >= instr.size()) {
+                return;
+            }
+        }
+        m_executed++;
         switch (const auto op = static_cast<opcodes>(instr[ip])) {
             case opcodes::constant: {
                 current_frame().ip += 2;
-                const auto const_idx = read_uint16_big_endian(instr, ip + 1UL);
-                if (const auto* constant = (*m_constants)[const_idx]; constant == nullptr) {
+                const auto const_idx = read_uint16<Checked>(instr, ip + 1UL);
+                if (Checked && (*m_constants)[const_idx] == nullptr) {
                     throw std::runtime_error(fmt::format("constant at index {} does not exist", const_idx));
                 }
                 push((*m_constants)[const_idx]);
             } break;
+            case opcodes::constant_small: {
+                current_frame().ip += 1;
+                const auto const_idx = instr[ip + 1UL];
+                if (Checked && (*m_constants)[const_idx] == nullptr) {
+                    throw std::runtime_error(fmt::format("constant at index {} does not exist", const_idx));
+                }
+                push((*m_constants)[const_idx]);
+            } break;
+            case opcodes::wide:
+                exec_wide<Checked>(ip, instr);
+                break;
             case opcodes::add:
             case opcodes::sub:
             case opcodes::mul:
@@ -92,7 +201,24 @@ auto vm::run() -> void
             case opcodes::not_equal:
             case opcodes::greater_than:
             case opcodes::greater_equal:
-                exec_binary_op(op);
+                exec_binary_op(op, ip);
+                break;
+            case opcodes::add_int:
+            case opcodes::sub_int:
+            case opcodes::mul_int:
+            case opcodes::equal_int:
+            case opcodes::not_equal_int:
+            case opcodes::greater_than_int:
+            case opcodes::greater_equal_int:
+                exec_integers_op(op, ip);
+                break;
+            case opcodes::add_dec:
+            case opcodes::sub_dec:
+            case opcodes::mul_dec:
+            case opcodes::div_dec:
+            case opcodes::greater_than_dec:
+            case opcodes::greater_equal_dec:
+                exec_decimals_op(op, ip);
                 break;
             case opcodes::pop:
                 pop();
@@ -110,12 +236,12 @@ auto vm::run() -> void
                 exec_minus();
                 break;
             case opcodes::jump: {
-                current_frame().ip = read_uint16_big_endian(instr, ip + 1UL) - 1;
+                current_frame().ip = read_uint16<Checked>(instr, ip + 1UL) - 1;
             } break;
             case opcodes::jump_not_truthy: {
                 current_frame().ip += 2;
                 if (const auto* condition = pop(); !condition->is_truthy()) {
-                    current_frame().ip = read_uint16_big_endian(instr, ip + 1UL) - 1;
+                    current_frame().ip = read_uint16<Checked>(instr, ip + 1UL) - 1;
                 }
             } break;
             case opcodes::null:
@@ -123,11 +249,11 @@ auto vm::run() -> void
                 break;
             case opcodes::set_global: {
                 current_frame().ip += 2;
-                const auto global_index = read_uint16_big_endian(instr, ip + 1UL);
+                const auto global_index = read_uint16<Checked>(instr, ip + 1UL);
                 (*m_globals)[global_index] = pop();
             } break;
             case opcodes::get_global: {
-                auto global_index = read_uint16_big_endian(instr, ip + 1UL);
+                auto global_index = read_uint16<Checked>(instr, ip + 1UL);
                 current_frame().ip += 2;
                 const auto* global = (*m_globals)[global_index];
                 if (global == nullptr) {
@@ -137,14 +263,14 @@ auto vm::run() -> void
             } break;
             case opcodes::array: {
                 current_frame().ip += 2;
-                const auto num_elements = read_uint16_big_endian(instr, ip + 1UL);
+                const auto num_elements = read_uint16<Checked>(instr, ip + 1UL);
                 const auto* arr = build_array(m_sp - num_elements, m_sp);
                 m_sp -= num_elements;
                 push(arr);
             } break;
             case opcodes::hash: {
                 current_frame().ip += 2;
-                const auto num_elements = read_uint16_big_endian(instr, ip + 1UL);
+                const auto num_elements = read_uint16<Checked>(instr, ip + 1UL);
                 const auto* hsh = build_hash(m_sp - num_elements, m_sp);
                 m_sp -= num_elements;
                 push(hsh);
@@ -152,13 +278,18 @@ auto vm::run() -> void
             case opcodes::index: {
                 const auto* index = pop();
                 const auto* left = pop();
-                exec_index(left, index);
+                exec_index(left, index, ip);
             } break;
             case opcodes::call: {
                 current_frame().ip += 1;
                 const auto num_args = instr[ip + 1UL];
                 exec_call(num_args);
             } break;
+            case opcodes::tail_call: {
+                current_frame().ip += 1;
+                const auto num_args = instr[ip + 1UL];
+                exec_tail_call(num_args);
+            } break;
             case opcodes::brake: {
                 current_frame().ip += 1;
                 const auto& frame = pop_frame();
@@ -199,15 +330,18 @@ auto vm::run() -> void
             } break;
             case opcodes::set_outer:
                 current_frame().ip += 3;
-                exec_set_outer(ip, instr);
+                exec_set_outer(instr[ip + 1UL], static_cast<symbol_scope>(instr[ip + 2UL]), instr[ip + 3UL]);
                 break;
             case opcodes::get_outer:
                 current_frame().ip += 3;
-                exec_get_outer(ip, instr);
+                exec_get_outer(instr[ip + 1UL], static_cast<symbol_scope>(instr[ip + 2UL]), instr[ip + 3UL]);
                 break;
             case opcodes::get_builtin: {
                 current_frame().ip += 1;
                 const auto builtin_index = instr[ip + 1UL];
+                if (Checked && builtin_index >= builtin::builtins().size()) {
+                    throw std::runtime_error(fmt::format("builtin at index {} does not exist", builtin_index));
+                }
                 const auto* const builtin = builtin::builtins()[builtin_index];
                 push(allocate<builtin_object>(builtin));
             } break;
@@ -224,10 +358,39 @@ auto vm::run() -> void
             } break;
             case opcodes::closure: {
                 current_frame().ip += 3;
-                const auto const_idx = read_uint16_big_endian(instr, ip + 1UL);
+                const auto const_idx = read_uint16<Checked>(instr, ip + 1UL);
                 const auto num_free = instr[ip + 3UL];
+                if (const auto* constant = (*m_constants)[const_idx];
+                    Checked && !constant->is(object::object_type::compiled_function))
+                {
+                    throw std::runtime_error(
+                        fmt::format("expected a compiled_function, got an object of type {}", constant->type()));
+                }
                 push_closure(const_idx, num_free);
             } break;
+            case opcodes::frame_closure: {
+                current_frame().ip += 4;
+                const auto const_idx = read_uint16<Checked>(instr, ip + 1UL);
+                const auto num_free = instr[ip + 3UL];
+                const auto slot = instr[ip + 4UL];
+                if (const auto* constant = (*m_constants)[const_idx];
+                    Checked && !constant->is(object::object_type::compiled_function))
+                {
+                    throw std::runtime_error(
+                        fmt::format("expected a compiled_function, got an object of type {}", constant->type()));
+                }
+                push_frame_closure(const_idx, num_free, slot);
+            } break;
+            case opcodes::frame_array: {
+                current_frame().ip += 3;
+                const auto num_elements = read_uint16<Checked>(instr, ip + 1UL);
+                const auto slot = instr[ip + 3UL];
+                auto* arr = frame_object<array_object>(slot);
+                const auto first = m_stack.begin() + (m_sp - num_elements);
+                arr->value.assign(first, first + num_elements);
+                m_sp -= num_elements;
+                push(arr);
+            } break;
             case opcodes::current_closure: {
                 push(current_frame().cl);
             } break;
@@ -238,18 +401,25 @@ auto vm::run() -> void
 auto vm::push(const object* obj) -> void
 {
     assert(obj != nullptr);
-    if (as_size_t(m_sp) >= stack_size) {
-        throw std::runtime_error("stack overflow");
-    }
+    assert(as_size_t(m_sp) < m_stack.size());
     m_stack[as_size_t(m_sp)] = obj;
     m_sp++;
 }
 
-auto vm::pop() -> const object*
+auto vm::reserve_stack(const std::size_t size) -> void
 {
-    if (m_sp == 0) {
-        throw std::runtime_error("stack empty");
+    if (size <= m_stack.size()) {
+        return;
+    }
+    if (size > m_limits.stack) {
+        throw std::runtime_error("stack overflow");
     }
+    m_stack.resize(std::min(std::max(size, m_stack.size() * 2), m_limits.stack));
+}
+
+auto vm::pop() -> const object*
+{
+    assert(m_sp > 0);
     const auto* const result = m_stack[as_size_t(m_sp) - 1U];
     m_sp--;
     return result;
@@ -260,9 +430,6 @@ auto vm::last_popped() const -> const object*
     return m_stack[as_size_t(m_sp)];
 }
 
-namespace
-{
-
 auto apply_binary_operator(const opcodes opcode, const object* left, const object* right) -> const object*
 {
     using enum opcodes;
@@ -305,12 +472,152 @@ auto apply_binary_operator(const opcodes opcode, const object* left, const objec
             return nullptr;
     }
 }
+
+namespace
+{
+auto integers_operator(const opcodes opcode, const std::int64_t lhs, const std::int64_t rhs) -> const object*
+{
+    using enum opcodes;
+    switch (opcode) {
+        case add:
+            return allocate<integer_object>(lhs + rhs);
+        case sub:
+            return allocate<integer_object>(lhs - rhs);
+        case mul:
+            return allocate<integer_object>(lhs * rhs);
+        case bit_and:
+            return allocate<integer_object>(lhs & rhs);
+        case bit_or:
+            return allocate<integer_object>(lhs | rhs);
+        case bit_xor:
+            return allocate<integer_object>(lhs ^ rhs);
+        case equal:
+            return native_bool_to_object(lhs == rhs);
+        case not_equal:
+            return native_bool_to_object(lhs != rhs);
+        case greater_than:
+            return native_bool_to_object(lhs > rhs);
+        case greater_equal:
+            return native_bool_to_object(lhs >= rhs);
+        default:
+            return nullptr;
+    }
+}
+
+auto decimals_operator(const opcodes opcode, const double lhs, const double rhs) -> const object*
+{
+    using enum opcodes;
+    switch (opcode) {
+        case add:
+            return allocate<decimal_object>(lhs + rhs);
+        case sub:
+            return allocate<decimal_object>(lhs - rhs);
+        case mul:
+            return allocate<decimal_object>(lhs * rhs);
+        case div:
+            return allocate<decimal_object>(lhs / rhs);
+        case greater_than:
+            return native_bool_to_object(lhs > rhs);
+        case greater_equal:
+            return native_bool_to_object(lhs >= rhs);
+        default:
+            return nullptr;
+    }
+}
+
+auto strings_operator(const opcodes opcode, const std::string& lhs, const std::string& rhs) -> const object*
+{
+    using enum opcodes;
+    switch (opcode) {
+        case add:
+            return allocate<string_object>(lhs + rhs);
+        case equal:
+            return native_bool_to_object(lhs == rhs);
+        case not_equal:
+            return native_bool_to_object(lhs != rhs);
+        case greater_than:
+            return native_bool_to_object(lhs > rhs);
+        case greater_equal:
+            return native_bool_to_object(lhs >= rhs);
+        default:
+            return nullptr;
+    }
+}
+
+// the guard of the fast paths, which compares the dynamic type without a virtual call
+template<typename T>
+auto is_exactly(const object* obj) -> bool
+{
+    return typeid(*obj) == typeid(T);
+}
+
+auto observe_binary(const object* left, const object* right) -> operand_types
+{
+    using enum object::object_type;
+    if (left->type() != right->type()) {
+        return operand_types::generic;
+    }
+    switch (left->type()) {
+        case integer:
+            return operand_types::integers;
+        case decimal:
+            return operand_types::decimals;
+        case string:
+            return operand_types::strings;
+        default:
+            return operand_types::generic;
+    }
+}
+
+// the result of the fast path for the cached operand types, nullptr if the operands do not match them or the
+// operator has no fast path for them
+auto cached_binary_operator(const operand_types cached, const opcodes opcode, const object* left, const object* right)
+    -> const object*
+{
+    switch (cached) {
+        case operand_types::integers:
+            if (is_exactly<integer_object>(left) && is_exactly<integer_object>(right)) {
+                return integers_operator(opcode, left->val<integer_object>(), right->val<integer_object>());
+            }
+            return nullptr;
+        case operand_types::decimals:
+            if (is_exactly<decimal_object>(left) && is_exactly<decimal_object>(right)) {
+                return decimals_operator(opcode, left->val<decimal_object>(), right->val<decimal_object>());
+            }
+            return nullptr;
+        case operand_types::strings:
+            if (is_exactly<string_object>(left) && is_exactly<string_object>(right)) {
+                return strings_operator(
+                    opcode, left->as<string_object>()->value, right->as<string_object>()->value);
+            }
+            return nullptr;
+        default:
+            return nullptr;
+    }
+}
 }  // namespace
 
-auto vm::exec_binary_op(opcodes opcode) -> void
+auto vm::type_feedback(const std::size_t ip) -> operand_types&
+{
+    const auto* func = current_frame().cl->fn;
+    if (func->type_feedback.empty()) {
+        func->type_feedback.resize(func->instrs.size());
+    }
+    return func->type_feedback[ip];
+}
+
+auto vm::exec_binary_op(const opcodes opcode, const std::size_t ip) -> void
 {
     const auto* right = pop();
     const auto* left = pop();
+    auto& cached = type_feedback(ip);
+    if (const auto* result = cached_binary_operator(cached, opcode, left, right); result != nullptr) {
+        m_cache_stats.hits++;
+        push(result);
+        return;
+    }
+    m_cache_stats.misses++;
+    cached = cached == operand_types::unseen ? observe_binary(left, right) : operand_types::generic;
     if (const auto* result = apply_binary_operator(opcode, left, right); result != nullptr) {
         push(result);
         return;
@@ -319,6 +626,39 @@ auto vm::exec_binary_op(opcodes opcode) -> void
         fmt::format("unsupported types for binary operation: {} {} {}", left->type(), opcode, right->type()));
 }
 
+auto vm::exec_integers_op(const opcodes opcode, const std::size_t ip) -> void
+{
+    const auto* right = m_stack[as_size_t(m_sp) - 1U];
+    const auto* left = m_stack[as_size_t(m_sp) - 2U];
+    if (is_exactly<integer_object>(left) && is_exactly<integer_object>(right)) {
+        m_sp -= 2;
+        push(integers_operator(generic_opcode(opcode), left->val<integer_object>(), right->val<integer_object>()));
+        return;
+    }
+    deoptimize(opcode, ip);
+}
+
+auto vm::exec_decimals_op(const opcodes opcode, const std::size_t ip) -> void
+{
+    const auto* right = m_stack[as_size_t(m_sp) - 1U];
+    const auto* left = m_stack[as_size_t(m_sp) - 2U];
+    if (is_exactly<decimal_object>(left) && is_exactly<decimal_object>(right)) {
+        m_sp -= 2;
+        push(decimals_operator(generic_opcode(opcode), left->val<decimal_object>(), right->val<decimal_object>()));
+        return;
+    }
+    deoptimize(opcode, ip);
+}
+
+auto vm::deoptimize(const opcodes opcode, const std::size_t ip) -> void
+{
+    // the inferred types did not hold, the instruction stays generic from now on
+    const auto generic = generic_opcode(opcode);
+    current_frame().cl->fn->as_mutable()->instrs[ip] = static_cast<std::uint8_t>(generic);
+    m_deoptimizations++;
+    exec_binary_op(generic, ip);
+}
+
 auto vm::exec_bang() -> void
 {
     using enum object::object_type;
@@ -326,26 +666,25 @@ auto vm::exec_bang() -> void
     push(native_bool_to_object(!operand->is_truthy()));
 }
 
-auto vm::exec_minus() -> void
+auto apply_minus(const object* operand) -> const object*
 {
-    const auto* operand = pop();
     if (operand->is(object::object_type::integer)) {
-        push(allocate<integer_object>(-operand->as<integer_object>()->value));
-        return;
+        return allocate<integer_object>(-operand->as<integer_object>()->value);
     }
     if (operand->is(object::object_type::decimal)) {
-        push(allocate<decimal_object>(-operand->as<decimal_object>()->value));
-        return;
+        return allocate<decimal_object>(-operand->as<decimal_object>()->value);
     }
 
     throw std::runtime_error(fmt::format("unsupported type for negation {}", operand->type()));
 }
 
-void vm::exec_set_outer(const size_t ip, const instructions& instr)
+auto vm::exec_minus() -> void
+{
+    push(apply_minus(pop()));
+}
+
+void vm::exec_set_outer(const std::size_t level, const symbol_scope scope, const std::size_t index)
 {
-    const auto level = instr[ip + 1UL];
-    const auto scope = static_cast<symbol_scope>(instr[ip + 2UL]);
-    const auto index = instr[ip + 3UL];
     const auto& frame = m_frames[as_size_t(m_frame_index) - (level + 1U)];
     if (scope == symbol_scope::local) {
         m_stack[as_size_t(frame.base_ptr) + index] = pop();
@@ -354,14 +693,16 @@ void vm::exec_set_outer(const size_t ip, const instructions& instr)
     }
 }
 
-void vm::exec_get_outer(const size_t ip, const instructions& instr)
+void vm::exec_get_outer(const std::size_t level, const symbol_scope scope, const std::size_t index)
 {
-    const auto level = instr[ip + 1UL];
-    const auto scope = static_cast<symbol_scope>(instr[ip + 2UL]);
-    const auto index = instr[ip + 3UL];
     const auto& frame = m_frames[as_size_t(m_frame_index) - (level + 1U)];
     if (scope == symbol_scope::local) {
-        push(m_stack[static_cast<std::size_t>(frame.base_ptr) + index]);
+        // the verifier checks the locals a function reads itself, not those its loop bodies read from its frame
+        const auto* local = m_stack[static_cast<std::size_t>(frame.base_ptr) + index];
+        if (local == nullptr) {
+            throw std::runtime_error(fmt::format("outer local {} is read before it is written", index));
+        }
+        push(local);
     } else if (scope == symbol_scope::free) {
         push(frame.cl->free[index]);
     } else if (scope == symbol_scope::function) {
@@ -369,6 +710,99 @@ void vm::exec_get_outer(const size_t ip, const instructions& instr)
     }
 }
 
+// the instructions with operands which do not fit their short form are rare, so they are decoded generically
+template<bool Checked>
+auto vm::exec_wide(const std::size_t ip, const instructions& instr) -> void
+{
+    const auto opcode = opcode_at(instr, ip);
+    const auto ops = operands_at(instr, ip);
+    current_frame().ip += static_cast<int>(instruction_length(instr, ip)) - 1;
+    const auto first = ops.front();
+    const auto count = static_cast<int>(first);
+    switch (opcode) {
+        case opcodes::constant:
+            if (Checked && (first >= m_constants->size() || (*m_constants)[first] == nullptr)) {
+                throw std::runtime_error(fmt::format("constant at index {} does not exist", first));
+            }
+            push((*m_constants)[first]);
+            break;
+        case opcodes::jump:
+            current_frame().ip = count - 1;
+            break;
+        case opcodes::jump_not_truthy:
+            if (const auto* condition = pop(); !condition->is_truthy()) {
+                current_frame().ip = count - 1;
+            }
+            break;
+        case opcodes::set_global:
+            (*m_globals)[first] = pop();
+            break;
+        case opcodes::get_global:
+            if ((*m_globals)[first] == nullptr) {
+                throw std::runtime_error(fmt::format("global at index {} does not exits", first));
+            }
+            push((*m_globals)[first]);
+            break;
+        case opcodes::array: {
+            const auto* arr = build_array(m_sp - count, m_sp);
+            m_sp -= count;
+            push(arr);
+        } break;
+        case opcodes::hash: {
+            const auto* hsh = build_hash(m_sp - count, m_sp);
+            m_sp -= count;
+            push(hsh);
+        } break;
+        case opcodes::call:
+            exec_call(count);
+            break;
+        case opcodes::tail_call:
+            exec_tail_call(count);
+            break;
+        case opcodes::set_local:
+            m_stack[as_size_t(current_frame().base_ptr) + first] = pop();
+            break;
+        case opcodes::get_local:
+            push(m_stack[as_size_t(current_frame().base_ptr) + first]);
+            break;
+        case opcodes::set_free:
+            current_frame().cl->free[first] = pop();
+            break;
+        case opcodes::get_free:
+            push(current_frame().cl->free[first]);
+            break;
+        case opcodes::set_outer:
+            exec_set_outer(first, static_cast<symbol_scope>(ops[1]), ops[2]);
+            break;
+        case opcodes::get_outer:
+            exec_get_outer(first, static_cast<symbol_scope>(ops[1]), ops[2]);
+            break;
+        case opcodes::closure:
+            if (Checked && !(*m_constants)[first]->is(object::object_type::compiled_function)) {
+                throw std::runtime_error(fmt::format("expected a compiled_function, got an object of type {}",
+                                                     (*m_constants)[first]->type()));
+            }
+            push_closure(first, ops[1]);
+            break;
+        case opcodes::frame_closure:
+            if (Checked && !(*m_constants)[first]->is(object::object_type::compiled_function)) {
+                throw std::runtime_error(fmt::format("expected a compiled_function, got an object of type {}",
+                                                     (*m_constants)[first]->type()));
+            }
+            push_frame_closure(first, ops[1], ops[2]);
+            break;
+        case opcodes::frame_array: {
+            auto* arr = frame_object<array_object>(ops[1]);
+            const auto elements = m_stack.begin() + (m_sp - count);
+            arr->value.assign(elements, elements + count);
+            m_sp -= count;
+            push(arr);
+        } break;
+        default:
+            throw std::runtime_error(fmt::format("invalid wide instruction {}", opcode));
+    }
+}
+
 auto vm::build_array(const int start, const int end) const -> const object*
 {
     array_object::value_type arr;
@@ -400,32 +834,56 @@ auto exec_hash(const hash_object::value_type& hsh, const hashable::key_type& key
 }
 }  // namespace
 
-auto vm::exec_index(const object* left, const object* index) -> void
+auto apply_index(const object* left, const object* index) -> const object*
 {
     using enum object::object_type;
     if (left->is(array) && index->is(integer)) {
         const auto idx = index->as<integer_object>()->value;
         if (auto max = static_cast<int64_t>(left->as<array_object>()->value.size()) - 1; idx < 0 || idx > max) {
-            push(null());
-            return;
+            return null();
         }
-        push(left->as<array_object>()->value[as_size_t(idx)]);
-        return;
+        return left->as<array_object>()->value[as_size_t(idx)];
     }
     if (left->is(string) && index->is(integer)) {
         const auto idx = index->as<integer_object>()->value;
         if (auto max = static_cast<int64_t>(left->as<string_object>()->value.size()) - 1; idx < 0 || idx > max) {
-            push(null());
-            return;
+            return null();
         }
-        push(allocate<string_object>(left->as<string_object>()->value.substr(as_size_t(idx), 1)));
-        return;
+        return allocate<string_object>(left->as<string_object>()->value.substr(as_size_t(idx), 1));
     }
     if (left->is(hash) && index->is_hashable()) {
-        push(exec_hash(left->as<hash_object>()->value, index->as<hashable>()->hash_key()));
+        return exec_hash(left->as<hash_object>()->value, index->as<hashable>()->hash_key());
+    }
+    return make_error("invalid index operation: {}[{}]", left->type(), index->type());
+}
+
+auto vm::exec_index(const object* left, const object* index, const std::size_t ip) -> void
+{
+    using enum object::object_type;
+    auto& cached = type_feedback(ip);
+    if (cached == operand_types::array_integer && is_exactly<array_object>(left) && is_exactly<integer_object>(index)) {
+        m_cache_stats.hits++;
+        const auto& elements = left->as<array_object>()->value;
+        const auto idx = index->val<integer_object>();
+        push(idx < 0 || as_size_t(idx) >= elements.size() ? null() : elements[as_size_t(idx)]);
         return;
     }
-    push(make_error("invalid index operation: {}[{}]", left->type(), index->type()));
+    if (cached == operand_types::hash_string && is_exactly<hash_object>(left) && is_exactly<string_object>(index)) {
+        m_cache_stats.hits++;
+        push(exec_hash(left->as<hash_object>()->value, index->val<string_object>()));
+        return;
+    }
+    m_cache_stats.misses++;
+    if (cached != operand_types::unseen) {
+        cached = operand_types::generic;
+    } else if (left->is(array) && index->is(integer)) {
+        cached = operand_types::array_integer;
+    } else if (left->is(hash) && index->is(string)) {
+        cached = operand_types::hash_string;
+    } else {
+        cached = operand_types::generic;
+    }
+    push(apply_index(left, index));
 }
 
 auto vm::exec_call(int num_args) -> void
@@ -438,7 +896,11 @@ auto vm::exec_call(int num_args) -> void
             throw std::runtime_error(
                 fmt::format("wrong number of arguments: want={}, got={}", clsr->fn->num_arguments, num_args));
         }
+        if (m_jit_threshold != 0) {
+            count_call(clsr->fn);
+        }
         const frame frm {.cl = clsr->as_mutable(), .ip = -1, .base_ptr = m_sp - num_args};
+        reserve_stack(as_size_t(frm.base_ptr + clsr->fn->num_locals + clsr->fn->max_stack));
         m_sp = frm.base_ptr + clsr->fn->num_locals;
         push_frame(frm);
         return;
@@ -457,6 +919,71 @@ auto vm::exec_call(int num_args) -> void
     throw std::runtime_error("calling non-closure and non-builtin");
 }
 
+auto vm::exec_tail_call(const int num_args) -> void
+{
+    const auto* callee = m_stack[as_size_t(m_sp) - 1U - as_size_t(num_args)];
+    if (!callee->is(object::object_type::closure)) {
+        // builtins push no frame, the following return_value returns their result
+        exec_call(num_args);
+        return;
+    }
+    const auto* clsr = callee->as<closure_object>();
+    if (num_args != clsr->fn->num_arguments) {
+        throw std::runtime_error(
+            fmt::format("wrong number of arguments: want={}, got={}", clsr->fn->num_arguments, num_args));
+    }
+    if (m_jit_threshold != 0) {
+        count_call(clsr->fn);
+    }
+    auto& frm = current_frame();
+    const auto args = m_stack.begin() + (m_sp - num_args);
+    std::copy(args - 1, args + num_args, m_stack.begin() + (frm.base_ptr - 1));
+    frm.cl = clsr->as_mutable();
+    frm.ip = -1;
+    reserve_stack(as_size_t(frm.base_ptr + clsr->fn->num_locals + clsr->fn->max_stack));
+    m_sp = frm.base_ptr + clsr->fn->num_locals;
+}
+
+auto vm::enable_jit(const std::uint32_t threshold) -> void
+{
+    if (jit_available()) {
+        m_jit_threshold = std::max(threshold, 1U);
+    }
+}
+
+auto vm::count_call(const compiled_function_object* func) const -> void
+{
+    auto* mutable_func = func->as_mutable();
+    if (++mutable_func->call_count == m_jit_threshold) {
+        mutable_func->native = jit_compile(*func);
+    }
+}
+
+auto vm::run_native(const native_code& native, const std::size_t ip) -> std::size_t
+{
+    auto& frm = current_frame();
+    jit_state state {
+        .stack = m_stack.data(),
+        .sp = &m_sp,
+        .locals = m_stack.data() + frm.base_ptr,
+        .consts = m_constants->data(),
+        .globals = m_globals->data(),
+        .closure = frm.cl,
+    };
+    frm.ip = static_cast<int>(native.run(&state, ip));
+    return as_size_t(frm.ip);
+}
+
+auto vm::push_frame_closure(const std::size_t const_idx, const std::size_t num_free, const std::size_t slot) -> void
+{
+    auto* clsr = frame_object<closure_object>(slot);
+    clsr->fn = (*m_constants)[const_idx]->as<compiled_function_object>();
+    const auto first = m_stack.begin() + (m_sp - static_cast<int>(num_free));
+    clsr->free.assign(first, first + static_cast<int>(num_free));
+    m_sp -= static_cast<int>(num_free);
+    push(clsr);
+}
+
 auto vm::current_frame() -> frame&
 {
     return m_frames[as_size_t(m_frame_index) - 1U];
@@ -464,6 +991,12 @@ auto vm::current_frame() -> frame&
 
 auto vm::push_frame(const frame frm) -> void
 {
+    if (as_size_t(m_frame_index) == m_frames.size()) {
+        if (m_frames.size() >= m_limits.frames) {
+            throw std::runtime_error("stack overflow");
+        }
+        m_frames.resize(std::min(m_frames.size() * 2, m_limits.frames));
+    }
     m_frames[as_size_t(m_frame_index)] = frm;
     m_frame_index++;
 }
@@ -474,18 +1007,14 @@ auto vm::pop_frame() -> frame&
     return m_frames[as_size_t(m_frame_index)];
 }
 
-auto vm::push_closure(const uint16_t const_idx, const uint8_t num_free) -> void
+auto vm::push_closure(const std::size_t const_idx, const std::size_t num_free) -> void
 {
     const auto* constant = (*m_constants)[const_idx];
-    if (!constant->is(object::object_type::compiled_function)) {
-        throw std::runtime_error(
-            fmt::format("expected a compiled_function, got an object of type {}", constant->type()));
-    }
     array_object::value_type free;
     for (auto i = 0UL; i < num_free; i++) {
         free.push_back(m_stack[as_size_t(m_sp) - num_free + i]);
     }
-    m_sp -= num_free;
+    m_sp -= static_cast<int>(num_free);
     push(allocate<closure_object>(constant->as<compiled_function_object>(), free));
 }
 
@@ -506,15 +1035,15 @@ auto check_no_parse_errors(const parser& prsr) -> bool
     return prsr.errors().empty();
 }
 
-using parsed_program = std::pair<const program*, parser>;
+using parsed_program = std::pair<std::unique_ptr<program>, parser>;
 
 auto check_program(const std::string_view input) -> parsed_program
 {
     auto prsr = parser {lexer {input}};
-    auto* prgrm = prsr.parse_program();
+    auto prgrm = prsr.parse_program();
     INFO("while parsing: `", input, "`");
     CHECK(check_no_parse_errors(prsr));
-    return {prgrm, std::move(prsr)};
+    return {std::move(prgrm), std::move(prsr)};
 }
 
 struct error
@@ -666,13 +1195,61 @@ auto run(const std::array<vt<Expecteds...>, N>& tests)
     for (const auto& [input, expected] : tests) {
         auto [prgrm, _] = check_program(input);
         auto cmplr = compiler::create();
-        cmplr.compile(prgrm);
+        cmplr.compile(prgrm.get());
         auto byte_code = cmplr.byte_code();
         auto mchn = vm::create(std::move(byte_code));
         mchn.run();
 
         const auto* top = mchn.last_popped();
         require_eq(expected, top, input);
+
+        auto verified_cmplr = compiler::create();
+        verified_cmplr.compile(prgrm.get());
+        auto verified_mchn = vm::create_verified(verified_cmplr.byte_code(), allocate<constants>(globals_size));
+        verified_mchn.run();
+
+        INFO("verified");
+        const auto* verified_top = verified_mchn.last_popped();
+        require_eq(expected, verified_top, input);
+
+        auto optimized_cmplr = compiler::create();
+        optimized_cmplr.set_optimization_level(2);
+        optimized_cmplr.compile(prgrm.get());
+        auto optimized_mchn = vm::create_verified(optimized_cmplr.byte_code(), allocate<constants>(globals_size));
+        optimized_mchn.run();
+
+        INFO("optimized, code:\n", to_string(optimized_cmplr.byte_code().instrs));
+        const auto* optimized_top = optimized_mchn.last_popped();
+        require_eq(expected, optimized_top, input);
+
+        auto jit_cmplr = compiler::create();
+        jit_cmplr.compile(prgrm.get());
+        auto jit_mchn = vm::create(jit_cmplr.byte_code());
+        jit_mchn.enable_jit(1);
+        jit_mchn.run();
+
+        INFO("jit enabled");
+        const auto* jit_top = jit_mchn.last_popped();
+        require_eq(expected, jit_top, input);
+
+        auto reg_cmplr = compiler::create(backend::registers);
+        reg_cmplr.compile(prgrm.get());
+        auto reg_mchn = register_vm::create(reg_cmplr.byte_code());
+        reg_mchn.run();
+
+        INFO("register vm, code:\n", to_string(reg_cmplr.byte_code().register_code.instrs));
+        const auto* reg_top = reg_mchn.last_popped();
+        require_eq(expected, reg_top, input);
+
+        auto optimized_reg_cmplr = compiler::create(backend::registers);
+        optimized_reg_cmplr.set_optimization_level(2);
+        optimized_reg_cmplr.compile(prgrm.get());
+        auto optimized_reg_mchn = register_vm::create(optimized_reg_cmplr.byte_code());
+        optimized_reg_mchn.run();
+
+        INFO("optimized register vm");
+        const auto* optimized_reg_top = optimized_reg_mchn.last_popped();
+        require_eq(expected, optimized_reg_top, input);
     }
 }
 
@@ -1135,11 +1712,15 @@ TEST_CASE("callFunctionsWithWrongArgument")
             R"(fn(a, b) { a + b; }(1);)",
             "wrong number of arguments: want=2, got=1",
         },
+        vt<std::string> {
+            R"(fn() { fn(a) { a; }() }();)",
+            "wrong number of arguments: want=1, got=0",
+        },
     };
     for (const auto& [input, expected] : tests) {
         auto [prgrm, _] = check_program(input);
         auto cmplr = compiler::create();
-        cmplr.compile(prgrm);
+        cmplr.compile(prgrm.get());
         auto mchn = vm::create(cmplr.byte_code());
         CHECK_THROWS_WITH(mchn.run(), std::get<std::string>(expected).c_str());
     }
@@ -1298,6 +1879,272 @@ TEST_CASE("recursiveFibonacci")
     run(tests);
 }
 
+TEST_CASE("tailCalls")
+{
+    const std::array tests {
+        vt<int64_t> {R"(let f = fn(x) { if (x) { 1 } else { len("ab") } }; f(true) + f(false))", 3},
+        vt<int64_t> {R"(let f = fn(x) { return if (x) { 1 } else { fn(y) { y }(2) }; }; f(true) + f(false))", 3},
+        vt<int64_t> {R"(let g = fn(a, b) { let c = a * b; c }; let f = fn(x) { let y = x + 1; g(y, x) }; f(3))", 12},
+        vt<int64_t> {R"(let f = fn(n) { while (n > 0) { return fn(m) { m * 2 }(n); } 0 }; f(4))", 8},
+    };
+    run(tests);
+
+    // accumulator style recursion runs in a single frame, which would overflow the frame array otherwise
+    auto [prgrm, _] = check_program(R"(
+        let sum = fn(n, acc) { if (n == 0) { return acc; } sum(n - 1, acc + n) };
+        let count = fn(n) { if (n == 0) { 0 } else { return count(n - 1); } };
+        count(100000) + sum(100000, 0))");
+    auto cmplr = compiler::create();
+    cmplr.compile(prgrm.get());
+    auto mchn = vm::create(cmplr.byte_code());
+    mchn.run();
+    CHECK_EQ(mchn.last_popped()->as<integer_object>()->value, 5000050000);
+}
+
+TEST_CASE("inlinedCalls")
+{
+    const std::array tests {
+        vt<int64_t> {R"(let sq = fn(x) { x * x }; let add = fn(a, b) { a + b }; add(sq(2), sq(add(1, 2))))", 13},
+        vt<int64_t> {R"(let f = fn() {}; let g = fn(x) { if (x) { 1 } else { 2 } }; if (f()) { 0 } else { g(!f()) })", 1},
+        vt<int64_t> {R"(let f = fn(x) { x + 1 }; let g = fn(f) { f(1) }; g(fn(x) { x + 10 }))", 11},
+        vt<int64_t> {R"(let f = fn(x) { x + 1 }; let g = fn(x) { f(x) }; f = fn(x) { x + 2 }; g(1))", 3},
+        vt<int64_t> {R"(let y = 1; let f = fn(x) { x + y }; let g = fn(y) { f(y) }; g(5))", 6},
+        vt<int64_t> {R"(let g = fn(k) { let f = fn(x) { x + k }; k = 10; f(1) }; g(1))", 2},
+        vt<int64_t> {R"(let g = fn(k) { let f = fn(x) { x + k }; fn() { f(2) }() }; g(1))", 3},
+        vt<int64_t> {R"(let f = fn(x, y) { x - y }; let g = fn(x) { f(x, 1) + f(1, x) }; g(5))", 0},
+        vt<int64_t> {R"(let f = fn(x) { x * 2 }; let i = 0; let s = 0; while (i < 3) { s = s + f(i); i = i + 1; } s)",
+                     6},
+    };
+    run(tests);
+
+    auto [prgrm, _] = check_program(R"(let f = fn(a, b) { a + b }; let g = fn(a) { f(a, a) }; g(1) + f(1, 2))");
+    auto cmplr = compiler::create();
+    cmplr.set_optimization_level(2);
+    cmplr.compile(prgrm.get());
+    CHECK_EQ(cmplr.inlined_calls(), 4);
+}
+
+TEST_CASE("eliminatedStatements")
+{
+    const std::array tests {
+        vt<int64_t> {R"(let f = fn(a) { let n = len(a); 1; a; return 2; puts(a); }; f([1]))", 2},
+        vt<int64_t> {R"(let a = [1, 2]; let b = first(a); puts(3); len(a); let c = a[5]; a[1])", 2},
+        vt<int64_t> {R"(let f = fn(a) { let b = 1; if (a) { return b; 3 } 4; a + b }; f(false) + f(true))", 2},
+        vt<int64_t> {R"(let i = 0; while (i < 3) { i = i + 1; if (i > 1) { break; puts(i); } } i)", 2},
+        vt<int64_t> {R"(let f = fn() { let x = fn() { f() }; 5 }; f())", 5},
+    };
+    run(tests);
+
+    auto [prgrm, _] =
+        check_program(R"(let f = fn(a) { let n = len(a); 1; a; return 2; puts(a); }; let unused = 1; f(1))");
+    auto cmplr = compiler::create();
+    cmplr.set_optimization_level(1);
+    cmplr.compile(prgrm.get());
+    CHECK_EQ(cmplr.eliminated_statements(), 5);
+}
+
+TEST_CASE("specializedOperators")
+{
+    const std::array tests {
+        vt<int64_t, double, bool> {R"(let f = fn() { let i = 2; let j = i * 3; j - i > 3 }; f())", true},
+        vt<int64_t, double, bool> {R"(let f = fn() { let x = 1.5; let y = x * 2.0; y / 0.5 }; f())", 6.0},
+        vt<int64_t, double, bool> {R"(let f = fn(a) { let n = len(a); n + n }; f("abc"))", 6},
+        vt<int64_t, double, bool> {R"(let f = fn(a) { len(a) == 1 }; f("a"); f(1))", false},
+    };
+    run(tests);
+
+    // the let keeps the function from being inlined
+    auto [prgrm, _] = check_program(R"(let f = fn(a) { let n = len(a); n == 1 }; [f("a"), f(1), f([1]), f(2)])");
+    auto cmplr = compiler::create();
+    cmplr.set_optimization_level(2);
+    cmplr.compile(prgrm.get());
+    const auto code = cmplr.byte_code();
+    const auto* func = (*std::ranges::find_if(*code.consts, [](const auto* obj) {
+                           return obj->is(object::object_type::compiled_function);
+                       }))->as<compiled_function_object>();
+    REQUIRE(to_string(func->instrs).contains("OpEqualInt"));
+    auto mchn = vm::create(code);
+    mchn.run();
+    CHECK_EQ(mchn.last_popped()->inspect(), "[true, false, true, false]");
+    // the guard fails once, the instruction is generic afterwards
+    CHECK_EQ(mchn.deoptimizations(), 1);
+    CHECK_FALSE(to_string(func->instrs).contains("OpEqualInt"));
+
+    auto jit_cmplr = compiler::create();
+    jit_cmplr.set_optimization_level(2);
+    jit_cmplr.compile(prgrm.get());
+    auto jit_mchn = vm::create(jit_cmplr.byte_code());
+    jit_mchn.enable_jit(1);
+    jit_mchn.run();
+    CHECK_EQ(jit_mchn.last_popped()->inspect(), "[true, false, true, false]");
+}
+
+TEST_CASE("frameAllocations")
+{
+    const std::array tests {
+        vt<int64_t> {R"(let f = fn(i) { [i, i * 2][1] + [i][0] + [i][3 - 3] + [i, i][i - 1] }; f(1) + f(2))", 15},
+        vt<int64_t> {R"(let f = fn(n) { fn(x) { fn() { x + n } }(1) }; let g = f(2); f(5); g())", 3},
+        vt<int64_t> {R"(let r = fn(n) { if (n == 0) { 0 } else { fn(k) { r(k - 1) + k }(n) + 0 } }; r(10))", 55},
+        vt<int64_t> {R"(let f = fn(a) { fn(x) { [x, a][1] }([1, 2][0]) + [a][0] }; f(3) + f(4))", 14},
+        vt<int64_t> {R"(let f = fn() { let i = 0; while (true) { if (i == 3) { return i; } i = i + 1; } }; f() + f())", 6},
+    };
+    run(tests);
+}
+
+TEST_CASE("growingStack")
+{
+    auto [prgrm, _] = check_program(R"(
+        let depth = fn(n) { if (n == 0) { 0 } else { 1 + depth(n - 1) } };
+        let wide = fn(n) { if (n == 0) { [] } else { [n, n, n, n, n, n, n, n] + wide(n - 1) } };
+        depth(5000) + len(wide(1000)))");
+    auto cmplr = compiler::create();
+    cmplr.compile(prgrm.get());
+    const auto code = cmplr.byte_code();
+    auto mchn = vm::create(code);
+    mchn.run();
+    CHECK_EQ(mchn.last_popped()->as<integer_object>()->value, 5000 + 8000);
+
+    auto jit_mchn = vm::create(code);
+    jit_mchn.enable_jit(1);
+    jit_mchn.run();
+    CHECK_EQ(jit_mchn.last_popped()->as<integer_object>()->value, 5000 + 8000);
+
+    auto frames_capped = vm::create(code, {.frames = 1000});
+    CHECK_THROWS_WITH(frames_capped.run(), "stack overflow");
+    auto stack_capped = vm::create(code, {.stack = 5000});
+    CHECK_THROWS_WITH(stack_capped.run(), "stack overflow");
+}
+
+TEST_CASE("wideOperands")
+{
+    std::string locals;
+    std::string sum = "0";
+    for (auto idx = 0; idx < 300; ++idx) {
+        const auto name = fmt::format("v{}{}", static_cast<char>('a' + idx / 26), static_cast<char>('a' + idx % 26));
+        locals += fmt::format("let {} = {}; ", name, idx);
+        sum += fmt::format(" + {}", name);
+    }
+    const auto many_locals = fmt::format("let f = fn() {{ {}{} }}; f()", locals, sum);
+    const std::array tests {
+        vt<int64_t> {many_locals, 44850},
+    };
+    run(tests);
+
+    // more constants than two bytes index, jumped over by more code than two bytes address
+    std::string elements = "0";
+    for (auto idx = 1; idx < 70000; ++idx) {
+        elements += fmt::format(", {}", idx);
+    }
+    const auto input =
+        fmt::format("let a = if (len(\"a\") == 1) {{ [{}] }} else {{ [] }}; len(a) + a[69999]", elements);
+    auto [prgrm, _] = check_program(input);
+    for (const auto level : {0, 2}) {
+        INFO("optimization level ", level);
+        auto cmplr = compiler::create();
+        cmplr.set_optimization_level(level);
+        cmplr.compile(prgrm.get());
+        auto code = cmplr.byte_code();
+        CHECK_GT(code.consts->size(), 70000);
+        CHECK_GT(code.instrs.size(), 65536);
+        auto mchn = vm::create_verified(std::move(code), allocate<constants>(globals_size));
+        mchn.run();
+        CHECK_EQ(mchn.last_popped()->as<integer_object>()->value, 139999);
+    }
+}
+
+TEST_CASE("inlineCaches")
+{
+    const std::array tests {
+        vt<int64_t, std::string, double> {R"(let f = fn(a, b) { a + b }; f(1, 2); f("a", "b"); f(1, 2.5) + f(1.5, 2))", 7.0},
+        vt<int64_t, std::string, double> {R"(let f = fn(a, b) { a + b }; f(1.5, 2.5); f(1, 2))", 3},
+        vt<int64_t, std::string, double> {R"(let f = fn(a, b) { a + b }; f("a", "b"); f("c", "d"))", "cd"},
+        vt<int64_t, std::string, double> {R"(let f = fn(a, b) { a / b }; f(3, 2); f(4, 2); f(2.0, 4.0))", 0.5},
+        vt<int64_t, std::string, double> {R"(let f = fn(a, i) { a[i] }; f([1, 2], 1); f([1, 2], 2); f({"a": 3}, "a"))",
+                                          3},
+        vt<int64_t, std::string, double> {R"(let f = fn(a, i) { a[i] }; f({"a": 3}, "a"); f("abc", 1))", "b"},
+    };
+    run(tests);
+
+    auto [prgrm, _] = check_program(
+        R"(let a = [1, 2, 3]; let i = 0; let s = 0; while (i < 100) { s = s + a[i % 3]; i = i + 1; } s)");
+    auto cmplr = compiler::create();
+    cmplr.compile(prgrm.get());
+    auto mchn = vm::create(cmplr.byte_code());
+    mchn.run();
+    CHECK_EQ(mchn.last_popped()->as<integer_object>()->value, 199);
+    // the modulo has no fast path, the other four sites miss once, the loop condition runs once more
+    CHECK_EQ(mchn.cache_stats().misses, 100 + 4);
+    CHECK_EQ(mchn.cache_stats().hits, 4 * 100 + 1 - 4);
+}
+
+TEST_CASE("replInputs")
+{
+    struct input
+    {
+        std::string_view code;
+        std::optional<std::int64_t> expected;
+    };
+
+    // each input runs on the machine the previous ones left, the fifth fails
+    const std::array inputs {
+        input {"let a = 2; let f = fn(x) { x * a };", std::nullopt},
+        input {"f(3)", 6},
+        input {"a = a + 1; f(3)", 9},
+        input {"let g = fn(n) { if (n == 0) { 0 } else { n + g(n - 1) } }; g(10) + f(1)", 58},
+        input {"f({})", std::nullopt},
+        input {"f(1) + 1", 4},
+    };
+    for (const auto bkend : {backend::stack, backend::registers}) {
+        for (const auto level : {0, 2}) {
+            INFO("registers: ", bkend == backend::registers, ", level: ", level);
+            auto* symbols = symbol_table::create();
+            for (auto idx = 0; const auto& bltn : builtin::builtins()) {
+                symbols->define_builtin(idx++, bltn->name);
+            }
+            constants consts;
+            constants globals(globals_size);
+            auto cmplr = compiler::create_with_state(&consts, symbols, bkend);
+            cmplr.set_optimization_level(level);
+            const bytecode shared {
+                .instrs = {},
+                .consts = &consts,
+                .max_stack = 0,
+                .num_globals = 0,
+                .register_code = {},
+            };
+            auto mchn = vm::create_verified(shared, &globals);
+            auto reg_mchn = register_vm::create_with_state(shared, &globals);
+            const auto run_input = [&](const std::string_view code) -> const object*
+            {
+                auto [prgrm, _] = check_program(code);
+                cmplr.compile_input(prgrm.get());
+                if (bkend == backend::registers) {
+                    reg_mchn.run_input(cmplr.byte_code());
+                    return reg_mchn.last_popped();
+                }
+                mchn.run_input(cmplr.byte_code());
+                return mchn.last_popped();
+            };
+            for (const auto& [code, expected] : inputs) {
+                INFO(code);
+                if (code == "f({})") {
+                    CHECK_THROWS(run_input(code));
+                    continue;
+                }
+                const auto* result = run_input(code);
+                if (expected.has_value()) {
+                    REQUIRE(result->is(object::object_type::integer));
+                    CHECK_EQ(result->as<integer_object>()->value, *expected);
+                }
+            }
+            // equal literals of all inputs share a constant
+            const auto num_constants = consts.size();
+            CHECK_EQ(run_input("1 + 2 + 3")->as<integer_object>()->value, 6);
+            CHECK_EQ(consts.size(), num_constants);
+        }
+    }
+}
+
 TEST_SUITE_END();
 // NOLINTEND(*)
 }  // namespace
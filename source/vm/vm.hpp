@@ -3,16 +3,22 @@
 
 #pragma once
 
-#include <array>
+#include <cstddef>
 #include <cstdint>
+#include <memory>
+#include <vector>
 
 #include <code/code.hpp>
 #include <compiler/compiler.hpp>
 #include <object/object.hpp>
 
+#include "jit.hpp"
+
+// the initial sizes of the stack and frames of the vm, and the fixed sizes of those of the register vm
 constexpr std::size_t stack_size = 2 * 2048UL;
 constexpr std::size_t globals_size = 65536UL;
-constexpr std::size_t max_frames = 1024UL;
+inline constexpr std::size_t max_frames = 1024UL;
+inline constexpr std::uint32_t default_jit_threshold = 1000U;
 
 struct frame final
 {
@@ -21,32 +27,100 @@ struct frame final
     int base_ptr {};
 };
 
-using frames = std::array<frame, max_frames>;
+using frames = std::vector<frame>;
+
+// The stack and frames of the vm grow on demand up to these sizes. Frames refer to the stack by index, so it
+// stays contiguous and is reallocated when it grows.
+struct stack_limits final
+{
+    std::size_t stack {1024UL * 1024UL};
+    std::size_t frames {64UL * 1024UL};
+};
+
+// The inline cache state of a binary operator or index instruction: the operand types it has seen so far, if
+// there is a fast path for them. Once a second combination shows up the instruction stays generic.
+enum class operand_types : std::uint8_t
+{
+    unseen,
+    integers,
+    decimals,
+    strings,
+    array_integer,
+    hash_string,
+    generic,
+};
+
+struct inline_cache_stats final
+{
+    std::uint64_t hits {};
+    std::uint64_t misses {};
+};
+
+// the semantics of operators, shared with the register vm
+[[nodiscard]] auto apply_binary_operator(opcodes opcode, const object* left, const object* right) -> const object*;
+[[nodiscard]] auto apply_minus(const object* operand) -> const object*;
+[[nodiscard]] auto apply_index(const object* left, const object* index) -> const object*;
 
 struct vm final
 {
-    static auto create(bytecode code) -> vm;
-    static auto create_with_state(bytecode code, constants* globals) -> vm;
+    static auto create(bytecode code, stack_limits limits = {}) -> vm;
+    static auto create_with_state(bytecode code, constants* globals, stack_limits limits = {}) -> vm;
+    // Verifies the code first and runs it without the checks the verifier made redundant. The globals only need
+    // the `num_globals` slots of the code here. Throws std::runtime_error if the code does not verify.
+    static auto create_verified(bytecode code, constants* globals, stack_limits limits = {}) -> vm;
     auto run() -> void;
+    // Runs the code of the next input of a repl in place of the main program, on the globals, stack and frames
+    // the earlier inputs left. A verified vm only verifies the functions added since.
+    auto run_input(bytecode code) -> void;
+    [[nodiscard]] auto verified() const -> bool { return m_verified; }
     [[nodiscard]] auto last_popped() const -> const object*;
 
+    // counts the instructions executed by the interpreter, not those run as native code
+    [[nodiscard]] auto instructions_executed() const -> std::uint64_t { return m_executed; }
+
+    [[nodiscard]] auto cache_stats() const -> const inline_cache_stats& { return m_cache_stats; }
+
+    // counts the type specialized instructions which met other operands and were turned back into generic ones
+    [[nodiscard]] auto deoptimizations() const -> std::uint64_t { return m_deoptimizations; }
+
+    // compiles functions to native code once they have been called `threshold` times, where a jit is available
+    auto enable_jit(std::uint32_t threshold = default_jit_threshold) -> void;
+
   private:
-    vm(const frames& frames, const constants* consts, constants* globals);
+    vm(frames&& frms, const constants* consts, constants* globals, stack_limits limits);
+    template<bool Checked>
+    auto execute() -> void;
+    // unchecked, calls reserve the maximum stack depth computed by the compiler for the called function
     auto push(const object* obj) -> void;
+    auto reserve_stack(std::size_t size) -> void;
     auto pop() -> const object*;
-    auto exec_binary_op(opcodes opcode) -> void;
+    auto exec_binary_op(opcodes opcode, std::size_t ip) -> void;
+    auto exec_integers_op(opcodes opcode, std::size_t ip) -> void;
+    auto exec_decimals_op(opcodes opcode, std::size_t ip) -> void;
+    auto deoptimize(opcodes opcode, std::size_t ip) -> void;
     auto exec_bang() -> void;
     auto exec_minus() -> void;
-    auto exec_index(const object* left, const object* index) -> void;
+    auto exec_index(const object* left, const object* index, std::size_t ip) -> void;
+    auto type_feedback(std::size_t ip) -> operand_types&;
     auto exec_call(int num_args) -> void;
-    void exec_set_outer(std::size_t ip, const instructions& instr);
-    void exec_get_outer(std::size_t ip, const instructions& instr);
+    auto exec_tail_call(int num_args) -> void;
+    void exec_set_outer(std::size_t level, symbol_scope scope, std::size_t index);
+    void exec_get_outer(std::size_t level, symbol_scope scope, std::size_t index);
+    template<bool Checked>
+    auto exec_wide(std::size_t ip, const instructions& instr) -> void;
     [[nodiscard]] auto build_array(int start, int end) const -> const object*;
     [[nodiscard]] auto build_hash(int start, int end) const -> const object*;
     auto current_frame() -> frame&;
     auto push_frame(frame frm) -> void;
     auto pop_frame() -> frame&;
-    auto push_closure(uint16_t const_idx, uint8_t num_free) -> void;
+    auto push_closure(std::size_t const_idx, std::size_t num_free) -> void;
+    auto push_frame_closure(std::size_t const_idx, std::size_t num_free, std::size_t slot) -> void;
+    // the object in a slot of the current frame, its previous value is dead once the instruction using the slot
+    // runs again, the slots of a frame are reused by the next call at the same depth
+    template<typename T>
+    auto frame_object(std::size_t slot) -> T*;
+    auto count_call(const compiled_function_object* func) const -> void;
+    auto run_native(const native_code& native, std::size_t ip) -> std::size_t;
 
     const constants* m_constants {};
     constants* m_globals {};
@@ -54,4 +128,13 @@ struct vm final
     int m_sp {0};
     frames m_frames;
     int m_frame_index {1};
+    stack_limits m_limits;
+    std::uint64_t m_executed {};
+    std::uint32_t m_jit_threshold {};
+    inline_cache_stats m_cache_stats;
+    std::uint64_t m_deoptimizations {};
+    std::vector<std::vector<std::unique_ptr<object>>> m_frame_objects;
+    bool m_verified {};
+    // the number of constants verified so far
+    std::size_t m_verified_constants {};
 };
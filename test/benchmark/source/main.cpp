@@ -1,25 +1,223 @@
 // Copyright 2023-2025 hrzlgnm
 // SPDX-License-Identifier: MIT-0
 
+#include <algorithm>
 #include <chrono>
 #include <cstddef>
+#include <cstdlib>
+#include <fstream>
 #include <span>
+#include <string>
 #include <string_view>
+#include <thread>
 
+#include <analyzer/analyzer.hpp>
+#include <builtin/builtin.hpp>
+#include <code/register_code.hpp>
 #include <compiler/compiler.hpp>
+#include <compiler/symbol_table.hpp>
 #include <eval/environment.hpp>
 #include <eval/evaluator.hpp>
 #include <fmt/base.h>
+#include <fmt/format.h>
+#include <gc.hpp>
 #include <lexer/lexer.hpp>
+#include <lexer/token_type.hpp>
 #include <object/object.hpp>
 #include <parser/parser.hpp>
+#include <vm/register_vm.hpp>
 #include <vm/vm.hpp>
 
+#if defined(__linux__)
+#    include <unistd.h>
+#endif
+
 using namespace std::chrono_literals;
 
-auto main(int argc, char* argv[]) -> int
+namespace
+{
+using clock = std::chrono::steady_clock;
+using seconds = std::chrono::duration<double>;
+
+auto identifier_for(std::size_t idx) -> std::string
+{
+    // identifiers may only contain letters and underscores
+    constexpr auto letters = 26U;
+    std::string name = "f_";
+    do {
+        name += static_cast<char>('a' + (idx % letters));
+        idx /= letters;
+    } while (idx != 0);
+    return name;
+}
+
+// generates a script with roughly `lines` lines, made of small functions that are each called once,
+// keeping the number of globals and constants within the limits of the compiler
+auto generate_script(const std::size_t lines) -> std::string
+{
+    constexpr auto lines_per_function = 12U;
+    std::string script;
+    for (std::size_t idx = 0; idx * lines_per_function < lines; ++idx) {
+        const auto name = identifier_for(idx);
+        script += fmt::format(R"(let {} = fn(a, b) {{
+    let c = a + b;
+    let d = c * a - b;
+    if (c > d) {{
+        c = c - d;
+    }} else {{
+        d = d - c;
+    }}
+    let e = [a, b, c, d];
+    c + d + len(e) + e[1]
+}};
+{}(1, 2);
+)",
+                              name,
+                              name);
+    }
+    return script;
+}
+
+// parses the same source repeatedly and reports the throughput in MB/s of source text
+auto parse_throughput(const std::string& input, const std::size_t rounds) -> double
+{
+    const auto start = clock::now();
+    for (std::size_t round = 0; round < rounds; ++round) {
+        auto prsr = parser {lexer {input}};
+        const auto prgrm = prsr.parse_program();
+        if (!prsr.errors().empty()) {
+            fmt::print("parse errors: {}\n", prsr.errors().front());
+            std::exit(1);
+        }
+    }
+    const seconds duration = clock::now() - start;
+    constexpr auto megabyte = 1024.0 * 1024.0;
+    return static_cast<double>(input.size() * rounds) / megabyte / duration.count();
+}
+
+auto bench_parse(const std::size_t lines) -> int
+{
+    constexpr auto script_rounds = 20U;
+    constexpr auto line_rounds = 200000U;
+    const auto script = generate_script(lines);
+    const auto line = std::string {"let x = [a + b * c, d(e, f)][0];"};
+    fmt::print("script: bytes={}, rounds={}, throughput={:.1f} MB/s\n",
+               script.size(),
+               script_rounds,
+               parse_throughput(script, script_rounds));
+    fmt::print("line: bytes={}, rounds={}, throughput={:.1f} MB/s\n",
+               line.size(),
+               line_rounds,
+               parse_throughput(line, line_rounds));
+    return 0;
+}
+
+auto bench_lex(const std::size_t lines) -> int
+{
+    constexpr auto rounds = 50U;
+    const auto input = generate_script(lines);
+    std::size_t tokens = 0;
+    const auto start = clock::now();
+    for (auto round = 0U; round < rounds; ++round) {
+        auto lxr = lexer {input};
+        while (lxr.next_token().type != token_type::eof) {
+            ++tokens;
+        }
+    }
+    const seconds duration = clock::now() - start;
+    constexpr auto megabyte = 1024.0 * 1024.0;
+    fmt::print("bytes={}, rounds={}, tokens={}\n", input.size(), rounds, tokens);
+    fmt::print("lex={}, throughput={:.1f} MB/s, {:.1f} Mtokens/s\n",
+               duration.count(),
+               static_cast<double>(input.size() * rounds) / megabyte / duration.count(),
+               static_cast<double>(tokens) / 1e6 / duration.count());
+    return 0;
+}
+
+// compiles the same script at the highest level with the functions optimized on one up to all hardware threads
+auto bench_compile(const std::size_t lines) -> int
 {
-    const char* input = R"(
+    const auto input = generate_script(lines);
+    auto prsr = parser {lexer {input}};
+    const auto prgrm = prsr.parse_program();
+    if (!prsr.errors().empty()) {
+        fmt::print("parse errors: {}\n", prsr.errors().front());
+        return 1;
+    }
+    const auto max_jobs = std::max(std::thread::hardware_concurrency(), 1U);
+    fmt::print("lines={}, bytes={}, hardware threads={}\n", lines, input.size(), max_jobs);
+    double serial = 0;
+    for (auto jobs = 1U; jobs <= max_jobs; ++jobs) {
+        const auto start = clock::now();
+        auto cmplr = compiler::create();
+        cmplr.set_optimization_level(2);
+        cmplr.set_jobs(static_cast<int>(jobs));
+        cmplr.compile(prgrm.get());
+        const auto code = cmplr.byte_code();
+        const seconds duration = clock::now() - start;
+        if (jobs == 1) {
+            serial = duration.count();
+        }
+        fmt::print("jobs={}, compile={}, speedup={:.2f}\n", jobs, duration.count(), serial / duration.count());
+    }
+    return 0;
+}
+
+// the resident set size of the process, 0 where it can not be read
+auto resident_set_size() -> std::size_t
+{
+#if defined(__linux__)
+    std::ifstream statm("/proc/self/statm");
+    std::size_t pages = 0;
+    std::size_t resident = 0;
+    statm >> pages >> resident;
+    return resident * static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+#else
+    return 0;
+#endif
+}
+
+// feeds the same input to one compiler and machine the way the repl does, the time per line and the resident set
+// size stay flat once the trees of the inputs are released after compiling them
+auto bench_repl(const std::size_t lines) -> int
+{
+    constexpr auto window = 10000U;
+    // the machine never frees the values it creates, so the input only yields the shared booleans
+    constexpr auto input = R"(if (a == b) { c = a; } else { c = !b; }; if (!c) { a } else { b }; a == (b != c);)";
+    auto* symbols = symbol_table::create();
+    for (auto idx = 0; const auto& builtin : builtin::builtins()) {
+        symbols->define_builtin(idx++, builtin->name);
+    }
+    constants consts;
+    constants globals(globals_size);
+    auto cmplr = compiler::create_with_state(&consts, symbols);
+    auto machine = vm::create_verified(
+        {.instrs = {}, .consts = &consts, .max_stack = 0, .num_globals = 0, .register_code = {}}, &globals);
+    const auto run = [&](const std::string_view line)
+    {
+        auto prsr = parser {lexer {line}};
+        const auto prgrm = prsr.parse_program();
+        const auto resolution = analyze_program(prgrm.get(), symbols);
+        cmplr.compile_input(prgrm.get(), &resolution);
+        machine.run_input(cmplr.byte_code());
+    };
+    run("let a = true; let b = false; let c = a;");
+    auto start = clock::now();
+    for (std::size_t idx = 1; idx <= lines; ++idx) {
+        run(input);
+        if (idx % window == 0) {
+            const seconds duration = clock::now() - start;
+            fmt::print("lines={}, per line={:.1f} us, resident={} KiB\n",
+                       idx,
+                       duration.count() * 1e6 / window,
+                       resident_set_size() / 1024);
+            start = clock::now();
+        }
+    }
+    return 0;
+}
+
+constexpr auto fibonacci_program = R"(
 let fibonacci = fn(x) {
   if (x == 0) {
     0
@@ -34,22 +232,81 @@ let fibonacci = fn(x) {
 fibonacci(35);
     )";
 
-    auto engine_vm = true;
-    for (const std::string_view arg : std::span(++argv, static_cast<std::size_t>(argc - 1))) {
-        if (arg == "--eval") {
-            engine_vm = false;
+// compares the stack and the register form of the same program by instruction count and wall time
+auto bench_registers() -> int
+{
+    auto prsr = parser {lexer {fibonacci_program}};
+    const auto prgrm = prsr.parse_program();
+    auto cmplr = compiler::create(backend::registers);
+    cmplr.compile(prgrm.get());
+    const auto code = cmplr.byte_code();
+
+    std::size_t stack_units = code.instrs.size();
+    std::size_t register_units = code.register_code.instrs.size();
+    for (const auto* constant : *code.consts) {
+        if (constant->is(object::object_type::compiled_function)) {
+            stack_units += constant->as<compiled_function_object>()->instrs.size();
+            register_units += constant->as<compiled_function_object>()->register_code.instrs.size();
         }
     }
+    fmt::print("code size: stack={} bytes, register={} bytes\n", stack_units, register_units * 2);
+
+    auto stack_vm = vm::create(code);
+    auto start = clock::now();
+    stack_vm.run();
+    const seconds stack_duration = clock::now() - start;
+    fmt::print("engine=vm, result={}, executed={}, duration={}\n",
+               stack_vm.last_popped()->inspect(),
+               stack_vm.instructions_executed(),
+               stack_duration.count());
 
-    auto lxr = lexer {input};
+    auto reg_vm = register_vm::create(code);
+    start = clock::now();
+    reg_vm.run();
+    const seconds register_duration = clock::now() - start;
+    fmt::print("engine=register vm, result={}, executed={}, duration={}\n",
+               reg_vm.last_popped()->inspect(),
+               reg_vm.instructions_executed(),
+               register_duration.count());
+    return 0;
+}
+
+// compares the interpreter with and without compiling the hot function to native code
+auto bench_jit() -> int
+{
+    auto prsr = parser {lexer {fibonacci_program}};
+    const auto prgrm = prsr.parse_program();
+    auto cmplr = compiler::create();
+    cmplr.compile(prgrm.get());
+    const auto code = cmplr.byte_code();
+    for (const auto jit : {false, true}) {
+        auto mchn = vm::create(code);
+        if (jit) {
+            mchn.enable_jit();
+        }
+        const auto start = clock::now();
+        mchn.run();
+        const seconds duration = clock::now() - start;
+        fmt::print("engine=vm, jit={}, result={}, interpreted={}, duration={}\n",
+                   jit && jit_available(),
+                   mchn.last_popped()->inspect(),
+                   mchn.instructions_executed(),
+                   duration.count());
+    }
+    return 0;
+}
+
+auto bench_fibonacci(const bool engine_vm) -> int
+{
+    auto lxr = lexer {fibonacci_program};
     auto prsr = parser {lxr};
-    const auto* prgrm = prsr.parse_program();
+    const auto prgrm = prsr.parse_program();
     const object* result = nullptr;
     std::chrono::duration<double> duration {};
     if (engine_vm) {
         auto cmplr = compiler::create();
-        cmplr.compile(prgrm);
-        auto mchn = vm::create(cmplr.byte_code());
+        cmplr.compile(prgrm.get());
+        auto mchn = vm::create_verified(cmplr.byte_code(), allocate<constants>(globals_size));
         auto start = std::chrono::steady_clock::now();
         mchn.run();
         result = mchn.last_popped();
@@ -59,10 +316,65 @@ fibonacci(35);
         environment env;
         evaluator ev(&env);
         auto start = std::chrono::steady_clock::now();
-        result = ev.evaluate(prgrm);
+        result = ev.evaluate(prgrm.get());
         auto end = std::chrono::steady_clock::now();
         duration = end - start;
     }
     fmt::print("engine={}, result={}, duration={}\n", engine_vm ? "vm" : "eval", result->inspect(), duration.count());
     return 0;
 }
+}  // namespace
+
+auto main(int argc, char* argv[]) -> int
+{
+    constexpr auto default_lines = 100000UL;
+    auto engine_vm = true;
+    auto parse = false;
+    auto lex = false;
+    auto registers = false;
+    auto jit = false;
+    auto compile = false;
+    auto repl = false;
+    for (const std::string_view arg : std::span(++argv, static_cast<std::size_t>(argc - 1))) {
+        if (arg == "--eval") {
+            engine_vm = false;
+        }
+        if (arg == "--parse") {
+            parse = true;
+        }
+        if (arg == "--lex") {
+            lex = true;
+        }
+        if (arg == "--registers") {
+            registers = true;
+        }
+        if (arg == "--jit") {
+            jit = true;
+        }
+        if (arg == "--compile") {
+            compile = true;
+        }
+        if (arg == "--repl") {
+            repl = true;
+        }
+    }
+    if (parse) {
+        return bench_parse(default_lines);
+    }
+    if (lex) {
+        return bench_lex(default_lines);
+    }
+    if (registers) {
+        return bench_registers();
+    }
+    if (jit) {
+        return bench_jit();
+    }
+    if (compile) {
+        return bench_compile(default_lines);
+    }
+    if (repl) {
+        return bench_repl(default_lines);
+    }
+    return bench_fibonacci(engine_vm);
+}